@@ -0,0 +1,824 @@
+//==============================================================================
+//
+//  @file max_stub.c
+//  @brief Minimal implementation of the Max API, to build and run the object
+//  headlessly, outside of Max. Only what the object uses is implemented:
+//  classes and attributes, atoms, memory, files, dictionaries and threads.
+//  There is no scheduler: qelems and deferred calls run immediately, and
+//  clocks never fire.
+//
+//  This Source Code Form is subject to the terms of the Mozilla Public
+//  License, v. 2.0. If a copy of the MPL was not distributed with this
+//  file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+//==============================================================================
+
+#define _GNU_SOURCE
+#include "max_stub.h"
+
+#include <stdarg.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+
+t_max_stub_dsp max_stub_dsp = { NULL, NULL, 0, NULL };
+int max_stub_post = 0;
+
+#define STUB_MAGIC_DICT 0x44494354  // Tag in o_magic for dictionaries
+
+// ====  SYMBOLS  ====
+// Interned in a hash table, so that symbols can be compared as pointers
+
+#define SYM_HASH 1024
+
+typedef struct _sym_node { t_symbol sym; struct _sym_node* next; } t_sym_node;
+
+static t_sym_node* sym_table[SYM_HASH];
+static pthread_mutex_t sym_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+t_symbol* gensym(const char* s) {
+
+  t_uint32 hash = 5381;
+  for (const char* c = s; *c; c++) { hash = hash * 33 + (unsigned char)*c; }
+  hash %= SYM_HASH;
+
+  pthread_mutex_lock(&sym_mutex);
+
+  t_sym_node* node = sym_table[hash];
+  while (node && strcmp(node->sym.s_name, s)) { node = node->next; }
+
+  if (!node) {
+    node = (t_sym_node*)malloc(sizeof(t_sym_node));
+    node->sym.s_name = strdup(s);
+    node->sym.s_thing = NULL;
+    node->next = sym_table[hash];
+    sym_table[hash] = node;
+  }
+
+  pthread_mutex_unlock(&sym_mutex);
+  return &node->sym;
+}
+
+// ====  POSTS  ====
+
+static void _stub_vpost(FILE* stream, const char* fmt, va_list args) {
+
+  vfprintf(stream, fmt, args);
+  fputc('\n', stream);
+}
+
+void post(const char* fmt, ...) {
+
+  if (!max_stub_post) { return; }
+  va_list args;
+  va_start(args, fmt);
+  _stub_vpost(stdout, fmt, args);
+  va_end(args);
+}
+
+void object_post(t_object* x, const char* s, ...) {
+
+  // The object reports its errors through object_post with an "ERROR" prefix
+  t_bool is_err = (strncmp(s, "ERROR", 5) == 0);
+  if (!max_stub_post && !is_err) { return; }
+
+  va_list args;
+  va_start(args, s);
+  _stub_vpost(is_err ? stderr : stdout, s, args);
+  va_end(args);
+}
+
+void object_error(t_object* x, const char* s, ...) {
+
+  va_list args;
+  va_start(args, s);
+  _stub_vpost(stderr, s, args);
+  va_end(args);
+}
+
+// ====  CLASSES AND ATTRIBUTES  ====
+
+#define ATTR_MAX 64
+
+typedef struct _stub_attr { t_symbol* name; t_symbol* type; long offset; } t_stub_attr;
+
+struct _class {
+
+  const char* name;
+  method      mnew;
+  method      mfree;
+  long        size;
+  t_int32     attr_cnt;
+  t_stub_attr attr_arr[ATTR_MAX];
+};
+
+t_class* class_new(const char* name, method mnew, method mfree, long size, method mmenu, short type, ...) {
+
+  t_class* c = (t_class*)calloc(1, sizeof(t_class));
+  c->name = name;
+  c->mnew = mnew;
+  c->mfree = mfree;
+  c->size = size;
+  return c;
+}
+
+t_max_err class_addmethod(t_class* c, method m, const char* name, ...) { return MAX_ERR_NONE; }
+t_max_err class_register(t_symbol* name_space, t_class* c) { return MAX_ERR_NONE; }
+void class_dspinit(t_class* c) { }
+
+void class_attr_stub(t_class* c, const char* name, const char* type, long offset) {
+
+  if (c->attr_cnt == ATTR_MAX) { return; }
+  c->attr_arr[c->attr_cnt].name = gensym(name);
+  c->attr_arr[c->attr_cnt].type = gensym(type);
+  c->attr_arr[c->attr_cnt].offset = offset;
+  c->attr_cnt++;
+}
+
+long attr_args_offset(short ac, t_atom* av) {
+
+  for (short i = 0; i < ac; i++) {
+    if ((av[i].a_type == A_SYM) && (av[i].a_w.w_sym->s_name[0] == '@')) { return i; }
+  }
+  return ac;
+}
+
+void attr_args_process(void* x, short ac, t_atom* av) {
+
+  t_class* c = (t_class*)((t_object*)x)->o_messlist;
+  t_stub_attr* attr = NULL;
+  char* field = NULL;
+
+  for (short i = attr_args_offset(ac, av); i < ac - 1; i++) {
+    if ((av[i].a_type != A_SYM) || (av[i].a_w.w_sym->s_name[0] != '@')) { continue; }
+
+    t_symbol* name = gensym(av[i].a_w.w_sym->s_name + 1);
+    for (t_int32 a = 0; a < c->attr_cnt; a++) {
+      attr = c->attr_arr + a;
+      if (attr->name != name) { continue; }
+
+      field = (char*)x + attr->offset;
+      if      (attr->type == gensym("long"))    { *(t_atom_long*)field = atom_getlong(av + i + 1); }
+      else if (attr->type == gensym("float32")) { *(float*)field = (float)atom_getfloat(av + i + 1); }
+      else if (attr->type == gensym("float64")) { *(double*)field = atom_getfloat(av + i + 1); }
+      else if (attr->type == gensym("symbol"))  { *(t_symbol**)field = atom_getsym(av + i + 1); }
+    }
+  }
+}
+
+// ====  OBJECTS  ====
+
+void* object_alloc(t_class* c) {
+
+  t_object* x = (t_object*)calloc(1, c->size);
+  if (x) { x->o_messlist = c; }
+  return x;
+}
+
+static void _stub_dict_free(t_dictionary* d);
+
+t_max_err object_free(void* x) {
+
+  if (!x) { return MAX_ERR_GENERIC; }
+
+  if (((t_object*)x)->o_magic == STUB_MAGIC_DICT) { _stub_dict_free((t_dictionary*)x); return MAX_ERR_NONE; }
+
+  t_class* c = (t_class*)((t_object*)x)->o_messlist;
+  if (c && c->mfree) { c->mfree(x); }
+  free(x);
+  return MAX_ERR_NONE;
+}
+
+void* object_method(void* x, t_symbol* s, ...) {
+
+  // The DSP chain: store the perform routine for the host
+  if (s == gensym("dsp_add64")) {
+    va_list args;
+    va_start(args, s);
+    max_stub_dsp.obj = va_arg(args, t_object*);
+    max_stub_dsp.perform = va_arg(args, t_perfroutine64);
+    max_stub_dsp.flags = va_arg(args, long);
+    max_stub_dsp.userparam = va_arg(args, void*);
+    va_end(args);
+  }
+  return NULL;
+}
+
+// ====  INLETS AND OUTLETS  ====
+// Outlets are not connected: the messages are dropped
+
+static char stub_outlet;
+
+void* outlet_new(void* x, const char* type) { return &stub_outlet; }
+void* floatout(void* x) { return &stub_outlet; }
+void* outlet_bang(void* o) { return NULL; }
+void* outlet_int(void* o, t_atom_long n) { return NULL; }
+void* outlet_float(void* o, double f) { return NULL; }
+void* outlet_list(void* o, t_symbol* s, short ac, t_atom* av) { return NULL; }
+void* outlet_anything(void* o, t_symbol* s, short ac, t_atom* av) { return NULL; }
+void* proxy_new(void* x, long id, long* stuffloc) { return NULL; }
+
+// ====  MSP  ====
+
+void dsp_setup(t_pxobject* x, long nsignals) { x->z_in = nsignals; }
+void dsp_free(t_pxobject* x) { }
+double sys_getsr(void) { return 44100; }
+long sys_getblksize(void) { return 64; }
+
+// The DSP of an object is running once it has added a perform routine
+short sys_getdspobjdspstate(t_object* o) { return (max_stub_dsp.obj == o) && (max_stub_dsp.perform != NULL); }
+
+// ====  ATOMS  ====
+
+t_max_err atom_setlong(t_atom* a, t_atom_long b) { a->a_type = A_LONG; a->a_w.w_long = b; return MAX_ERR_NONE; }
+t_max_err atom_setfloat(t_atom* a, double b) { a->a_type = A_FLOAT; a->a_w.w_float = b; return MAX_ERR_NONE; }
+t_max_err atom_setsym(t_atom* a, t_symbol* b) { a->a_type = A_SYM; a->a_w.w_sym = b; return MAX_ERR_NONE; }
+t_max_err atom_setobj(t_atom* a, void* b) { a->a_type = A_OBJ; a->a_w.w_obj = b; return MAX_ERR_NONE; }
+
+t_atom_long atom_getlong(const t_atom* a) {
+
+  if (a->a_type == A_LONG)  { return a->a_w.w_long; }
+  if (a->a_type == A_FLOAT) { return (t_atom_long)a->a_w.w_float; }
+  return 0;
+}
+
+t_atom_float atom_getfloat(const t_atom* a) {
+
+  if (a->a_type == A_FLOAT) { return a->a_w.w_float; }
+  if (a->a_type == A_LONG)  { return (t_atom_float)a->a_w.w_long; }
+  return 0;
+}
+
+t_symbol* atom_getsym(const t_atom* a) { return (a->a_type == A_SYM) ? a->a_w.w_sym : gensym(""); }
+void* atom_getobj(const t_atom* a) { return (a->a_type == A_OBJ) ? a->a_w.w_obj : NULL; }
+long atom_gettype(const t_atom* a) { return a->a_type; }
+
+t_max_err atom_setdouble_array(long ac, t_atom* av, long count, double* vals) {
+
+  for (long i = 0; i < MIN(ac, count); i++) { atom_setfloat(av + i, vals[i]); }
+  return MAX_ERR_NONE;
+}
+
+t_max_err atom_getdouble_array(long ac, t_atom* av, long count, double* vals) {
+
+  for (long i = 0; i < MIN(ac, count); i++) { vals[i] = atom_getfloat(av + i); }
+  return MAX_ERR_NONE;
+}
+
+// ====  MEMORY  ====
+// Pointers keep their size in a header, so that they can be resized and cleared
+
+#define PTR_HEAD 16
+
+static long _stub_ptr_size(void* ptr) { return ptr ? *(long*)((char*)ptr - PTR_HEAD) : 0; }
+
+t_ptr sysmem_newptr(long size) {
+
+  char* mem = (char*)malloc(PTR_HEAD + size);
+  if (!mem) { return NULL; }
+  *(long*)mem = size;
+  return mem + PTR_HEAD;
+}
+
+t_ptr sysmem_newptrclear(long size) {
+
+  t_ptr ptr = sysmem_newptr(size);
+  if (ptr) { memset(ptr, 0, size); }
+  return ptr;
+}
+
+t_ptr sysmem_resizeptr(void* ptr, long newsize) {
+
+  if (!ptr) { return sysmem_newptr(newsize); }
+  char* mem = (char*)realloc((char*)ptr - PTR_HEAD, PTR_HEAD + newsize);
+  if (!mem) { return NULL; }
+  *(long*)mem = newsize;
+  return mem + PTR_HEAD;
+}
+
+t_ptr sysmem_resizeptrclear(void* ptr, long newsize) {
+
+  long size = _stub_ptr_size(ptr);
+  t_ptr new_ptr = sysmem_resizeptr(ptr, newsize);
+  if (new_ptr && (newsize > size)) { memset(new_ptr + size, 0, newsize - size); }
+  return new_ptr;
+}
+
+void sysmem_freeptr(void* ptr) { if (ptr) { free((char*)ptr - PTR_HEAD); } }
+void sysmem_copyptr(const void* src, void* dst, long bytes) { memmove(dst, src, bytes); }
+
+// A handle points to the data pointer, which is the first field of its block
+typedef struct _stub_handle { char* data; long size; } t_stub_handle;
+
+t_handle sysmem_newhandle(long size) {
+
+  t_stub_handle* h = (t_stub_handle*)malloc(sizeof(t_stub_handle));
+  h->data = (char*)malloc(MAX(size, 1));
+  h->size = size;
+  return (t_handle)h;
+}
+
+t_handle sysmem_newhandleclear(unsigned long size) {
+
+  t_handle h = sysmem_newhandle((long)size);
+  memset(*h, 0, MAX(size, 1));
+  return h;
+}
+
+t_max_err sysmem_resizehandle(t_handle handle, long newsize) {
+
+  t_stub_handle* h = (t_stub_handle*)handle;
+  char* data = (char*)realloc(h->data, MAX(newsize, 1));
+  if (!data) { return MAX_ERR_GENERIC; }
+  h->data = data;
+  h->size = newsize;
+  return MAX_ERR_NONE;
+}
+
+long sysmem_handlesize(t_handle handle) { return ((t_stub_handle*)handle)->size; }
+
+void sysmem_freehandle(t_handle handle) {
+
+  if (!handle) { return; }
+  free(((t_stub_handle*)handle)->data);
+  free(handle);
+}
+
+// ====  FILES AND PATHS  ====
+// Path ids are not used: file names are full paths, and the path id is 0
+
+short path_frompathname(const char* name, short* path, char* filename) {
+
+  strncpy(filename, name, MAX_FILENAME_CHARS - 1);
+  filename[MAX_FILENAME_CHARS - 1] = '\0';
+  *path = 0;
+  return 0;
+}
+
+short path_fileinfo(const char* name, short path, t_fileinfo* info) {
+
+  struct stat st;
+  if (stat(name, &st)) { return 1; }
+  if (info) { memset(info, 0, sizeof(t_fileinfo)); }
+  return 0;
+}
+
+short path_opensysfile(const char* name, short path, t_filehandle* ref, short perm) {
+
+  FILE* file = fopen(name, (perm == PATH_READ_PERM) ? "rb" : "r+b");
+  *ref = file;
+  return file ? 0 : 1;
+}
+
+short path_createsysfile(const char* name, short path, t_fourcc type, t_filehandle* ref) {
+
+  FILE* file = fopen(name, "w+b");
+  *ref = file;
+  return file ? 0 : 1;
+}
+
+short path_toabsolutesystempath(short in_path, const char* in_filename, char* out_filename) {
+
+  strncpy(out_filename, in_filename, MAX_PATH_CHARS - 1);
+  out_filename[MAX_PATH_CHARS - 1] = '\0';
+  return 0;
+}
+
+short path_getfilemoddate(const char* filename, const short path, t_ptr_uint* date) {
+
+  struct stat st;
+  if (stat(filename, &st)) { return 1; }
+  *date = (t_ptr_uint)st.st_mtime;
+  return 0;
+}
+
+short path_nameconform(const char* src, char* dst, long style, long type) {
+
+  strncpy(dst, src, MAX_PATH_CHARS - 1);
+  dst[MAX_PATH_CHARS - 1] = '\0';
+  return 0;
+}
+
+// No dialogs: always cancelled
+void open_promptset(const char* s) { }
+short open_dialog(char* name, short* volptr, t_fourcc* typeptr, t_fourcc* types, short ntypes) { return 1; }
+void saveas_promptset(const char* s) { }
+short saveasdialog_extended(char* name, short* vol, t_fourcc* type, t_fourcc* typelist, short numtypes) { return 1; }
+
+t_max_err sysfile_close(t_filehandle f) { return fclose((FILE*)f) ? MAX_ERR_GENERIC : MAX_ERR_NONE; }
+
+t_max_err sysfile_read(t_filehandle f, t_ptr_size* count, void* bufptr) {
+
+  t_ptr_size req = *count;
+  *count = fread(bufptr, 1, req, (FILE*)f);
+  return (*count == req) ? MAX_ERR_NONE : MAX_ERR_GENERIC;
+}
+
+t_max_err sysfile_write(t_filehandle f, t_ptr_size* count, const void* bufptr) {
+
+  t_ptr_size req = *count;
+  *count = fwrite(bufptr, 1, req, (FILE*)f);
+  return (*count == req) ? MAX_ERR_NONE : MAX_ERR_GENERIC;
+}
+
+t_max_err sysfile_geteof(t_filehandle f, t_ptr_size* logeof) {
+
+  long pos = ftell((FILE*)f);
+  fseek((FILE*)f, 0, SEEK_END);
+  *logeof = (t_ptr_size)ftell((FILE*)f);
+  fseek((FILE*)f, pos, SEEK_SET);
+  return MAX_ERR_NONE;
+}
+
+t_max_err sysfile_getpos(t_filehandle f, t_ptr_size* filepos) {
+
+  *filepos = (t_ptr_size)ftell((FILE*)f);
+  return MAX_ERR_NONE;
+}
+
+t_max_err sysfile_setpos(t_filehandle f, t_sysfile_pos_mode mode, t_ptr_int offset) {
+
+  int whence = (mode == SYSFILE_FROMLEOF) ? SEEK_END : (mode == SYSFILE_FROMSTART) ? SEEK_SET : SEEK_CUR;
+  return fseek((FILE*)f, (long)offset, whence) ? MAX_ERR_GENERIC : MAX_ERR_NONE;
+}
+
+t_max_err sysfile_readtextfile(t_filehandle f, t_handle htext, t_ptr_size maxlen, long flags) {
+
+  t_ptr_size eof = 0, pos = 0;
+  sysfile_geteof(f, &eof);
+  sysfile_getpos(f, &pos);
+  t_ptr_size len = eof - pos;
+  if (maxlen && (len > maxlen)) { len = maxlen; }
+
+  if (sysmem_resizehandle(htext, (long)len + 1)) { return MAX_ERR_GENERIC; }
+  len = fread(*htext, 1, len, (FILE*)f);
+  (*htext)[len] = '\0';
+  return MAX_ERR_NONE;
+}
+
+// ====  SCHEDULING  ====
+// No scheduler: qelems and deferred calls run immediately in the calling thread
+
+struct _qelem { void* obj; method fn; };
+
+t_qelem qelem_new(void* obj, method fn) {
+
+  t_qelem q = (t_qelem)malloc(sizeof(struct _qelem));
+  q->obj = obj;
+  q->fn = fn;
+  return q;
+}
+
+void qelem_set(t_qelem q) { q->fn(q->obj); }
+void qelem_unset(t_qelem q) { }
+void qelem_free(t_qelem q) { free(q); }
+
+// Clocks never fire: the host calls the perform routine itself
+// A clock starts with an object header without class, so that object_free only frees it
+struct _clock { t_object ob; void* obj; method fn; };
+
+void* clock_new(void* obj, method fn) {
+
+  struct _clock* c = (struct _clock*)calloc(1, sizeof(struct _clock));
+  c->obj = obj;
+  c->fn = fn;
+  return c;
+}
+
+void clock_fdelay(void* c, double time) { }
+void clock_unset(void* c) { }
+
+void defer_low(void* ob, method fn, t_symbol* sym, short argc, t_atom* argv) { fn(ob, sym, argc, argv); }
+
+double systimer_gettime(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// ====  THREADS  ====
+
+long systhread_create(method entryproc, void* arg, long stacksize, long priority, long flags, t_systhread* thread) {
+
+  pthread_t* th = (pthread_t*)malloc(sizeof(pthread_t));
+  if (pthread_create(th, NULL, (void* (*)(void*))entryproc, arg)) { free(th); return 1; }
+  *thread = th;
+  return 0;
+}
+
+long systhread_join(t_systhread thread, unsigned int* retval) {
+
+  void* ret = NULL;
+  long err = pthread_join(*(pthread_t*)thread, &ret);
+  if (retval) { *retval = (unsigned int)(uintptr_t)ret; }
+  free(thread);
+  return err;
+}
+
+void systhread_exit(long status) { pthread_exit((void*)(intptr_t)status); }
+void systhread_sleep(long milliseconds) { usleep(milliseconds * 1000); }
+
+static pthread_t stub_main_thread;
+static int stub_main_thread_set = 0;
+
+long systhread_ismainthread(void) {
+
+  // The first thread to ask is the main thread
+  if (!stub_main_thread_set) { stub_main_thread = pthread_self(); stub_main_thread_set = 1; }
+  return pthread_equal(stub_main_thread, pthread_self()) ? 1 : 0;
+}
+
+long systhread_mutex_new(t_systhread_mutex* pmutex, long flags) {
+
+  pthread_mutex_t* mutex = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(mutex, NULL);
+  *pmutex = mutex;
+  return 0;
+}
+
+long systhread_mutex_free(t_systhread_mutex pmutex) {
+
+  pthread_mutex_destroy((pthread_mutex_t*)pmutex);
+  free(pmutex);
+  return 0;
+}
+
+long systhread_mutex_lock(t_systhread_mutex pmutex) { return pthread_mutex_lock((pthread_mutex_t*)pmutex); }
+long systhread_mutex_unlock(t_systhread_mutex pmutex) { return pthread_mutex_unlock((pthread_mutex_t*)pmutex); }
+long systhread_mutex_trylock(t_systhread_mutex pmutex) { return pthread_mutex_trylock((pthread_mutex_t*)pmutex); }
+
+// ====  MICROSOFT CRT  ====
+// qsort_s passes a context to the comparison function, in first position
+
+static __thread int (*stub_qsort_cmp)(void*, const void*, const void*);
+static __thread void* stub_qsort_ctx;
+
+static int _stub_qsort_tramp(const void* a, const void* b) { return stub_qsort_cmp(stub_qsort_ctx, a, b); }
+
+void qsort_s(void* base, size_t num, size_t width, int (*compare)(), void* context) {
+
+  stub_qsort_cmp = (int (*)(void*, const void*, const void*))compare;
+  stub_qsort_ctx = context;
+  qsort(base, num, width, _stub_qsort_tramp);
+}
+
+// ====  DICTIONARIES  ====
+// Entries are kept in insertion order, each entry holds an array of atoms.
+// A dictionary value is held as one A_OBJ atom, and is owned by its parent.
+
+typedef struct _stub_entry { t_symbol* key; long argc; t_atom* argv; } t_stub_entry;
+
+struct _dictionary {
+
+  t_object      obj;       // o_magic is STUB_MAGIC_DICT
+  long          cnt;
+  long          max;
+  t_stub_entry* entries;
+  t_symbol*     name;      // Registered name, or NULL
+  long          refcnt;
+};
+
+#define DICT_REG_MAX 256
+static t_dictionary* dict_reg[DICT_REG_MAX];
+static long dict_reg_cnt = 0;
+static pthread_mutex_t dict_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+t_dictionary* dictionary_new(void) {
+
+  t_dictionary* d = (t_dictionary*)calloc(1, sizeof(t_dictionary));
+  d->obj.o_magic = STUB_MAGIC_DICT;
+  return d;
+}
+
+static t_stub_entry* _stub_dict_find(const t_dictionary* d, t_symbol* key) {
+
+  for (long i = 0; i < d->cnt; i++) { if (d->entries[i].key == key) { return d->entries + i; } }
+  return NULL;
+}
+
+static void _stub_entry_clear(t_stub_entry* e, t_bool free_obj) {
+
+  if (free_obj) {
+    for (long i = 0; i < e->argc; i++) {
+      if (e->argv[i].a_type == A_OBJ) { object_free(e->argv[i].a_w.w_obj); }
+    }
+  }
+  free(e->argv);
+  e->argv = NULL;
+  e->argc = 0;
+}
+
+static t_max_err _stub_dict_put(t_dictionary* d, t_symbol* key, long argc, t_atom* argv) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+
+  if (e) { _stub_entry_clear(e, true); }
+  else {
+    if (d->cnt == d->max) {
+      d->max = d->max ? 2 * d->max : 8;
+      d->entries = (t_stub_entry*)realloc(d->entries, sizeof(t_stub_entry) * d->max);
+    }
+    e = d->entries + d->cnt++;
+    e->key = key;
+  }
+
+  e->argc = argc;
+  e->argv = (t_atom*)malloc(sizeof(t_atom) * MAX(argc, 1));
+  memcpy(e->argv, argv, sizeof(t_atom) * argc);
+  return MAX_ERR_NONE;
+}
+
+t_max_err dictionary_appendlong(t_dictionary* d, t_symbol* key, t_atom_long value) {
+
+  t_atom a; atom_setlong(&a, value);
+  return _stub_dict_put(d, key, 1, &a);
+}
+
+t_max_err dictionary_appendfloat(t_dictionary* d, t_symbol* key, double value) {
+
+  t_atom a; atom_setfloat(&a, value);
+  return _stub_dict_put(d, key, 1, &a);
+}
+
+t_max_err dictionary_appendsym(t_dictionary* d, t_symbol* key, t_symbol* value) {
+
+  t_atom a; atom_setsym(&a, value);
+  return _stub_dict_put(d, key, 1, &a);
+}
+
+t_max_err dictionary_appendatoms(t_dictionary* d, t_symbol* key, long argc, t_atom* argv) {
+
+  return _stub_dict_put(d, key, argc, argv);
+}
+
+// "@key value ..." pairs, the values are parsed as ints, floats or symbols
+t_dictionary* dictionary_sprintf(const char* fmt, ...) {
+
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  char* str = (char*)malloc(len + 1);
+  va_start(args, fmt);
+  vsnprintf(str, len + 1, fmt, args);
+  va_end(args);
+
+  t_dictionary* d = dictionary_new();
+  t_symbol* key = NULL;
+  t_atom argv[64];
+  long argc = 0;
+  char* end = NULL;
+
+  for (char* tok = strtok(str, " \t\n"); ; tok = strtok(NULL, " \t\n")) {
+    if ((!tok) || (tok[0] == '@')) {
+      if (key) { _stub_dict_put(d, key, argc, argv); }
+      if (!tok) { break; }
+      key = gensym(tok + 1);
+      argc = 0;
+      continue;
+    }
+    if (argc == 64) { continue; }
+    long l = strtol(tok, &end, 10);
+    if (*end == '\0') { atom_setlong(argv + argc++, l); continue; }
+    double f = strtod(tok, &end);
+    if (*end == '\0') { atom_setfloat(argv + argc++, f); continue; }
+    atom_setsym(argv + argc++, gensym(tok));
+  }
+
+  free(str);
+  return d;
+}
+
+t_max_err dictionary_appenddictionary(t_dictionary* d, t_symbol* key, t_object* value) {
+
+  t_atom a; atom_setobj(&a, value);
+  return _stub_dict_put(d, key, 1, &a);
+}
+
+t_max_err dictionary_getlong(const t_dictionary* d, t_symbol* key, t_atom_long* value) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+  if (!e || !e->argc) { return MAX_ERR_GENERIC; }
+  *value = atom_getlong(e->argv);
+  return MAX_ERR_NONE;
+}
+
+t_max_err dictionary_getfloat(const t_dictionary* d, t_symbol* key, double* value) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+  if (!e || !e->argc) { return MAX_ERR_GENERIC; }
+  *value = atom_getfloat(e->argv);
+  return MAX_ERR_NONE;
+}
+
+t_max_err dictionary_getsym(const t_dictionary* d, t_symbol* key, t_symbol** value) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+  if (!e || !e->argc) { return MAX_ERR_GENERIC; }
+  *value = atom_getsym(e->argv);
+  return MAX_ERR_NONE;
+}
+
+t_max_err dictionary_getatoms(const t_dictionary* d, t_symbol* key, long* argc, t_atom** argv) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+  if (!e) { *argc = 0; *argv = NULL; return MAX_ERR_GENERIC; }
+  *argc = e->argc;
+  *argv = e->argv;
+  return MAX_ERR_NONE;
+}
+
+t_max_err dictionary_getdictionary(const t_dictionary* d, t_symbol* key, t_object** value) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+  if (!e || !e->argc || (e->argv->a_type != A_OBJ)) { *value = NULL; return MAX_ERR_GENERIC; }
+  *value = (t_object*)e->argv->a_w.w_obj;
+  return MAX_ERR_NONE;
+}
+
+long dictionary_hasentry(const t_dictionary* d, t_symbol* key) { return _stub_dict_find(d, key) ? 1 : 0; }
+
+static t_max_err _stub_dict_remove(t_dictionary* d, t_symbol* key, t_bool free_obj) {
+
+  t_stub_entry* e = _stub_dict_find(d, key);
+  if (!e) { return MAX_ERR_GENERIC; }
+  _stub_entry_clear(e, free_obj);
+  long ind = (long)(e - d->entries);
+  memmove(e, e + 1, sizeof(t_stub_entry) * (d->cnt - ind - 1));
+  d->cnt--;
+  return MAX_ERR_NONE;
+}
+
+t_max_err dictionary_deleteentry(t_dictionary* d, t_symbol* key) { return _stub_dict_remove(d, key, true); }
+t_max_err dictionary_chuckentry(t_dictionary* d, t_symbol* key) { return _stub_dict_remove(d, key, false); }
+
+t_max_err dictionary_clear(t_dictionary* d) {
+
+  for (long i = 0; i < d->cnt; i++) { _stub_entry_clear(d->entries + i, true); }
+  d->cnt = 0;
+  return MAX_ERR_NONE;
+}
+
+static void _stub_dict_free(t_dictionary* d) {
+
+  dictobj_unregister(d);
+  dictionary_clear(d);
+  free(d->entries);
+  free(d);
+}
+
+t_dictionary* dictobj_register(t_dictionary* d, t_symbol** name) {
+
+  static long uid = 0;
+  char str[32];
+
+  pthread_mutex_lock(&dict_mutex);
+
+  if (dict_reg_cnt == DICT_REG_MAX) { pthread_mutex_unlock(&dict_mutex); return NULL; }
+
+  // Generate a unique name if none is given
+  if (!*name || !(*name)->s_name[0]) {
+    snprintf(str, 32, "u%06li", ++uid);
+    *name = gensym(str);
+  }
+  d->name = *name;
+  d->refcnt = 1;
+  dict_reg[dict_reg_cnt++] = d;
+
+  pthread_mutex_unlock(&dict_mutex);
+  return d;
+}
+
+t_max_err dictobj_unregister(t_dictionary* d) {
+
+  pthread_mutex_lock(&dict_mutex);
+  for (long i = 0; i < dict_reg_cnt; i++) {
+    if (dict_reg[i] == d) { dict_reg[i] = dict_reg[--dict_reg_cnt]; break; }
+  }
+  d->name = NULL;
+  pthread_mutex_unlock(&dict_mutex);
+  return MAX_ERR_NONE;
+}
+
+t_dictionary* dictobj_findregistered_retain(t_symbol* name) {
+
+  t_dictionary* d = NULL;
+
+  pthread_mutex_lock(&dict_mutex);
+  for (long i = 0; i < dict_reg_cnt; i++) {
+    if (dict_reg[i]->name == name) { d = dict_reg[i]; d->refcnt++; break; }
+  }
+  pthread_mutex_unlock(&dict_mutex);
+  return d;
+}
+
+t_max_err dictobj_release(t_dictionary* d) {
+
+  pthread_mutex_lock(&dict_mutex);
+  if (d->refcnt > 0) { d->refcnt--; }
+  pthread_mutex_unlock(&dict_mutex);
+  return MAX_ERR_NONE;
+}
@@ -0,0 +1,300 @@
+#ifndef YC_MAX_STUB_H_
+#define YC_MAX_STUB_H_
+
+// ========  MINIMAL STUB OF THE MAX API FOR HEADLESS BUILDS  ========
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <stddef.h>
+
+// ====  TYPES  ====
+
+typedef int32_t   t_int32;
+typedef uint32_t  t_uint32;
+typedef int64_t   t_int64;
+typedef uint64_t  t_uint64;
+typedef int16_t   t_int16;
+typedef uint16_t  t_uint16;
+typedef uint8_t   t_uint8;
+typedef long      t_atom_long;
+typedef double    t_atom_float;
+typedef double    t_double;
+typedef double    t_sample;
+typedef float     t_float;
+typedef intptr_t  t_ptr_int;
+typedef uintptr_t t_ptr_uint;
+typedef uintptr_t t_ptr_size;
+typedef long      t_max_err;
+typedef uint32_t  t_fourcc;
+typedef char      t_bool;
+typedef char**    t_handle;
+typedef char*     t_ptr;
+
+typedef void* (*method)(void*, ...);
+
+typedef struct _symbol { char* s_name; void* s_thing; } t_symbol;
+
+typedef enum { A_NOTHING = 0, A_LONG, A_FLOAT, A_SYM, A_OBJ, A_DEFLONG, A_DEFFLOAT, A_DEFSYM,
+  A_GIMME, A_CANT, A_SEMI, A_COMMA, A_DOLLAR, A_DOLLSYM, A_GIMMEBACK, A_DEFER = 0x41, A_USURP = 0x42,
+  A_DEFER_LOW = 0x43, A_USURP_LOW = 0x44 } e_max_atomtypes;
+
+typedef union word { t_atom_long w_long; t_atom_float w_float; t_symbol* w_sym; void* w_obj; } word;
+typedef struct atom { short a_type; union word a_w; } t_atom;
+
+typedef struct _object { void* o_messlist; t_ptr_int o_magic; void* o_inlet; void* o_outlet; } t_object;
+typedef struct _pxobject { t_object z_ob; long z_in; void* z_proxy; long z_disabled; short z_count;
+  short z_misc; } t_pxobject;
+
+typedef struct _class t_class;
+typedef struct _dictionary t_dictionary;
+typedef struct _qelem* t_qelem;
+typedef void* t_filehandle;
+typedef void* t_systhread;
+typedef void* t_systhread_mutex;
+
+typedef struct _fileinfo { t_fourcc type; t_fourcc creator; long unused; long flags; } t_fileinfo;
+
+typedef enum { SYSFILE_ATMARK = 0, SYSFILE_FROMSTART = 1, SYSFILE_FROMLEOF = 2, SYSFILE_FROMMARK = 3 } t_sysfile_pos_mode;
+
+// ====  DEFINES  ====
+
+#ifndef true
+#define true 1
+#endif
+#ifndef false
+#define false 0
+#endif
+
+#define C74_EXPORT
+#define MAX_FILENAME_CHARS 512
+#define MAX_PATH_CHARS 2048
+#define FOUR_CHAR_CODE(x) ((t_fourcc)(x))
+#define PATH_READ_PERM 1
+#define PATH_WRITE_PERM 2
+#define PATH_RW_PERM 3
+#define TEXT_LB_NATIVE 0x0010
+#define TEXT_NULL_TERMINATE 0x0100
+#define ASSIST_INLET 1
+#define ASSIST_OUTLET 2
+#define CLASS_BOX gensym("box")
+#define Z_NO_INPLACE 1
+#define Z_PUT_LAST 2
+#define Z_PUT_FIRST 4
+#define Z_IGNORE_DISABLE 8
+#define Z_MC_INLETS 16
+#define MAX_ERR_NONE 0
+#define MAX_ERR_GENERIC -1
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+#ifndef TWOPI
+#define TWOPI 6.28318530717958647692
+#endif
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef CLAMP
+#define CLAMP(a, lo, hi) ((a) > (lo) ? ((a) < (hi) ? (a) : (hi)) : (lo))
+#endif
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+// Microsoft CRT variants used by the sources
+#define sscanf_s sscanf
+void qsort_s(void* base, size_t num, size_t width, int (*compare)(), void* context);
+
+// ====  ATTRIBUTES  ====
+
+#define calcoffset(x, y) ((long)offsetof(x, y))
+#define ATTR_FLAGS_NONE 0
+#define CLASS_ATTR_LONG(c, name, flags, type, field)   class_attr_stub(c, name, "long", calcoffset(type, field))
+#define CLASS_ATTR_FLOAT(c, name, flags, type, field)  class_attr_stub(c, name, "float32", calcoffset(type, field))
+#define CLASS_ATTR_DOUBLE(c, name, flags, type, field) class_attr_stub(c, name, "float64", calcoffset(type, field))
+#define CLASS_ATTR_SYM(c, name, flags, type, field)    class_attr_stub(c, name, "symbol", calcoffset(type, field))
+#define CLASS_ATTR_LABEL(c, name, flags, label)        ((void)0)
+#define CLASS_ATTR_STYLE_LABEL(c, name, flags, style, label) ((void)0)
+#define CLASS_ATTR_MIN(c, name, flags, val)            ((void)0)
+#define CLASS_ATTR_MAX(c, name, flags, val)            ((void)0)
+#define CLASS_ATTR_FILTER_CLIP(c, name, min, max)      ((void)0)
+#define CLASS_ATTR_SAVE(c, name, flags)                ((void)0)
+#define CLASS_ATTR_ACCESSORS(c, name, getter, setter)  ((void)0)
+#define CLASS_ATTR_ENUMINDEX(c, name, flags, str)      ((void)0)
+
+void class_attr_stub(t_class* c, const char* name, const char* type, long offset);
+long attr_args_offset(short ac, t_atom* av);
+void attr_args_process(void* x, short ac, t_atom* av);
+
+// ====  CLASSES AND OBJECTS  ====
+
+t_class* class_new(const char* name, method mnew, method mfree, long size, method mmenu, short type, ...);
+t_max_err class_addmethod(t_class* c, method m, const char* name, ...);
+t_max_err class_register(t_symbol* name_space, t_class* c);
+void class_dspinit(t_class* c);
+void* object_alloc(t_class* c);
+t_max_err object_free(void* x);
+void object_post(t_object* x, const char* s, ...);
+void object_error(t_object* x, const char* s, ...);
+void* object_method(void* x, t_symbol* s, ...);
+void post(const char* fmt, ...);
+
+t_symbol* gensym(const char* s);
+
+// ====  INLETS AND OUTLETS  ====
+
+void* outlet_new(void* x, const char* type);
+void* floatout(void* x);
+void* outlet_bang(void* o);
+void* outlet_int(void* o, t_atom_long n);
+void* outlet_float(void* o, double f);
+void* outlet_list(void* o, t_symbol* s, short ac, t_atom* av);
+void* outlet_anything(void* o, t_symbol* s, short ac, t_atom* av);
+void* proxy_new(void* x, long id, long* stuffloc);
+
+// ====  MSP  ====
+
+void dsp_setup(t_pxobject* x, long nsignals);
+void dsp_free(t_pxobject* x);
+double sys_getsr(void);
+long sys_getblksize(void);
+short sys_getdspobjdspstate(t_object* o);
+
+// ====  ATOMS  ====
+
+t_max_err atom_setlong(t_atom* a, t_atom_long b);
+t_max_err atom_setfloat(t_atom* a, double b);
+t_max_err atom_setsym(t_atom* a, t_symbol* b);
+t_max_err atom_setobj(t_atom* a, void* b);
+t_atom_long atom_getlong(const t_atom* a);
+t_atom_float atom_getfloat(const t_atom* a);
+t_symbol* atom_getsym(const t_atom* a);
+void* atom_getobj(const t_atom* a);
+long atom_gettype(const t_atom* a);
+t_max_err atom_setdouble_array(long ac, t_atom* av, long count, double* vals);
+t_max_err atom_getdouble_array(long ac, t_atom* av, long count, double* vals);
+
+// ====  MEMORY  ====
+
+t_ptr sysmem_newptr(long size);
+t_ptr sysmem_newptrclear(long size);
+t_ptr sysmem_resizeptr(void* ptr, long newsize);
+t_ptr sysmem_resizeptrclear(void* ptr, long newsize);
+void sysmem_freeptr(void* ptr);
+void sysmem_copyptr(const void* src, void* dst, long bytes);
+t_handle sysmem_newhandle(long size);
+t_handle sysmem_newhandleclear(unsigned long size);
+t_max_err sysmem_resizehandle(t_handle handle, long newsize);
+long sysmem_handlesize(t_handle handle);
+void sysmem_freehandle(t_handle handle);
+
+// ====  FILES AND PATHS  ====
+
+short path_frompathname(const char* name, short* path, char* filename);
+short path_fileinfo(const char* name, short path, t_fileinfo* info);
+short path_opensysfile(const char* name, short path, t_filehandle* ref, short perm);
+short path_createsysfile(const char* name, short path, t_fourcc type, t_filehandle* ref);
+short path_toabsolutesystempath(short in_path, const char* in_filename, char* out_filename);
+short path_getfilemoddate(const char* filename, const short path, t_ptr_uint* date);
+short path_nameconform(const char* src, char* dst, long style, long type);
+void open_promptset(const char* s);
+short open_dialog(char* name, short* volptr, t_fourcc* typeptr, t_fourcc* types, short ntypes);
+void saveas_promptset(const char* s);
+short saveasdialog_extended(char* name, short* vol, t_fourcc* type, t_fourcc* typelist, short numtypes);
+t_max_err sysfile_close(t_filehandle f);
+t_max_err sysfile_read(t_filehandle f, t_ptr_size* count, void* bufptr);
+t_max_err sysfile_write(t_filehandle f, t_ptr_size* count, const void* bufptr);
+t_max_err sysfile_geteof(t_filehandle f, t_ptr_size* logeof);
+t_max_err sysfile_getpos(t_filehandle f, t_ptr_size* filepos);
+t_max_err sysfile_setpos(t_filehandle f, t_sysfile_pos_mode mode, t_ptr_int offset);
+t_max_err sysfile_readtextfile(t_filehandle f, t_handle htext, t_ptr_size maxlen, long flags);
+
+#define PATH_STYLE_NATIVE 2
+#define PATH_TYPE_ABSOLUTE 1
+
+// ====  SCHEDULING  ====
+
+t_qelem qelem_new(void* obj, method fn);
+void qelem_set(t_qelem q);
+void qelem_unset(t_qelem q);
+void qelem_free(t_qelem q);
+void* clock_new(void* obj, method fn);
+void clock_fdelay(void* c, double time);
+void clock_unset(void* c);
+void defer_low(void* ob, method fn, t_symbol* sym, short argc, t_atom* argv);
+double systimer_gettime(void);
+
+// ====  THREADS  ====
+
+long systhread_create(method entryproc, void* arg, long stacksize, long priority, long flags, t_systhread* thread);
+long systhread_join(t_systhread thread, unsigned int* retval);
+void systhread_exit(long status);
+void systhread_sleep(long milliseconds);
+long systhread_mutex_new(t_systhread_mutex* pmutex, long flags);
+long systhread_mutex_free(t_systhread_mutex pmutex);
+long systhread_mutex_lock(t_systhread_mutex pmutex);
+long systhread_mutex_unlock(t_systhread_mutex pmutex);
+long systhread_mutex_trylock(t_systhread_mutex pmutex);
+long systhread_ismainthread(void);
+
+#define SYSTHREAD_MUTEX_NORMAL 0
+
+// ====  ATOMICS  ====
+
+typedef volatile int32_t t_int32_atomic;
+
+#define ATOMIC_INCREMENT(p) __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define ATOMIC_DECREMENT(p) __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+
+// ====  DICTIONARIES  ====
+
+t_dictionary* dictionary_new(void);
+t_dictionary* dictionary_sprintf(const char* fmt, ...);
+t_max_err dictionary_appendlong(t_dictionary* d, t_symbol* key, t_atom_long value);
+t_max_err dictionary_appendfloat(t_dictionary* d, t_symbol* key, double value);
+t_max_err dictionary_appendsym(t_dictionary* d, t_symbol* key, t_symbol* value);
+t_max_err dictionary_appendatoms(t_dictionary* d, t_symbol* key, long argc, t_atom* argv);
+t_max_err dictionary_appenddictionary(t_dictionary* d, t_symbol* key, t_object* value);
+t_max_err dictionary_getlong(const t_dictionary* d, t_symbol* key, t_atom_long* value);
+t_max_err dictionary_getfloat(const t_dictionary* d, t_symbol* key, double* value);
+t_max_err dictionary_getsym(const t_dictionary* d, t_symbol* key, t_symbol** value);
+t_max_err dictionary_getatoms(const t_dictionary* d, t_symbol* key, long* argc, t_atom** argv);
+t_max_err dictionary_getdictionary(const t_dictionary* d, t_symbol* key, t_object** value);
+long dictionary_hasentry(const t_dictionary* d, t_symbol* key);
+t_max_err dictionary_deleteentry(t_dictionary* d, t_symbol* key);
+t_max_err dictionary_chuckentry(t_dictionary* d, t_symbol* key);
+t_max_err dictionary_clear(t_dictionary* d);
+t_dictionary* dictobj_findregistered_retain(t_symbol* name);
+t_max_err dictobj_release(t_dictionary* d);
+t_dictionary* dictobj_register(t_dictionary* d, t_symbol** name);
+t_max_err dictobj_unregister(t_dictionary* d);
+
+// ====  HEADLESS HOST  ====
+// Not part of the Max API: used by the host driving the object
+
+typedef void (*t_perfroutine64)(t_object* x, t_object* dsp64, double** ins, long numins,
+  double** outs, long numouts, long sampleframes, long flags, void* userparam);
+
+typedef struct _max_stub_dsp {
+
+  t_object*       obj;        // Object that added a perform routine with dsp_add64
+  t_perfroutine64 perform;
+  long            flags;
+  void*           userparam;
+
+} t_max_stub_dsp;
+
+extern t_max_stub_dsp max_stub_dsp;  // Set by object_method(dsp64, gensym("dsp_add64"), ...)
+extern int max_stub_post;           // Print the posts of the objects, errors are always printed
+
+#endif
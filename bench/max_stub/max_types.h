@@ -0,0 +1 @@
+#include "max_stub.h"
@@ -0,0 +1,269 @@
+//==============================================================================
+//
+//  @file modal_bench.c
+//  @brief Headless benchmark of the DSP core of modal~. The object is created,
+//  loaded with random banks of modes and run through its perform routine
+//  outside of Max, over a grid of settings. The results are written as JSON,
+//  in ns per mode per sample, so that builds can be compared.
+//
+//  modal_bench [--quick] [--out file.json] [--post]
+//    --quick:  small grid and short runs, used as a smoke test
+//    --out:    write the JSON to a file instead of stdout
+//    --post:   print the posts of the object
+//
+//  This Source Code Form is subject to the terms of the Mozilla Public
+//  License, v. 2.0. If a copy of the MPL was not distributed with this
+//  file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+//==============================================================================
+
+#include "modal~.h"
+
+#include <stdarg.h>
+
+void ext_main(void* r);
+
+#define BENCH_SR      44100
+#define BENCH_CHAN    8
+#define BENCH_WARMUP  100   // Warm up time in ms, before timing
+#define BENCH_RUN     2000  // Timed run in ms
+#define BENCH_RUN_Q   100   // Timed run in ms, in quick mode
+
+typedef enum _bench_mode { BENCH_FIXED, BENCH_CYCLING, BENCH_RAMPING, BENCH_FROZEN, BENCH_CONV, BENCH_IFFT, BENCH_RATE, BENCH_MODE_CNT } t_bench_mode;
+typedef enum _bench_diff { BENCH_DIFF_ONE, BENCH_DIFF_ALL, BENCH_DIFF_CNT } t_bench_diff;
+
+static const char* bench_mode_str[BENCH_MODE_CNT] = { "fixed", "cycling", "ramping", "frozen", "conv", "ifft", "multirate" };
+static const char* bench_diff_str[BENCH_DIFF_CNT] = { "one", "all" };
+static const char* bench_kernel_str[2] = { "biquad", "phasor" };
+
+// ====  BENCH_SEND  ====
+
+//******************************************************************************
+//  Send a message to the object, with the arguments as a printf style string
+//  Ints, floats and symbols are parsed from the string
+//
+typedef void (*t_bench_meth)(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+
+static void bench_send(t_modal* x, t_bench_meth meth, const char* name, const char* fmt, ...) {
+
+  char str[256];
+  t_atom argv[16];
+  t_int32 argc = 0;
+  char* tok = NULL;
+  char* end = NULL;
+  va_list args;
+
+  va_start(args, fmt);
+  vsnprintf(str, 256, fmt, args);
+  va_end(args);
+
+  for (tok = strtok(str, " "); tok && (argc < 16); tok = strtok(NULL, " "), argc++) {
+    long l = strtol(tok, &end, 10);
+    if (*end == '\0') { atom_setlong(argv + argc, l); continue; }
+    double f = strtod(tok, &end);
+    if (*end == '\0') { atom_setfloat(argv + argc, f); continue; }
+    atom_setsym(argv + argc, gensym(tok));
+  }
+
+  meth(x, gensym(name), argc, argv);
+}
+
+// ====  BENCH_BANK_LOAD  ====
+
+//******************************************************************************
+//  Fill a bank with random modes: log distributed frequencies, amplitudes
+//  over 60 dB and decays from 0.5 to 20
+//
+static void bench_bank_load(t_modal* x, t_bank* bank, t_int32 reson_cnt) {
+
+  bank_free(x, bank);
+  bank_new(x, bank, reson_cnt);
+  bank->name = gensym("bench");
+  bank->gain = 1.0;
+
+  t_model* model = bank->model;
+  for (t_int32 res = 0; res < reson_cnt; res++) {
+    model->ampl_ref[res]  = pow(10, -3 * (t_double)rand() / RAND_MAX);
+    model->freq_ref[res]  = 50 * pow(300, (t_double)rand() / RAND_MAX);
+    model->decay_ref[res] = 0.5 + 19.5 * (t_double)rand() / RAND_MAX;
+  }
+
+  bank_update(x, bank);
+  bank_sort(x, bank);
+  bank->is_on = true;
+}
+
+// ====  BENCH_RUN  ====
+
+//******************************************************************************
+//  Run the perform routine over a duration in samples
+//  Returns the elapsed time in ns, or -1 if the output is not finite
+//
+static t_double bench_run(t_modal* x, t_double** ins, t_double** outs, long vec, t_int64 samples) {
+
+  struct timespec t0, t1;
+  t_int32 finite = true;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  for (t_int64 smp = 0; smp < samples; smp += vec) {
+    max_stub_dsp.perform(max_stub_dsp.obj, NULL, ins, x->in_cnt, outs, x->chan_cnt, vec, 0, NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    for (long smp = 0; smp < vec; smp++) { finite &= isfinite(outs[ch][smp]); }
+  }
+
+  return finite ? (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec) : -1;
+}
+
+// ====  BENCH_CONFIG  ====
+
+//******************************************************************************
+//  Create an object for one configuration, time it, and write the result
+//  Returns 0 on success
+//
+static int bench_config(FILE* out, t_bool* first, t_int32 bank_cnt, t_int32 reson_max, long vec,
+  t_bench_mode mode, t_bench_diff diff, t_int32 kernel, t_int32 run_ms) {
+
+  t_atom argv[4];
+  atom_setlong(argv, bank_cnt);
+  atom_setlong(argv + 1, reson_max);
+  atom_setlong(argv + 2, 2);
+  atom_setlong(argv + 3, BENCH_CHAN);
+
+  t_modal* x = (t_modal*)modal_new(gensym("y.modal~"), 4, argv);
+  if (!x) { fprintf(stderr, "modal_bench:  modal_new failed.\n"); return 1; }
+  x->kernel = kernel;
+
+  // DSP chain: one connected input, fed with quiet noise
+  t_int32 count[IN_MAX] = { 1 };
+  max_stub_dsp.perform = NULL;
+  modal_dsp64(x, NULL, count, BENCH_SR, vec, 0);
+  if (!max_stub_dsp.perform) { fprintf(stderr, "modal_bench:  No perform routine.\n"); object_free(x); return 1; }
+
+  t_double* in = (t_double*)malloc(sizeof(t_double) * vec);
+  t_double* outs[BENCH_CHAN];
+  for (long smp = 0; smp < vec; smp++) { in[smp] = 1e-3 * ((t_double)rand() / RAND_MAX - 0.5); }
+  for (t_int32 ch = 0; ch < BENCH_CHAN; ch++) { outs[ch] = (t_double*)malloc(sizeof(t_double) * vec); }
+
+  // Load the banks, switch all the modes on and set the diffusion
+  t_int32 mode_cnt = 0;
+  for (t_int32 bnk = 0; bnk < bank_cnt; bnk++) {
+    bench_bank_load(x, x->bank_arr + bnk, reson_max);
+    mode_cnt += (x->bank_arr + bnk)->reson_cnt;
+    bench_send(x, mode_all_on, "all_on", "%i", bnk);
+    if (diff == BENCH_DIFF_ALL) { bench_send(x, mode_diffusion, "diffusion", "%i all all", bnk); }
+  }
+
+  // Warm up, so that the modes are on
+  bench_run(x, &in, outs, vec, (t_int64)(BENCH_WARMUP * BENCH_SR / 1000));
+
+  // Then set the mode type
+  for (t_int32 bnk = 0; bnk < bank_cnt; bnk++) {
+    switch (mode) {
+    case BENCH_FIXED:
+      break;
+    case BENCH_CYCLING:
+      bench_send(x, mode_cycle, "cycle", "%i all times 20 40 20 40 20 40 20 40", bnk);
+      bench_send(x, mode_cycle, "cycle", "%i all resume", bnk);
+      break;
+    case BENCH_RAMPING:
+      bench_send(x, state_state, "state", "store %i 0 bench", bnk);
+      bench_send(x, state_ramp_to, "ramp_to", "%i 0 1000000", bnk);
+      break;
+    case BENCH_FROZEN:
+      bench_send(x, state_freeze, "freeze", "%i 1", bnk);
+      break;
+    case BENCH_CONV:
+      bench_send(x, conv_conv, "conv", "%i 1", bnk);
+      bench_send(x, state_freeze, "freeze", "%i 1", bnk);
+      break;
+    case BENCH_IFFT:
+      bench_send(x, ifft_ifft, "ifft", "%i 1", bnk);
+      break;
+    case BENCH_RATE:
+      bench_send(x, rate_multirate, "multirate", "%i 1", bnk);
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Time the run
+  t_int64 samples = (t_int64)run_ms * BENCH_SR / 1000;
+  samples -= samples % vec;
+  t_double ns = bench_run(x, &in, outs, vec, samples);
+
+  if (ns >= 0) {
+    fprintf(out, "%s\n    { \"banks\": %i, \"reson_max\": %i, \"modes\": %i, \"vector\": %li, \"mode\": \"%s\", "
+      "\"diffusion\": \"%s\", \"kernel\": \"%s\", \"channels\": %i, \"samples\": %lli, \"ns\": %.0f, \"ns_per_mode_sample\": %.4f }",
+      *first ? "" : ",", bank_cnt, reson_max, mode_cnt, vec, bench_mode_str[mode], bench_diff_str[diff],
+      bench_kernel_str[kernel], BENCH_CHAN, (long long)samples, ns, ns / ((t_double)mode_cnt * samples));
+    *first = false;
+  }
+  else { fprintf(stderr, "modal_bench:  Output not finite:  %s / %s / %s.\n",
+    bench_mode_str[mode], bench_diff_str[diff], bench_kernel_str[kernel]); }
+
+  for (t_int32 ch = 0; ch < BENCH_CHAN; ch++) { free(outs[ch]); }
+  free(in);
+  object_free(x);
+
+  return (ns >= 0) ? 0 : 1;
+}
+
+// ====  MAIN  ====
+
+int main(int argc, char** argv) {
+
+  t_bool quick = false;
+  const char* file_name = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if      (!strcmp(argv[i], "--quick")) { quick = true; }
+    else if (!strcmp(argv[i], "--post"))  { max_stub_post = 1; }
+    else if (!strcmp(argv[i], "--out") && (i + 1 < argc)) { file_name = argv[++i]; }
+    else { fprintf(stderr, "usage:  modal_bench [--quick] [--out file.json] [--post]\n"); return 2; }
+  }
+
+  FILE* out = file_name ? fopen(file_name, "w") : stdout;
+  if (!out) { fprintf(stderr, "modal_bench:  Failed to open %s.\n", file_name); return 1; }
+
+  // The grid of settings
+  t_int32 bank_arr[] = { 1, 4 };
+  t_int32 reson_arr[] = { 32, 256 };
+  long vec_arr[] = { 64, 512 };
+  t_int32 bank_n = quick ? 1 : 2;
+  t_int32 reson_n = quick ? 1 : 2;
+  t_int32 vec_n = quick ? 1 : 2;
+  t_int32 run_ms = quick ? BENCH_RUN_Q : BENCH_RUN;
+
+  ext_main(NULL);
+  srand(1);
+
+  int err = 0;
+  t_bool first = true;
+
+  fprintf(out, "{\n  \"samplerate\": %i,\n  \"run_ms\": %i,\n  \"results\": [", BENCH_SR, run_ms);
+
+  for (t_int32 b = 0; b < bank_n; b++) {
+    for (t_int32 r = 0; r < reson_n; r++) {
+      for (t_int32 v = 0; v < vec_n; v++) {
+        for (t_int32 m = 0; m < BENCH_MODE_CNT; m++) {
+          for (t_int32 d = 0; d < BENCH_DIFF_CNT; d++) {
+            for (t_int32 k = KERNEL_BIQUAD; k <= KERNEL_PHASOR; k++) {
+              err |= bench_config(out, &first, bank_arr[b], reson_arr[r], vec_arr[v], m, d, k, run_ms);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  if (file_name) { fclose(out); }
+
+  return err;
+}
@@ -0,0 +1,187 @@
+#include "fft.h"
+
+// ====  FFT_INIT  ====
+
+//******************************************************************************
+//  Allocate and compute the tables for a real FFT of a given size
+//  size:  a power of 2, at least 4
+//
+t_my_err fft_init(t_fft* fft, t_int32 size) {
+
+  t_int32 half = size / 2;
+  t_int32 bits = 0;
+
+  fft->size = 0;
+  fft->bitrev = NULL;
+  fft->cos_arr = NULL;
+  fft->sin_arr = NULL;
+  fft->z_re = NULL;
+  fft->z_im = NULL;
+
+  if ((size < 4) || (size & (size - 1))) { return ERR_ARG_VALUE; }
+
+  fft->bitrev  = (t_int32*)sysmem_newptr(sizeof(t_int32) * half);
+  fft->cos_arr = (t_double*)sysmem_newptr(sizeof(t_double) * half);
+  fft->sin_arr = (t_double*)sysmem_newptr(sizeof(t_double) * half);
+  fft->z_re    = (t_double*)sysmem_newptr(sizeof(t_double) * half);
+  fft->z_im    = (t_double*)sysmem_newptr(sizeof(t_double) * half);
+
+  if (!fft->bitrev || !fft->cos_arr || !fft->sin_arr || !fft->z_re || !fft->z_im) {
+    fft_free(fft);
+    return ERR_ALLOC;
+  }
+
+  fft->size = size;
+
+  for (t_int32 k = 0; k < half; k++) {
+    fft->cos_arr[k] = cos(TWOPI * k / size);
+    fft->sin_arr[k] = sin(TWOPI * k / size);
+  }
+
+  // Bit reversal of the indexes of the complex FFT of size N / 2
+  while ((1 << bits) < half) { bits++; }
+  for (t_int32 k = 0; k < half; k++) {
+    fft->bitrev[k] = 0;
+    for (t_int32 b = 0; b < bits; b++) { if (k & (1 << b)) { fft->bitrev[k] |= 1 << (bits - 1 - b); } }
+  }
+
+  return ERR_NONE;
+}
+
+// ====  FFT_FREE  ====
+
+void fft_free(t_fft* fft) {
+
+  if (fft->bitrev)  { sysmem_freeptr(fft->bitrev); }
+  if (fft->cos_arr) { sysmem_freeptr(fft->cos_arr); }
+  if (fft->sin_arr) { sysmem_freeptr(fft->sin_arr); }
+  if (fft->z_re)    { sysmem_freeptr(fft->z_re); }
+  if (fft->z_im)    { sysmem_freeptr(fft->z_im); }
+
+  fft->size = 0;
+  fft->bitrev = NULL;
+  fft->cos_arr = NULL;
+  fft->sin_arr = NULL;
+  fft->z_re = NULL;
+  fft->z_im = NULL;
+}
+
+// ====  _FFT_COMPLEX  ====
+
+//******************************************************************************
+//  In place radix 2 complex FFT of size N / 2 on the work arrays, unscaled
+//  sign:  -1 for the forward transform, 1 for the inverse transform
+//
+static void _fft_complex(t_fft* fft, t_double sign) {
+
+  t_int32 half = fft->size / 2;
+  t_double* re = fft->z_re;
+  t_double* im = fft->z_im;
+  t_double tmp_re, tmp_im, w_re, w_im;
+  t_int32 j, step;
+
+  // Bit reversal permutation
+  for (t_int32 k = 0; k < half; k++) {
+    j = fft->bitrev[k];
+    if (j > k) {
+      tmp_re = re[k]; re[k] = re[j]; re[j] = tmp_re;
+      tmp_im = im[k]; im[k] = im[j]; im[j] = tmp_im;
+    }
+  }
+
+  // Butterflies: the twiddle factors of a stage of length len are every N / len in the tables
+  for (t_int32 len = 2; len <= half; len <<= 1) {
+    step = fft->size / len;
+    for (t_int32 i = 0; i < half; i += len) {
+      for (t_int32 k = 0; k < len / 2; k++) {
+        w_re = fft->cos_arr[k * step];
+        w_im = sign * fft->sin_arr[k * step];
+        j = i + k + len / 2;
+        tmp_re = w_re * re[j] - w_im * im[j];
+        tmp_im = w_re * im[j] + w_im * re[j];
+        re[j] = re[i + k] - tmp_re;
+        im[j] = im[i + k] - tmp_im;
+        re[i + k] += tmp_re;
+        im[i + k] += tmp_im;
+      }
+    }
+  }
+}
+
+// ====  FFT_FORWARD  ====
+
+//******************************************************************************
+//  Forward real FFT, unscaled
+//  The even and odd samples are packed as the real and imaginary parts of a
+//  complex FFT of size N / 2, and the two halves of the spectrum are separated:
+//    X(k) = E(k) + e^(-2 pi j k / N) O(k)
+//  in:  N samples
+//  re, im:  N / 2 + 1 bins
+//
+void fft_forward(t_fft* fft, t_double* in, t_double* re, t_double* im) {
+
+  t_int32 half = fft->size / 2;
+  t_double* z_re = fft->z_re;
+  t_double* z_im = fft->z_im;
+  t_double e_re, e_im, o_re, o_im, w_re, w_im;
+
+  for (t_int32 k = 0; k < half; k++) { z_re[k] = in[2 * k]; z_im[k] = in[2 * k + 1]; }
+
+  _fft_complex(fft, -1.0);
+
+  re[0] = z_re[0] + z_im[0];     im[0] = 0.0;
+  re[half] = z_re[0] - z_im[0];  im[half] = 0.0;
+
+  for (t_int32 k = 1; k < half; k++) {
+
+    // E = (Z(k) + Z*(N/2 - k)) / 2  and  O = (Z(k) - Z*(N/2 - k)) / 2j
+    e_re = 0.5 * (z_re[k] + z_re[half - k]);
+    e_im = 0.5 * (z_im[k] - z_im[half - k]);
+    o_re = 0.5 * (z_im[k] + z_im[half - k]);
+    o_im = -0.5 * (z_re[k] - z_re[half - k]);
+
+    w_re = fft->cos_arr[k];
+    w_im = -fft->sin_arr[k];
+
+    re[k] = e_re + w_re * o_re - w_im * o_im;
+    im[k] = e_im + w_re * o_im + w_im * o_re;
+  }
+}
+
+// ====  FFT_INVERSE  ====
+
+//******************************************************************************
+//  Inverse real FFT, scaled so that it inverts fft_forward
+//  re, im:  N / 2 + 1 bins
+//  out:  N samples
+//
+void fft_inverse(t_fft* fft, t_double* re, t_double* im, t_double* out) {
+
+  t_int32 half = fft->size / 2;
+  t_double* z_re = fft->z_re;
+  t_double* z_im = fft->z_im;
+  t_double e_re, e_im, d_re, d_im, o_re, o_im, w_re, w_im;
+  t_double scale = 1.0 / half;
+
+  for (t_int32 k = 0; k < half; k++) {
+
+    // E = (X(k) + X*(N/2 - k)) / 2  and  O = e^(2 pi j k / N) (X(k) - X*(N/2 - k)) / 2
+    e_re = 0.5 * (re[k] + re[half - k]);
+    e_im = 0.5 * (im[k] - im[half - k]);
+    d_re = 0.5 * (re[k] - re[half - k]);
+    d_im = 0.5 * (im[k] + im[half - k]);
+
+    w_re = fft->cos_arr[k];
+    w_im = fft->sin_arr[k];
+    o_re = d_re * w_re - d_im * w_im;
+    o_im = d_re * w_im + d_im * w_re;
+
+    // Z = E + j O
+    z_re[k] = e_re - o_im;
+    z_im[k] = e_im + o_re;
+  }
+
+  _fft_complex(fft, 1.0);
+
+  for (t_int32 k = 0; k < half; k++) { out[2 * k] = z_re[k] * scale; out[2 * k + 1] = z_im[k] * scale; }
+}
@@ -0,0 +1,30 @@
+#ifndef YC_FFT_H_
+#define YC_FFT_H_
+
+// ========  HEADER FILE FOR A REAL FFT  ========
+
+#include "max_util.h"
+
+// ========  STRUCTURE:  FFT  ========
+// Tables for a real FFT of size N, computed with a complex FFT of size N / 2
+// Spectra are stored as separate real and imaginary arrays of N / 2 + 1 bins
+
+typedef struct _fft {
+
+  t_int32   size;     // Size N of the real transform, a power of 2, at least 4
+  t_int32*  bitrev;   // Bit reversal permutation for the complex FFT of size N / 2
+  t_double* cos_arr;  // Twiddle factors: cos(2 pi k / N), for k < N / 2
+  t_double* sin_arr;  // Twiddle factors: sin(2 pi k / N), for k < N / 2
+  t_double* z_re;     // Work arrays for the complex FFT
+  t_double* z_im;
+
+} t_fft;
+
+// ========  FUNCTION DECLARATIONS  ========
+
+t_my_err fft_init(t_fft* fft, t_int32 size);
+void     fft_free(t_fft* fft);
+void     fft_forward(t_fft* fft, t_double* in, t_double* re, t_double* im);
+void     fft_inverse(t_fft* fft, t_double* re, t_double* im, t_double* out);
+
+#endif
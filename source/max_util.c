@@ -1,5 +1,11 @@
 #include "max_util.h"
 
+#ifdef WIN_VERSION
+#include <windows.h>  // For QueryPerformanceCounter
+#else
+#include <time.h>     // For clock_gettime
+#endif
+
 // ====  PROCEDURE: MESS_SYM_LONG  ====
 // Send a message composed of one symbol and one long integer
 
@@ -86,3 +92,21 @@ void mess_sym_string(void* outlet, t_symbol* sym, char* str, t_atom* atoms) {
   atom_setsym(atoms + 1, gensym(str));
   outlet_list(outlet, NULL, 2, atoms);
 }
+
+// ====  PROCEDURE: TIME_NOW_MS  ====
+// High resolution monotonic time in milliseconds, to time DSP routines
+
+t_double time_now_ms(void) {
+
+#ifdef WIN_VERSION
+  static LARGE_INTEGER freq = { 0 };
+  LARGE_INTEGER count;
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  QueryPerformanceCounter(&count);
+  return 1000.0 * (t_double)count.QuadPart / (t_double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000.0 * (t_double)ts.tv_sec + (t_double)ts.tv_nsec / 1000000.0;
+#endif
+}
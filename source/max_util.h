@@ -69,6 +69,8 @@ void mess_sym_sing   (void* outlet, t_symbol* sym, char* str, t_atom* atoms);
 
 void mess_sing (void* outlet, char* str, t_atom* atoms);
 
+t_double time_now_ms(void);
+
 // ========  END OF HEADER FILE  ========
 
 #endif
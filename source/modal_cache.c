@@ -0,0 +1,423 @@
+#include "modal~.h"
+
+// The cache is shared by all the instances, and used by their worker threads
+static t_cache cache = { NULL, NULL, NULL, 0, 0, 0, 0, 0 };
+
+// ====  _MODEL_NEW  ====
+
+//******************************************************************************
+//  Allocate a model in one block, held by the caller
+//  The parameters are set to default values, and the permutations to identity.
+//  Returns the model, or NULL
+//
+t_model* _model_new(t_int32 reson_cnt) {
+
+  t_ptr_size size = sizeof(t_model) + sizeof(t_double) * 3 * reson_cnt + sizeof(t_int32) * 4 * reson_cnt;
+
+  t_model* model = (t_model*)sysmem_newptr((long)size);
+  if (!model) { return NULL; }
+
+  model->refcnt = 1;
+  model->reson_cnt = reson_cnt;
+  model->gain = 1.0;
+  model->size = size;
+
+  model->ampl_ref   = (t_double*)(model + 1);
+  model->freq_ref   = model->ampl_ref + reson_cnt;
+  model->decay_ref  = model->freq_ref + reson_cnt;
+  model->sort_ampl  = (t_int32*)(model->decay_ref + reson_cnt);
+  model->sort_freq  = model->sort_ampl + reson_cnt;
+  model->sort_decay = model->sort_freq + reson_cnt;
+  model->sort_prio  = model->sort_decay + reson_cnt;
+
+  for (t_int32 res = 0; res < reson_cnt; res++) {
+    model->ampl_ref[res]   = 1.0;
+    model->freq_ref[res]   = 400;
+    model->decay_ref[res]  = 1000;
+    model->sort_ampl[res]  = res;
+    model->sort_freq[res]  = res;
+    model->sort_decay[res] = res;
+    model->sort_prio[res]  = res;
+  }
+
+  return model;
+}
+
+// ====  _MODEL_RETAIN  ====
+
+//******************************************************************************
+//  Take a reference to a model, from any thread
+//
+void _model_retain(t_model* model) {
+
+  ATOMIC_INCREMENT(&model->refcnt);
+}
+
+// ====  _MODEL_RELEASE  ====
+
+//******************************************************************************
+//  Release a reference to a model, freed by the last release
+//
+void _model_release(t_model* model) {
+
+  if (ATOMIC_DECREMENT(&model->refcnt) == 0) { sysmem_freeptr(model); }
+}
+
+// ====  _MODEL_OWN  ====
+
+//******************************************************************************
+//  Copy on write:  give a bank its own copy of its model before changing it
+//  Nothing is copied if the bank holds the only reference.
+//  Returns ERR_NONE, or ERR_ALLOC
+//
+t_my_err _model_own(t_modal* x, t_bank* bank) {
+
+  if (bank->model->refcnt == 1) { return ERR_NONE; }
+
+  t_model* model = _model_new(bank->model->reson_cnt);
+  MY_ASSERT_ERR(!model, ERR_ALLOC, "bank:  Failed to copy the model.");
+
+  t_int32 cnt = model->reson_cnt;
+  model->gain = bank->model->gain;
+  memcpy(model->ampl_ref, bank->model->ampl_ref, sizeof(t_double) * 3 * cnt);
+  memcpy(model->sort_ampl, bank->model->sort_ampl, sizeof(t_int32) * 4 * cnt);
+
+  _bank_model(bank, model);
+  _model_release(model);
+
+  return ERR_NONE;
+}
+
+// ====  _CACHE_UNLINK  ====
+
+//******************************************************************************
+//  Remove an entry from the list, called with the mutex locked
+//
+static void _cache_unlink(t_cache_entry* entry) {
+
+  if (entry->prev) { entry->prev->next = entry->next; } else { cache.head = entry->next; }
+  if (entry->next) { entry->next->prev = entry->prev; } else { cache.tail = entry->prev; }
+}
+
+// ====  _CACHE_LINK  ====
+
+//******************************************************************************
+//  Insert an entry at the head of the list, called with the mutex locked
+//
+static void _cache_link(t_cache_entry* entry) {
+
+  entry->prev = NULL;
+  entry->next = cache.head;
+  if (cache.head) { cache.head->prev = entry; } else { cache.tail = entry; }
+  cache.head = entry;
+}
+
+// ====  _CACHE_FREE  ====
+
+//******************************************************************************
+//  Remove and free an entry, called with the mutex locked
+//
+static void _cache_free(t_cache_entry* entry) {
+
+  _cache_unlink(entry);
+  cache.size -= entry->size;
+  cache.entry_cnt--;
+  _model_release(entry->model);
+  sysmem_freeptr(entry);
+}
+
+// ====  CACHE_CACHE  ====
+
+//******************************************************************************
+//  Report on the model cache, clear it, or set its memory cap
+//  The cache is shared by all the instances of the object.
+//  cache info
+//  cache clear
+//  cache size (MB):  0 to disable the cache
+//  Replies:  cache (entries) (size MB) (cap MB) (hits) (misses)
+//
+void cache_cache(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("cache_cache");
+
+  MY_ASSERT((argc < 1) || (atom_gettype(argv) != A_SYM),
+    "cache:  Arg 0:  \"info\", \"clear\" or \"size\" expected.");
+
+  t_symbol* cmd = atom_getsym(argv);
+
+  if (cmd == gensym("clear")) {
+    MY_ASSERT(argc != 1, "cache:  No argument expected after \"clear\".");
+    _cache_drop("");
+  }
+
+  else if (cmd == gensym("size")) {
+    MY_ASSERT((argc != 2) || ((atom_gettype(argv + 1) != A_LONG) && (atom_gettype(argv + 1) != A_FLOAT)),
+      "cache:  Arg 1:  The memory cap in MB expected:  cache size (MB)");
+    t_double size_mb = atom_getfloat(argv + 1);
+    MY_ASSERT(size_mb < 0, "cache:  Arg 1:  The memory cap should be positive.");
+
+    // Evict the least recently used entries above the new cap
+    systhread_mutex_lock(cache.mutex);
+    cache.size_max = (t_ptr_size)(size_mb * 1048576);
+    while ((cache.tail) && (cache.size > cache.size_max)) { _cache_free(cache.tail); }
+    systhread_mutex_unlock(cache.mutex);
+  }
+
+  else { MY_ASSERT(cmd != gensym("info"), "cache:  Arg 0:  \"info\", \"clear\" or \"size\" expected."); }
+
+  t_atom mess_arr[5];
+  systhread_mutex_lock(cache.mutex);
+  atom_setlong(mess_arr, cache.entry_cnt);
+  atom_setfloat(mess_arr + 1, (t_double)cache.size / 1048576);
+  atom_setfloat(mess_arr + 2, (t_double)cache.size_max / 1048576);
+  atom_setlong(mess_arr + 3, (t_atom_long)cache.hit_cnt);
+  atom_setlong(mess_arr + 4, (t_atom_long)cache.miss_cnt);
+  systhread_mutex_unlock(cache.mutex);
+
+  outlet_anything(x->outl_mess, gensym("cache"), 5, mess_arr);
+}
+
+// ====  _CACHE_INIT  ====
+
+//******************************************************************************
+//  Initialize the cache once for all the instances, called by ext_main
+//
+void _cache_init(void) {
+
+  if (cache.mutex) { return; }
+
+  systhread_mutex_new(&cache.mutex, SYSTHREAD_MUTEX_NORMAL);
+  cache.head = NULL;
+  cache.tail = NULL;
+  cache.entry_cnt = 0;
+  cache.size = 0;
+  cache.size_max = (t_ptr_size)CACHE_SIZE * 1048576;
+  cache.hit_cnt = 0;
+  cache.miss_cnt = 0;
+}
+
+// ====  _CACHE_KEY_FILE  ====
+
+//******************************************************************************
+//  The key of a file:  "file:" and its absolute path, and its modification date
+//  key:  at least CACHE_KEY characters
+//  Returns false if the path or the date are not found
+//
+t_bool _cache_key_file(char* key, char* file_name, short file_path, t_uint64* stamp) {
+
+  char path_abs[MAX_PATH_CHARS];
+  char path_native[MAX_PATH_CHARS];
+  t_ptr_uint date = 0;
+
+  if (path_toabsolutesystempath(file_path, file_name, path_abs)) { return false; }
+  path_nameconform(path_abs, path_native, PATH_STYLE_NATIVE, PATH_TYPE_ABSOLUTE);
+  if (path_getfilemoddate(file_name, file_path, &date)) { return false; }
+
+  snprintf(key, CACHE_KEY, "file:%s", path_native);
+  *stamp = (t_uint64)date;
+  return true;
+}
+
+// ====  _CACHE_KEY_DICT  ====
+
+//******************************************************************************
+//  The key of a bank in a dictionary:  "dict:" and the dictionary and bank names
+//  key:  at least CACHE_KEY characters
+//
+void _cache_key_dict(char* key, t_symbol* dict_sym, t_symbol* bank_sym) {
+
+  snprintf(key, CACHE_KEY, "dict:%s:%s", dict_sym->s_name, bank_sym ? bank_sym->s_name : "");
+}
+
+// ====  _CACHE_HASH  ====
+
+//******************************************************************************
+//  Fold the bytes of a value into a 64 bit FNV-1a hash
+//
+static t_uint64 _cache_hash(t_uint64 hash, t_double val) {
+
+  unsigned char* byte = (unsigned char*)&val;
+  for (t_int32 i = 0; i < (t_int32)sizeof(t_double); i++) {
+    hash ^= byte[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// ====  _CACHE_STAMP_DICT  ====
+
+//******************************************************************************
+//  The stamp of a bank in a dictionary, as dictionaries have no revision:
+//  a hash of its number of resonators, its gain, and the parameters of the
+//  resonators, in either layout. Any edit of the bank changes the stamp.
+//
+t_uint64 _cache_stamp_dict(t_dictionary* dict_bank) {
+
+  t_uint64 hash = 14695981039346656037ULL;
+  t_atom_long a_al = 0;
+  double a_d = 0;
+
+  dictionary_getlong(dict_bank, gensym("reson_cnt"), &a_al);
+  dictionary_getfloat(dict_bank, gensym("gain"), &a_d);
+  hash = _cache_hash(hash, (t_double)a_al);
+  hash = _cache_hash(hash, (t_double)a_d);
+
+  // Flat arrays of amplitudes, frequencies and decays
+  if (dictionary_hasentry(dict_bank, gensym("ampl"))) {
+
+    t_symbol* sym_arr[3] = { gensym("ampl"), gensym("freq"), gensym("decay") };
+    for (t_int32 j = 0; j < 3; j++) {
+      t_atom* atom_arr = NULL;
+      long a_l = 0;
+      dictionary_getatoms(dict_bank, sym_arr[j], &a_l, &atom_arr);
+      hash = _cache_hash(hash, (t_double)a_l);
+      for (long i = 0; i < a_l; i++) { hash = _cache_hash(hash, atom_getfloat(atom_arr + i)); }
+    }
+  }
+
+  // Older layout: an array with one subdictionary per resonator
+  else {
+
+    t_atom* atom_arr = NULL;
+    long a_l = 0;
+    dictionary_getatoms(dict_bank, gensym("resonators"), &a_l, &atom_arr);
+    hash = _cache_hash(hash, (t_double)a_l);
+
+    t_dictionary* dict_reson;
+    for (long i = 0; i < a_l; i++) {
+      dict_reson = (t_dictionary*)atom_getobj(atom_arr + i);
+      if (!dict_reson) { continue; }
+      a_d = 0; dictionary_getfloat(dict_reson, gensym("ampl"),  &a_d); hash = _cache_hash(hash, (t_double)a_d);
+      a_d = 0; dictionary_getfloat(dict_reson, gensym("freq"),  &a_d); hash = _cache_hash(hash, (t_double)a_d);
+      a_d = 0; dictionary_getfloat(dict_reson, gensym("decay"), &a_d); hash = _cache_hash(hash, (t_double)a_d);
+    }
+  }
+
+  return hash;
+}
+
+// ====  _CACHE_FIND  ====
+
+//******************************************************************************
+//  Find an entry by key, called with the mutex locked
+//  Returns the entry, or NULL
+//
+static t_cache_entry* _cache_find(const char* key) {
+
+  t_cache_entry* entry = cache.head;
+  while ((entry) && (strcmp(entry->key, key))) { entry = entry->next; }
+  return entry;
+}
+
+// ====  _CACHE_FETCH  ====
+
+//******************************************************************************
+//  Build a bank sharing the cached model, if it is found with the same stamp
+//  Called by the worker thread, with a bank that is not rendered yet.
+//  Returns true on a hit
+//
+t_bool _cache_fetch(t_modal* x, t_bank* bank, t_symbol* name, const char* key, t_uint64 stamp) {
+
+  t_model* model = NULL;
+
+  systhread_mutex_lock(cache.mutex);
+
+  // An entry with another stamp is stale, otherwise it becomes the most recently used
+  t_cache_entry* entry = _cache_find(key);
+  if ((entry) && (entry->stamp != stamp)) { _cache_free(entry); entry = NULL; }
+  if (entry) { _cache_unlink(entry); _cache_link(entry); }
+
+  // Held while the bank is built, in case the entry is evicted meanwhile
+  if ((entry) && (entry->model->reson_cnt <= x->reson_max)) { model = entry->model; _model_retain(model); }
+
+  if (model) { cache.hit_cnt++; } else { cache.miss_cnt++; }
+
+  systhread_mutex_unlock(cache.mutex);
+
+  if (!model) { return false; }
+
+  // Only the coefficients and the state of the resonators are allocated
+  bank_free(x, bank);
+  t_bool is_hit = (bank_new_model(x, bank, model) == ERR_NONE);
+  if (is_hit) { bank->name = name; }
+  _model_release(model);
+
+  return is_hit;
+}
+
+// ====  _CACHE_STORE  ====
+
+//******************************************************************************
+//  Store the model of a bank that was just built, sorted, and not rendered yet
+//  The entry holds a reference to the model, and is allocated with its key.
+//  The least recently used entries are evicted to stay below the memory cap.
+//
+void _cache_store(t_bank* bank, const char* key, t_uint64 stamp) {
+
+  t_int32 cnt = bank->reson_cnt;
+  t_ptr_size key_len = strlen(key) + 1;
+  t_ptr_size size = sizeof(t_cache_entry) + key_len + bank->model->size;
+
+  // The model is not shared yet, and keeps the gain of the bank
+  bank->model->gain = bank->gain;
+
+  systhread_mutex_lock(cache.mutex);
+
+  // Replace a previous entry, and skip models larger than the cap
+  t_cache_entry* entry = _cache_find(key);
+  if (entry) { _cache_free(entry); }
+  if ((cnt < 1) || (size > cache.size_max)) { systhread_mutex_unlock(cache.mutex); return; }
+
+  while ((cache.tail) && (cache.size + size > cache.size_max)) { _cache_free(cache.tail); }
+
+  entry = (t_cache_entry*)sysmem_newptr((long)size);
+  if (!entry) { systhread_mutex_unlock(cache.mutex); return; }
+
+  entry->key = (char*)(entry + 1);
+  memcpy(entry->key, key, key_len);
+  entry->stamp = stamp;
+  entry->size = size;
+  entry->model = bank->model;
+  _model_retain(entry->model);
+
+  _cache_link(entry);
+  cache.size += size;
+  cache.entry_cnt++;
+
+  systhread_mutex_unlock(cache.mutex);
+}
+
+// ====  _CACHE_DROP  ====
+
+//******************************************************************************
+//  Free the entry with a given key, or all of them for ""
+//  The key is matched exactly, so that dropping a bank does not drop the banks
+//  with a name that starts with its own.
+//
+void _cache_drop(const char* key) {
+
+  systhread_mutex_lock(cache.mutex);
+
+  t_cache_entry* entry = cache.head;
+  t_cache_entry* next = NULL;
+  while (entry) {
+    next = entry->next;
+    if ((!key[0]) || (!strcmp(entry->key, key))) { _cache_free(entry); }
+    entry = next;
+  }
+
+  systhread_mutex_unlock(cache.mutex);
+}
+
+// ====  _CACHE_DROP_DICT  ====
+
+//******************************************************************************
+//  Free the entry of a bank in a dictionary, when it is saved, renamed or deleted
+//  The stamp would tell the entry is stale, but its memory is released earlier.
+//
+void _cache_drop_dict(t_symbol* dict_sym, t_symbol* bank_sym) {
+
+  char key[CACHE_KEY];
+  _cache_key_dict(key, dict_sym, bank_sym);
+  _cache_drop(key);
+}
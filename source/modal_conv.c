@@ -0,0 +1,600 @@
+#include "modal~.h"
+
+// ====  CONV_CONV  ====
+
+//******************************************************************************
+//  Set a bank to be rendered by convolution when it is frozen or static
+//  conv (bank) (int: 0 or 1) [float: floor in dB]
+//  The impulse responses are computed when the message is received, if the
+//  bank is already frozen or static, and each time the bank is frozen.
+//
+void conv_conv(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("conv_conv");
+
+  MY_ASSERT((argc != 2) && (argc != 3), "conv:  2 or 3 args expected:  conv (bank) (int: 0 or 1) [float: floor in dB]");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "conv:  Arg 0:  Bank not found.");
+
+  // Argument 1 should be 0 or 1
+  MY_ASSERT(atom_gettype(argv + 1) != A_LONG, "conv:  Arg 1:  0 or 1 expected.");
+  t_atom_long use = atom_getlong(argv + 1);
+  MY_ASSERT((use != 0) && (use != 1), "conv:  Arg 1:  0 or 1 expected.");
+  MY_ASSERT((use == 1) && ((bank->ifft_targ) || (bank->ifft_active) || (bank->ifft_new)), "conv:  The bank is rendered by inverse FFT.");
+  MY_ASSERT((use == 1) && (bank->rate_use), "conv:  The bank is rendered at multiple rates.");
+
+  // Argument 2 is the floor in dB under the peak
+  if (argc == 3) {
+    MY_ASSERT((atom_gettype(argv + 2) != A_FLOAT) && (atom_gettype(argv + 2) != A_LONG), "conv:  Arg 2:  Float expected.");
+    bank->conv_db = MAX(fabs(atom_getfloat(argv + 2)), 1.0);
+  }
+
+  bank->conv_use = (t_bool)use;
+
+  // The recursion takes over again with a crossfade
+  if (!bank->conv_use) { bank->conv_targ = false; return; }
+
+  if (bank->is_frozen || _conv_is_static(bank)) { _conv_start(x, bank); }
+}
+
+// ====  _CONV_START  ====
+
+//******************************************************************************
+//  Compute the impulse responses of a frozen or static bank, and start
+//  rendering it by convolution, with a crossfade from the recursion.
+//  Called from the main thread, as it allocates memory. The responses are
+//  handed over to the perform routine, which installs them between blocks.
+//
+void _conv_start(t_modal* x, t_bank* bank) {
+
+  TRACE("_conv_start");
+
+  MY_ASSERT(!_conv_is_static(bank), "conv:  The bank is neither frozen nor static.");
+  MY_ASSERT(x->vec_max == 0, "conv:  The DSP has not been started.");
+
+  t_conv* conv = _conv_build(x, bank);
+  if (!conv) { return; }
+
+  // Replace the responses waiting to be installed, if any
+  systhread_mutex_lock(x->load_mutex);
+  t_conv* conv_new = bank->conv_new;
+  bank->conv_new = conv;
+  x->conv_pend = true;
+  systhread_mutex_unlock(x->load_mutex);
+
+  if (conv_new) { _conv_free(conv_new); }
+
+  // Installed by the main thread if the perform routine is not running
+  qelem_set(x->load_qelem);
+}
+
+// ====  _CONV_INSTALL  ====
+
+//******************************************************************************
+//  Install the impulse responses built by the main thread
+//  The previous responses are kept to be freed by the main thread. A bank
+//  whose previous responses are not freed yet is installed on a later call.
+//  Called with the mutex of the loads locked: by the perform routine between
+//  two blocks, or by the main thread if the perform routine is not running.
+//  Returns true if responses were installed
+//
+t_bool _conv_install(t_modal* x) {
+
+  t_bank* bank = NULL;
+  t_bool installed = false;
+  t_bool is_left = false;
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    bank = x->bank_arr + bnk;
+    if (!bank->conv_new) { continue; }
+    if (bank->conv_old) { is_left = true; continue; }
+
+    bank->conv_old = bank->conv;
+    bank->conv = bank->conv_new;
+    bank->conv_new = NULL;
+    bank->conv_A = 0.0;
+    bank->conv_targ = true;
+    installed = true;
+  }
+
+  x->conv_pend = is_left;
+  return installed;
+}
+
+// ====  _CONV_RELEASE  ====
+
+//******************************************************************************
+//  Free the impulse responses replaced by the perform routine
+//  Called by the main thread with the mutex of the loads locked.
+//
+void _conv_release(t_modal* x) {
+
+  t_bank* bank = NULL;
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    bank = x->bank_arr + bnk;
+    if (bank->conv_old) { _conv_free(bank->conv_old); bank->conv_old = NULL; }
+  }
+}
+
+// ====  _CONV_IS_STATIC  ====
+
+//******************************************************************************
+//  Test if the output of a bank is a linear time invariant function of its
+//  input: frozen, or only fixed resonators with no countdown, and no pending
+//  mode change or diffusion interpolation.
+//
+t_bool _conv_is_static(t_bank* bank) {
+
+  t_resonator* reson = NULL;
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+
+    if ((reson->cntd == 0) || (reson->diff_cntd > 0)) { return false; }
+
+    if (!bank->is_frozen && ((reson->cntd != INDEFINITE)
+      || ((reson->mode_type != MODE_TYPE_OFF) && (reson->mode_type != MODE_TYPE_FIX)))) { return false; }
+  }
+
+  return true;
+}
+
+// ====  _CONV_AMPL  ====
+
+//******************************************************************************
+//  Bound of the envelope of the impulse response of a resonator, over all the
+//  channels:  |a0 / sin(theta)| r^n, or 0 if the resonator is not rendered.
+//
+static t_double _conv_ampl(t_modal* x, t_resonator* reson) {
+
+  t_double gain = 0.0;
+
+  if ((reson->mode_type == MODE_TYPE_OFF) || (reson->skip)) { return 0.0; }
+
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { gain = MAX(gain, fabs(reson->diff_targ[ch])); }
+
+  return fabs(reson->a0 * reson->in_A_cur * reson->out_A_cur) * gain
+    / MAX(fabs(sin(TWOPI * reson->freq / x->samplerate)), 1e-3);
+}
+
+// ====  _CONV_BUILD  ====
+
+//******************************************************************************
+//  Compute the impulse responses of a bank, truncated at the floor under the
+//  peak, and the spectra of their partitions. The responses include the input
+//  and output amplitudes and the diffusion gains of the resonators, but not
+//  the gain of the bank, applied when rendering.
+//  Returns NULL on failure.
+//
+t_conv* _conv_build(t_modal* x, t_bank* bank) {
+
+  TRACE("_conv_build");
+
+  t_conv* conv = NULL;
+  t_resonator* reson = NULL;
+  t_double* ir = NULL;
+  t_double* H = NULL;
+  t_int32 B = x->vec_max;
+  t_int32 ch_map[CHAN_MAX];
+  t_int32 ch_cnt = 0;
+  t_int32 ch_ind[CHAN_MAX];
+  t_double gain[CHAN_MAX];
+  t_double ampl = 0.0, peak = 0.0;
+  t_double floor_A = pow(10, -bank->conv_db / 20);
+  t_int32 len_max = (t_int32)(CONV_LEN_MAX * x->samplerate);
+  t_int32 len = 0, len_res = 0, ofs = 0;
+  t_double y = 0.0, y_m1 = 0.0, y_m2 = 0.0;
+
+  MY_ASSERT_RETURN((B < 2) || (B & (B - 1)), NULL, "conv:  The vector size should be a power of 2.");
+
+  // The peak of the envelopes
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) { peak = MAX(peak, _conv_ampl(x, bank->reson_arr + res)); }
+  MY_ASSERT_RETURN(peak == 0.0, NULL, "conv:  No resonator is rendered in the bank.");
+
+  // The length of the responses, and the channels they are diffused into
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { ch_map[ch] = -1; }
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+    ampl = _conv_ampl(x, reson);
+    if (ampl <= floor_A * peak) { continue; }
+
+    len_res = (reson->decay > 0) ? (t_int32)MIN(x->samplerate * log(ampl / (floor_A * peak)) / reson->decay, len_max) : len_max;
+    len = MAX(len, len_res);
+
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      if ((reson->diff_targ[ch] != 0.0) && (ch_map[ch] == -1)) { ch_map[ch] = 0; }
+    }
+  }
+  len = CLAMP(len, 1, len_max);
+
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    if (ch_map[ch] == 0) { ch_map[ch] = ch_cnt; ch_ind[ch_cnt++] = ch; }
+  }
+
+  // Allocate the structure, cleared so that it can be freed at any point
+  conv = (t_conv*)sysmem_newptrclear(sizeof(t_conv));
+  MY_ASSERT_RETURN(!conv, NULL, "conv:  Failed to allocate the convolution.");
+
+  conv->len = len;
+  conv->chan_cnt = ch_cnt;
+  for (t_int32 c = 0; c < ch_cnt; c++) { conv->chan_ind[c] = ch_ind[c]; }
+
+  // Partitions: the head covers the first tail partition, so that the tail
+  // output of a period is ready at its end, for the next period.
+  // The cost per sample is about ratio + len / (ratio B) products per bin,
+  // lowest for a ratio close to the square root of len / B.
+  conv->ratio = 4;
+  while ((conv->ratio < CONV_RATIO_MAX) && ((t_double)conv->ratio * conv->ratio * B < len)) { conv->ratio *= 2; }
+
+  conv->head_len = B;
+  conv->tail_len = B * conv->ratio;
+  if (len <= conv->tail_len) {
+    conv->head_cnt = (len + B - 1) / B;
+    conv->tail_cnt = 0;
+  }
+  else {
+    conv->head_cnt = conv->ratio;
+    conv->tail_cnt = (len - conv->tail_len + conv->tail_len - 1) / conv->tail_len;
+  }
+
+  t_int32 bins1 = conv->head_len + 1;
+  t_int32 bins2 = conv->tail_len + 1;
+
+  if (fft_init(&conv->head_fft, 2 * conv->head_len) != ERR_NONE) { goto CONV_BUILD_FAIL; }
+  conv->head_H  = (t_double*)sysmem_newptrclear(sizeof(t_double) * ch_cnt * conv->head_cnt * 2 * bins1);
+  conv->head_X  = (t_double*)sysmem_newptrclear(sizeof(t_double) * conv->head_cnt * 2 * bins1);
+  conv->head_in = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * conv->head_len);
+  conv->work    = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * conv->tail_len);
+  conv->spec    = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * bins2);
+  if (!conv->head_H || !conv->head_X || !conv->head_in || !conv->work || !conv->spec) { goto CONV_BUILD_FAIL; }
+
+  if (conv->tail_cnt) {
+    if (fft_init(&conv->tail_fft, 2 * conv->tail_len) != ERR_NONE) { goto CONV_BUILD_FAIL; }
+    conv->tail_H   = (t_double*)sysmem_newptrclear(sizeof(t_double) * ch_cnt * conv->tail_cnt * 2 * bins2);
+    conv->tail_X   = (t_double*)sysmem_newptrclear(sizeof(t_double) * conv->tail_cnt * 2 * bins2);
+    conv->tail_in  = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * conv->tail_len);
+    conv->tail_acc = (t_double*)sysmem_newptrclear(sizeof(t_double) * ch_cnt * 2 * bins2);
+    conv->tail_out = (t_double*)sysmem_newptrclear(sizeof(t_double) * ch_cnt * conv->tail_len);
+    if (!conv->tail_H || !conv->tail_X || !conv->tail_in || !conv->tail_acc || !conv->tail_out) { goto CONV_BUILD_FAIL; }
+  }
+
+  // Sum the impulse responses of the resonators into each channel
+  ir = (t_double*)sysmem_newptrclear(sizeof(t_double) * ch_cnt * len);
+  if (!ir) { goto CONV_BUILD_FAIL; }
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+    ampl = _conv_ampl(x, reson);
+    if (ampl <= floor_A * peak) { continue; }
+
+    len_res = (reson->decay > 0) ? (t_int32)MIN(x->samplerate * log(ampl / (floor_A * peak)) / reson->decay, len) : len;
+
+    for (t_int32 c = 0; c < ch_cnt; c++) { gain[c] = reson->in_A_cur * reson->out_A_cur * reson->diff_targ[ch_ind[c]]; }
+
+    // The recursion of the resonator, with a unit impulse as input
+    y_m1 = 0.0; y_m2 = 0.0;
+    for (t_int32 n = 0; n < len_res; n++) {
+      y = ((n == 0) ? reson->a0 : 0.0) + reson->b1 * y_m1 + reson->b2 * y_m2;
+      y_m2 = y_m1;
+      y_m1 = y;
+      for (t_int32 c = 0; c < ch_cnt; c++) { ir[c * len + n] += gain[c] * y; }
+    }
+  }
+
+  // Spectra of the partitions, zero padded to twice their length
+  for (t_int32 c = 0; c < ch_cnt; c++) {
+
+    for (t_int32 p = 0; p < conv->head_cnt; p++) {
+      ofs = p * conv->head_len;
+      for (t_int32 i = 0; i < 2 * conv->head_len; i++) {
+        conv->work[i] = ((i < conv->head_len) && (ofs + i < len)) ? ir[c * len + ofs + i] : 0.0;
+      }
+      H = conv->head_H + (c * conv->head_cnt + p) * 2 * bins1;
+      fft_forward(&conv->head_fft, conv->work, H, H + bins1);
+    }
+
+    for (t_int32 p = 0; p < conv->tail_cnt; p++) {
+      ofs = (p + 1) * conv->tail_len;
+      for (t_int32 i = 0; i < 2 * conv->tail_len; i++) {
+        conv->work[i] = ((i < conv->tail_len) && (ofs + i < len)) ? ir[c * len + ofs + i] : 0.0;
+      }
+      H = conv->tail_H + (c * conv->tail_cnt + p) * 2 * bins2;
+      fft_forward(&conv->tail_fft, conv->work, H, H + bins2);
+    }
+  }
+
+  sysmem_freeptr(ir);
+
+  // After this many silent samples, the inputs have left all the partitions
+  conv->silent_max = (conv->head_cnt + 1) * conv->head_len + ((conv->tail_cnt) ? (conv->tail_cnt + 3) * conv->tail_len : 0);
+  _conv_reset(conv);
+
+  POST("conv:  Bank %s:  %i channels, %.2f s, %i + %i partitions.",
+    bank->name->s_name, ch_cnt, len / x->samplerate, conv->head_cnt, conv->tail_cnt);
+
+  return conv;
+
+CONV_BUILD_FAIL:
+  MY_ERR("conv:  Failed to allocate the impulse responses.");
+  if (ir) { sysmem_freeptr(ir); }
+  _conv_free(conv);
+  return NULL;
+}
+
+// ====  _CONV_FREE  ====
+
+void _conv_free(t_conv* conv) {
+
+  fft_free(&conv->head_fft);
+  fft_free(&conv->tail_fft);
+
+  if (conv->head_H)   { sysmem_freeptr(conv->head_H); }
+  if (conv->tail_H)   { sysmem_freeptr(conv->tail_H); }
+  if (conv->head_X)   { sysmem_freeptr(conv->head_X); }
+  if (conv->tail_X)   { sysmem_freeptr(conv->tail_X); }
+  if (conv->head_in)  { sysmem_freeptr(conv->head_in); }
+  if (conv->tail_in)  { sysmem_freeptr(conv->tail_in); }
+  if (conv->tail_acc) { sysmem_freeptr(conv->tail_acc); }
+  if (conv->tail_out) { sysmem_freeptr(conv->tail_out); }
+  if (conv->work)     { sysmem_freeptr(conv->work); }
+  if (conv->spec)     { sysmem_freeptr(conv->spec); }
+
+  sysmem_freeptr(conv);
+}
+
+// ====  _CONV_RESET  ====
+
+//******************************************************************************
+//  Clear the input history and the pending output of the convolution
+//
+void _conv_reset(t_conv* conv) {
+
+  t_int32 bins1 = conv->head_len + 1;
+  t_int32 bins2 = conv->tail_len + 1;
+
+  for (t_int32 i = 0; i < conv->head_cnt * 2 * bins1; i++) { conv->head_X[i] = 0.0; }
+  for (t_int32 i = 0; i < 2 * conv->head_len; i++) { conv->head_in[i] = 0.0; }
+
+  if (conv->tail_cnt) {
+    for (t_int32 i = 0; i < conv->tail_cnt * 2 * bins2; i++) { conv->tail_X[i] = 0.0; }
+    for (t_int32 i = 0; i < 2 * conv->tail_len; i++) { conv->tail_in[i] = 0.0; }
+    for (t_int32 i = 0; i < conv->chan_cnt * 2 * bins2; i++) { conv->tail_acc[i] = 0.0; }
+    for (t_int32 i = 0; i < conv->chan_cnt * conv->tail_len; i++) { conv->tail_out[i] = 0.0; }
+  }
+
+  conv->head_pos = 0;
+  conv->tail_pos = 0;
+  conv->tail_fill = 0;
+  conv->silent = conv->silent_max;
+}
+
+// ====  _CONV_CMAC  ====
+
+//******************************************************************************
+//  Multiply two spectra and accumulate:  acc += X H
+//
+static __inline void _conv_cmac(t_double* acc, t_double* X, t_double* H, t_int32 bins) {
+
+  t_double* acc_im = acc + bins;
+  t_double* X_im = X + bins;
+  t_double* H_im = H + bins;
+
+  for (t_int32 k = 0; k < bins; k++) {
+    acc[k]    += X[k] * H[k] - X_im[k] * H_im[k];
+    acc_im[k] += X[k] * H_im[k] + X_im[k] * H[k];
+  }
+}
+
+// ====  _CONV_PROCESS  ====
+
+//******************************************************************************
+//  Render one vector of the impulse responses, added to the outputs
+//  The head is a uniformly partitioned overlap-save convolution on each vector.
+//  The tail has partitions ratio times longer, and starts after the first
+//  tail partition, covered by the head: the output of a period is computed at
+//  its end and played over the next period. The products of the older input
+//  spectra are spread over the vectors of the period, so that only the newest
+//  partition and the inverse FFT are computed at its end.
+//  in:  input vector, or NULL if silent
+//  gain, d_gain:  output gain, ramped by d_gain per sample
+//
+static void _conv_process(t_conv* conv, t_double* in, t_double** outs, t_double gain, t_double d_gain) {
+
+  t_int32 B = conv->head_len;
+  t_int32 bins1 = conv->head_len + 1;
+  t_int32 bins2 = conv->tail_len + 1;
+  t_double* X = NULL;
+  t_double* out = NULL;
+  t_double* tail = NULL;
+  t_int32 p_start = 0, p_end = 0, p_step = 0;
+
+  // Nothing to render once the input has been silent long enough
+  if (in) { conv->silent = 0; }
+  else if (conv->silent >= conv->silent_max) { return; }
+  else { conv->silent += B; }
+
+  // == Head: slide the input window and add the spectrum of the new window to the ring
+  for (t_int32 i = 0; i < B; i++) {
+    conv->head_in[i] = conv->head_in[B + i];
+    conv->head_in[B + i] = (in) ? in[i] : 0.0;
+  }
+  conv->head_pos = (conv->head_pos + 1) % conv->head_cnt;
+  X = conv->head_X + conv->head_pos * 2 * bins1;
+  fft_forward(&conv->head_fft, conv->head_in, X, X + bins1);
+
+  for (t_int32 c = 0; c < conv->chan_cnt; c++) {
+
+    for (t_int32 k = 0; k < 2 * bins1; k++) { conv->spec[k] = 0.0; }
+
+    for (t_int32 p = 0; p < conv->head_cnt; p++) {
+      X = conv->head_X + ((conv->head_pos - p + conv->head_cnt) % conv->head_cnt) * 2 * bins1;
+      _conv_cmac(conv->spec, X, conv->head_H + (c * conv->head_cnt + p) * 2 * bins1, bins1);
+    }
+
+    // The second half of the window is the valid output
+    fft_inverse(&conv->head_fft, conv->spec, conv->spec + bins1, conv->work);
+
+    out = outs[conv->chan_ind[c]];
+    if (conv->tail_cnt) {
+      tail = conv->tail_out + c * conv->tail_len + conv->tail_fill;
+      for (t_int32 smp = 0; smp < B; smp++) { out[smp] += (gain + d_gain * smp) * (conv->work[B + smp] + tail[smp]); }
+    }
+    else {
+      for (t_int32 smp = 0; smp < B; smp++) { out[smp] += (gain + d_gain * smp) * conv->work[B + smp]; }
+    }
+  }
+
+  if (!conv->tail_cnt) { return; }
+
+  // == Tail: add the vector to the period
+  for (t_int32 i = 0; i < B; i++) { conv->tail_in[conv->tail_len + conv->tail_fill + i] = (in) ? in[i] : 0.0; }
+
+  // Share of the older partitions for this vector: partition p uses the spectrum of p - 1 periods ago
+  p_step = (conv->tail_cnt - 1 + conv->ratio - 1) / conv->ratio;
+  p_start = 1 + (conv->tail_fill / B) * p_step;
+  p_end = MIN(p_start + p_step, conv->tail_cnt);
+
+  for (t_int32 c = 0; c < conv->chan_cnt; c++) {
+    for (t_int32 p = p_start; p < p_end; p++) {
+      X = conv->tail_X + ((conv->tail_pos - p + 1 + conv->tail_cnt) % conv->tail_cnt) * 2 * bins2;
+      _conv_cmac(conv->tail_acc + c * 2 * bins2, X, conv->tail_H + (c * conv->tail_cnt + p) * 2 * bins2, bins2);
+    }
+  }
+
+  conv->tail_fill += B;
+
+  // End of the period: add the newest partition, and compute the output of the next period
+  if (conv->tail_fill == conv->tail_len) {
+
+    conv->tail_pos = (conv->tail_pos + 1) % conv->tail_cnt;
+    X = conv->tail_X + conv->tail_pos * 2 * bins2;
+    fft_forward(&conv->tail_fft, conv->tail_in, X, X + bins2);
+
+    for (t_int32 c = 0; c < conv->chan_cnt; c++) {
+      t_double* acc = conv->tail_acc + c * 2 * bins2;
+      _conv_cmac(acc, X, conv->tail_H + c * conv->tail_cnt * 2 * bins2, bins2);
+      fft_inverse(&conv->tail_fft, acc, acc + bins2, conv->work);
+
+      tail = conv->tail_out + c * conv->tail_len;
+      for (t_int32 smp = 0; smp < conv->tail_len; smp++) { tail[smp] = conv->work[conv->tail_len + smp]; }
+      for (t_int32 k = 0; k < 2 * bins2; k++) { acc[k] = 0.0; }
+    }
+
+    for (t_int32 i = 0; i < conv->tail_len; i++) { conv->tail_in[i] = conv->tail_in[conv->tail_len + i]; }
+    conv->tail_fill = 0;
+  }
+}
+
+// ====  _CONV_CLEAR_STATES  ====
+
+//******************************************************************************
+//  Clear the states of the resonators, when the recursion has been stopped
+//  The convolution renders the response to all the input since then.
+//
+static void _conv_clear_states(t_bank* bank) {
+
+  t_resonator* reson = NULL;
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+    reson->y_m1 = 0.0;
+    reson->y_m2 = 0.0;
+    reson->u_re = 0.0;
+    reson->u_im = 0.0;
+  }
+}
+
+// ====  _CONV_PERFORM  ====
+
+//******************************************************************************
+//  Render a bank by convolution, and crossfade with the recursion.
+//  When switching, the renderer taking over receives the input right away,
+//  while the other one receives no input and its tail is faded out, so that
+//  the response to the new input is not faded.
+//  Called by the perform routine, before the resonators are rendered.
+//  in:  input of the bank, with the exciters
+//  gain:  gain of the bank
+//  d_rec:  set to the increment per sample of the gain of the recursion
+//  Returns the gain multiplier of the recursion at the start of the vector,
+//  0 with no increment if it can be skipped.
+//
+t_double _conv_perform(t_modal* x, t_bank* bank, t_double* in, t_double** outs, long sampleframes, t_double gain, t_double* d_rec) {
+
+  t_conv* conv = bank->conv;
+
+  *d_rec = 0.0;
+
+  // The impulse responses are partitioned for one vector size: the recursion
+  // takes over at once, from silence as its states are stale or ringing out
+  if (sampleframes != conv->head_len) {
+    if (bank->conv_A > 0.0) { _conv_clear_states(bank); _conv_reset(conv); }
+    bank->conv_targ = false;
+    bank->conv_A = 0.0;
+    return 1.0;
+  }
+
+  // A bank that is not static anymore goes back to the recursion
+  if ((bank->conv_targ) && (!_conv_is_static(bank))) { bank->conv_targ = false; }
+
+  t_double step = sampleframes / (CONV_FADE * x->msr);
+  t_double A0 = bank->conv_A;
+  t_double A1 = (bank->conv_targ) ? MIN(A0 + step, 1.0) : MAX(A0 - step, 0.0);
+  t_double gain_rec = 1.0;
+
+  bank->conv_A = A1;
+
+  // == Convolution: the input goes to the convolution, the recursion rings out
+  if (bank->conv_targ) {
+
+    // Add a pending impulse to the input
+    if (bank->imp_ofs >= 0) {
+      in = _excite_input(x, bank, in, sampleframes);
+      in[bank->imp_ofs] += bank->imp_ampl;
+      bank->imp_ampl = 0.0;
+      bank->imp_ofs = -1;
+    }
+
+    _conv_process(conv, (bank->in_silent) ? NULL : in, outs, gain, 0.0);
+
+    // The recursion is faded out sample by sample, as the convolution tail
+    bank->in_silent = true;
+    gain_rec = 1.0 - A0;
+    *d_rec = (A0 - A1) / sampleframes;
+  }
+
+  // == Recursion: the input goes to the recursion, the convolution rings out
+  else {
+
+    // The recursion restarts from silence
+    if (A0 == 1.0) { _conv_clear_states(bank); }
+
+    _conv_process(conv, NULL, outs, gain * A0, gain * (A1 - A0) / sampleframes);
+    if ((A0 > 0.0) && (A1 == 0.0)) { _conv_reset(conv); }
+  }
+
+  return gain_rec;
+}
+
+// ====  _CONV_RAMP  ====
+
+//******************************************************************************
+//  Apply the gain of the recursion to the rows of a tile, before it is mixed
+//  Called by the perform routine while the recursion is faded out.
+//  gain:  gain at the start of the vector
+//  d_gain:  increment per sample
+//
+void _conv_ramp(t_modal* x, t_int32 tile_cnt, long sampleframes, t_double gain, t_double d_gain) {
+
+  t_double* row = NULL;
+  t_double g = 0.0;
+
+  for (t_int32 t = 0; t < tile_cnt; t++) {
+    row = x->mix_buf + t * x->vec_max;
+    g = gain;
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { row[smp] *= g; g += d_gain; }
+  }
+}
@@ -0,0 +1,188 @@
+#include "modal~.h"
+
+// ====  EXCITE_STRIKE  ====
+
+//******************************************************************************
+//  Strike a bank with an internal exciter, after an optional delay
+//  impulse:  a single sample, rendered exactly within the perform cycle
+//  noise:    a burst of lowpassed noise, param from 0 (white) to 1 (dark)
+//  mallet:   a contact pulse, param from 0 (soft) to 1 (hard)
+//  strike (bank) (sym: impulse / noise / mallet) (float: ampl) [float: delay ms] [float: duration ms] [float: param]
+//
+void excite_strike(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("excite_strike");
+
+  MY_ASSERT((argc < 3) || (argc > 6),
+    "strike:  3 to 6 args expected:  strike (bank) (sym: type) (float: ampl) [float: delay] [float: duration] [float: param]");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "strike:  Arg 0:  Bank not found.");
+
+  // Argument 1 should be the type of exciter
+  MY_ASSERT(atom_gettype(argv + 1) != A_SYM, "strike:  Arg 1:  Symbol expected:  impulse, noise or mallet.");
+  t_symbol* type_sym = atom_getsym(argv + 1);
+  t_exc_type type = EXC_NONE;
+  if      (type_sym == gensym("impulse")) { type = EXC_IMPULSE; }
+  else if (type_sym == gensym("noise"))   { type = EXC_NOISE; }
+  else if (type_sym == gensym("mallet"))  { type = EXC_MALLET; }
+  MY_ASSERT(type == EXC_NONE, "strike:  Arg 1:  Invalid exciter:  %s.", type_sym->s_name);
+
+  // The other arguments: amplitude, delay, duration and parameter
+  t_double ampl  = atom_getfloat(argv + 2);
+  t_double delay = (argc > 3) ? atom_getfloat(argv + 3) : 0;
+  t_double dur   = (argc > 4) ? atom_getfloat(argv + 4) : ((type == EXC_NOISE) ? EXC_NOISE_DEF : EXC_MALLET_DEF);
+  t_double param = (argc > 5) ? atom_getfloat(argv + 5) : 0.5;
+  MY_ASSERT((delay < 0) || (dur < 0), "strike:  The delay and duration should be positive.");
+
+  // An impulse is injected at its sample offset within the perform cycle
+  if (type == EXC_IMPULSE) {
+    bank->imp_ampl = ampl;
+    bank->imp_cntd = (t_int32)(delay * x->msr);
+  }
+
+  // Bursts are rendered into the input of the bank
+  else {
+    bank->exc_type  = type;
+    bank->exc_ampl  = ampl;
+    bank->exc_cntd  = (t_int32)(delay * x->msr);
+    bank->exc_len   = MAX((t_int32)(dur * x->msr), 1);
+    bank->exc_pos   = 0;
+    bank->exc_param = CLAMP(param, 0, 1);
+    bank->exc_lp    = 0.0;
+  }
+}
+
+// ====  _EXCITE  ====
+
+//******************************************************************************
+//  Called once per perform cycle for each bank, after routing the inputs
+//  Adds the current burst to the input of the bank, in which case the input
+//  is copied to in_buf first, as it may be an input vector of the object.
+//  An impulse is added to the input when the input is not silent. Otherwise
+//  its offset in the cycle is stored in imp_ofs, for the zero input path.
+//  Returns the input vector of the bank.
+//
+t_double* _excite(t_modal* x, t_bank* bank, t_double* in, long sampleframes) {
+
+  t_int32 start = 0;
+  t_int32 end = 0;
+  t_double u = 0.0;
+  t_double a = 0.0;
+
+  bank->imp_ofs = -1;
+
+  // == Burst: wait for the delay, then render to the end of the cycle or of the burst
+  if (bank->exc_type != EXC_NONE) {
+
+    if (bank->exc_cntd >= sampleframes) { bank->exc_cntd -= sampleframes; }
+
+    else {
+      in = _excite_input(x, bank, in, sampleframes);
+      start = bank->exc_cntd;
+      end = (t_int32)MIN(sampleframes, start + bank->exc_len - bank->exc_pos);
+      bank->exc_cntd = 0;
+
+      // Noise burst: white noise from a linear congruential generator, lowpassed, with a Hann window
+      if (bank->exc_type == EXC_NOISE) {
+        for (t_int32 smp = start; smp < end; smp++) {
+          bank->exc_seed = bank->exc_seed * 1664525 + 1013904223;
+          bank->exc_lp = bank->exc_param * bank->exc_lp + (1 - bank->exc_param) * ((t_double)bank->exc_seed / 2147483648.0 - 1);
+          u = (t_double)(bank->exc_pos++) / bank->exc_len;
+          in[smp] += bank->exc_ampl * bank->exc_lp * env_hann(u, 0, 0);
+        }
+      }
+
+      // Mallet: asymmetric contact pulse, with an attack that shortens as the mallet gets harder
+      else if (bank->exc_type == EXC_MALLET) {
+        a = 0.5 - 0.45 * bank->exc_param;
+        for (t_int32 smp = start; smp < end; smp++) {
+          u = (t_double)(bank->exc_pos++) / bank->exc_len;
+          in[smp] += bank->exc_ampl * env_expodec(u, a, 10);
+        }
+      }
+
+      if (bank->exc_pos >= bank->exc_len) { bank->exc_type = EXC_NONE; }
+    }
+  }
+
+  // == Impulse: wait for the delay, then add it to the input, or keep its offset for the zero input path
+  if (bank->imp_ampl != 0.0) {
+
+    if (bank->imp_cntd >= sampleframes) { bank->imp_cntd -= sampleframes; }
+
+    else if (!bank->in_silent) {
+      in = _excite_input(x, bank, in, sampleframes);
+      in[bank->imp_cntd] += bank->imp_ampl;
+      bank->imp_ampl = 0.0;
+    }
+
+    else { bank->imp_ofs = bank->imp_cntd; }
+  }
+
+  return in;
+}
+
+// ====  _EXCITE_INPUT  ====
+
+//******************************************************************************
+//  Make the input of the bank writable: copy it to in_buf, or clear in_buf if
+//  the input is silent, as in_buf might hold the input of another bank
+//
+t_double* _excite_input(t_modal* x, t_bank* bank, t_double* in, long sampleframes) {
+
+  if (bank->in_silent) {
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { x->in_buf[smp] = 0.0; }
+  }
+  else if (in != x->in_buf) {
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { x->in_buf[smp] = in[smp]; }
+  }
+
+  bank->in_silent = false;
+  return x->in_buf;
+}
+
+// ====  _RESON_ZERO_INPUT  ====
+
+//******************************************************************************
+//  Render a chunk of a resonator with no input, except an optional impulse
+//  The chunk is split at the impulse, and only that sample uses the input term
+//    imp_pos:  position of the impulse in the chunk, no impulse if out of the chunk
+//    imp:      input value of the impulse, including the input amplitude
+//
+void _reson_zero_input(t_resonator* reson, t_double* buf, t_int32 len, t_double gain,
+  t_double* sum_sqr, t_int32 imp_pos, t_double imp) {
+
+  t_double tmp = 0.0;
+  t_double sum = 0.0;
+  t_int32 end = ((imp_pos >= 0) && (imp_pos < len)) ? imp_pos : len;
+
+  // Before the impulse
+  for (t_int32 smp = 0; smp < end; smp++) {
+    tmp = reson->b1 * reson->y_m1 + reson->b2 * reson->y_m2;
+    reson->y_m2 = reson->y_m1;
+    reson->y_m1 = tmp;
+    sum += tmp * tmp;
+    buf[smp] = tmp * gain;
+  }
+
+  // The impulse, then the rest of the chunk
+  if (end < len) {
+    tmp = reson->a0 * imp + reson->b1 * reson->y_m1 + reson->b2 * reson->y_m2;
+    reson->y_m2 = reson->y_m1;
+    reson->y_m1 = tmp;
+    sum += tmp * tmp;
+    buf[end] = tmp * gain;
+
+    for (t_int32 smp = end + 1; smp < len; smp++) {
+      tmp = reson->b1 * reson->y_m1 + reson->b2 * reson->y_m2;
+      reson->y_m2 = reson->y_m1;
+      reson->y_m1 = tmp;
+      sum += tmp * tmp;
+      buf[smp] = tmp * gain;
+    }
+  }
+
+  *sum_sqr += sum;
+}
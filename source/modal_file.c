@@ -0,0 +1,502 @@
+#include "modal~.h"
+
+#include <locale.h>    // For the decimal point of strtod
+
+#ifdef WIN_VERSION
+#include <windows.h>   // For file mapping
+#else
+#include <fcntl.h>     // For open
+#include <sys/mman.h>  // For mmap
+#include <sys/stat.h>  // For fstat
+#include <unistd.h>    // For close
+#endif
+
+// ====  FILE_EXPORT  ====
+
+//******************************************************************************
+//  Export a bank to a binary bank file
+//  export (bank) [sym: file name]
+//  Without a file name a dialog box is opened. The file holds the reference
+//  parameters of the resonators and the sort permutations of the bank, so
+//  that it can be imported without parsing or sorting.
+//
+void file_export(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("file_export");
+
+  MY_ASSERT((argc != 1) && (argc != 2), "export:  1 or 2 args expected:  export (bank) [sym: file name]");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "export:  Arg 0:  Bank not found.");
+
+  char       file_name[MAX_FILENAME_CHARS];
+  short      file_path;
+  t_fourcc   file_type = FOUR_CHAR_CODE('YMBK');
+  t_filehandle file_handle = NULL;
+
+  // Argument 1 is the file name, otherwise open a dialog box
+  if (argc == 2) {
+    MY_ASSERT(atom_gettype(argv + 1) != A_SYM, "export:  Arg 1:  Symbol expected.");
+    MY_ASSERT(path_frompathname(atom_getsym(argv + 1)->s_name, &file_path, file_name),
+      "export:  Arg 1:  Invalid path and file name.");
+  }
+  else {
+    snprintf(file_name, MAX_FILENAME_CHARS, "%s.ymb", bank->name->s_name);
+    saveas_promptset("Save the bank as a binary bank file.");
+    if (saveasdialog_extended(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+  }
+
+  MY_ASSERT(path_createsysfile(file_name, file_path, file_type, &file_handle), "export:  Failed to create the file.");
+
+  // The header, with the ranges of the reference parameters
+  t_int32 cnt = bank->reson_cnt;
+  t_bank_file head;
+  memset(&head, 0, sizeof(t_bank_file));
+  memcpy(head.magic, FILE_MAGIC, 4);
+  head.version = FILE_VERSION;
+  head.size = sizeof(t_bank_file);
+  head.order = FILE_ORDER;
+  head.reson_cnt = cnt;
+  head.flags = FILE_SORTED;
+  head.samplerate = x->samplerate;
+  head.gain = bank->gain;
+  t_model* model = bank->model;
+  head.ampl_min  = model->ampl_ref[model->sort_ampl[cnt - 1]];
+  head.ampl_max  = model->ampl_ref[model->sort_ampl[0]];
+  head.freq_min  = model->freq_ref[model->sort_freq[0]];
+  head.freq_max  = model->freq_ref[model->sort_freq[cnt - 1]];
+  head.decay_min = model->decay_ref[model->sort_decay[cnt - 1]];
+  head.decay_max = model->decay_ref[model->sort_decay[0]];
+  strncpy(head.name, bank->name->s_name, FILE_NAME - 1);
+
+  t_max_err err = MAX_ERR_NONE;
+  t_ptr_size len = sizeof(t_bank_file);
+  err |= sysfile_write(file_handle, &len, &head);
+
+  // The parameters and the sort permutations, contiguous in the model as in the file.
+  // The multipliers of the bank do not change the orders.
+  len = sizeof(t_double) * 3 * cnt;
+  err |= sysfile_write(file_handle, &len, model->ampl_ref);
+  len = sizeof(t_int32) * 4 * cnt;
+  err |= sysfile_write(file_handle, &len, model->sort_ampl);
+
+  MY_ASSERT_GOTO(err != MAX_ERR_NONE, FILE_EXPORT_END, "export:  Failed to write the file.");
+
+  // Send out a message to indicate completion of export
+  t_atom mess_arr[3];
+  atom_setlong(mess_arr, bank - x->bank_arr);
+  atom_setsym(mess_arr + 1, bank->name);
+  atom_setlong(mess_arr + 2, cnt);
+  outlet_anything(x->outl_mess, gensym("export"), 3, mess_arr);
+
+  FILE_EXPORT_END:
+  sysfile_close(file_handle);
+}
+
+// ====  _FILE_IS_BINARY  ====
+
+//******************************************************************************
+//  Test if an open file starts with the signature of binary bank files
+//  The position is set back to the start of the file.
+//
+t_bool _file_is_binary(t_filehandle file_handle) {
+
+  char magic[4];
+  t_ptr_size len = 4;
+  t_bool is_binary = (sysfile_read(file_handle, &len, magic) == MAX_ERR_NONE) && (!memcmp(magic, FILE_MAGIC, 4));
+
+  sysfile_setpos(file_handle, SYSFILE_FROMSTART, 0);
+  return is_binary;
+}
+
+// ====  _FILE_MAP  ====
+
+//******************************************************************************
+//  Map a whole file in memory, read only
+//  path:  absolute path in the native style
+//  Returns a pointer to the mapped file, or NULL
+//
+const char* _file_map(const char* path, t_ptr_size* size) {
+
+  const char* ptr = NULL;
+  *size = 0;
+
+#ifdef WIN_VERSION
+  WCHAR path_w[MAX_PATH_CHARS];
+  if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, path_w, MAX_PATH_CHARS)) { return NULL; }
+
+  HANDLE file = CreateFileW(path_w, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) { return NULL; }
+
+  LARGE_INTEGER file_size;
+  if ((GetFileSizeEx(file, &file_size)) && (file_size.QuadPart > 0)) {
+    HANDLE map = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map) {
+      ptr = (const char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(map);  // The view keeps the mapping alive
+    }
+    if (ptr) { *size = (t_ptr_size)file_size.QuadPart; }
+  }
+  CloseHandle(file);
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) { return NULL; }
+
+  struct stat st;
+  if ((!fstat(fd, &st)) && (st.st_size > 0)) {
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) { ptr = (const char*)map; *size = (t_ptr_size)st.st_size; }
+  }
+  close(fd);  // The mapping stays valid
+#endif
+
+  return ptr;
+}
+
+// ====  _FILE_UNMAP  ====
+
+void _file_unmap(const char* ptr, t_ptr_size size) {
+
+#ifdef WIN_VERSION
+  UnmapViewOfFile(ptr);
+#else
+  munmap((void*)ptr, (size_t)size);
+#endif
+}
+
+// ====  _FILE_IMPORT  ====
+
+//******************************************************************************
+//  Import a binary bank file into a bank
+//  The file is mapped in memory, the header is checked, and the arrays are
+//  copied into the resonators. If the file holds valid sort permutations the
+//  bank is not sorted again.
+//  Returns ERR_NONE on success
+//
+t_my_err _file_import(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path) {
+
+  TRACE("_file_import");
+
+  char path_abs[MAX_PATH_CHARS];
+  char path_native[MAX_PATH_CHARS];
+
+  MY_ASSERT_ERR(path_toabsolutesystempath(file_path, file_name, path_abs), ERR_ARG_VALUE,
+    "import:  Failed to resolve the path of %s.", file_name);
+  path_nameconform(path_abs, path_native, PATH_STYLE_NATIVE, PATH_TYPE_ABSOLUTE);
+
+  t_ptr_size size = 0;
+  const char* ptr = _file_map(path_native, &size);
+  MY_ASSERT_ERR(!ptr, ERR_ARG_VALUE, "import:  Failed to map the file %s.", file_name);
+
+  t_my_err err = ERR_NONE;
+  const t_bank_file* head = (const t_bank_file*)ptr;
+  t_int32 cnt = 0;
+
+  // Test the validity of the header and of the size of the file
+  if ((size < sizeof(t_bank_file)) || (memcmp(head->magic, FILE_MAGIC, 4))) {
+    MY_ERR("import:  %s is not a binary bank file.", file_name); err = ERR_SYNTAX; goto FILE_IMPORT_END;
+  }
+  if ((head->order != FILE_ORDER) || (head->version != FILE_VERSION)) {
+    MY_ERR("import:  %s:  Unsupported version or byte order.", file_name); err = ERR_SYNTAX; goto FILE_IMPORT_END;
+  }
+
+  cnt = head->reson_cnt;
+  t_ptr_size size_exp = (t_ptr_size)head->size + sizeof(t_double) * 3 * (t_ptr_size)cnt
+    + ((head->flags & FILE_SORTED) ? sizeof(t_int32) * 4 * (t_ptr_size)cnt : 0);
+
+  if ((head->size < sizeof(t_bank_file)) || (head->size % sizeof(t_double)) || (cnt < 1) || (size < size_exp)) {
+    MY_ERR("import:  %s:  Invalid header or truncated file.", file_name); err = ERR_SYNTAX; goto FILE_IMPORT_END;
+  }
+  if (cnt > x->reson_max) {
+    MY_ERR("import:  Invalid number of resonators: %i. Expected: 1 to %i.", cnt, x->reson_max); err = ERR_COUNT; goto FILE_IMPORT_END;
+  }
+
+  // Infinite and NaN values are rejected, as by the text parser
+  const t_double* param_arr = (const t_double*)(ptr + head->size);
+  t_bool is_finite = isfinite(head->gain);
+  for (t_int32 ind = 0; (is_finite) && (ind < 3 * cnt); ind++) { is_finite = isfinite(param_arr[ind]); }
+  if (!is_finite) {
+    MY_ERR("import:  %s:  Infinite or NaN value.", file_name); err = ERR_SYNTAX; goto FILE_IMPORT_END;
+  }
+
+  // Free the existing bank and create a new one
+  bank_free(x, bank);
+  if (bank_new(x, bank, cnt) == ERR_ALLOC) { err = ERR_ALLOC; goto FILE_IMPORT_END; }
+
+  bank->name = name;
+  bank->gain = head->gain;
+
+  // Copy the parameters from the mapped arrays
+  const t_double* ampl_arr  = param_arr;
+  const t_double* freq_arr  = ampl_arr + cnt;
+  const t_double* decay_arr = freq_arr + cnt;
+
+  memcpy(bank->model->ampl_ref,  ampl_arr,  sizeof(t_double) * cnt);
+  memcpy(bank->model->freq_ref,  freq_arr,  sizeof(t_double) * cnt);
+  memcpy(bank->model->decay_ref, decay_arr, sizeof(t_double) * cnt);
+
+  bank_update(x, bank);
+
+  // Use the sort permutations of the file if all the indexes are in range
+  t_bool is_sorted = (head->flags & FILE_SORTED) != 0;
+  const t_int32* sort_src = (const t_int32*)(decay_arr + cnt);
+  for (t_int32 ind = 0; (is_sorted) && (ind < 4 * cnt); ind++) {
+    if ((sort_src[ind] < 0) || (sort_src[ind] >= cnt)) { is_sorted = false; }
+  }
+
+  if (is_sorted) {
+    memcpy(bank->sort_ampl,  sort_src,           sizeof(t_int32) * cnt);
+    memcpy(bank->sort_freq,  sort_src + cnt,     sizeof(t_int32) * cnt);
+    memcpy(bank->sort_decay, sort_src + 2 * cnt, sizeof(t_int32) * cnt);
+    memcpy(bank->sort_prio,  sort_src + 3 * cnt, sizeof(t_int32) * cnt);
+    _bank_ranges(x, bank);
+  }
+  else { bank_sort(x, bank); }
+
+  FILE_IMPORT_END:
+  _file_unmap(ptr, size);
+  return err;
+}
+
+// ====  _FILE_READER_PEEK  ====
+
+//******************************************************************************
+//  Next character of a text file, without consuming it
+//  The next block of the file is read when the current one is consumed.
+//  Returns the character, or -1 at the end of the file
+//
+static t_int32 _file_reader_peek(t_file_reader* rd) {
+
+  if (rd->pos == rd->len) {
+    if (rd->eof) { return -1; }
+
+    // Short reads only happen at the end of the file
+    t_ptr_size cnt = FILE_BUF;
+    sysfile_read(rd->handle, &cnt, rd->buf);
+    rd->len = (t_int32)cnt;
+    rd->pos = 0;
+    if (cnt < FILE_BUF) { rd->eof = true; }
+    if (cnt == 0) { return -1; }
+  }
+
+  return (unsigned char)rd->buf[rd->pos];
+}
+
+// ====  _FILE_READER_NEXT  ====
+
+static void _file_reader_next(t_file_reader* rd) {
+
+  if (rd->buf[rd->pos++] == '\n') { rd->line++; rd->col = 1; }
+  else { rd->col++; }
+}
+
+// ====  _FILE_READER_TOKEN  ====
+
+//******************************************************************************
+//  Read the next token of a text file into rd->tok
+//  Tokens are separated by white space or commas. Comments start with # or //
+//  and run to the end of the line.
+//  Returns 1 if a token was read, 0 at the end of the file, -1 if it is too long
+//
+static t_int32 _file_reader_token(t_file_reader* rd) {
+
+  t_int32 c = 0;
+  t_int32 len = 0;
+
+  // Skip white space and comments
+  while (true) {
+    c = _file_reader_peek(rd);
+    if (c == -1) { return 0; }
+
+    if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '\f') || (c == '\v') || (c == ',')) {
+      _file_reader_next(rd);
+      continue;
+    }
+
+    // A single / starts a token
+    if (c == '/') {
+      rd->tok_line = rd->line;
+      rd->tok_col = rd->col;
+      _file_reader_next(rd);
+      if (_file_reader_peek(rd) != '/') { rd->tok[len++] = '/'; break; }
+      c = '#';
+    }
+
+    if (c == '#') {
+      while ((c != -1) && (c != '\n')) { _file_reader_next(rd); c = _file_reader_peek(rd); }
+      continue;
+    }
+
+    rd->tok_line = rd->line;
+    rd->tok_col = rd->col;
+    break;
+  }
+
+  // Read up to the next separator
+  while (true) {
+    c = _file_reader_peek(rd);
+    if ((c == -1) || (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == '\f') || (c == '\v')
+      || (c == ',') || (c == '#')) { break; }
+
+    if (len == FILE_TOKEN - 1) { rd->tok[len] = '\0'; return -1; }
+    _file_reader_next(rd);
+
+    // A // comment also ends the token, and is skipped to the end of the line
+    if ((c == '/') && (_file_reader_peek(rd) == '/')) {
+      while (((c = _file_reader_peek(rd)) != -1) && (c != '\n')) { _file_reader_next(rd); }
+      break;
+    }
+    rd->tok[len++] = (char)c;
+  }
+
+  rd->tok[len] = '\0';
+  return 1;
+}
+
+// ====  _FILE_STRTOD  ====
+
+//******************************************************************************
+//  Convert a decimal number, independently of the locale
+//  [+-] digits [. digits] [e|E [+-] digits], with at least one digit
+//  The result is computed directly when the significant digits fit in 53 bits
+//  and the power of 10 is exact, as for most model files, and by strtod
+//  otherwise. Hexadecimal, infinite and NaN values are rejected.
+//  Returns true if the whole string is a valid number
+//
+static const t_double _file_pow10[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static t_bool _file_strtod(const char* str, t_double* val) {
+
+  const char* beg = str;
+  t_uint64 mant = 0;
+  t_int32  digits = 0;   // Significant digits in the mantissa
+  t_int32  exp10 = 0;
+  t_bool   any = false;
+  t_bool   neg = false;
+
+  if ((*str == '+') || (*str == '-')) { neg = (*str == '-'); str++; }
+
+  // Integer part: digits past the 19th only scale the value
+  for (; (*str >= '0') && (*str <= '9'); str++) {
+    any = true;
+    if ((mant == 0) && (*str == '0')) { continue; }
+    if (digits < 19) { mant = 10 * mant + (*str - '0'); digits++; }
+    else { exp10++; }
+  }
+
+  // Fractional part
+  if (*str == '.') {
+    for (str++; (*str >= '0') && (*str <= '9'); str++) {
+      any = true;
+      if ((mant == 0) && (*str == '0')) { exp10--; continue; }
+      if (digits < 19) { mant = 10 * mant + (*str - '0'); digits++; exp10--; }
+    }
+  }
+
+  if (!any) { return false; }
+
+  // Exponent
+  if ((*str == 'e') || (*str == 'E')) {
+    t_bool exp_neg = false;
+    t_int32 exp = 0;
+    str++;
+    if ((*str == '+') || (*str == '-')) { exp_neg = (*str == '-'); str++; }
+    if ((*str < '0') || (*str > '9')) { return false; }
+    for (; (*str >= '0') && (*str <= '9'); str++) { if (exp < 100000) { exp = 10 * exp + (*str - '0'); } }
+    exp10 += exp_neg ? -exp : exp;
+  }
+
+  if (*str != '\0') { return false; }
+
+  if (mant == 0) { *val = 0.0; }
+  else if ((mant < ((t_uint64)1 << 53)) && (exp10 >= -22) && (exp10 <= 22)) {
+    *val = (exp10 >= 0) ? (t_double)mant * _file_pow10[exp10] : (t_double)mant / _file_pow10[-exp10];
+    if (neg) { *val = -*val; }
+  }
+
+  // Otherwise the C library rounds correctly, given the decimal point of the locale
+  else {
+    char tok[FILE_TOKEN];
+    char point = localeconv()->decimal_point[0];
+    strncpy(tok, beg, FILE_TOKEN - 1);
+    tok[FILE_TOKEN - 1] = '\0';
+    for (char* c = tok; *c; c++) { if (*c == '.') { *c = point; } }
+    *val = strtod(tok, NULL);
+  }
+
+  return isfinite(*val);
+}
+
+// ====  _FILE_PARSE_TEXT  ====
+
+//******************************************************************************
+//  Parse a text bank file in one pass, reading it in blocks
+//  The file holds the number of resonators, followed by the amplitude,
+//  frequency and decay of each resonator. Errors are reported with the line
+//  and column of the token.
+//  param_arr:  allocated and filled with 3 values per resonator, to be freed
+//  Returns ERR_NONE on success
+//
+t_my_err _file_parse_text(t_modal* x, t_filehandle file_handle, char* file_name, t_double** param_arr, t_int32* reson_cnt) {
+
+  TRACE("_file_parse_text");
+
+  t_file_reader rd;
+  rd.handle = file_handle;
+  rd.len = 0;
+  rd.pos = 0;
+  rd.eof = false;
+  rd.line = 1;
+  rd.col = 1;
+  rd.tok_line = 1;
+  rd.tok_col = 1;
+  rd.tok[0] = '\0';
+
+  *param_arr = NULL;
+  *reson_cnt = 0;
+
+  rd.buf = (char*)sysmem_newptr(FILE_BUF);
+  MY_ASSERT_ERR(!rd.buf, ERR_ALLOC, "import:  Allocation failed.");
+
+  t_my_err err = ERR_NONE;
+  t_int32 ret = 0;
+  t_double val = 0.0;
+
+  // The first token is the number of resonators
+  ret = _file_reader_token(&rd);
+  if ((ret != 1) || (!_file_strtod(rd.tok, &val)) || (val != floor(val)) || (val < 1) || (val > x->reson_max)) {
+    MY_ERR("import:  %s:%i:%i:  Invalid number of resonators \"%s\". Expected: 1 to %i.",
+      file_name, rd.tok_line, rd.tok_col, rd.tok, x->reson_max);
+    err = ERR_COUNT; goto FILE_PARSE_END;
+  }
+
+  t_int32 cnt = (t_int32)val;
+  *param_arr = (t_double*)sysmem_newptr(sizeof(t_double) * 3 * cnt);
+  if (!*param_arr) { MY_ERR("import:  Allocation failed."); err = ERR_ALLOC; goto FILE_PARSE_END; }
+
+  // Followed by 3 values per resonator
+  for (t_int32 ind = 0; ind < 3 * cnt; ind++) {
+
+    ret = _file_reader_token(&rd);
+
+    if (ret == 0) {
+      MY_ERR("import:  %s:%i:%i:  Unexpected end of file: %i values read, %i expected.",
+        file_name, rd.line, rd.col, ind, 3 * cnt);
+      err = ERR_SYNTAX; goto FILE_PARSE_END;
+    }
+    if ((ret == -1) || (!_file_strtod(rd.tok, (*param_arr) + ind))) {
+      MY_ERR("import:  %s:%i:%i:  Invalid number \"%s%s\".",
+        file_name, rd.tok_line, rd.tok_col, rd.tok, (ret == -1) ? "..." : "");
+      err = ERR_SYNTAX; goto FILE_PARSE_END;
+    }
+  }
+
+  *reson_cnt = cnt;
+
+  FILE_PARSE_END:
+  if ((err != ERR_NONE) && (*param_arr)) { sysmem_freeptr(*param_arr); *param_arr = NULL; }
+  sysmem_freeptr(rd.buf);
+  return err;
+}
@@ -0,0 +1,565 @@
+#include "modal~.h"
+
+// ====  IFFT_IFFT  ====
+
+//******************************************************************************
+//  Render a bank by inverse FFT synthesis instead of recursion
+//  ifft (bank) (int: 0 or 1) [int: FFT size]
+//  The cost per mode is a few bins per hop, and the fixed cost one inverse FFT
+//  per channel per hop, so that banks of thousands of modes are cheaper to
+//  render than by recursion. The output is delayed by up to a hop.
+//  The synthesis is built here, and handed over to the perform routine.
+//
+void ifft_ifft(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("ifft_ifft");
+
+  MY_ASSERT((argc != 2) && (argc != 3), "ifft:  2 or 3 args expected:  ifft (bank) (int: 0 or 1) [int: FFT size]");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "ifft:  Arg 0:  Bank not found.");
+
+  // Argument 1 should be 0 or 1
+  MY_ASSERT(atom_gettype(argv + 1) != A_LONG, "ifft:  Arg 1:  0 or 1 expected.");
+  t_atom_long use = atom_getlong(argv + 1);
+  MY_ASSERT((use != 0) && (use != 1), "ifft:  Arg 1:  0 or 1 expected.");
+
+  // Back to the recursion, at the next hop boundary, and drop a synthesis waiting to be installed
+  if (use == 0) {
+    systhread_mutex_lock(x->load_mutex);
+    t_ifft* ifft_new = bank->ifft_new;
+    bank->ifft_new = NULL;
+    bank->ifft_targ = false;
+    systhread_mutex_unlock(x->load_mutex);
+    if (ifft_new) { _ifft_free(ifft_new); }
+    return;
+  }
+
+  MY_ASSERT(bank->conv_use, "ifft:  The bank is set to be rendered by convolution.");
+  MY_ASSERT(bank->rate_use, "ifft:  The bank is rendered at multiple rates.");
+  MY_ASSERT(bank->ifft_active, "ifft:  The bank is already rendered by inverse FFT.");
+  MY_ASSERT(x->vec_max == 0, "ifft:  The DSP has not been started.");
+
+  // Argument 2 is the FFT size: a power of 2, with a hop of at least the vector size
+  t_int32 size = MAX(IFFT_SIZE_DEF, 4 * x->vec_max);
+  if (argc == 3) {
+    MY_ASSERT(atom_gettype(argv + 2) != A_LONG, "ifft:  Arg 2:  Int expected.");
+    size = (t_int32)atom_getlong(argv + 2);
+    MY_ASSERT((size < 4 * x->vec_max) || (size & (size - 1)),
+      "ifft:  Arg 2:  Power of 2 expected, at least 4 times the vector size:  %i.", 4 * x->vec_max);
+  }
+
+  t_ifft* ifft = _ifft_build(x, bank, size);
+  if (!ifft) { return; }
+
+  // Replace the synthesis waiting to be installed, if any
+  systhread_mutex_lock(x->load_mutex);
+  t_ifft* ifft_new = bank->ifft_new;
+  bank->ifft_new = ifft;
+  x->ifft_pend = true;
+  systhread_mutex_unlock(x->load_mutex);
+
+  if (ifft_new) { _ifft_free(ifft_new); }
+
+  // Installed by the main thread if the perform routine is not running
+  qelem_set(x->load_qelem);
+}
+
+// ====  _IFFT_INSTALL  ====
+
+//******************************************************************************
+//  Install the syntheses built by the main thread, and switch to them at the
+//  next hop boundary. The previous synthesis is kept to be freed by the main
+//  thread. A bank that is rendered by inverse FFT, or whose previous synthesis
+//  is not freed yet, is installed on a later call.
+//  Called with the mutex of the loads locked: by the perform routine between
+//  two blocks, or by the main thread if the perform routine is not running.
+//  Returns true if syntheses were installed
+//
+t_bool _ifft_install(t_modal* x) {
+
+  t_bank* bank = NULL;
+  t_bool installed = false;
+  t_bool is_left = false;
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    bank = x->bank_arr + bnk;
+    if (!bank->ifft_new) { continue; }
+    if ((bank->ifft_active) || (bank->ifft_old)) { is_left = true; continue; }
+
+    bank->ifft_old = bank->ifft;
+    bank->ifft = bank->ifft_new;
+    bank->ifft_new = NULL;
+    bank->ifft_targ = true;
+    installed = true;
+  }
+
+  x->ifft_pend = is_left;
+  return installed;
+}
+
+// ====  _IFFT_RELEASE  ====
+
+//******************************************************************************
+//  Free the syntheses replaced by the perform routine
+//  Called by the main thread with the mutex of the loads locked.
+//
+void _ifft_release(t_modal* x) {
+
+  t_bank* bank = NULL;
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    bank = x->bank_arr + bnk;
+    if (bank->ifft_old) { _ifft_free(bank->ifft_old); bank->ifft_old = NULL; }
+  }
+}
+
+// ====  _IFFT_BUILD  ====
+
+//******************************************************************************
+//  Allocate the synthesis for a bank, and compute the window tables
+//  The analysis window is a 4 term Blackman-Harris window, with a main lobe of
+//  4 bins on each side and side lobes under -92 dB.
+//  Returns NULL on failure.
+//
+t_ifft* _ifft_build(t_modal* x, t_bank* bank, t_int32 size) {
+
+  TRACE("_ifft_build");
+
+  t_int32 bins = size / 2 + 1;
+  t_double win = 0.0, tri = 0.0, delta = 0.0, sum = 0.0;
+  t_int32 n = 0;
+
+  t_ifft* ifft = (t_ifft*)sysmem_newptrclear(sizeof(t_ifft));
+  MY_ASSERT_RETURN(!ifft, NULL, "ifft:  Failed to allocate the synthesis.");
+
+  ifft->size = size;
+  ifft->hop = size / 4;
+  ifft->mode_cnt = bank->reson_cnt;
+
+  if (fft_init(&ifft->fft, size) != ERR_NONE) { goto IFFT_BUILD_FAIL; }
+  ifft->tri_w    = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * ifft->hop);
+  ifft->cen      = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * bins);
+  ifft->mode_arr = (t_ifft_mode*)sysmem_newptrclear(sizeof(t_ifft_mode) * ifft->mode_cnt);
+  ifft->in_hop   = (t_double*)sysmem_newptrclear(sizeof(t_double) * ifft->hop);
+  ifft->in_spec  = (t_double*)sysmem_newptrclear(sizeof(t_double) * 2 * bins);
+  ifft->spec     = (t_double*)sysmem_newptrclear(sizeof(t_double) * x->chan_cnt * 2 * bins);
+  ifft->acc      = (t_double*)sysmem_newptrclear(sizeof(t_double) * x->chan_cnt * 2 * ifft->hop);
+  ifft->work     = (t_double*)sysmem_newptrclear(sizeof(t_double) * size);
+  if (!ifft->tri_w || !ifft->cen || !ifft->mode_arr || !ifft->in_hop || !ifft->in_spec
+    || !ifft->spec || !ifft->acc || !ifft->work) { goto IFFT_BUILD_FAIL; }
+
+  // Transform of the window, real as it is symmetric around N / 2, tabulated over the main lobe
+  for (t_int32 i = 0; i <= 2 * IFFT_BINS * IFFT_OS; i++) {
+    delta = (t_double)i / IFFT_OS - IFFT_BINS;
+    sum = 0.0;
+    for (n = 0; n < size; n++) {
+      win = 0.35875 - 0.48829 * cos(TWOPI * n / size) + 0.14128 * cos(2 * TWOPI * n / size) - 0.01168 * cos(3 * TWOPI * n / size);
+      sum += win * cos(TWOPI * delta * (n - size / 2) / size);
+    }
+    ifft->win_tab[i] = sum;
+  }
+
+  // Triangle over the central half of the frame, divided by the window
+  for (t_int32 i = 0; i < 2 * ifft->hop; i++) {
+    n = ifft->hop + i;
+    win = 0.35875 - 0.48829 * cos(TWOPI * n / size) + 0.14128 * cos(2 * TWOPI * n / size) - 0.01168 * cos(3 * TWOPI * n / size);
+    tri = 1.0 - fabs((t_double)(n - size / 2)) / ifft->hop;
+    ifft->tri_w[i] = tri / win;
+  }
+
+  // Phase shift to center the spectrum of a hop of input
+  for (t_int32 k = 0; k < bins; k++) {
+    ifft->cen[k] = cos(TWOPI * k * (ifft->hop - 1) / (2.0 * size));
+    ifft->cen[bins + k] = sin(TWOPI * k * (ifft->hop - 1) / (2.0 * size));
+  }
+
+  // Force the calculation of the powers of the poles
+  for (t_int32 res = 0; res < ifft->mode_cnt; res++) { ifft->mode_arr[res].freq = -1.0; }
+
+  ifft->in_type = IFFT_IN_NONE;
+  ifft->hop_pos = 0;
+
+  POST("ifft:  Bank %s:  FFT size %i, hop %i.", bank->name->s_name, size, ifft->hop);
+
+  return ifft;
+
+IFFT_BUILD_FAIL:
+  MY_ERR("ifft:  Failed to allocate the synthesis.");
+  _ifft_free(ifft);
+  return NULL;
+}
+
+// ====  _IFFT_FREE  ====
+
+void _ifft_free(t_ifft* ifft) {
+
+  fft_free(&ifft->fft);
+
+  if (ifft->tri_w)    { sysmem_freeptr(ifft->tri_w); }
+  if (ifft->cen)      { sysmem_freeptr(ifft->cen); }
+  if (ifft->mode_arr) { sysmem_freeptr(ifft->mode_arr); }
+  if (ifft->in_hop)   { sysmem_freeptr(ifft->in_hop); }
+  if (ifft->in_spec)  { sysmem_freeptr(ifft->in_spec); }
+  if (ifft->spec)     { sysmem_freeptr(ifft->spec); }
+  if (ifft->acc)      { sysmem_freeptr(ifft->acc); }
+  if (ifft->work)     { sysmem_freeptr(ifft->work); }
+
+  sysmem_freeptr(ifft);
+}
+
+// ====  _IFFT_POW  ====
+
+//******************************************************************************
+//  Power of the pole of a resonator:  p^e = r^e e^(j theta e)
+//
+static __inline void _ifft_pow(t_modal* x, t_resonator* reson, t_double e, t_double* re, t_double* im) {
+
+  t_double r = exp(-reson->decay * e / x->samplerate);
+  t_double theta = TWOPI * reson->freq * e / x->samplerate;
+
+  *re = r * cos(theta);
+  *im = r * sin(theta);
+}
+
+// ====  _IFFT_MODE  ====
+
+//******************************************************************************
+//  Update the cached powers of the pole of a resonator if its parameters changed
+//
+static __inline t_ifft_mode* _ifft_mode(t_modal* x, t_ifft* ifft, t_resonator* reson, t_int32 res) {
+
+  t_ifft_mode* mode = ifft->mode_arr + res;
+
+  if ((mode->freq != reson->freq) || (mode->decay != reson->decay)) {
+    mode->freq = reson->freq;
+    mode->decay = reson->decay;
+    mode->bin = reson->freq * ifft->size / x->samplerate;
+    _ifft_pow(x, reson, ifft->hop, &mode->pH_re, &mode->pH_im);
+    _ifft_pow(x, reson, ifft->hop + 1, &mode->pH1_re, &mode->pH1_im);
+    _ifft_pow(x, reson, 0.5 * (ifft->hop - 1), &mode->pM_re, &mode->pM_im);
+  }
+
+  return mode;
+}
+
+// ====  _IFFT_IN_BIN  ====
+
+//******************************************************************************
+//  Bin of the centered input spectrum, extended to negative bins and above
+//  N / 2 by symmetry. The centering phase is not periodic: for an even hop,
+//  X(2 pi - w) = -X*(w).
+//
+static __inline void _ifft_in_bin(t_ifft* ifft, t_int32 k, t_double* re, t_double* im) {
+
+  t_int32 half = ifft->size / 2;
+  t_double* spec_im = ifft->in_spec + half + 1;
+
+  if (k < 0)         { *re = ifft->in_spec[-k];  *im = -spec_im[-k]; }
+  else if (k > half) { *re = -ifft->in_spec[ifft->size - k]; *im = spec_im[ifft->size - k]; }
+  else               { *re = ifft->in_spec[k];   *im = spec_im[k]; }
+}
+
+// ====  _IFFT_INPUT  ====
+
+//******************************************************************************
+//  Input of a hop at the frequency of a resonator, brought to the end of the hop:
+//    sum over m of x(m) p^(H - 1 - m)  =  p^((H - 1) / 2) Xc(theta + j sigma)
+//  with Xc the spectrum of the hop centered on its middle, and sigma the decay
+//  per sample. It is interpolated with a Lagrange polynomial between the bins,
+//  evaluated at the complex bin to account for the decay within the hop.
+//  A single impulse is brought to the end of the hop exactly.
+//
+static void _ifft_input(t_modal* x, t_ifft* ifft, t_resonator* reson, t_ifft_mode* mode, t_double* re, t_double* im) {
+
+  t_double a_re = 0.0, a_im = 0.0, w_re = 0.0, w_im = 0.0, d_re = 0.0, d_im = 0.0;
+  t_double s_re = 0.0, s_im = 0.0, tmp = 0.0;
+  t_int32 k = 0;
+
+  if (ifft->in_type == IFFT_IN_IMP) {
+    _ifft_pow(x, reson, ifft->hop - 1 - ifft->imp_pos, re, im);
+    *re *= ifft->imp_ampl;
+    *im *= ifft->imp_ampl;
+    return;
+  }
+
+  // Position relative to the first of the IFFT_INTERP bins around the frequency
+  k = (t_int32)floor(mode->bin) - IFFT_INTERP / 2 + 1;
+  t_double t_re = mode->bin - k;
+  t_double t_im = reson->decay * ifft->size / (TWOPI * x->samplerate);
+
+  for (t_int32 i = 0; i < IFFT_INTERP; i++) {
+
+    // Lagrange weight:  product of (t - j) / (i - j)
+    w_re = 1.0; w_im = 0.0;
+    for (t_int32 j = 0; j < IFFT_INTERP; j++) {
+      if (j == i) { continue; }
+      d_re = (t_re - j) / (i - j);
+      d_im = t_im / (i - j);
+      tmp = w_re * d_re - w_im * d_im;
+      w_im = w_re * d_im + w_im * d_re;
+      w_re = tmp;
+    }
+
+    _ifft_in_bin(ifft, k + i, &a_re, &a_im);
+    s_re += w_re * a_re - w_im * a_im;
+    s_im += w_re * a_im + w_im * a_re;
+  }
+
+  *re = mode->pM_re * s_re - mode->pM_im * s_im;
+  *im = mode->pM_re * s_im + mode->pM_im * s_re;
+}
+
+// ====  _IFFT_FRAME  ====
+
+//******************************************************************************
+//  Add the frame of all the resonators, centered e samples after the end of
+//  the hop, to the overlap-add buffers. A mode adds its state advanced to the
+//  center, times the transform of the window around its frequency, with the
+//  phase (-1)^k of the center of the frame.
+//  prime:  add only the second half of the frame, centered on the start of the hop
+//
+static void _ifft_frame(t_modal* x, t_bank* bank, t_double gain, t_bool prime) {
+
+  t_ifft* ifft = bank->ifft;
+  t_resonator* reson = NULL;
+  t_ifft_mode* mode = NULL;
+  t_int32 half = ifft->size / 2;
+  t_int32 bins = half + 1;
+  t_double* spec = NULL;
+  t_double s_re, s_im, g, t, w, v_re, v_im, d;
+  t_double k_re[2 * IFFT_BINS], k_im[2 * IFFT_BINS];
+  t_int32 k0, kk, ind;
+
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { ifft->chan_used[ch] = false; }
+  for (t_int32 i = 0; i < x->chan_cnt * 2 * bins; i++) { ifft->spec[i] = 0.0; }
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+    if ((reson->mode_type == MODE_TYPE_OFF) || (reson->skip)) { continue; }
+
+    mode = _ifft_mode(x, ifft, reson, res);
+    g = gain * reson->out_A_cur;
+
+    // The state at the center of the frame, with the gain
+    if (prime) {
+      s_re = g * (reson->p_re * reson->u_re - reson->p_im * reson->u_im);
+      s_im = g * (reson->p_re * reson->u_im + reson->p_im * reson->u_re);
+    }
+    else {
+      s_re = g * (mode->pH1_re * reson->u_re - mode->pH1_im * reson->u_im);
+      s_im = g * (mode->pH1_re * reson->u_im + mode->pH1_im * reson->u_re);
+    }
+
+    // The spectral kernel over the main lobe
+    k0 = (t_int32)floor(mode->bin) - IFFT_BINS + 1;
+    for (t_int32 i = 0; i < 2 * IFFT_BINS; i++) {
+      t = (k0 + i - mode->bin + IFFT_BINS) * IFFT_OS;
+      ind = CLAMP((t_int32)t, 0, 2 * IFFT_BINS * IFFT_OS - 1);
+      w = ifft->win_tab[ind] + (t - ind) * (ifft->win_tab[ind + 1] - ifft->win_tab[ind]);
+      if ((k0 + i) & 1) { w = -w; }
+      k_re[i] = w * s_re;
+      k_im[i] = w * s_im;
+    }
+
+    // Add the kernel to the channels, folding the bins under 0 and over N / 2
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      d = reson->diff_mult[ch];
+      if (d == 0.0) { continue; }
+      ifft->chan_used[ch] = true;
+      spec = ifft->spec + ch * 2 * bins;
+
+      for (t_int32 i = 0; i < 2 * IFFT_BINS; i++) {
+        kk = k0 + i;
+        v_re = d * k_re[i];
+        v_im = d * k_im[i];
+        if ((kk == 0) || (kk == half)) { spec[kk] += 2 * v_re; }
+        else if (kk < 0)               { spec[-kk] += v_re; spec[bins - kk] -= v_im; }
+        else if (kk > half)            { if (kk < ifft->size) { spec[ifft->size - kk] += v_re; spec[bins + ifft->size - kk] -= v_im; } }
+        else                           { spec[kk] += v_re; spec[bins + kk] += v_im; }
+      }
+    }
+  }
+
+  // Inverse FFT, and overlap-add the central half of the frame with the triangle
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    if (!ifft->chan_used[ch]) { continue; }
+
+    spec = ifft->spec + ch * 2 * bins;
+    fft_inverse(&ifft->fft, spec, spec + bins, ifft->work);
+
+    t_double* acc = ifft->acc + ch * 2 * ifft->hop;
+    if (prime) {
+      for (t_int32 i = 0; i < ifft->hop; i++) { acc[i] += ifft->work[half + i] * ifft->tri_w[ifft->hop + i]; }
+    }
+    else {
+      for (t_int32 i = 0; i < 2 * ifft->hop; i++) { acc[i] += ifft->work[ifft->hop + i] * ifft->tri_w[i]; }
+    }
+  }
+}
+
+// ====  _IFFT_HOP  ====
+
+//******************************************************************************
+//  End of a hop: add the input of the hop to the states of the resonators,
+//  advance them to the end of the hop, and add the next frame.
+//  prime:  start from the states of the recursion, with no input to add
+//
+static void _ifft_hop(t_modal* x, t_bank* bank, t_double gain, t_bool prime) {
+
+  t_ifft* ifft = bank->ifft;
+  t_resonator* reson = NULL;
+  t_ifft_mode* mode = NULL;
+  t_int32 hop = ifft->hop;
+  t_int32 bins = ifft->size / 2 + 1;
+  t_double in_A = 0.0, in_re = 0.0, in_im = 0.0, tmp = 0.0, len = 0.0;
+
+  if (!prime) {
+
+    // Centered spectrum of the input of the hop
+    if (ifft->in_type == IFFT_IN_DENSE) {
+      for (t_int32 i = 0; i < hop; i++) { ifft->work[i] = ifft->in_hop[i]; }
+      for (t_int32 i = hop; i < ifft->size; i++) { ifft->work[i] = 0.0; }
+      fft_forward(&ifft->fft, ifft->work, ifft->in_spec, ifft->in_spec + bins);
+      for (t_int32 k = 0; k < bins; k++) {
+        tmp = ifft->in_spec[k] * ifft->cen[k] - ifft->in_spec[bins + k] * ifft->cen[bins + k];
+        ifft->in_spec[bins + k] = ifft->in_spec[k] * ifft->cen[bins + k] + ifft->in_spec[bins + k] * ifft->cen[k];
+        ifft->in_spec[k] = tmp;
+      }
+    }
+
+    ifft->rms_sum = 0.0;
+
+    for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+      reson = bank->reson_arr + res;
+
+      in_A = _mode_countdown(x, bank, reson, hop);
+      if (reson->mode_type == MODE_TYPE_OFF) { continue; }
+
+      mode = _ifft_mode(x, ifft, reson, res);
+
+      // Free evolution over the hop
+      tmp = mode->pH_re * reson->u_re - mode->pH_im * reson->u_im;
+      reson->u_im = mode->pH_re * reson->u_im + mode->pH_im * reson->u_re;
+      reson->u_re = tmp;
+
+      // Response to the input of the hop:  c times the input brought to the end of the hop
+      if ((ifft->in_type != IFFT_IN_NONE) && (in_A != 0.0)) {
+        _ifft_input(x, ifft, reson, mode, &in_re, &in_im);
+        reson->u_re += in_A * (reson->c_re * in_re - reson->c_im * in_im);
+        reson->u_im += in_A * (reson->c_re * in_im + reson->c_im * in_re);
+      }
+
+      // The rms of the sinusoid 2 Re(u)
+      reson->rms = x->a_smoothing * sqrt(2 * (reson->u_re * reson->u_re + reson->u_im * reson->u_im))
+        + (1 - x->a_smoothing) * reson->rms;
+      ifft->rms_sum += reson->rms;
+
+      // Interpolate the diffusion gains over the hop
+      if (reson->diff_cntd > 0) {
+        len = MAX(reson->diff_cntd, hop);
+        for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+          reson->diff_mult[ch] += (reson->diff_targ[ch] - reson->diff_mult[ch]) * hop / len;
+        }
+        reson->diff_cntd -= hop;
+        if (reson->diff_cntd <= 0) { _diff_snap(x, reson); }
+      }
+    }
+  }
+
+  // Slide the overlap-add buffers by a hop
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    t_double* acc = ifft->acc + ch * 2 * hop;
+    for (t_int32 i = 0; i < hop; i++) {
+      acc[i] = (prime) ? 0.0 : acc[hop + i];
+      acc[hop + i] = 0.0;
+    }
+  }
+
+  if (prime) { _ifft_frame(x, bank, gain, true); }
+  _ifft_frame(x, bank, gain, false);
+
+  ifft->in_type = IFFT_IN_NONE;
+}
+
+// ====  _IFFT_PERFORM  ====
+
+//******************************************************************************
+//  Render a vector of a bank by inverse FFT synthesis
+//  The synthesis is switched on and off at hop boundaries, which fall on
+//  vector boundaries. The states of the resonators are kept in the form of the
+//  phasor kernel while the synthesis is active, and converted back for the
+//  biquad kernel when it stops, so that the recursion continues seamlessly.
+//  in:  input of the bank, with the exciters
+//  gain:  gain of the bank
+//  Returns true if the bank was rendered, false if the recursion renders it.
+//
+t_bool _ifft_perform(t_modal* x, t_bank* bank, t_double* in, t_double** outs, long sampleframes, t_double gain) {
+
+  t_ifft* ifft = bank->ifft;
+
+  // Switch at a hop boundary
+  if (ifft->hop_pos == 0) {
+
+    // The synthesis is sized for a number of resonators and a vector size
+    if ((bank->reson_cnt > ifft->mode_cnt) || (ifft->hop % sampleframes)) { bank->ifft_targ = false; }
+
+    if ((bank->ifft_targ) && (!bank->ifft_active)) {
+      if (x->kernel_cur == KERNEL_BIQUAD) {
+        for (t_int32 res = 0; res < bank->reson_cnt; res++) { _phasor_from_biquad(bank->reson_arr + res); }
+      }
+      bank->ifft_active = true;
+      ifft->in_type = IFFT_IN_NONE;
+      _ifft_hop(x, bank, gain, true);
+    }
+
+    else if ((!bank->ifft_targ) && (bank->ifft_active)) {
+      if (x->kernel_cur == KERNEL_BIQUAD) {
+        for (t_int32 res = 0; res < bank->reson_cnt; res++) { _phasor_to_biquad(bank->reson_arr + res); }
+      }
+      bank->ifft_active = false;
+    }
+  }
+
+  if (!bank->ifft_active) { return false; }
+
+  // Collect the input of the hop
+  t_double* in_hop = ifft->in_hop + ifft->hop_pos;
+
+  if (!bank->in_silent) {
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { in_hop[smp] = in[smp]; }
+    ifft->in_type = IFFT_IN_DENSE;
+  }
+  else {
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { in_hop[smp] = 0.0; }
+  }
+
+  if (bank->imp_ofs >= 0) {
+    in_hop[bank->imp_ofs] += bank->imp_ampl;
+    if (ifft->in_type == IFFT_IN_NONE) {
+      ifft->in_type = IFFT_IN_IMP;
+      ifft->imp_pos = ifft->hop_pos + bank->imp_ofs;
+      ifft->imp_ampl = bank->imp_ampl;
+    }
+    else { ifft->in_type = IFFT_IN_DENSE; }
+    bank->imp_ampl = 0.0;
+    bank->imp_ofs = -1;
+  }
+
+  bank->rms_sum = ifft->rms_sum;
+
+  // Play the output of the hop
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    t_double* acc = ifft->acc + ch * 2 * ifft->hop + ifft->hop_pos;
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { outs[ch][smp] += acc[smp]; }
+  }
+
+  ifft->hop_pos += (t_int32)sampleframes;
+  if (ifft->hop_pos == ifft->hop) {
+    _ifft_hop(x, bank, gain, false);
+    ifft->hop_pos = 0;
+  }
+
+  return true;
+}
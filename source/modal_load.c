@@ -0,0 +1,484 @@
+#include "modal~.h"
+
+// ====  _LOAD_INIT  ====
+
+//******************************************************************************
+//  Initialize the queue of loads, called by modal_new
+//  The worker thread is only started when a load is queued.
+//
+void _load_init(t_modal* x) {
+
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) { x->load_arr[ind].state = LOAD_FREE; }
+
+  x->load_seq = 0;
+  x->load_done = 0;
+  x->load_running = false;
+  x->load_stop = false;
+  x->load_thread = NULL;
+  systhread_mutex_new(&x->load_mutex, SYSTHREAD_MUTEX_NORMAL);
+  x->load_qelem = qelem_new(x, (method)_load_main);
+  x->load_clock = clock_new(x, (method)_load_tick);
+  x->perform_cnt = 0;
+  x->perform_seen = 0;
+  x->perform_busy = 0;
+  x->load_installing = 0;
+  x->conv_pend = false;
+  x->ifft_pend = false;
+}
+
+// ====  _LOAD_FREE  ====
+
+//******************************************************************************
+//  Stop the worker thread and free the banks held by the loads
+//  Called by modal_free, the running load is cancelled.
+//
+void _load_free(t_modal* x) {
+
+  systhread_mutex_lock(x->load_mutex);
+  x->load_stop = true;
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) { x->load_arr[ind].cancel = true; }
+  systhread_mutex_unlock(x->load_mutex);
+
+  if (x->load_thread) { systhread_join(x->load_thread, NULL); x->load_thread = NULL; }
+
+  clock_unset(x->load_clock);
+  object_free(x->load_clock);
+
+  // The new banks not installed yet, and the replaced banks not freed yet
+  // The state libraries not installed or written yet
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) {
+    t_load* load = x->load_arr + ind;
+    if ((load->state == LOAD_DONE) || (load->state == LOAD_INSTALLED)) { bank_free(x, &load->bank); }
+    if (load->state != LOAD_FREE) { _state_load_free(load); }
+    load->state = LOAD_FREE;
+  }
+
+  qelem_free(x->load_qelem);
+  systhread_mutex_free(x->load_mutex);
+}
+
+// ====  _LOAD_NEXT  ====
+
+//******************************************************************************
+//  The load in a given state that was queued first, or NULL
+//
+static t_load* _load_next(t_modal* x, t_load_state state) {
+
+  t_load* next = NULL;
+
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) {
+    t_load* load = x->load_arr + ind;
+    if ((load->state == state) && ((!next) || (load->seq < next->seq))) { next = load; }
+  }
+
+  return next;
+}
+
+// ====  _LOAD_MESS  ====
+
+//******************************************************************************
+//  The message of a type of load, for the errors and the replies
+//
+static const char* _load_mess(t_load_type type) {
+
+  switch (type) {
+    case LOAD_IMPORT:      return "import";
+    case LOAD_DICT:        return "load";
+    case LOAD_STATE_READ:  return "read";
+    case LOAD_STATE_WRITE: return "write";
+    case LOAD_STREAM:      return "stream";
+    case LOAD_SDIF:        return "sdif";
+  }
+  return "";
+}
+
+// ====  _LOAD_QUEUE  ====
+
+//******************************************************************************
+//  Queue an import or a load into a bank, and start the worker thread if needed
+//  A free bank is reserved under the new name, so that it is not found again
+//  as free by the next loads.
+//  bank:  NULL to read or write the state library
+//  file_name, file_path:  the file to import, unused for a load from the dictionary
+//  extra:  the fields specific to the type of load, or NULL:  the encoded
+//  states to write, taken over by the load, or the frame of a SDIF file
+//  Returns the queued load, or NULL if the queue is full
+//
+t_load* _load_queue(t_modal* x, t_bank* bank, t_load_type type, t_symbol* name, char* file_name, short file_path, t_load* extra) {
+
+  TRACE("_load_queue");
+
+  const char* mess = _load_mess(type);
+  t_load* load = NULL;
+
+  systhread_mutex_lock(x->load_mutex);
+
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) {
+    if (x->load_arr[ind].state == LOAD_FREE) { load = x->load_arr + ind; break; }
+  }
+
+  if (!load) {
+    systhread_mutex_unlock(x->load_mutex);
+    MY_ERR("%s:  Too many loads queued:  %i at most.", mess, LOAD_MAX);
+    return NULL;
+  }
+
+  load->type = type;
+  load->seq = x->load_seq++;
+  load->bank_ind = (bank) ? (t_int32)(bank - x->bank_arr) : -1;
+  load->name = name;
+  load->file_name[0] = '\0';
+  if (file_name) { strncpy(load->file_name, file_name, MAX_FILENAME_CHARS - 1); load->file_name[MAX_FILENAME_CHARS - 1] = '\0'; }
+  load->file_path = file_path;
+  load->cancel = false;
+  memset(&load->bank, 0, sizeof(t_bank));
+  load->state_blob = (extra) ? extra->state_blob : NULL;
+  load->state_size = (extra) ? extra->state_size : 0;
+  load->state_arr = NULL;
+  load->state_cnt = (extra) ? extra->state_cnt : 0;
+  load->sdif_frame = (extra) ? extra->sdif_frame : 0;
+  load->sdif_time = (extra) ? extra->sdif_time : 0.0;
+  load->sdif_rate = (extra) && (extra->sdif_rate);
+
+  load->reserved = (bank) && (bank->name == gensym("free"));
+  if (load->reserved) { bank->name = name; }
+
+  load->state = LOAD_QUEUED;
+
+  // The previous worker thread has ended, or is about to
+  if (!x->load_running) {
+    if (x->load_thread) { systhread_join(x->load_thread, NULL); x->load_thread = NULL; }
+    if (systhread_create((method)_load_worker, x, 0, 0, 0, &x->load_thread)) {
+      x->load_thread = NULL;
+      load->state = LOAD_FREE;
+      load->state_blob = NULL;
+      if (load->reserved) { bank->name = gensym("free"); }
+      systhread_mutex_unlock(x->load_mutex);
+      MY_ERR("%s:  Failed to start the worker thread.", mess);
+      return NULL;
+    }
+    x->load_running = true;
+  }
+
+  systhread_mutex_unlock(x->load_mutex);
+  return load;
+}
+
+// ====  _LOAD_WORKER  ====
+
+//******************************************************************************
+//  Worker thread: build the banks of the queued loads, in order
+//  The thread ends when the queue is empty.
+//
+void* _load_worker(t_modal* x) {
+
+  t_load* load = NULL;
+  t_my_err err = ERR_NONE;
+
+  while (true) {
+
+    systhread_mutex_lock(x->load_mutex);
+    load = x->load_stop ? NULL : _load_next(x, LOAD_QUEUED);
+    if (!load) {
+      x->load_running = false;
+      systhread_mutex_unlock(x->load_mutex);
+      break;
+    }
+    load->state = LOAD_RUNNING;
+    systhread_mutex_unlock(x->load_mutex);
+
+    // The file I/O, parsing and sorting, outside of the mutex
+    switch (load->type) {
+      case LOAD_IMPORT:      err = _io_import_file(x, &load->bank, load->name, load->file_name, load->file_path); break;
+      case LOAD_DICT:        err = _io_load_dict(x, &load->bank, load->name); break;
+      case LOAD_STATE_READ:  err = _state_file_read(x, load); break;
+      case LOAD_STATE_WRITE: err = _state_file_write(x, load); break;
+      case LOAD_STREAM:      err = _stream_open(x, &load->bank, load->name, load->file_name, load->file_path); break;
+      case LOAD_SDIF:
+        err = _sdif_import(x, &load->bank, load->name, load->file_name, load->file_path, load->sdif_frame, load->sdif_time, load->sdif_rate);
+        break;
+    }
+
+    systhread_mutex_lock(x->load_mutex);
+    if ((err != ERR_NONE) || (load->cancel)) {
+      bank_free(x, &load->bank);
+      _state_load_free(load);
+      load->state = load->cancel ? LOAD_CANCELLED : LOAD_FAILED;
+    }
+    // The state library is not used by the perform routine
+    else if (load->bank_ind == -1) {
+      load->state = LOAD_INSTALLED;
+    }
+    else {
+      load->state = LOAD_DONE;
+      ATOMIC_INCREMENT(&x->load_done);
+    }
+    systhread_mutex_unlock(x->load_mutex);
+
+    qelem_set(x->load_qelem);
+  }
+
+  systhread_exit(0);
+  return NULL;
+}
+
+// ====  _LOAD_KEEP  ====
+
+//******************************************************************************
+//  Copy the settings that belong to the slot of a bank into the bank loaded
+//  into it: the routing of the inputs, the voice, the level of detail, and the
+//  pending impulse or burst. The gain is the one loaded with the model.
+//
+static void _load_keep(t_modal* x, t_bank* bank, t_bank* bank_old) {
+
+  for (t_int32 i = 0; i < IN_MAX; i++) { bank->in_gain[i] = bank_old->in_gain[i]; }
+
+  bank->voice_ind   = bank_old->voice_ind;
+  bank->voice_busy  = bank_old->voice_busy;
+  bank->voice_pitch = bank_old->voice_pitch;
+  bank->rms_peak    = bank_old->rms_peak;
+
+  bank->lod_type = bank_old->lod_type;
+  bank->lod_val  = bank_old->lod_val;
+  if (bank->lod_type != LOD_OFF) { _bank_lod(x, bank); }
+
+  bank->imp_ampl  = bank_old->imp_ampl;
+  bank->imp_cntd  = bank_old->imp_cntd;
+  bank->exc_type  = bank_old->exc_type;
+  bank->exc_ampl  = bank_old->exc_ampl;
+  bank->exc_cntd  = bank_old->exc_cntd;
+  bank->exc_len   = bank_old->exc_len;
+  bank->exc_pos   = bank_old->exc_pos;
+  bank->exc_param = bank_old->exc_param;
+  bank->exc_lp    = bank_old->exc_lp;
+  bank->exc_seed  = bank_old->exc_seed;
+}
+
+// ====  _LOAD_INSTALL  ====
+
+//******************************************************************************
+//  Install the banks built by the worker thread, in order
+//  The new bank is swapped with the bank it replaces, which is freed later
+//  by the main thread, and keeps the settings of the slot. Called with the
+//  mutex locked: by the perform routine between two blocks, or by the main
+//  thread if the perform routine is not running.
+//  Returns the number of banks installed
+//
+t_int32 _load_install(t_modal* x) {
+
+  t_load* load = NULL;
+  t_bank  bank_tmp;
+  t_int32 cnt = 0;
+
+  while ((load = _load_next(x, LOAD_DONE))) {
+    t_bank* bank = x->bank_arr + load->bank_ind;
+    bank_tmp = *bank;
+    *bank = load->bank;
+    load->bank = bank_tmp;
+    _load_keep(x, bank, &load->bank);
+    load->state = LOAD_INSTALLED;
+    ATOMIC_DECREMENT(&x->load_done);
+    cnt++;
+  }
+
+  return cnt;
+}
+
+// ====  _LOAD_PENDING  ====
+
+//******************************************************************************
+//  Returns true if banks, impulse responses, inverse FFT syntheses, voices or
+//  a snapshot are waiting to be installed
+//
+t_bool _load_pending(t_modal* x) {
+
+  return (x->load_done) || (x->conv_pend) || (x->ifft_pend) || (x->voice_pend >= 0) || (x->snap_stage == SNAP_READY);
+}
+
+// ====  _LOAD_INSTALL_MAIN  ====
+
+//******************************************************************************
+//  Install from the main thread everything waiting for the perform routine
+//  Called with the mutex of the loads locked. The perform routine does not
+//  hold the mutex while rendering, so the two threads are kept apart by two
+//  atomic counters: the install is skipped if the perform routine is in a
+//  cycle, and a cycle that starts during the install outputs silence.
+//  Returns true if installed
+//
+static t_bool _load_install_main(t_modal* x) {
+
+  ATOMIC_INCREMENT(&x->load_installing);
+  t_bool is_idle = (x->perform_busy == 0);
+
+  if (is_idle) {
+    _load_install(x);
+    _conv_install(x);
+    _ifft_install(x);
+    _voice_install(x);
+    _snap_install(x);
+  }
+
+  ATOMIC_DECREMENT(&x->load_installing);
+  return is_idle;
+}
+
+// ====  _LOAD_WAIT  ====
+
+//******************************************************************************
+//  Called by the main thread with the mutex of the loads locked, for the banks,
+//  impulse responses, syntheses and snapshots waiting to be installed by the perform
+//  routine. They are installed here if the DSP is off. Otherwise the perform
+//  routine might still not run, in a muted subpatcher for instance, so a clock
+//  checks later that it has run in the meantime.
+//  Returns true if installed here
+//
+t_bool _load_wait(t_modal* x) {
+
+  if ((!sys_getdspobjdspstate((t_object*)x)) && (_load_install_main(x))) { return true; }
+
+  if (_load_pending(x)) {
+    x->perform_seen = x->perform_cnt;
+    clock_fdelay(x->load_clock, LOAD_WAIT);
+  }
+  return false;
+}
+
+// ====  _LOAD_TICK  ====
+
+//******************************************************************************
+//  Called by the clock set by _load_wait
+//  If the perform routine has not run since, the waiting banks, impulse
+//  responses and snapshot are installed here, and the qelems free the replaced
+//  ones and reply from the main thread.
+//
+void _load_tick(t_modal* x) {
+
+  t_bool is_installed = false;
+
+  systhread_mutex_lock(x->load_mutex);
+  if ((x->perform_cnt == x->perform_seen) && (_load_install_main(x))) { is_installed = true; }
+  else { is_installed = _load_wait(x); }
+  systhread_mutex_unlock(x->load_mutex);
+
+  if (is_installed) {
+    qelem_set(x->load_qelem);
+    qelem_set(x->snap_qelem);
+  }
+}
+
+// ====  _LOAD_MAIN  ====
+
+//******************************************************************************
+//  Finish the loads from the main thread, called by the qelem
+//  The replaced banks are freed and the replies sent in order, with the
+//  format of the synchronous messages:  import/load (bank) (name) (count) (gain)
+//  A state library read is installed, and the reply is:  state read/write (count)
+//  A bank reserved by a load that failed or was cancelled is free again.
+//
+void _load_main(t_modal* x) {
+
+  TRACE("_load_main");
+
+  t_load_type type_arr[LOAD_MAX];
+  t_int32 bank_arr[LOAD_MAX];
+  t_int32 reply_cnt = 0;
+  t_load* load = NULL;
+
+  systhread_mutex_lock(x->load_mutex);
+
+  // Install here if the perform routine does not run
+  t_bool is_main = _load_wait(x);
+
+  // The impulse responses, syntheses and voices replaced by the perform routine
+  _conv_release(x);
+  _ifft_release(x);
+  if (x->voice_pend < 0) { _voice_release(x); }
+
+  while ((load = _load_next(x, LOAD_INSTALLED))) {
+    bank_free(x, &load->bank);
+    if (load->type == LOAD_STATE_READ) { _state_install(x, load); }
+    _state_load_free(load);
+    type_arr[reply_cnt] = load->type;
+    bank_arr[reply_cnt] = (load->bank_ind != -1) ? load->bank_ind : load->state_cnt;
+    reply_cnt++;
+    load->state = LOAD_FREE;
+  }
+
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) {
+    load = x->load_arr + ind;
+    if ((load->state == LOAD_FAILED) || (load->state == LOAD_CANCELLED)) {
+      _state_load_free(load);
+      if ((load->reserved) && ((x->bank_arr + load->bank_ind)->name == load->name)) {
+        (x->bank_arr + load->bank_ind)->name = gensym("free");
+      }
+      load->state = LOAD_FREE;
+    }
+  }
+
+  systhread_mutex_unlock(x->load_mutex);
+
+  // The current resonator was in the replaced banks
+  if (!x->reson_cur) { x->reson_cur = x->bank_cur->reson_arr; }
+
+  // A snapshot installed here is finished by its own qelem
+  if ((is_main) && (x->snap_stage == SNAP_INSTALLED)) { qelem_set(x->snap_qelem); }
+
+  // Outside of the mutex, as the replies might queue other loads
+  t_atom mess_arr[4];
+  for (t_int32 rep = 0; rep < reply_cnt; rep++) {
+    if ((type_arr[rep] == LOAD_STATE_READ) || (type_arr[rep] == LOAD_STATE_WRITE)) {
+      atom_setsym(mess_arr, gensym(_load_mess(type_arr[rep])));
+      atom_setlong(mess_arr + 1, bank_arr[rep]);
+      outlet_anything(x->outl_mess, gensym("state"), 2, mess_arr);
+      continue;
+    }
+    t_bank* bank = x->bank_arr + bank_arr[rep];
+    atom_setlong(mess_arr, bank_arr[rep]);
+    atom_setsym(mess_arr + 1, bank->name);
+    atom_setlong(mess_arr + 2, bank->reson_cnt);
+    atom_setfloat(mess_arr + 3, bank->gain);
+    outlet_anything(x->outl_mess, gensym(_load_mess(type_arr[rep])), 4, mess_arr);
+  }
+}
+
+// ====  LOAD_CANCEL  ====
+
+//******************************************************************************
+//  Cancel the queued and running loads
+//  cancel [bank]
+//  Without argument all the loads are cancelled, otherwise the ones into a
+//  bank. Loads that are already built are installed anyway.
+//  Replies:  cancel (count)
+//
+void load_cancel(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("load_cancel");
+
+  MY_ASSERT(argc > 1, "cancel:  0 or 1 arg expected:  cancel [bank]");
+
+  t_int32 bank_ind = -1;
+  if (argc == 1) {
+    t_bank* bank = bank_find(x, argv, sym);
+    MY_ASSERT(!bank, "cancel:  Arg 0:  Bank not found.");
+    bank_ind = (t_int32)(bank - x->bank_arr);
+  }
+
+  t_int32 cnt = 0;
+
+  systhread_mutex_lock(x->load_mutex);
+  for (t_int32 ind = 0; ind < LOAD_MAX; ind++) {
+    t_load* load = x->load_arr + ind;
+    if ((bank_ind != -1) && (load->bank_ind != bank_ind)) { continue; }
+
+    // Queued loads are dropped, running ones are dropped when finished
+    if (load->state == LOAD_QUEUED) { load->state = LOAD_CANCELLED; cnt++; }
+    else if ((load->state == LOAD_RUNNING) && (!load->cancel)) { load->cancel = true; cnt++; }
+  }
+  systhread_mutex_unlock(x->load_mutex);
+
+  qelem_set(x->load_qelem);
+
+  t_atom mess_arr[1];
+  atom_setlong(mess_arr, cnt);
+  outlet_anything(x->outl_mess, gensym("cancel"), 1, mess_arr);
+}
@@ -0,0 +1,146 @@
+#include "modal~.h"
+
+// ====  METHOD: _MIX_TILE_N  ====
+// Accumulate a tile of resonator outputs into the channel buses.
+// The tile holds one row of sampleframes values per resonator, already scaled
+// by the bank and resonator gains. The rows are at the sample rate divided by
+// decim, for the resonators rendered at a decimated rate. The accumulation is a small matrix product:
+//   out[ch][smp] += sum over t of row[t][smp] * gain[t][ch]
+// with the gains interpolated linearly over the block when they are ramping.
+// The tile stays in cache while looping over the channels.
+// The kernel is specialized per channel count, so that the gain tables are
+// sized at compile time and the channel loops have a constant trip count.
+
+#define MIX_TILE_DEF(N)                                                              \
+void _mix_tile_##N(t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim) { \
+                                                                                     \
+  t_double gain[MIX_TILE][N];  /* Gains at the start of the block */                 \
+  t_double step[MIX_TILE][N];  /* Gain increments per sample */                      \
+  t_resonator* reson = NULL;                                                         \
+  t_int32 len = 0;                                                                   \
+                                                                                     \
+  /* Get the gains of the tile, and advance the interpolation of the gains */        \
+  for (t_int32 t = 0; t < tile_cnt; t++) {                                           \
+    reson = x->mix_tile[t];                                                          \
+                                                                                     \
+    /* No interpolation: constant gains over the block */                            \
+    if (reson->diff_cntd <= 0) {                                                     \
+      for (t_int32 ch = 0; ch < N; ch++) {                                           \
+        gain[t][ch] = reson->diff_mult[ch];                                          \
+        step[t][ch] = 0.0;                                                           \
+      }                                                                              \
+    }                                                                                \
+                                                                                     \
+    /* Interpolation: linear ramp towards the target gains */                        \
+    else {                                                                           \
+      len = MAX(reson->diff_cntd, (t_int32)sampleframes * decim);                    \
+      for (t_int32 ch = 0; ch < N; ch++) {                                           \
+        gain[t][ch] = reson->diff_mult[ch];                                          \
+        step[t][ch] = (reson->diff_targ[ch] - reson->diff_mult[ch]) * decim / len;   \
+        reson->diff_mult[ch] += step[t][ch] * sampleframes;                          \
+      }                                                                              \
+                                                                                     \
+      /* Snap to the target at the end of the interpolation */                       \
+      reson->diff_cntd -= (t_int32)sampleframes * decim;                             \
+      if (reson->diff_cntd <= 0) { _diff_snap(x, reson); }                           \
+    }                                                                                \
+  }                                                                                  \
+                                                                                     \
+  /* Accumulate the rows into each channel */                                        \
+  t_double* out = NULL;                                                              \
+  t_double* row = NULL;                                                              \
+  t_double  g = 0.0, dg = 0.0;                                                       \
+                                                                                     \
+  for (t_int32 ch = 0; ch < N; ch++) {                                               \
+    out = outs[ch];                                                                  \
+                                                                                     \
+    for (t_int32 t = 0; t < tile_cnt; t++) {                                         \
+      g  = gain[t][ch];                                                              \
+      dg = step[t][ch];                                                              \
+                                                                                     \
+      /* Skip the channels the resonator is not diffused into */                     \
+      if ((g == 0.0) && (dg == 0.0)) { continue; }                                   \
+                                                                                     \
+      row = x->mix_buf + t * x->vec_max;                                             \
+                                                                                     \
+      if (dg == 0.0) {                                                               \
+        for (t_int32 smp = 0; smp < sampleframes; smp++) { out[smp] += g * row[smp]; } \
+      }                                                                              \
+      else {                                                                         \
+        for (t_int32 smp = 0; smp < sampleframes; smp++) { out[smp] += (g + dg * smp) * row[smp]; } \
+      }                                                                              \
+    }                                                                                \
+  }                                                                                  \
+}
+
+MIX_TILE_DEF(1)
+MIX_TILE_DEF(2)
+MIX_TILE_DEF(4)
+MIX_TILE_DEF(8)
+MIX_TILE_DEF(16)
+MIX_TILE_DEF(32)
+MIX_TILE_DEF(64)
+
+// ====  METHOD: _MIX_FUNC_SET  ====
+// Select the mixing kernel matching the channel count
+
+void _mix_func_set(t_modal* x) {
+
+  switch (x->chan_cnt) {
+  case 1:  x->mix_func = _mix_tile_1;  break;
+  case 2:  x->mix_func = _mix_tile_2;  break;
+  case 4:  x->mix_func = _mix_tile_4;  break;
+  case 8:  x->mix_func = _mix_tile_8;  break;
+  case 16: x->mix_func = _mix_tile_16; break;
+  case 32: x->mix_func = _mix_tile_32; break;
+  case 64: x->mix_func = _mix_tile_64; break;
+  default:
+    MY_ERR("_mix_func_set:  Invalid channel count: %i.", x->chan_cnt);
+    x->chan_cnt = CHAN_CNT_DEF;
+    x->mix_func = _mix_tile_8;
+    break;
+  }
+}
+
+// ====  METHOD: _ROUTE_INPUTS  ====
+// Route the inputs into a bank, using the gains of the bank routing table.
+// Returns the input vector of the bank: either an input vector directly, when
+// a single input is routed with unit gain, or the sum in in_buf.
+// Sets bank->in_silent when no input is routed, or when the routed input is
+// all zeros for the block, so the perform routine can skip the input term.
+
+t_double* _route_inputs(t_modal* x, t_bank* bank, t_double** ins, long numins, long sampleframes) {
+
+  t_int32 in_cnt = MIN((t_int32)numins, (t_int32)x->in_cnt);
+  t_int32 routed_cnt = 0;
+  t_int32 routed_ind = -1;
+  t_double* in = x->in_buf;
+
+  // == Count the connected inputs with a non zero gain
+  for (t_int32 i = 0; i < in_cnt; i++) {
+    if ((bank->in_gain[i] != 0.0) && (x->in_conn[i])) { routed_cnt++; routed_ind = i; }
+  }
+
+  // == No input: the input vector is not read
+  if (routed_cnt == 0) { bank->in_silent = true; return in; }
+
+  // == One input with unit gain: use the input vector directly
+  else if ((routed_cnt == 1) && (bank->in_gain[routed_ind] == 1.0)) { in = ins[routed_ind]; }
+
+  // == Otherwise sum the gain weighted inputs into the buffer
+  else {
+    t_double g = 0.0;
+    for (t_int32 smp = 0; smp < sampleframes; smp++) { in[smp] = 0.0; }
+    for (t_int32 i = 0; i < in_cnt; i++) {
+      if (((g = bank->in_gain[i]) == 0.0) || (!x->in_conn[i])) { continue; }
+      for (t_int32 smp = 0; smp < sampleframes; smp++) { in[smp] += g * ins[i][smp]; }
+    }
+  }
+
+  // == Flag a silent input
+  t_int32 smp = 0;
+  while ((smp < sampleframes) && (in[smp] == 0.0)) { smp++; }
+  bank->in_silent = (smp == sampleframes);
+
+  return in;
+}
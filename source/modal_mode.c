@@ -15,42 +15,49 @@ void st_act_diff(t_modal* x, t_bank* bank, t_resonator* reson, t_mode* mode) {
 
     switch (reson->diff_type) {
     case MODE_DIFF_ALL:
-      for (t_int32 ch = 0; ch < 8; ch++) { reson->diff_mult[ch] = 1.0; };
-      reson->diff_ind = 7;
-      reson->diff_cnt = 8;
+      for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] = 1.0; };
+      reson->diff_ind = x->chan_cnt - 1;
+      reson->diff_cnt = x->chan_cnt;
+      _diff_snap(x, reson);
       break;
 
     // One channel set by cmd
     case MODE_DIFF_ONE_S:
-      for (t_int32 ch = 0; ch < 8; ch++) { reson->diff_mult[ch] = 0.0; };
+      for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] = 0.0; };
       reson->diff_ind = reson->diff_sto;
-      reson->diff_mult[reson->diff_ind] = 1.0;
+      reson->diff_targ[reson->diff_ind] = 1.0;
       reson->diff_cnt = 1;
+      _diff_snap(x, reson);
       break;
 
     // One channel chosen at random once or repeatedly
     case MODE_DIFF_ONE_R:
     case MODE_DIFF_ONE_RR:
-      for (t_int32 ch = 0; ch < 8; ch++) { reson->diff_mult[ch] = 0.0; };
-      reson->diff_ind = rand() % 8;
-      reson->diff_mult[reson->diff_ind] = 1.0;
+      for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] = 0.0; };
+      reson->diff_ind = rand() % x->chan_cnt;
+      reson->diff_targ[reson->diff_ind] = 1.0;
       reson->diff_cnt = 1;
+      _diff_snap(x, reson);
       break;
 
     // N channels chosen at random once or repeatedly
     case MODE_DIFF_NUM_R:
     case MODE_DIFF_NUM_RR:
-    { reson->diff_cnt = reson->diff_sto;
-      t_int32 index_arr[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
-      random_n_of_m(reson->diff_cnt, 8, index_arr);
-      for (t_int32 ch = 0; ch < reson->diff_cnt; ch++) { reson->diff_mult[index_arr[ch]] = 1.0; };
-      for (t_int32 ch = reson->diff_cnt; ch < 8; ch++) { reson->diff_mult[index_arr[ch]] = 0.0; };
-      t_int32 ch = 8;
-      while ((ch--) && (reson->diff_mult[ch] != 1.0)) {; }
+    { reson->diff_cnt = MIN(reson->diff_sto, x->chan_cnt);
+      t_int32 index_arr[CHAN_MAX];
+      for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { index_arr[ch] = ch; }
+      random_n_of_m(reson->diff_cnt, x->chan_cnt, index_arr);
+      for (t_int32 ch = 0; ch < reson->diff_cnt; ch++) { reson->diff_targ[index_arr[ch]] = 1.0; };
+      for (t_int32 ch = reson->diff_cnt; ch < x->chan_cnt; ch++) { reson->diff_targ[index_arr[ch]] = 0.0; };
+      t_int32 ch = x->chan_cnt;
+      while ((ch--) && (reson->diff_targ[ch] != 1.0)) {; }
       reson->diff_ind = ch;
+      _diff_snap(x, reson);
     }
       break;
 
+    // Continuous gains, set from a matrix, a dictionary or a panning function
+    // They are interpolated by the mixing kernel and persist across modes
     case MODE_DIFF_MATR: break;
     case MODE_DIFF_FUNC: break;
   }
@@ -59,6 +66,72 @@ void st_act_diff(t_modal* x, t_bank* bank, t_resonator* reson, t_mode* mode) {
   }
 }
 
+// ====  METHOD: _DIFF_SNAP  ====
+// Set the diffusion gains to their target values, ending any interpolation
+
+void _diff_snap(t_modal* x, t_resonator* reson) {
+
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_mult[ch] = reson->diff_targ[ch]; }
+  reson->diff_cntd = 0;
+}
+
+// ====  METHOD: _DIFF_ARR_SET  ====
+// Point the diffusion gains of an array of resonators into the bank storage:
+// chan_cnt current gains followed by chan_cnt target gains per resonator
+
+void _diff_arr_set(t_modal* x, t_resonator* reson_arr, t_double* diff_arr, t_int32 reson_cnt) {
+
+  for (t_int32 res = 0; res < reson_cnt; res++) {
+    reson_arr[res].diff_mult = diff_arr + 2 * x->chan_cnt * res;
+    reson_arr[res].diff_targ = diff_arr + 2 * x->chan_cnt * res + x->chan_cnt;
+  }
+}
+
+// ====  METHOD: _DIFF_TARG  ====
+// Start interpolating towards new target diffusion gains, over the bank ramp time
+// Also sets the channel index and count used for monitoring
+
+void _diff_targ(t_modal* x, t_bank* bank, t_resonator* reson) {
+
+  t_double g_max = 0.0;
+
+  reson->diff_ind = 0;
+  reson->diff_cnt = 0;
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    if (reson->diff_targ[ch] != 0.0) { reson->diff_cnt++; }
+    if (reson->diff_targ[ch] > g_max) { g_max = reson->diff_targ[ch]; reson->diff_ind = ch; }
+  }
+
+  reson->diff_chg = false;
+  reson->diff_cntd = bank->diff_ramp;
+  if (reson->diff_cntd <= 0) { _diff_snap(x, reson); }
+}
+
+// ====  METHOD: _DIFF_PAN  ====
+// Panning function: equal power panning over a ring of channels
+//   azim:    position on the ring, 0 to 1 for a full turn
+//   spread:  0 to pan between adjacent channels, up to 1 to spread over all channels
+
+void _diff_pan(t_modal* x, t_bank* bank, t_resonator* reson, t_double azim, t_double spread) {
+
+  t_double pos = x->chan_cnt * (azim - floor(azim));
+  t_double width = 1 + CLAMP(spread, 0, 1) * (x->chan_cnt - 1);
+  t_double dist = 0.0, sum_sqr = 0.0;
+
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    dist = fabs(pos - ch);
+    dist = MIN(dist, x->chan_cnt - dist);
+    reson->diff_targ[ch] = (dist < width) ? cos(PI * dist / (2 * width)) : 0.0;
+    sum_sqr += reson->diff_targ[ch] * reson->diff_targ[ch];
+  }
+
+  // Normalize to constant power
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] /= sqrt(sum_sqr); }
+
+  reson->diff_type = MODE_DIFF_FUNC;
+  _diff_targ(x, bank, reson);
+}
+
 // ====  METHOD:  MODE_NEW  ====
 
 void _mode_new(t_modal* x, t_bank* bank) {
@@ -238,6 +311,56 @@ void _mode_iterate(t_modal* x, t_bank* bank, t_resonator* reson) {
   }
 }
 
+// ====  _MODE_COUNTDOWN  ====
+
+//******************************************************************************
+//  Advance the countdown, the mode changes and the input amplitude ramps of a
+//  resonator over a number of samples, as the perform routine does over a
+//  vector, without rendering it. Used by the renderers that do not run the
+//  recursion sample by sample.
+//  Returns the mean input amplitude over the samples, 0 if the resonator is off.
+//
+t_double _mode_countdown(t_modal* x, t_bank* bank, t_resonator* reson, t_int32 len) {
+
+  t_int32 counter = len;
+  t_int32 chunk_len = 0;
+  t_int32 counter_x_vel = 0;
+  t_int32 cntd_d_vel = 0;
+  t_double in_A_sum = 0.0;
+  t_double tmp = 0.0;
+
+  while (counter) {
+
+    counter_x_vel = (t_int32)(counter * bank->velocity);
+    cntd_d_vel = (t_int32)(reson->cntd / bank->velocity);
+    if ((cntd_d_vel == 0) && (reson->cntd != 0)) { cntd_d_vel = 1; }
+
+    if (bank->is_frozen) { chunk_len = len; counter = 0; }
+    else if (reson->cntd == 0) { goto MODE_COUNTDOWN_CHANGE; }
+    else if (reson->cntd == INDEFINITE) { chunk_len = counter; counter = 0; }
+    else if (reson->cntd > counter_x_vel) { chunk_len = counter; counter = 0; reson->cntd -= counter_x_vel; }
+    else { chunk_len = cntd_d_vel; counter -= chunk_len; reson->cntd = 0; }
+
+    if (reson->mode_type == MODE_TYPE_OFF) { }
+
+    else if ((reson->mode_type == MODE_TYPE_FIX) || (bank->is_frozen) || (reson->cntd == INDEFINITE)) {
+      in_A_sum += reson->in_A_cur * chunk_len;
+    }
+
+    else if (reson->mode_type == MODE_TYPE_VAR_A) {
+      reson->in_U_cur += chunk_len * (reson->in_U_targ - reson->in_U_cur) / cntd_d_vel;
+      tmp = x->ramp_func(reson->in_U_cur, x->ramp_param);
+      in_A_sum += 0.5 * (reson->in_A_cur + tmp) * chunk_len;
+      reson->in_A_cur = tmp;
+    }
+
+  MODE_COUNTDOWN_CHANGE:
+    if (reson->cntd == 0) { _mode_iterate(x, bank, reson); }
+  }
+
+  return in_A_sum / len;
+}
+
 // ====  METHOD:  MODE_ALL_ON  ====
 
 void mode_all_on(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
@@ -555,6 +678,9 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   t_bank* bank = bank_find(x, argv, sym);
   if (bank == NULL) { MY_ERR("%s:  Invalid arguments:  Arg 0: bank not found.", sym->s_name); return; }
 
+  // The impulse responses of a bank rendered by convolution include the diffusion gains
+  bank->conv_targ = false;
+
   // ==== Applying command to ALL resonators
 
   // The second argument can be the symbol "all"
@@ -572,15 +698,17 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       t_int32 ch = -1;
 
       if ((argc == 4) && (atom_gettype(argv + 3) == A_LONG)
-          && ((ch = (t_int32)atom_getlong(argv + 3)) >= 0) && (ch <= 7)) {
+          && ((ch = (t_int32)atom_getlong(argv + 3)) >= 0) && (ch < x->chan_cnt)) {
 
         for (t_int32 res = 0; res < bank->reson_cnt; res++) {
           reson = bank->reson_arr + res;
           reson->diff_type = MODE_DIFF_ONE_S;
           reson->diff_ind = ch;
+          reson->diff_sto = ch;
           reson->diff_cnt = 1;
-          for (t_int32 ch2 = 0; ch2 < 8; ch2++) { reson->diff_mult[ch2] = 0; }
-          reson->diff_mult[reson->diff_ind] = 1;
+          for (t_int32 ch2 = 0; ch2 < x->chan_cnt; ch2++) { reson->diff_targ[ch2] = 0; }
+          reson->diff_targ[reson->diff_ind] = 1;
+          _diff_snap(x, reson);
         }
       }
 
@@ -590,7 +718,7 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     // == Output to one set channel
     if (cmd == gensym("1to1")) {
 
-      for (t_int32 bk = 0; bk < 8; bk++) {
+      for (t_int32 bk = 0; bk < MIN(x->bank_cnt, x->chan_cnt); bk++) {
         t_bank* bank2 = x->bank_arr + bk;
 
         for (t_int32 res = 0; res < bank2->reson_cnt; res++) {
@@ -599,8 +727,9 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
           reson->diff_type = MODE_DIFF_ONE_S;
           reson->diff_ind = bk;
           reson->diff_cnt = 1;
-          for (t_int32 ch2 = 0; ch2 < 8; ch2++) { reson->diff_mult[ch2] = 0; }
-          reson->diff_mult[reson->diff_ind] = 1;
+          for (t_int32 ch2 = 0; ch2 < x->chan_cnt; ch2++) { reson->diff_targ[ch2] = 0; }
+          reson->diff_targ[reson->diff_ind] = 1;
+          _diff_snap(x, reson);
         }
       }
     }
@@ -619,7 +748,7 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       t_int32 ch = -1;
 
       if ((argc == 4) && (atom_gettype(argv + 3) == A_LONG)
-          && ((ch = (t_int32)atom_getlong(argv + 3)) >= 0) && (ch <= 7)) {
+          && ((ch = (t_int32)atom_getlong(argv + 3)) >= 0) && (ch < x->chan_cnt)) {
 
         for (t_int32 res = 0; res < bank->reson_cnt; res++) {
           reson = bank->reson_arr + res;
@@ -637,7 +766,7 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       t_int32 nb = -1;
 
       if ((argc == 4) && (atom_gettype(argv + 3) == A_LONG)
-          && ((nb = (t_int32)atom_getlong(argv + 3)) >= 1) && (nb <= 8)) {
+          && ((nb = (t_int32)atom_getlong(argv + 3)) >= 1) && (nb <= x->chan_cnt)) {
         for (t_int32 res = 0; res < bank->reson_cnt; res++) {
           reson = bank->reson_arr + res;
 
@@ -658,6 +787,87 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       else { MY_ERR("%s:  Invalid arguments for \"%s\" command.", sym->s_name, cmd->s_name); return; }
     }
 
+    // == Continuous gains from a matrix: one gain per channel for all, or per resonator in index order
+    else if (cmd == gensym("matrix")) {
+
+      if ((argc - 3 != x->chan_cnt) && (argc - 3 != x->chan_cnt * bank->reson_cnt)) {
+        MY_ERR("%s:  Invalid arguments for \"%s\" command:  %i or %i gains expected.",
+          sym->s_name, cmd->s_name, x->chan_cnt, x->chan_cnt * bank->reson_cnt);
+        return;
+      }
+
+      t_int32 stride = (argc - 3 == x->chan_cnt) ? 0 : x->chan_cnt;
+      for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+        reson = bank->reson_arr + res;
+        for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] = atom_getfloat(argv + 3 + res * stride + ch); }
+        reson->diff_type = MODE_DIFF_MATR;
+        _diff_targ(x, bank, reson);
+      }
+    }
+
+    // == Continuous gains from an array in a dictionary: one gain per channel for all, or per resonator
+    else if (cmd == gensym("dict")) {
+
+      if ((argc != 4) && (argc != 5)) {
+        MY_ERR("%s:  Invalid arguments for \"%s\" command:  dictionary name and optional key expected.", sym->s_name, cmd->s_name);
+        return;
+      }
+
+      t_dictionary* dict = dictobj_findregistered_retain(atom_getsym(argv + 3));
+      if (!dict) { MY_ERR("%s:  There is no dictionary %s.", sym->s_name, atom_getsym(argv + 3)->s_name); return; }
+
+      t_atom* atom_arr = NULL;
+      long    atom_cnt = 0;
+      dictionary_getatoms(dict, (argc == 5) ? atom_getsym(argv + 4) : gensym("gains"), &atom_cnt, &atom_arr);
+
+      if ((atom_arr == NULL) || ((atom_cnt != x->chan_cnt) && (atom_cnt != x->chan_cnt * bank->reson_cnt))) {
+        MY_ERR("%s:  The dictionary array should hold %i or %i gains.", sym->s_name, x->chan_cnt, x->chan_cnt * bank->reson_cnt);
+      }
+
+      else {
+        t_int32 stride = (atom_cnt == x->chan_cnt) ? 0 : x->chan_cnt;
+        for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+          reson = bank->reson_arr + res;
+          for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] = atom_getfloat(atom_arr + res * stride + ch); }
+          reson->diff_type = MODE_DIFF_MATR;
+          _diff_targ(x, bank, reson);
+        }
+      }
+
+      dictobj_release(dict);
+    }
+
+    // == Continuous gains from the panning function
+    // The optional width spreads the resonators around the azimuth by order of frequency
+    else if (cmd == gensym("pan")) {
+
+      if ((argc < 4) || (argc > 6)) {
+        MY_ERR("%s:  Invalid arguments for \"%s\" command:  azimuth [spread] [width] expected.", sym->s_name, cmd->s_name);
+        return;
+      }
+
+      t_double azim   = atom_getfloat(argv + 3);
+      t_double spread = (argc >= 5) ? atom_getfloat(argv + 4) : 0.0;
+      t_double width  = (argc == 6) ? atom_getfloat(argv + 5) : 0.0;
+
+      for (t_int32 ind = 0; ind < bank->reson_cnt; ind++) {
+        reson = bank->reson_arr + bank->sort_freq[ind];
+        _diff_pan(x, bank, reson, azim + width * ind / bank->reson_cnt, spread);
+      }
+    }
+
+    // == Interpolation time for continuous gains
+    else if (cmd == gensym("ramp")) {
+
+      if ((argc == 4) && ((atom_gettype(argv + 3) == A_LONG) || (atom_gettype(argv + 3) == A_FLOAT))
+          && (atom_getfloat(argv + 3) >= 0)) {
+        bank->diff_ramp_ms = atom_getfloat(argv + 3);
+        bank->diff_ramp = (t_int32)(bank->diff_ramp_ms * x->msr);
+      }
+
+      else { MY_ERR("%s:  Invalid arguments for \"%s\" command.", sym->s_name, cmd->s_name); return; }
+    }
+
     else { MY_ERR("%s:  Invalid command.", sym->s_name); return; }
   }
 
@@ -684,7 +894,7 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       t_int32 ch = -1;
 
       if ((argc == 4) && (atom_gettype(argv + 3) == A_LONG)
-          && ((ch = (t_int32)atom_getlong(argv + 3)) >= 0) && (ch <= 7)) {
+          && ((ch = (t_int32)atom_getlong(argv + 3)) >= 0) && (ch < x->chan_cnt)) {
         reson->diff_type = MODE_DIFF_ONE_S;
         reson->diff_sto  = ch;
         reson->diff_chg  = true;
@@ -698,7 +908,7 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       t_int32 nb = -1;
 
       if ((argc == 4) && (atom_gettype(argv + 3) == A_LONG)
-          && ((nb = (t_int32)atom_getlong(argv + 3)) >= 1) && (nb <= 8)) {
+          && ((nb = (t_int32)atom_getlong(argv + 3)) >= 1) && (nb <= x->chan_cnt)) {
 
         if (nb == 1) {
           if (cmd == gensym("rand"))  { reson->diff_type = MODE_DIFF_ONE_R; }
@@ -716,6 +926,28 @@ void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       else { MY_ERR("%s:  Invalid arguments for \"%s\" command.", sym->s_name, cmd->s_name); return; }
     }
 
+    // == Continuous gains for the resonator: one gain per channel
+    else if (cmd == gensym("gains")) {
+
+      if (argc == 3 + x->chan_cnt) {
+        for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch] = atom_getfloat(argv + 3 + ch); }
+        reson->diff_type = MODE_DIFF_MATR;
+        _diff_targ(x, bank, reson);
+      }
+
+      else { MY_ERR("%s:  Invalid arguments for \"%s\" command:  %i gains expected.", sym->s_name, cmd->s_name, x->chan_cnt); return; }
+    }
+
+    // == Continuous gains from the panning function
+    else if (cmd == gensym("pan")) {
+
+      if ((argc == 4) || (argc == 5)) {
+        _diff_pan(x, bank, reson, atom_getfloat(argv + 3), (argc == 5) ? atom_getfloat(argv + 4) : 0.0);
+      }
+
+      else { MY_ERR("%s:  Invalid arguments for \"%s\" command:  azimuth [spread] expected.", sym->s_name, cmd->s_name); return; }
+    }
+
     else { MY_ERR("%s:  Invalid command.", sym->s_name); return; }
   }
 }
@@ -831,8 +1063,9 @@ void mode_resonator(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   // Send out a message to indicate resonator information
   t_atom mess_arr[4];
   atom_setlong(mess_arr, atom_getlong(argv + 1));
-  atom_setfloat(mess_arr + 1, reson->ampl_ref);
-  atom_setfloat(mess_arr + 2, reson->freq_ref);
-  atom_setfloat(mess_arr + 3, reson->decay_ref);
+  t_int32 res = (t_int32)(reson - bank->reson_arr);
+  atom_setfloat(mess_arr + 1, bank->model->ampl_ref[res]);
+  atom_setfloat(mess_arr + 2, bank->model->freq_ref[res]);
+  atom_setfloat(mess_arr + 3, bank->model->decay_ref[res]);
   outlet_anything(x->outl_mess, gensym("reson"), 4, mess_arr);
 }
@@ -0,0 +1,158 @@
+#include "modal~.h"
+
+// ====  _PHASOR_UPDATE  ====
+
+//******************************************************************************
+//  Calculate the coefficients of the phasor kernel from the parameters
+//  The two pole filter  y(n) = a0 x(n) + b1 y(n-1) + b2 y(n-2)  with poles
+//  p and p* is split into partial fractions: y(n) = 2 Re(u(n)), with
+//    u(n) = p u(n-1) + c x(n),  p = r e^(j theta),  c = a0 p / (p - p*)
+//  The impulse responses are identical, so the kernels are energy matched.
+//  Modulating the frequency or decay only multiplies p by a complex step.
+//
+void _phasor_update(t_modal* x, t_resonator* reson) {
+
+  t_double r = exp(-reson->decay / x->samplerate);
+  t_double theta = TWOPI * reson->freq / x->samplerate;
+  t_double sin_t = sin(theta);
+
+  // Avoid the division at 0 and nyquist, where the pole is real
+  if (fabs(sin_t) < 1e-9) { sin_t = (sin_t < 0) ? -1e-9 : 1e-9; }
+
+  reson->p_re = r * cos(theta);
+  reson->p_im = r * sin(theta);
+
+  // c = a0 e^(j theta) / (2j sin(theta)) = a0 / 2 - j a0 cos(theta) / (2 sin(theta))
+  reson->c_re = 0.5 * reson->a0;
+  reson->c_im = -0.5 * reson->a0 * cos(theta) / sin_t;
+}
+
+// ====  _PHASOR_FROM_BIQUAD  ====
+
+//******************************************************************************
+//  Convert the state of a resonator from the biquad to the phasor kernel
+//  With no input between the two samples:  u(n-2) = u(n-1) / p
+//    2 Re(u(n-1)) = y(n-1)  and  2 Re(u(n-1) / p) = y(n-2)
+//
+void _phasor_from_biquad(t_resonator* reson) {
+
+  t_double r2 = reson->p_re * reson->p_re + reson->p_im * reson->p_im;
+
+  reson->u_re = 0.5 * reson->y_m1;
+  reson->u_im = (fabs(reson->p_im) > 1e-12)
+    ? (0.5 * reson->y_m2 * r2 - reson->u_re * reson->p_re) / reson->p_im
+    : 0.0;
+}
+
+// ====  _PHASOR_TO_BIQUAD  ====
+
+//******************************************************************************
+//  Convert the state of a resonator from the phasor to the biquad kernel
+//
+void _phasor_to_biquad(t_resonator* reson) {
+
+  t_double r2 = reson->p_re * reson->p_re + reson->p_im * reson->p_im;
+
+  reson->y_m1 = 2 * reson->u_re;
+  reson->y_m2 = (r2 > 0) ? 2 * (reson->u_re * reson->p_re + reson->u_im * reson->p_im) / r2 : 0.0;
+}
+
+// ====  _KERNEL_SWITCH  ====
+
+//******************************************************************************
+//  Convert the states of all the resonators to the kernel set by the attribute
+//  Called by the perform routine, so that the switch happens between blocks
+//
+void _kernel_switch(t_modal* x) {
+
+  t_bank* bank = NULL;
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    bank = x->bank_arr + bnk;
+
+    // The inverse FFT synthesis keeps the states in the phasor form
+    if (bank->ifft_active) { continue; }
+
+    for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+
+      // The resonators at decimated rates are always in the phasor form
+      if ((bank->reson_arr + res)->rate_cls) { continue; }
+
+      if (x->kernel == KERNEL_PHASOR) { _phasor_from_biquad(bank->reson_arr + res); }
+      else                            { _phasor_to_biquad(bank->reson_arr + res); }
+    }
+  }
+
+  x->kernel_cur = x->kernel;
+}
+
+// ====  _RESON_PHASOR  ====
+
+//******************************************************************************
+//  Render a chunk of a resonator with the phasor kernel
+//  The input amplitude is ramped by dA per sample, 0 for a fixed resonator
+//
+void _reson_phasor(t_resonator* reson, t_double* in, t_double* buf, t_int32 len,
+  t_double dA, t_double gain, t_double* sum_sqr) {
+
+  t_double p_re = reson->p_re, p_im = reson->p_im;
+  t_double c_re = reson->c_re, c_im = reson->c_im;
+  t_double u_re = reson->u_re, u_im = reson->u_im;
+  t_double in_A = reson->in_A_cur;
+  t_double sum = 0.0;
+  t_double tmp = 0.0;
+  t_double xin = 0.0;
+
+  for (t_int32 smp = 0; smp < len; smp++) {
+    xin = in[smp] * in_A;
+    in_A += dA;
+
+    // Rotate and decay the phasor, and add the input
+    tmp  = p_re * u_re - p_im * u_im + c_re * xin;
+    u_im = p_re * u_im + p_im * u_re + c_im * xin;
+    u_re = tmp;
+
+    tmp = 2 * u_re;
+    sum += tmp * tmp;
+    buf[smp] = tmp * gain;
+  }
+
+  reson->u_re = u_re;
+  reson->u_im = u_im;
+  reson->in_A_cur = in_A;
+  *sum_sqr += sum;
+}
+
+// ====  _RESON_PHASOR_ZERO_INPUT  ====
+
+//******************************************************************************
+//  Render a chunk of a resonator with the phasor kernel and no input, except
+//  an optional impulse, as _reson_zero_input does for the biquad kernel
+//    imp_pos:  position of the impulse in the chunk, no impulse if out of the chunk
+//    imp:      input value of the impulse, including the input amplitude
+//
+void _reson_phasor_zero_input(t_resonator* reson, t_double* buf, t_int32 len, t_double gain,
+  t_double* sum_sqr, t_int32 imp_pos, t_double imp) {
+
+  t_double p_re = reson->p_re, p_im = reson->p_im;
+  t_double u_re = reson->u_re, u_im = reson->u_im;
+  t_double sum = 0.0;
+  t_double tmp = 0.0;
+
+  for (t_int32 smp = 0; smp < len; smp++) {
+    tmp  = p_re * u_re - p_im * u_im;
+    u_im = p_re * u_im + p_im * u_re;
+    u_re = tmp;
+
+    // The impulse
+    if (smp == imp_pos) { u_re += reson->c_re * imp; u_im += reson->c_im * imp; }
+
+    tmp = 2 * u_re;
+    sum += tmp * tmp;
+    buf[smp] = tmp * gain;
+  }
+
+  reson->u_re = u_re;
+  reson->u_im = u_im;
+  *sum_sqr += sum;
+}
@@ -0,0 +1,413 @@
+#include "modal~.h"
+
+// ====  RATE_MULTIRATE  ====
+
+//******************************************************************************
+//  Render the low resonators of a bank at decimated rates
+//  multirate (bank) (int: 0 or 1)
+//  The resonators are grouped into octave band classes using the frequency
+//  order of the bank: under 1/8 of the sample rate at half rate, under 1/16 at
+//  a quarter, and under 1/32 at an eighth. A class with too few resonators is
+//  merged into the class above. The ringing of the resonators is aligned with
+//  the ones at full rate, but their onsets are smeared by a few ms.
+//
+void rate_multirate(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("rate_multirate");
+
+  MY_ASSERT(argc != 2, "multirate:  2 args expected:  multirate (bank) (int: 0 or 1)");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "multirate:  Arg 0:  Bank not found.");
+
+  // Argument 1 should be 0 or 1
+  MY_ASSERT(atom_gettype(argv + 1) != A_LONG, "multirate:  Arg 1:  0 or 1 expected.");
+  t_atom_long use = atom_getlong(argv + 1);
+  MY_ASSERT((use != 0) && (use != 1), "multirate:  Arg 1:  0 or 1 expected.");
+
+  // Back to the full rate, at the next perform cycle
+  if (use == 0) {
+    bank->rate_use = false;
+    if (bank->rate) { bank->rate->dirty = true; }
+    return;
+  }
+
+  MY_ASSERT(bank->conv_use, "multirate:  The bank is set to be rendered by convolution.");
+  MY_ASSERT((bank->ifft_targ) || (bank->ifft_active) || (bank->ifft_new), "multirate:  The bank is rendered by inverse FFT.");
+  MY_ASSERT(x->vec_max == 0, "multirate:  The DSP has not been started.");
+
+  // The buffers are allocated once, for the maximum vector size
+  if (!bank->rate) {
+    bank->rate = _rate_new(x);
+    if (!bank->rate) { return; }
+  }
+
+  bank->rate_use = true;
+  bank->rate->dirty = true;
+}
+
+// ====  _RATE_NEW  ====
+
+//******************************************************************************
+//  Allocate the buffers of the rate classes, and design the halfband filter:
+//  a windowed sinc with a passband to 1/8 and a stopband from 3/8 of the rate
+//  of its input, and every other tap at 0.
+//  Returns NULL on failure.
+//
+t_rate* _rate_new(t_modal* x) {
+
+  TRACE("_rate_new");
+
+  t_int32 half = RATE_TAPS / 2;
+  t_int32 size = 0;
+  t_double* ptr = NULL;
+  t_double sum = 0.0, win = 0.0;
+
+  t_rate* rate = (t_rate*)sysmem_newptrclear(sizeof(t_rate));
+  MY_ASSERT_RETURN(!rate, NULL, "multirate:  Failed to allocate the rate classes.");
+
+  rate->vec_max = x->vec_max;
+  rate->vec = 0;
+  rate->cls_max = 0;
+  rate->cls_run = 0;
+  rate->flush = 0;
+  rate->dirty = true;
+
+  // Input of each class and output of each decimated class and channel
+  for (t_int32 cls = 0; cls <= RATE_CLS_MAX; cls++) {
+    size += RATE_TAPS - 1 + (x->vec_max >> cls);
+    if (cls > 0) { size += x->chan_cnt * (half + (x->vec_max >> cls)); }
+  }
+
+  rate->mem = (t_double*)sysmem_newptrclear(sizeof(t_double) * size);
+  rate->cls_ind = (t_int32*)sysmem_newptrclear(sizeof(t_int32) * x->reson_max);
+  if (!rate->mem || !rate->cls_ind) {
+    MY_ERR("multirate:  Failed to allocate the rate classes.");
+    _rate_free(rate);
+    return NULL;
+  }
+
+  ptr = rate->mem;
+  for (t_int32 cls = 0; cls <= RATE_CLS_MAX; cls++) {
+    rate->in_arr[cls] = ptr;
+    ptr += RATE_TAPS - 1 + (x->vec_max >> cls);
+    if (cls == 0) { continue; }
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      rate->out_arr[cls][ch] = ptr;
+      ptr += half + (x->vec_max >> cls);
+    }
+  }
+
+  // Halfband filter: Blackman window, normalized for a unit gain at DC
+  for (t_int32 n = 0; n < RATE_TAPS; n++) {
+    t_int32 k = n - half;
+    win = 0.42 - 0.5 * cos(TWOPI * (n + 1) / (RATE_TAPS + 1)) + 0.08 * cos(2 * TWOPI * (n + 1) / (RATE_TAPS + 1));
+    rate->hb[n] = (k % 2) ? win * sin(PI * k / 2) / (PI * k) : 0.0;
+    sum += rate->hb[n];
+  }
+  for (t_int32 n = 0; n < RATE_TAPS; n++) { rate->hb[n] *= 0.5 / sum; }
+  rate->hb[half] = 0.5;
+
+  return rate;
+}
+
+// ====  _RATE_FREE  ====
+
+void _rate_free(t_rate* rate) {
+
+  if (rate->mem)     { sysmem_freeptr(rate->mem); }
+  if (rate->cls_ind) { sysmem_freeptr(rate->cls_ind); }
+
+  sysmem_freeptr(rate);
+}
+
+// ====  _RATE_POW  ====
+
+//******************************************************************************
+//  Power of the pole of a resonator:  p^e = r^e e^(j theta e)
+//
+static __inline void _rate_pow(t_modal* x, t_resonator* reson, t_double e, t_double* re, t_double* im) {
+
+  t_double r = exp(-reson->decay * e / x->samplerate);
+  t_double theta = TWOPI * reson->freq * e / x->samplerate;
+
+  *re = r * cos(theta);
+  *im = r * sin(theta);
+}
+
+// ====  _RATE_COEFS  ====
+
+//******************************************************************************
+//  Coefficients of the phasor kernel of a resonator at the rate of its class
+//  At the sample rate divided by D, the pole is p^D, and the input
+//  coefficient is D c, as the input is band limited. The decimation and
+//  interpolation filters delay the class by tau = (RATE_TAPS - 1) (D - 1)
+//  samples, compensated by advancing the response: the input coefficient is
+//  multiplied by p^tau, so that the ringing stays aligned with full rate.
+//  Called by reson_update.
+//
+void _rate_coefs(t_modal* x, t_resonator* reson) {
+
+  t_int32 D = 1 << reson->rate_cls;
+  t_double tau_re = 0.0, tau_im = 0.0;
+
+  _rate_pow(x, reson, D, &reson->rate_p_re, &reson->rate_p_im);
+  _rate_pow(x, reson, (RATE_TAPS - 1) * (D - 1), &tau_re, &tau_im);
+
+  reson->rate_c_re = D * (reson->c_re * tau_re - reson->c_im * tau_im);
+  reson->rate_c_im = D * (reson->c_re * tau_im + reson->c_im * tau_re);
+}
+
+// ====  _RATE_MOVE  ====
+
+//******************************************************************************
+//  Move a resonator to another rate class, converting its state
+//  The state of a class is in the phasor form, and it is the state at full
+//  rate advanced by e = (RATE_TAPS / 2 - 1) (D - 1) samples: the delay of the
+//  class, less the decimation delay and the length of a decimated sample.
+//
+void _rate_move(t_modal* x, t_resonator* reson, t_int32 cls) {
+
+  if (reson->rate_cls == cls) { return; }
+
+  t_int32 e_old = (RATE_TAPS / 2 - 1) * ((1 << reson->rate_cls) - 1);
+  t_int32 e_new = (RATE_TAPS / 2 - 1) * ((1 << cls) - 1);
+  t_double p_re = 0.0, p_im = 0.0, tmp = 0.0;
+
+  if ((reson->rate_cls == 0) && (x->kernel_cur == KERNEL_BIQUAD)) { _phasor_from_biquad(reson); }
+
+  _rate_pow(x, reson, e_new - e_old, &p_re, &p_im);
+  tmp = p_re * reson->u_re - p_im * reson->u_im;
+  reson->u_im = p_re * reson->u_im + p_im * reson->u_re;
+  reson->u_re = tmp;
+
+  reson->rate_cls = cls;
+
+  if (cls > 0) { _rate_coefs(x, reson); }
+  else if (x->kernel_cur == KERNEL_BIQUAD) { _phasor_to_biquad(reson); }
+}
+
+// ====  _RATE_ASSIGN  ====
+
+//******************************************************************************
+//  Assign the resonators to the rate classes, in the perform routine
+//  A class is used if the vector size is divisible by its rate division, and
+//  if it fits the buffers, allocated for the vector size when the rendering
+//  was first set.
+//  The filters of the classes that are not used anymore run until flushed,
+//  and the ones of the classes that start to be used are cleared.
+//
+static void _rate_assign(t_modal* x, t_bank* bank, long sampleframes) {
+
+  t_rate* rate = bank->rate;
+  t_resonator* reson = NULL;
+  t_int32 cnt[RATE_CLS_MAX + 1];
+  t_int32 cls_lim = 0;
+  t_int32 cls = 0;
+
+  rate->vec = (t_int32)sampleframes;
+
+  if ((bank->rate_use) && (sampleframes <= rate->vec_max)) {
+    while ((cls_lim < RATE_CLS_MAX) && (sampleframes % (2 << cls_lim) == 0)) { cls_lim++; }
+  }
+
+  // Count the resonators under the limit of each class:  1/4 of the rate of the class
+  for (cls = 0; cls <= RATE_CLS_MAX; cls++) { cnt[cls] = 0; }
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+    cls = 0;
+    while ((cls < cls_lim) && (reson->freq > 0.0) && (reson->freq < x->samplerate / (4 << (cls + 1)))) { cls++; }
+    cnt[cls]++;
+  }
+
+  // Merge the classes with too few resonators into the class above
+  for (cls = cls_lim; cls > 0; cls--) {
+    if (cnt[cls] < RATE_MIN) { cnt[cls - 1] += cnt[cls]; cnt[cls] = 0; }
+  }
+
+  // Move the resonators, and group them by class in order of frequency
+  rate->cls_beg[0] = 0;
+  for (cls = 0; cls <= RATE_CLS_MAX; cls++) { rate->cls_beg[cls + 1] = rate->cls_beg[cls] + cnt[cls]; cnt[cls] = 0; }
+
+  for (t_int32 i = 0; i < bank->reson_cnt; i++) {
+    reson = bank->reson_arr + bank->sort_freq[i];
+    cls = 0;
+    while ((cls < cls_lim) && (reson->freq > 0.0) && (reson->freq < x->samplerate / (4 << (cls + 1)))) { cls++; }
+    while ((cls > 0) && (rate->cls_beg[cls + 1] == rate->cls_beg[cls])) { cls--; }
+    _rate_move(x, reson, cls);
+    rate->cls_ind[rate->cls_beg[cls] + cnt[cls]++] = bank->sort_freq[i];
+  }
+
+  // Highest class used
+  for (rate->cls_max = RATE_CLS_MAX; rate->cls_max > 0; rate->cls_max--) {
+    if (rate->cls_beg[rate->cls_max + 1] > rate->cls_beg[rate->cls_max]) { break; }
+  }
+
+  // Flush the filters of the classes not used anymore, unless the buffers are too short
+  if (sampleframes > rate->vec_max) { rate->cls_run = 0; }
+  if (rate->cls_max < rate->cls_run) { rate->flush = RATE_TAPS << RATE_CLS_MAX; }
+
+  // Clear the filters of the classes starting to be used
+  for (cls = rate->cls_run + 1; cls <= rate->cls_max; cls++) {
+    for (t_int32 i = 0; i < RATE_TAPS - 1; i++) { rate->in_arr[cls - 1][i] = 0.0; }
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      for (t_int32 i = 0; i < RATE_TAPS / 2; i++) { rate->out_arr[cls][ch][i] = 0.0; }
+    }
+  }
+  rate->cls_run = MAX(rate->cls_run, rate->cls_max);
+}
+
+// ====  _RATE_DECIMATE  ====
+
+//******************************************************************************
+//  Halfband decimation by 2, keeping the history of the input
+//  src:  RATE_TAPS - 1 samples of history, then len samples
+//  dst:  len / 2 samples
+//
+static void _rate_decimate(t_rate* rate, t_double* src, t_double* dst, t_int32 len) {
+
+  t_double* in = src + RATE_TAPS - 1;
+  t_double acc = 0.0;
+
+  for (t_int32 k = 0; k < len / 2; k++) {
+    acc = 0.5 * in[2 * k - RATE_TAPS / 2];
+    for (t_int32 n = 0; n < RATE_TAPS; n += 2) { acc += rate->hb[n] * in[2 * k - n]; }
+    dst[k] = acc;
+  }
+
+  for (t_int32 i = 0; i < RATE_TAPS - 1; i++) { src[i] = src[len + i]; }
+}
+
+// ====  _RATE_INTERPOLATE  ====
+
+//******************************************************************************
+//  Halfband interpolation by 2, added to the destination, keeping the history
+//  The odd outputs only need the center tap.
+//  src:  RATE_TAPS / 2 samples of history, then len samples
+//  dst:  2 len samples
+//
+static void _rate_interpolate(t_rate* rate, t_double* src, t_double* dst, t_int32 len) {
+
+  t_double* in = src + RATE_TAPS / 2;
+  t_double acc = 0.0;
+
+  for (t_int32 j = 0; j < len; j++) {
+    acc = 0.0;
+    for (t_int32 n = 0; n < RATE_TAPS; n += 2) { acc += rate->hb[n] * in[j - n / 2]; }
+    dst[2 * j] += 2 * acc;
+    dst[2 * j + 1] += in[j - RATE_TAPS / 4];
+  }
+
+  for (t_int32 i = 0; i < RATE_TAPS / 2; i++) { src[i] = src[len + i]; }
+}
+
+// ====  _RATE_PERFORM  ====
+
+//******************************************************************************
+//  Render the decimated classes of a bank, called before the resonators at
+//  full rate, which skip the resonators of the classes.
+//  The countdowns and mode changes run at full rate, and the input amplitude
+//  is ramped linearly over the vector.
+//  in:  input of the bank, with the exciters
+//  gain:  gain of the bank
+//
+void _rate_perform(t_modal* x, t_bank* bank, t_double* in, t_double** outs, long sampleframes, t_double gain) {
+
+  t_rate* rate = bank->rate;
+  t_resonator* reson = NULL;
+  t_double* outs_cls[CHAN_MAX];
+  t_double* dst = NULL;
+  t_double* row = NULL;
+  t_double* in_cls = NULL;
+  t_double A = 0.0, dA = 0.0, g = 0.0, sum_sqr = 0.0, tmp = 0.0, u_re = 0.0, u_im = 0.0;
+  t_bool is_on = false;
+  t_int32 len = 0;
+  t_int32 tile_cnt = 0;
+
+  if ((rate->dirty) || (sampleframes != rate->vec)) { rate->dirty = false; _rate_assign(x, bank, sampleframes); }
+  if (rate->cls_run == 0) { return; }
+
+  // Input at full rate, with the impulse of the zero input path
+  dst = rate->in_arr[0] + RATE_TAPS - 1;
+  if (bank->in_silent) { for (t_int32 smp = 0; smp < sampleframes; smp++) { dst[smp] = 0.0; } }
+  else                 { for (t_int32 smp = 0; smp < sampleframes; smp++) { dst[smp] = in[smp]; } }
+  if (bank->imp_ofs >= 0) { dst[bank->imp_ofs] += bank->imp_ampl; }
+
+  // Decimate the input through the classes
+  for (t_int32 cls = 1; cls <= rate->cls_run; cls++) {
+    _rate_decimate(rate, rate->in_arr[cls - 1], rate->in_arr[cls] + RATE_TAPS - 1, (t_int32)sampleframes >> (cls - 1));
+  }
+
+  // Render the resonators of each class, and mix them into the outputs of the class
+  for (t_int32 cls = 1; cls <= rate->cls_run; cls++) {
+
+    len = (t_int32)sampleframes >> cls;
+    in_cls = rate->in_arr[cls] + RATE_TAPS - 1;
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      outs_cls[ch] = rate->out_arr[cls][ch] + RATE_TAPS / 2;
+      for (t_int32 smp = 0; smp < len; smp++) { outs_cls[ch][smp] = 0.0; }
+    }
+
+    if (cls > rate->cls_max) { continue; }
+
+    for (t_int32 i = rate->cls_beg[cls]; i < rate->cls_beg[cls + 1]; i++) {
+      reson = bank->reson_arr + rate->cls_ind[i];
+
+      // Run the countdown at full rate
+      A = reson->in_A_cur;
+      is_on = (reson->mode_type != MODE_TYPE_OFF);
+      _mode_countdown(x, bank, reson, (t_int32)sampleframes);
+      is_on |= (reson->mode_type != MODE_TYPE_OFF);
+
+      sum_sqr = 0.0;
+
+      if ((is_on) && ((!reson->skip) || (reson->skip_A != 0.0))) {
+
+        // Phasor kernel at the rate of the class
+        row = x->mix_buf + tile_cnt * x->vec_max;
+        dA = (reson->in_A_cur - A) / len;
+        g = gain * reson->out_A_cur;
+        u_re = reson->u_re;
+        u_im = reson->u_im;
+
+        for (t_int32 smp = 0; smp < len; smp++) {
+          tmp = reson->rate_p_re * u_re - reson->rate_p_im * u_im + reson->rate_c_re * A * in_cls[smp];
+          u_im = reson->rate_p_re * u_im + reson->rate_p_im * u_re + reson->rate_c_im * A * in_cls[smp];
+          u_re = tmp;
+          A += dA;
+          sum_sqr += 4 * u_re * u_re;
+          row[smp] = 2 * u_re * g;
+        }
+
+        reson->u_re = u_re;
+        reson->u_im = u_im;
+
+        if ((reson->skip) || (reson->skip_A != 1.0)) { _skip_fade(x, reson, row, len, 1 << cls); }
+
+        x->mix_tile[tile_cnt++] = reson;
+        if (tile_cnt == MIX_TILE) { x->mix_func(x, outs_cls, tile_cnt, len, 1 << cls); tile_cnt = 0; }
+      }
+
+      reson->rms = x->a_smoothing * sqrt(sum_sqr / len) + (1 - x->a_smoothing) * reson->rms;
+      bank->rms_sum += reson->rms;
+    }
+
+    if (tile_cnt) { x->mix_func(x, outs_cls, tile_cnt, len, 1 << cls); tile_cnt = 0; }
+  }
+
+  // Interpolate the outputs from the lowest class up, and add them to the outputs
+  for (t_int32 cls = rate->cls_run; cls > 0; cls--) {
+    len = (t_int32)sampleframes >> cls;
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      dst = (cls == 1) ? outs[ch] : rate->out_arr[cls - 1][ch] + RATE_TAPS / 2;
+      _rate_interpolate(rate, rate->out_arr[cls][ch], dst, len);
+    }
+  }
+
+  // Stop the filters of the classes not used anymore, once flushed
+  if (rate->cls_run > rate->cls_max) {
+    rate->flush -= (t_int32)sampleframes;
+    if (rate->flush <= 0) { rate->cls_run = rate->cls_max; }
+  }
+}
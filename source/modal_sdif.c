@@ -0,0 +1,392 @@
+#include "modal~.h"
+
+// ====  _SDIF_U32  ====
+
+//******************************************************************************
+//  Values of SDIF files, which are big endian
+//
+static t_uint32 _sdif_u32(const t_uint8* ptr) {
+
+  return ((t_uint32)ptr[0] << 24) | ((t_uint32)ptr[1] << 16) | ((t_uint32)ptr[2] << 8) | (t_uint32)ptr[3];
+}
+
+static t_double _sdif_f64(const t_uint8* ptr) {
+
+  t_uint64 bits = ((t_uint64)_sdif_u32(ptr) << 32) | _sdif_u32(ptr + 4);
+  t_double val;
+  memcpy(&val, &bits, sizeof(t_double));
+  return val;
+}
+
+static t_double _sdif_f32(const t_uint8* ptr) {
+
+  t_uint32 bits = _sdif_u32(ptr);
+  t_float val;
+  memcpy(&val, &bits, sizeof(t_float));
+  return val;
+}
+
+// ====  _SDIF_READ  ====
+
+//******************************************************************************
+//  Read a number of bytes at a position of the file
+//  Returns true if they were all read
+//
+static t_bool _sdif_read(t_filehandle file_handle, t_ptr_size pos, void* buf, t_ptr_size len) {
+
+  t_ptr_size cnt = len;
+  if (sysfile_setpos(file_handle, SYSFILE_FROMSTART, (t_ptr_int)pos) != MAX_ERR_NONE) { return false; }
+  return (sysfile_read(file_handle, &cnt, buf) == MAX_ERR_NONE) && (cnt == len);
+}
+
+// ====  _SDIF_FRAME  ====
+
+//******************************************************************************
+//  Find the next resonance or track frame from a position of the file
+//  The other frames, and the header chunks, are skipped from their size.
+//  frame->pos:  position of a frame header, set to the position of the frame found
+//  sig:  signature of the frame to find, or "" for the first 1RES or 1TRC frame
+//  Returns true if a frame is found
+//
+static t_bool _sdif_frame(t_filehandle file_handle, t_ptr_size eof, char* sig, t_sdif_frame* frame) {
+
+  t_uint8 head[SDIF_FRAME];
+
+  while (frame->pos + SDIF_FRAME <= eof) {
+
+    if (!_sdif_read(file_handle, frame->pos, head, SDIF_FRAME)) { return false; }
+    frame->size = 8 + (t_ptr_size)_sdif_u32(head + 4);
+    if (frame->size < SDIF_FRAME) { return false; }
+
+    t_bool is_model = (!memcmp(head, "1RES", 4)) || (!memcmp(head, "1TRC", 4));
+    if ((is_model) && ((!sig[0]) || (!memcmp(head, sig, 4)))) {
+      if (!sig[0]) { memcpy(sig, head, 4); }
+      frame->time = _sdif_f64(head + 8);
+      frame->stream_id = (t_int32)_sdif_u32(head + 16);
+      frame->mat_cnt = (t_int32)_sdif_u32(head + 20);
+      return true;
+    }
+
+    frame->pos += frame->size;
+  }
+
+  return false;
+}
+
+// ====  _SDIF_MATRIX  ====
+
+//******************************************************************************
+//  Read the first matrix of a frame with the signature of the frame
+//  Three columns are kept per row: frequency, amplitude and bandwidth for 1RES,
+//  and index, frequency and amplitude for 1TRC. The matrix is read in blocks of
+//  SDIF_ROWS rows, or if it has more than SDIF_COLS columns, row by row reading
+//  only the first three columns, so that the memory used does not depend on
+//  the number of columns.
+//  param_arr:  receives the rows, allocated here, 3 values per row
+//  Returns ERR_NONE, ERR_COUNT if there are too many rows, ERR_ALLOC, or ERR_SYNTAX
+//
+static t_my_err _sdif_matrix(t_modal* x, t_filehandle file_handle, t_ptr_size eof, const char* sig,
+  t_sdif_frame* frame, t_double** param_arr, t_int32* row_cnt) {
+
+  t_uint8 head[SDIF_MATRIX];
+  t_ptr_size pos = frame->pos + SDIF_FRAME;
+
+  for (t_int32 mat = 0; mat < frame->mat_cnt; mat++) {
+
+    if ((pos + SDIF_MATRIX > eof) || (!_sdif_read(file_handle, pos, head, SDIF_MATRIX))) { return ERR_SYNTAX; }
+    pos += SDIF_MATRIX;
+
+    t_uint32 type = _sdif_u32(head + 4);
+    t_int32 rows = (t_int32)_sdif_u32(head + 8);
+    t_int32 cols = (t_int32)_sdif_u32(head + 12);
+    t_int32 elem = (t_int32)(type & 0xFF);
+    if ((rows < 0) || (cols < 0)) { return ERR_SYNTAX; }
+
+    // Divide rather than multiply, as the product of the sizes can overflow
+    t_ptr_size row_size = (t_ptr_size)cols * elem;
+    if ((row_size) && ((t_ptr_size)rows > (eof - pos) / row_size)) { return ERR_SYNTAX; }
+    t_ptr_size size = (t_ptr_size)rows * row_size;
+    t_ptr_size size_pad = (size + 7) & ~(t_ptr_size)7;
+
+    // Another matrix, or one with values that are not floats
+    if ((memcmp(head, sig, 4)) || ((type != 0x0004) && (type != 0x0008)) || (cols < 3) || (rows < 1)) {
+      pos += size_pad;
+      continue;
+    }
+
+    if (rows > x->reson_max) {
+      MY_ERR("sdif:  Invalid number of resonators: %i. Expected: 1 to %i.", rows, x->reson_max);
+      return ERR_COUNT;
+    }
+
+    // Blocks of whole rows, or the first three columns of one row at a time
+    t_int32 block = (cols <= SDIF_COLS) ? SDIF_ROWS : 1;
+    t_int32 stride = (cols <= SDIF_COLS) ? cols : 3;
+
+    *param_arr = (t_double*)sysmem_newptr(sizeof(t_double) * 3 * rows);
+    t_uint8* buf = (t_uint8*)sysmem_newptr((long)elem * stride * block);
+    if ((!*param_arr) || (!buf)) {
+      if (buf) { sysmem_freeptr(buf); }
+      return ERR_ALLOC;
+    }
+
+    for (t_int32 row = 0; row < rows; row += block) {
+      t_int32 cnt = MIN(block, rows - row);
+      if (!_sdif_read(file_handle, pos + row_size * row, buf, (t_ptr_size)elem * stride * cnt)) { sysmem_freeptr(buf); return ERR_SYNTAX; }
+
+      for (t_int32 r = 0; r < cnt; r++) {
+        for (t_int32 c = 0; c < 3; c++) {
+          const t_uint8* ptr = buf + (t_ptr_size)elem * (stride * r + c);
+          (*param_arr)[3 * (row + r) + c] = (elem == 8) ? _sdif_f64(ptr) : _sdif_f32(ptr);
+        }
+      }
+    }
+
+    sysmem_freeptr(buf);
+    *row_cnt = rows;
+    return ERR_NONE;
+  }
+
+  return ERR_SYNTAX;
+}
+
+// ====  _SDIF_COMPARE  ====
+
+//******************************************************************************
+//  Order of the track rows by index, to match the tracks of two frames
+//
+static int _sdif_compare(const void* ptr1, const void* ptr2) {
+
+  t_double ind1 = ((const t_double*)ptr1)[0];
+  t_double ind2 = ((const t_double*)ptr2)[0];
+  return (ind1 < ind2) ? -1 : (ind1 > ind2) ? 1 : 0;
+}
+
+// ====  _SDIF_IS_SDIF  ====
+
+//******************************************************************************
+//  Test if an open file starts with the signature of SDIF files
+//  The position is set back to the start of the file.
+//
+t_bool _sdif_is_sdif(t_filehandle file_handle) {
+
+  char magic[4];
+  t_ptr_size len = 4;
+  t_bool is_sdif = (sysfile_read(file_handle, &len, magic) == MAX_ERR_NONE) && (!memcmp(magic, SDIF_MAGIC, 4));
+
+  sysfile_setpos(file_handle, SYSFILE_FROMSTART, 0);
+  return is_sdif;
+}
+
+// ====  _SDIF_IMPORT  ====
+
+//******************************************************************************
+//  Import a resonance or track frame of a SDIF file into a bank
+//  Called by the worker thread. The file is scanned frame by frame, and only
+//  the selected matrix is read, so the memory used does not depend on the
+//  size of the file.
+//  frame_ind:  index of the frame, or -1 to select by time
+//  time:  time in s, the last frame at or before it is selected, or the first frame
+//  is_rate:  the third column of 1RES is a decay rate instead of a bandwidth
+//  1RES:  frequency, amplitude, bandwidth in Hz:  decay = pi x bandwidth
+//  1TRC:  index, frequency, amplitude, with the decay of each track estimated
+//         from its amplitude in the next frame of the same stream
+//  Returns ERR_NONE on success
+//
+t_my_err _sdif_import(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path,
+  t_int32 frame_ind, t_double time, t_bool is_rate) {
+
+  TRACE("_sdif_import");
+
+  t_filehandle file_handle = NULL;
+  t_double* param_arr = NULL;
+  t_double* next_arr = NULL;
+  t_my_err err = ERR_NONE;
+
+  // The key of the model includes the selection of the frame
+  char key[CACHE_KEY];
+  t_uint64 stamp = 0;
+  t_bool is_key = _cache_key_file(key, file_name, file_path, &stamp);
+  if (is_key) {
+    t_ptr_size len = strlen(key);
+    if (frame_ind >= 0) { snprintf(key + len, CACHE_KEY - len, "|sdif:%i:%i", frame_ind, is_rate); }
+    else { snprintf(key + len, CACHE_KEY - len, "|sdif:%.9g:%i", time, is_rate); }
+    if (_cache_fetch(x, bank, name, key, stamp)) { return ERR_NONE; }
+  }
+
+  if (path_opensysfile(file_name, file_path, &file_handle, PATH_READ_PERM)) {
+    MY_ERR("sdif:  Failed to open the file %s.", file_name); return ERR_ARG_VALUE;
+  }
+
+  t_ptr_size eof = 0;
+  sysfile_geteof(file_handle, &eof);
+
+  // The file header:  "SDIF", its size, then the version
+  t_uint8 head[8];
+  if ((!_sdif_read(file_handle, 0, head, 8)) || (memcmp(head, SDIF_MAGIC, 4))) {
+    MY_ERR("sdif:  %s is not a SDIF file.", file_name); err = ERR_SYNTAX; goto SDIF_IMPORT_END;
+  }
+
+  // Select the frame:  by index, or the last one at or before the time
+  char sig[5] = "";
+  t_sdif_frame frame = { 8 + (t_ptr_size)_sdif_u32(head + 4), 0, 0.0, 0, 0 };
+  t_sdif_frame sel = frame;
+  t_bool is_sel = false;
+
+  for (t_int32 ind = 0; _sdif_frame(file_handle, eof, sig, &frame); ind++) {
+    if (frame_ind >= 0) {
+      if (ind == frame_ind) { sel = frame; is_sel = true; break; }
+    }
+    else {
+      if ((is_sel) && (frame.time > time)) { break; }
+      sel = frame; is_sel = true;
+    }
+    frame.pos += frame.size;
+  }
+
+  if (!is_sel) {
+    MY_ERR("sdif:  %s:  No 1RES or 1TRC frame found at this index or time.", file_name); err = ERR_ARG_VALUE; goto SDIF_IMPORT_END;
+  }
+
+  t_int32 nb = 0;
+  err = _sdif_matrix(x, file_handle, eof, sig, &sel, &param_arr, &nb);
+  if (err == ERR_SYNTAX) { MY_ERR("sdif:  %s:  Invalid or truncated frame.", file_name); }
+  if (err != ERR_NONE) { goto SDIF_IMPORT_END; }
+
+  // Infinite, NaN and negative values are rejected, except for the track indexes
+  t_int32 col_pos = (!memcmp(sig, "1RES", 4)) ? 0 : 1;
+  for (t_int32 ind = 0; ind < 3 * nb; ind++) {
+    if ((!isfinite(param_arr[ind])) || ((ind % 3 >= col_pos) && (param_arr[ind] < 0))) {
+      MY_ERR("sdif:  %s:  Row %i:  Infinite, NaN or negative value.", file_name, ind / 3);
+      err = ERR_SYNTAX; goto SDIF_IMPORT_END;
+    }
+  }
+
+  // Resonances:  frequency, amplitude and bandwidth into amplitude, frequency and decay
+  if (!memcmp(sig, "1RES", 4)) {
+    for (t_int32 row = 0; row < nb; row++) {
+      t_double* param = param_arr + 3 * row;
+      t_double freq = param[0];
+      param[0] = param[1];
+      param[1] = freq;
+      param[2] = (is_rate) ? param[2] : PI * param[2];
+    }
+  }
+
+  // Tracks:  the decay is estimated from the next frame of the same stream
+  else {
+    t_sdif_frame next = sel;
+    t_int32 next_cnt = 0;
+    t_bool is_next = false;
+    next.pos += next.size;
+    while (_sdif_frame(file_handle, eof, sig, &next)) {
+      if (next.stream_id == sel.stream_id) { is_next = true; break; }
+      next.pos += next.size;
+    }
+
+    if ((is_next) && (next.time > sel.time)
+      && (_sdif_matrix(x, file_handle, eof, sig, &next, &next_arr, &next_cnt) == ERR_NONE)) {
+      qsort(next_arr, next_cnt, 3 * sizeof(t_double), _sdif_compare);
+    }
+    else { next_cnt = 0; }
+
+    for (t_int32 row = 0; row < nb; row++) {
+      t_double* param = param_arr + 3 * row;
+      t_double* param_next = (next_cnt) ? (t_double*)bsearch(param, next_arr, next_cnt, 3 * sizeof(t_double), _sdif_compare) : NULL;
+      t_double ampl = param[2];
+
+      param[0] = ampl;
+      param[2] = SDIF_DECAY_DEF;
+      if ((param_next) && (param_next[2] > 0) && (param_next[2] < ampl)) {
+        param[2] = log(ampl / param_next[2]) / (next.time - sel.time);
+      }
+    }
+  }
+
+  // Free the existing bank and create a new one
+  bank_free(x, bank);
+  if (bank_new(x, bank, nb) == ERR_ALLOC) { err = ERR_ALLOC; goto SDIF_IMPORT_END; }
+
+  bank->name = name;
+  bank->gain = 1.0;
+
+  t_model* model = bank->model;
+  for (t_int32 res = 0; res < nb; res++) {
+    model->ampl_ref[res]  = param_arr[3 * res];
+    model->freq_ref[res]  = param_arr[3 * res + 1];
+    model->decay_ref[res] = param_arr[3 * res + 2];
+  }
+
+  bank_update(x, bank);
+  bank_sort(x, bank);
+
+  if (is_key) { _cache_store(bank, key, stamp); }
+
+  SDIF_IMPORT_END:
+  if (file_handle) { sysfile_close(file_handle); }
+  if (param_arr)   { sysmem_freeptr(param_arr); }
+  if (next_arr)    { sysmem_freeptr(next_arr); }
+  return err;
+}
+
+// ====  SDIF_IMPORT  ====
+
+//******************************************************************************
+//  Import a frame of a SDIF file into a bank
+//  sdif (bank) (sym: name) [sym: file name] [int: frame index / float: time in s] [sym: rate]
+//  The first frame is imported by default. With "rate" the third column of
+//  the 1RES matrices is a decay rate, otherwise it is a bandwidth in Hz.
+//  The import runs on the worker thread, and the reply is:
+//  sdif (bank) (name) (count) (gain)
+//
+void sdif_import(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("sdif_import");
+
+  MY_ASSERT((argc < 2) || (argc > 5),
+    "sdif:  2 to 5 args expected:  sdif (bank) (sym: name) [sym: file name] [int: frame index / float: time in s] [sym: rate]");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "sdif:  Arg 0:  Bank not found.");
+
+  // Argument 1 should be the name of the new bank
+  t_symbol* name = atom_getsym(argv + 1);
+  MY_ASSERT(name == gensym(""), "sdif:  Arg 1:  Symbol expected for the name of the bank.");
+
+  t_load extra = { 0 };
+  extra.sdif_frame = 0;
+  t_symbol* file_sym = NULL;
+
+  // The optional arguments in any order
+  for (t_int32 arg = 2; arg < argc; arg++) {
+    t_atom* atom = argv + arg;
+
+    if (atom_gettype(atom) == A_LONG) {
+      extra.sdif_frame = (t_int32)atom_getlong(atom);
+      MY_ASSERT(extra.sdif_frame < 0, "sdif:  Arg %i:  Positive int expected for the frame index.", arg);
+    }
+    else if (atom_gettype(atom) == A_FLOAT) {
+      extra.sdif_frame = -1;
+      extra.sdif_time = atom_getfloat(atom);
+    }
+    else if (atom_getsym(atom) == gensym("rate")) { extra.sdif_rate = true; }
+    else if ((atom_gettype(atom) == A_SYM) && (!file_sym)) { file_sym = atom_getsym(atom); }
+    else { MY_ERR("sdif:  Arg %i:  Invalid argument.", arg); return; }
+  }
+
+  char     file_name[MAX_FILENAME_CHARS];
+  short    file_path;
+  t_fourcc file_type = FOUR_CHAR_CODE('SDIF');
+
+  // The file name, otherwise open a dialog box
+  if (file_sym) {
+    MY_ASSERT(path_frompathname(file_sym->s_name, &file_path, file_name), "sdif:  Invalid path and file name.");
+  }
+  else {
+    open_promptset("Choose a SDIF file with resonance or track frames.");
+    if (open_dialog(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+  }
+
+  _load_queue(x, bank, LOAD_SDIF, name, file_name, file_path, &extra);
+}
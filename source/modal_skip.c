@@ -0,0 +1,262 @@
+#include "modal~.h"
+
+// ====  _SKIP_FADE  ====
+
+//******************************************************************************
+//  Fade the row of a resonator out when it is skipped, or in when it is restored
+//  The fade multiplier is ramped linearly over the cycle, over SKIP_FADE ms
+//  Once faded out, the state of the resonator is cleared, so that it is
+//  restored from silence, and it is not rendered anymore.
+//  decim:  rate division of the row, 1 at the sample rate
+//
+void _skip_fade(t_modal* x, t_resonator* reson, t_double* row, long sampleframes, t_int32 decim) {
+
+  t_double targ = (reson->skip) ? 0.0 : 1.0;
+  if (reson->skip_A == targ) { return; }
+
+  t_double step = sampleframes * decim / (SKIP_FADE * x->msr);
+  t_double A_end = (targ > reson->skip_A) ? MIN(reson->skip_A + step, 1.0) : MAX(reson->skip_A - step, 0.0);
+  t_double dA = (A_end - reson->skip_A) / sampleframes;
+
+  for (t_int32 smp = 0; smp < sampleframes; smp++) { row[smp] *= reson->skip_A + dA * smp; }
+
+  reson->skip_A = A_end;
+  if (reson->skip_A == 0.0) { reson->y_m1 = 0.0; reson->y_m2 = 0.0; reson->u_re = 0.0; reson->u_im = 0.0; }
+}
+
+// ====  _BUDGET_UPDATE  ====
+
+//******************************************************************************
+//  Called at the end of each perform cycle when the CPU budget is set
+//  Measures the load: the time spent as a fraction of the block period
+//  Over budget, the fraction of culled resonators increases quickly, and it
+//  decreases slowly once the load is back under a fraction of the budget.
+//  The same fraction of lowest priority resonators is culled in each bank.
+//
+void _budget_update(t_modal* x, t_double time_ms, long sampleframes) {
+
+  // Measure the load: fast increase and smoothed decrease
+  t_double load = time_ms * x->msr / sampleframes;
+  x->load = (load > x->load) ? load : BUDGET_SMOOTH * x->load + (1 - BUDGET_SMOOTH) * load;
+
+  // Budget disabled: restore all resonators
+  if (x->budget <= 0) { x->cull_frac = 0.0; x->load = 0.0; }
+
+  // Over budget: cull more resonators
+  else if (x->load > x->budget) { x->cull_frac = MIN(x->cull_frac + CULL_STEP_UP, CULL_MAX); }
+
+  // Under budget with some headroom: restore resonators
+  else if (x->load < x->budget * BUDGET_HYST) { x->cull_frac = MAX(x->cull_frac - CULL_STEP_DOWN, 0.0); }
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) { _bank_cull(x, x->bank_arr + bnk); }
+}
+
+// ====  _BANK_CULL  ====
+
+//******************************************************************************
+//  Flag the lowest priority resonators of a bank as culled, according to the
+//  culled fraction. Only done when the number of culled resonators changes.
+//
+void _bank_cull(t_modal* x, t_bank* bank) {
+
+  t_int32 cull_cnt = (t_int32)(x->cull_frac * bank->reson_cnt);
+  if (cull_cnt == bank->cull_cnt) { return; }
+
+  t_resonator* reson = NULL;
+  for (t_int32 rank = 0; rank < bank->reson_cnt; rank++) {
+    reson = bank->reson_arr + bank->sort_prio[rank];
+    if (rank >= bank->reson_cnt - cull_cnt) { reson->skip |= SKIP_CULL; }
+    else { reson->skip &= ~SKIP_CULL; }
+  }
+
+  bank->cull_cnt = cull_cnt;
+}
+
+// ====  SKIP_LOD  ====
+
+//******************************************************************************
+//  Set the level of detail of a bank: only the most significant resonators,
+//  ranked by amplitude, are rendered. The others are faded out, and the gain
+//  of the bank is renormalized so that the loudness stays roughly constant.
+//  lod (bank) (int: count)
+//  lod (bank) db (float: threshold in dB under the loudest resonator)
+//  lod (bank) frac (float: fraction of the resonators, 0 to 1)
+//  lod (bank) off
+//
+void skip_lod(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("skip_lod");
+
+  MY_ASSERT((argc != 2) && (argc != 3), "lod:  2 or 3 args expected:  lod (bank) (int: count) | db (float) | frac (float) | off");
+
+  // Argument 0 should reference a bank
+  t_bank* bank = bank_find(x, argv, sym);
+  MY_ASSERT(!bank, "lod:  Arg 0:  Bank not found.");
+
+  // A number of resonators
+  if ((argc == 2) && (atom_gettype(argv + 1) == A_LONG)) {
+    MY_ASSERT(atom_getlong(argv + 1) < 0, "lod:  Arg 1:  Positive int expected.");
+    bank->lod_type = LOD_CNT;
+    bank->lod_val = (t_double)atom_getlong(argv + 1);
+  }
+
+  // Off: render all resonators
+  else if ((argc == 2) && (atom_getsym(argv + 1) == gensym("off"))) {
+    bank->lod_type = LOD_OFF;
+  }
+
+  // A threshold in dB
+  else if ((argc == 3) && (atom_getsym(argv + 1) == gensym("db"))) {
+    bank->lod_type = LOD_DB;
+    bank->lod_val = -fabs(atom_getfloat(argv + 2));
+  }
+
+  // A fraction of the resonators
+  else if ((argc == 3) && (atom_getsym(argv + 1) == gensym("frac"))) {
+    bank->lod_type = LOD_FRAC;
+    bank->lod_val = CLAMP(atom_getfloat(argv + 2), 0, 1);
+  }
+
+  else { MY_ERR("lod:  Invalid arguments:  lod (bank) (int: count) | db (float) | frac (float) | off"); return; }
+
+  _bank_lod(x, bank);
+}
+
+// ====  _BANK_LOD  ====
+
+//******************************************************************************
+//  Flag the resonators of a bank outside of the level of detail, and set the
+//  gain that compensates for the energy of the skipped resonators.
+//  Called when the level of detail is set, and when the bank is updated or sorted.
+//
+void _bank_lod(t_modal* x, t_bank* bank) {
+
+  t_resonator* reson = NULL;
+  t_int32 lod_cnt = bank->reson_cnt;
+
+  // The threshold is relative to the current loudest resonator, as ampl_max is only set when sorting
+  t_double ampl_ref = (bank->reson_cnt > 0) ? (bank->reson_arr + bank->sort_ampl[0])->a0 : 0.0;
+
+  // The number of resonators to render, ranked by amplitude
+  switch (bank->lod_type) {
+  case LOD_CNT:  lod_cnt = (t_int32)bank->lod_val; break;
+  case LOD_FRAC: lod_cnt = (t_int32)ceil(bank->lod_val * bank->reson_cnt); break;
+  case LOD_DB:
+    lod_cnt = 0;
+    while ((lod_cnt < bank->reson_cnt)
+      && ((bank->reson_arr + bank->sort_ampl[lod_cnt])->a0 >= ampl_ref * pow(10, bank->lod_val / 20))) { lod_cnt++; }
+    break;
+  default: break;
+  }
+  lod_cnt = CLAMP(lod_cnt, 0, bank->reson_cnt);
+
+  // Flag the resonators, and sum the energy of all and of the rendered resonators
+  t_double sum_all = 0.0, sum_lod = 0.0;
+  for (t_int32 rank = 0; rank < bank->reson_cnt; rank++) {
+    reson = bank->reson_arr + bank->sort_ampl[rank];
+    sum_all += reson->a0 * reson->a0;
+    if (rank < lod_cnt) { reson->skip &= ~SKIP_LOD; sum_lod += reson->a0 * reson->a0; }
+    else { reson->skip |= SKIP_LOD; }
+  }
+
+  // Gain renormalization, limited to avoid boosting a few quiet resonators too much
+  bank->lod_cnt = lod_cnt;
+  bank->lod_gain = (sum_lod > 0) ? MIN(sqrt(sum_all / sum_lod), LOD_GAIN_MAX) : 1.0;
+}
+
+// ====  _BANK_PRUNE  ====
+
+//******************************************************************************
+//  Flag the resonators of a bank that are useless to render:
+//    - above the Nyquist frequency, or at a negative frequency, as they alias
+//    - more than PRUNE_DB under the loudest resonator of the bank
+//    - with a near zero or negative decay, as they do not decay or are unstable
+//  Pruned resonators are cut without fading, as they are not meaningful.
+//  Called by bank_update, so re-evaluated when the multipliers or the
+//  samplerate change. Streamed banks are not pruned.
+//
+void _bank_prune(t_modal* x, t_bank* bank) {
+
+  t_double ampl_thr = 0.0;
+
+  // The loudest resonator of the bank
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    ampl_thr = MAX(ampl_thr, fabs((bank->reson_arr + res)->a0));
+  }
+  bank->prune_thr = ampl_thr * pow(10, -PRUNE_DB / 20.0);
+
+  _bank_prune_flag(x, bank);
+}
+
+// ====  _BANK_PRUNE_FLAG  ====
+
+//******************************************************************************
+//  Flag the pruned resonators against the amplitude threshold of the bank
+//  Also called on its own when only the frequencies change, as the threshold
+//  does not depend on them.
+//
+void _bank_prune_flag(t_modal* x, t_bank* bank) {
+
+  t_resonator* reson = NULL;
+  t_double nyquist = x->samplerate / 2;
+
+  bank->prune_freq = 0;
+  bank->prune_ampl = 0;
+  bank->prune_decay = 0;
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+
+    if ((reson->freq >= nyquist) || (reson->freq <= 0)) { bank->prune_freq++; }
+    else if (fabs(reson->a0) < bank->prune_thr) { bank->prune_ampl++; }
+    else if (reson->decay < PRUNE_DECAY_MIN) { bank->prune_decay++; }
+
+    // Not pruned
+    else {
+      reson->skip &= ~SKIP_PRUNE;
+      continue;
+    }
+
+    // Pruned: cut without fading
+    reson->skip |= SKIP_PRUNE;
+    reson->skip_A = 0.0;
+    reson->y_m1 = 0.0;
+    reson->y_m2 = 0.0;
+    reson->u_re = 0.0;
+    reson->u_im = 0.0;
+  }
+}
+
+// ====  SKIP_PRUNED  ====
+
+//******************************************************************************
+//  Report the number of pruned resonators, for one or all banks
+//  Output:  pruned (int: bank) (int: total) (int: above Nyquist) (int: too quiet) (int: decay)
+//  pruned [bank]
+//
+void skip_pruned(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("skip_pruned");
+
+  t_atom mess_arr[5];
+  t_bank* bank = NULL;
+  t_int32 first = 0;
+  t_int32 last = x->bank_cnt - 1;
+
+  // One bank, or all banks
+  if (argc > 0) {
+    bank = bank_find(x, argv, sym);
+    MY_ASSERT(!bank, "pruned:  Arg 0:  Bank not found.");
+    first = last = (t_int32)(bank - x->bank_arr);
+  }
+
+  for (t_int32 bnk = first; bnk <= last; bnk++) {
+    bank = x->bank_arr + bnk;
+    atom_setlong(mess_arr, bnk);
+    atom_setlong(mess_arr + 1, bank->prune_freq + bank->prune_ampl + bank->prune_decay);
+    atom_setlong(mess_arr + 2, bank->prune_freq);
+    atom_setlong(mess_arr + 3, bank->prune_ampl);
+    atom_setlong(mess_arr + 4, bank->prune_decay);
+    outlet_anything(x->outl_mess, gensym("pruned"), 5, mess_arr);
+  }
+}
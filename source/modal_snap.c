@@ -0,0 +1,737 @@
+#include "modal~.h"
+
+// ====  _SNAP_INIT  ====
+
+//******************************************************************************
+//  Initialize the snapshots, called by modal_new
+//
+void _snap_init(t_modal* x) {
+
+  for (t_int32 ind = 0; ind < SNAP_MAX; ind++) {
+    x->snap_arr[ind].name = NULL;
+    x->snap_arr[ind].head = NULL;
+    x->snap_arr[ind].model_arr = NULL;
+  }
+
+  x->snap_stage = SNAP_IDLE;
+  x->snap_bank_arr = NULL;
+  x->snap_qelem = qelem_new(x, (method)_snap_main);
+}
+
+// ====  _SNAP_CLEAR  ====
+
+//******************************************************************************
+//  Free the blob and release the models of a snapshot
+//
+static void _snap_clear(t_snapshot* snap) {
+
+  if (snap->model_arr) {
+    for (t_int32 bnk = 0; bnk < snap->head->bank_cnt; bnk++) {
+      if (snap->model_arr[bnk]) { _model_release(snap->model_arr[bnk]); }
+    }
+    sysmem_freeptr(snap->model_arr);
+  }
+  if (snap->head) { sysmem_freeptr(snap->head); }
+
+  snap->name = NULL;
+  snap->head = NULL;
+  snap->model_arr = NULL;
+}
+
+// ====  _SNAP_RELEASE  ====
+
+//******************************************************************************
+//  Free the banks of a recall: not installed yet, or replaced
+//  Called with the mutex of the loads locked.
+//
+static void _snap_release(t_modal* x) {
+
+  if (x->snap_bank_arr) {
+    for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) { bank_free(x, x->snap_bank_arr + bnk); }
+    sysmem_freeptr(x->snap_bank_arr);
+  }
+
+  x->snap_bank_arr = NULL;
+  x->snap_stage = SNAP_IDLE;
+}
+
+// ====  _SNAP_FREE  ====
+
+//******************************************************************************
+//  Free the snapshots and the recall in progress, called by modal_free
+//  The DSP is stopped, the mutex is not needed.
+//
+void _snap_free(t_modal* x) {
+
+  for (t_int32 ind = 0; ind < SNAP_MAX; ind++) { _snap_clear(x->snap_arr + ind); }
+  _snap_release(x);
+
+  qelem_free(x->snap_qelem);
+}
+
+// ====  _SNAP_FIND  ====
+
+//******************************************************************************
+//  Find a snapshot by name
+//  Returns the snapshot, or NULL
+//
+static t_snapshot* _snap_find(t_modal* x, t_symbol* name) {
+
+  for (t_int32 ind = 0; ind < SNAP_MAX; ind++) {
+    if (x->snap_arr[ind].name == name) { return x->snap_arr + ind; }
+  }
+  return NULL;
+}
+
+// ====  _SNAP_SLOT  ====
+
+//******************************************************************************
+//  The snapshot with a name, emptied, or a free slot
+//  Returns the slot, or NULL if all the slots are used
+//
+static t_snapshot* _snap_slot(t_modal* x, t_symbol* name) {
+
+  t_snapshot* snap = _snap_find(x, name);
+  if (!snap) { snap = _snap_find(x, NULL); }
+  if (snap) { _snap_clear(snap); }
+
+  return snap;
+}
+
+// ====  _SNAP_BANK_SIZE  ====
+
+//******************************************************************************
+//  Size of the record of a bank in the blob
+//  The bank is followed by its resonators, its diffusion gains, the reference
+//  parameters and the sort permutations of its model: all multiples of 8 bytes.
+//
+static t_ptr_size _snap_bank_size(t_modal* x, t_int32 reson_cnt) {
+
+  return sizeof(t_snap_bank) + (t_ptr_size)reson_cnt
+    * (sizeof(t_resonator) + sizeof(t_double) * (2 * x->chan_cnt + 3) + sizeof(t_int32) * 4);
+}
+
+// ====  _SNAP_BUILD  ====
+
+//******************************************************************************
+//  Serialize the object into a new blob
+//  The states of the filters are set to 0 unless they are kept.
+//  Returns the blob, or NULL
+//
+static t_snap_head* _snap_build(t_modal* x, t_symbol* name, t_bool filters) {
+
+  t_ptr_size size = sizeof(t_snap_head);
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) { size += _snap_bank_size(x, (x->bank_arr + bnk)->reson_cnt); }
+  for (t_int32 st = 0; st < x->state_cnt; st++) {
+    size += sizeof(t_snap_state) + sizeof(t_double) * 2 * MAX((x->state_arr + st)->cnt, 0);
+  }
+
+  t_snap_head* head = (t_snap_head*)sysmem_newptrclear((long)size);
+  if (!head) { return NULL; }
+
+  memcpy(head->magic, SNAP_MAGIC, 4);
+  head->version = SNAP_VERSION;
+  head->order = FILE_ORDER;
+  head->flags = filters ? SNAP_FILTERS : 0;
+  head->size = size;
+  head->bank_size = sizeof(t_bank);
+  head->reson_size = sizeof(t_resonator);
+  head->bank_cnt = x->bank_cnt;
+  head->chan_cnt = x->chan_cnt;
+  head->state_cnt = x->state_cnt;
+  head->kernel = (t_int32)x->kernel_cur;
+  head->samplerate = x->samplerate;
+  head->master = x->master;
+  head->ramp_param = x->ramp_param;
+  head->voice_first = (x->voice_cnt) ? x->voice_first : 0;
+  head->voice_cnt = x->voice_cnt;
+  head->voice_ref = x->voice_ref;
+  head->voice_freq_mult = x->voice_freq_mult;
+  strncpy(head->name, name->s_name, FILE_NAME - 1);
+
+  char* ptr = (char*)(head + 1);
+
+  // The banks: the structures, then the arrays
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    t_bank* bank = x->bank_arr + bnk;
+    t_int32 cnt = bank->reson_cnt;
+    t_snap_bank* rec = (t_snap_bank*)ptr;
+
+    rec->size = _snap_bank_size(x, cnt);
+    rec->reson_cnt = cnt;
+    rec->ifft_size = (bank->ifft) ? bank->ifft->size : 0;
+    rec->model_gain = bank->model->gain;
+    strncpy(rec->name, bank->name->s_name, FILE_NAME - 1);
+    rec->bank = *bank;
+
+    t_resonator* reson_arr = (t_resonator*)(rec + 1);
+    t_double* diff_arr = (t_double*)(reson_arr + cnt);
+    t_double* param_arr = diff_arr + 2 * x->chan_cnt * cnt;
+    t_int32* sort_arr = (t_int32*)(param_arr + 3 * cnt);
+
+    memcpy(reson_arr, bank->reson_arr, sizeof(t_resonator) * cnt);
+    memcpy(diff_arr, bank->diff_arr, sizeof(t_double) * 2 * x->chan_cnt * cnt);
+    memcpy(param_arr, bank->model->ampl_ref, sizeof(t_double) * 3 * cnt);
+    memcpy(sort_arr, bank->model->sort_ampl, sizeof(t_int32) * 4 * cnt);
+
+    if (!filters) {
+      for (t_int32 res = 0; res < cnt; res++) {
+        reson_arr[res].y_m1 = 0.0;
+        reson_arr[res].y_m2 = 0.0;
+        reson_arr[res].u_re = 0.0;
+        reson_arr[res].u_im = 0.0;
+      }
+    }
+
+    ptr += rec->size;
+  }
+
+  // The states
+  for (t_int32 st = 0; st < x->state_cnt; st++) {
+    t_state* state = x->state_arr + st;
+    t_int32 cnt = MAX(state->cnt, 0);
+    t_snap_state* rec = (t_snap_state*)ptr;
+
+    rec->size = sizeof(t_snap_state) + sizeof(t_double) * 2 * cnt;
+    rec->cnt = cnt;
+    strncpy(rec->name, state->name->s_name, FILE_NAME - 1);
+    strncpy(rec->from, state->from->s_name, FILE_NAME - 1);
+
+    t_double* U_arr = (t_double*)(rec + 1);
+    if (cnt) {
+      memcpy(U_arr, state->U_arr, sizeof(t_double) * cnt);
+      memcpy(U_arr + cnt, state->A_arr, sizeof(t_double) * cnt);
+    }
+
+    ptr += rec->size;
+  }
+
+  return head;
+}
+
+// ====  _SNAP_CHECK_BANK  ====
+
+//******************************************************************************
+//  Validate the fields of a bank record that are used as indexes, counts or
+//  enums, as the structures are copied as is from the file
+//  Returns true if they are all in range
+//
+static t_bool _snap_check_bank(t_modal* x, t_snap_head* head, t_int32 bnk, t_snap_bank* rec) {
+
+  t_bank* bank = &rec->bank;
+  t_int32 cnt = rec->reson_cnt;
+  t_int32 voice = ((head->voice_cnt) && (bnk >= head->voice_first) && (bnk < head->voice_first + head->voice_cnt))
+    ? bnk - head->voice_first : -1;
+
+  if ((bank->reson_cnt != cnt) || (bank->voice_ind != voice)
+    || (bank->lod_type < LOD_OFF) || (bank->lod_type > LOD_FRAC)
+    || (bank->lod_cnt < 0) || (bank->lod_cnt > cnt) || (bank->cull_cnt < 0) || (bank->cull_cnt > cnt)
+    || (bank->exc_type < EXC_NONE) || (bank->exc_type > EXC_MALLET)
+    || (bank->imp_cntd < 0) || (bank->diff_ramp < 0)) { return false; }
+
+  // The burst fields are only used while a burst is running
+  if ((bank->exc_type != EXC_NONE) && ((bank->exc_cntd < 0)
+    || (bank->exc_len < 0) || (bank->exc_pos < 0) || (bank->exc_pos > bank->exc_len))) { return false; }
+
+  for (t_int32 i = 0; i < 16; i++) {
+    if (bank->times[i] < 0) { return false; }
+  }
+
+  t_resonator* reson = (t_resonator*)(rec + 1);
+  for (t_int32 res = 0; res < cnt; res++, reson++) {
+    if ((reson->mode_ind < 0) || (reson->mode_ind >= MODE_LAST)
+      || (reson->mode_type < MODE_TYPE_OFF) || (reson->mode_type > MODE_TYPE_VAR_S)
+      || (reson->cntd_type < MODE_CNTD_RESON) || (reson->cntd_type > MODE_CNTD_BANK)
+      || (reson->diff_type < MODE_DIFF_ALL) || (reson->diff_type > MODE_DIFF_FUNC)
+      || (reson->diff_ind < 0) || (reson->diff_ind >= x->chan_cnt)
+      || (reson->diff_cnt < 0) || (reson->diff_cnt > x->chan_cnt)
+      || ((reson->diff_type == MODE_DIFF_ONE_S) && ((reson->diff_sto < 0) || (reson->diff_sto >= x->chan_cnt)))
+      || ((reson->diff_type >= MODE_DIFF_NUM_R) && (reson->diff_type <= MODE_DIFF_NUM_RR) && (reson->diff_sto < 0))
+      || (reson->cntd < INDEFINITE) || (reson->diff_cntd < 0)
+      || (reson->rate_cls < 0) || (reson->rate_cls > RATE_CLS_MAX)) { return false; }
+
+    for (t_int32 i = 0; i < 8; i++) {
+      if (reson->times[i] < INDEFINITE) { return false; }
+    }
+  }
+
+  return true;
+}
+
+// ====  _SNAP_CHECK  ====
+
+//******************************************************************************
+//  Validate a blob read from a file, for this object
+//  All the records should fit in the blob, and the sort permutations and the
+//  fields used as indexes be valid.
+//  Returns ERR_NONE if the blob is valid
+//
+static t_my_err _snap_check(t_modal* x, t_snap_head* head, t_ptr_size size) {
+
+  MY_ASSERT_ERR((size < sizeof(t_snap_head)) || (memcmp(head->magic, SNAP_MAGIC, 4)),
+    ERR_SYNTAX, "snapshot:  Not a snapshot file.");
+  MY_ASSERT_ERR((head->version != SNAP_VERSION) || (head->order != FILE_ORDER)
+    || (head->bank_size != sizeof(t_bank)) || (head->reson_size != sizeof(t_resonator)),
+    ERR_SYNTAX, "snapshot:  The file was written by another version or build of the object.");
+  MY_ASSERT_ERR(head->size != size, ERR_SYNTAX, "snapshot:  Truncated file.");
+  MY_ASSERT_ERR((head->bank_cnt != x->bank_cnt) || (head->chan_cnt != x->chan_cnt), ERR_SYNTAX,
+    "snapshot:  The file is for %i banks and %i channels:  %i and %i expected.",
+    head->bank_cnt, head->chan_cnt, x->bank_cnt, x->chan_cnt);
+  MY_ASSERT_ERR((head->state_cnt < 0) || (head->voice_cnt < 0)
+    || ((head->voice_cnt) && ((head->voice_first < 0) || (head->voice_first + head->voice_cnt > x->bank_cnt))),
+    ERR_SYNTAX, "snapshot:  Invalid header.");
+
+  char* ptr = (char*)(head + 1);
+  char* end = (char*)head + size;
+
+  for (t_int32 bnk = 0; bnk < head->bank_cnt; bnk++) {
+    t_snap_bank* rec = (t_snap_bank*)ptr;
+    MY_ASSERT_ERR((t_ptr_size)(end - ptr) < sizeof(t_snap_bank), ERR_SYNTAX, "snapshot:  Truncated file.");
+
+    t_int32 cnt = rec->reson_cnt;
+    MY_ASSERT_ERR((cnt < 1) || (cnt > x->reson_max), ERR_SYNTAX,
+      "snapshot:  Bank %i:  Invalid number of resonators:  %i.  Expected:  1 to %i.", bnk, cnt, x->reson_max);
+    MY_ASSERT_ERR((rec->size != _snap_bank_size(x, cnt)) || ((t_ptr_size)(end - ptr) < rec->size), ERR_SYNTAX,
+      "snapshot:  Bank %i:  Invalid record.", bnk);
+
+    t_int32* sort_arr = (t_int32*)((t_double*)((t_resonator*)(rec + 1) + cnt) + (2 * x->chan_cnt + 3) * cnt);
+    for (t_int32 i = 0; i < 4 * cnt; i++) {
+      MY_ASSERT_ERR((sort_arr[i] < 0) || (sort_arr[i] >= cnt), ERR_SYNTAX, "snapshot:  Bank %i:  Invalid sort permutation.", bnk);
+    }
+    MY_ASSERT_ERR(!_snap_check_bank(x, head, bnk, rec), ERR_SYNTAX, "snapshot:  Bank %i:  Invalid parameters.", bnk);
+    rec->name[FILE_NAME - 1] = '\0';
+
+    ptr += rec->size;
+  }
+
+  for (t_int32 st = 0; st < head->state_cnt; st++) {
+    t_snap_state* rec = (t_snap_state*)ptr;
+    MY_ASSERT_ERR((t_ptr_size)(end - ptr) < sizeof(t_snap_state), ERR_SYNTAX, "snapshot:  Truncated file.");
+    MY_ASSERT_ERR((rec->cnt < 0) || (rec->size != sizeof(t_snap_state) + sizeof(t_double) * 2 * (t_ptr_size)rec->cnt)
+      || ((t_ptr_size)(end - ptr) < rec->size), ERR_SYNTAX, "snapshot:  State %i:  Invalid record.", st);
+    rec->name[FILE_NAME - 1] = '\0';
+    rec->from[FILE_NAME - 1] = '\0';
+
+    ptr += rec->size;
+  }
+
+  MY_ASSERT_ERR(ptr != end, ERR_SYNTAX, "snapshot:  Invalid file size.");
+
+  return ERR_NONE;
+}
+
+// ====  _SNAP_MODELS  ====
+
+//******************************************************************************
+//  Set the models of a snapshot: the models of the banks when saved, or new
+//  models copied from the blob when read from a file
+//  Returns ERR_NONE on success
+//
+static t_my_err _snap_models(t_modal* x, t_snapshot* snap, t_bool from_blob) {
+
+  t_snap_head* head = snap->head;
+
+  snap->model_arr = (t_model**)sysmem_newptrclear(sizeof(t_model*) * head->bank_cnt);
+  if (!snap->model_arr) { return ERR_ALLOC; }
+
+  char* ptr = (char*)(head + 1);
+
+  for (t_int32 bnk = 0; bnk < head->bank_cnt; bnk++) {
+    t_snap_bank* rec = (t_snap_bank*)ptr;
+    t_int32 cnt = rec->reson_cnt;
+
+    if (!from_blob) {
+      snap->model_arr[bnk] = (x->bank_arr + bnk)->model;
+      _model_retain(snap->model_arr[bnk]);
+    }
+    else {
+      t_model* model = _model_new(cnt);
+      if (!model) { return ERR_ALLOC; }
+      t_double* param_arr = (t_double*)((t_resonator*)(rec + 1) + cnt) + 2 * x->chan_cnt * cnt;
+      memcpy(model->ampl_ref, param_arr, sizeof(t_double) * 3 * cnt);
+      memcpy(model->sort_ampl, param_arr + 3 * cnt, sizeof(t_int32) * 4 * cnt);
+      model->gain = rec->model_gain;
+      snap->model_arr[bnk] = model;
+    }
+
+    ptr += rec->size;
+  }
+
+  return ERR_NONE;
+}
+
+// ====  _SNAP_BANK  ====
+
+//******************************************************************************
+//  Rebuild a bank from its record, sharing the model of the snapshot
+//  The resonators are brought back to the full rate and converted to the
+//  kernel in use, and the rendering structures that were in use are rebuilt.
+//  Returns ERR_NONE on success
+//
+static t_my_err _snap_bank(t_modal* x, t_bank* bank, t_snap_head* head, t_snap_bank* rec, t_model* model) {
+
+  if (bank_new_model(x, bank, model) != ERR_NONE) { return ERR_ALLOC; }
+
+  // Copy the bank, keeping the arrays of the bank
+  t_resonator* reson_arr = bank->reson_arr;
+  t_double* diff_arr = bank->diff_arr;
+  t_int32 cnt = rec->reson_cnt;
+
+  *bank = rec->bank;
+
+  bank->reson_arr = reson_arr;
+  bank->diff_arr = diff_arr;
+  bank->model = model;
+  bank->sort_ampl = model->sort_ampl;
+  bank->sort_freq = model->sort_freq;
+  bank->sort_decay = model->sort_decay;
+  bank->sort_prio = model->sort_prio;
+  bank->name = gensym(rec->name);
+  bank->conv = NULL;
+  bank->conv_new = NULL;
+  bank->conv_old = NULL;
+  bank->conv_A = 0.0;
+  bank->ifft = NULL;
+  bank->ifft_new = NULL;
+  bank->ifft_old = NULL;
+  bank->ifft_active = false;
+  bank->rate = NULL;
+  bank->stream = NULL;
+  bank->imp_ofs = -1;
+  _stats_reset(bank);
+
+  // Copy the arrays
+  memcpy(reson_arr, rec + 1, sizeof(t_resonator) * cnt);
+  memcpy(diff_arr, (t_resonator*)(rec + 1) + cnt, sizeof(t_double) * 2 * x->chan_cnt * cnt);
+  _diff_arr_set(x, reson_arr, diff_arr, cnt);
+
+  // The states of the filters in the kernel in use, at the full rate.
+  // The inverse FFT synthesis and the decimated rates keep them in the phasor form.
+  t_bool is_phasor = false;
+  for (t_int32 res = 0; res < cnt; res++) {
+    t_resonator* reson = reson_arr + res;
+    is_phasor = (head->kernel == KERNEL_PHASOR) || (rec->bank.ifft_active) || (reson->rate_cls);
+    reson->rate_cls = 0;
+    if ((is_phasor) && (x->kernel_cur == KERNEL_BIQUAD)) { _phasor_to_biquad(reson); }
+    else if ((!is_phasor) && (x->kernel_cur == KERNEL_PHASOR)) { _phasor_from_biquad(reson); }
+  }
+
+  // The coefficients depend on the sample rate
+  if (head->samplerate != x->samplerate) { bank_update(x, bank); }
+
+  // The rendering structures are allocated here, not in the perform routine
+  if ((bank->rate_use) && (x->vec_max)) { bank->rate = _rate_new(x); }
+  if (bank->rate) { bank->rate->dirty = true; }
+  else { bank->rate_use = false; }
+
+  if ((bank->ifft_targ) && (rec->ifft_size) && (x->vec_max)) { bank->ifft = _ifft_build(x, bank, rec->ifft_size); }
+  if (!bank->ifft) { bank->ifft_targ = false; }
+
+  // The bank is not installed yet, so the impulse responses are set directly
+  if ((bank->conv_targ) && (bank->conv_use) && (x->vec_max) && (_conv_is_static(bank))) {
+    bank->conv = _conv_build(x, bank);
+  }
+  bank->conv_targ = (bank->conv != NULL);
+
+  return ERR_NONE;
+}
+
+// ====  _SNAP_RECALL  ====
+
+//******************************************************************************
+//  Build the banks of a snapshot, to be installed between two blocks
+//  The states are restored directly, as the perform routine does not use them.
+//  Returns ERR_NONE on success
+//
+static t_my_err _snap_recall(t_modal* x, t_snapshot* snap) {
+
+  t_snap_head* head = snap->head;
+
+  // Drop a recall that is not installed yet, or free the banks replaced by the previous one
+  systhread_mutex_lock(x->load_mutex);
+  _snap_release(x);
+  systhread_mutex_unlock(x->load_mutex);
+
+  t_bank* bank_arr = (t_bank*)sysmem_newptrclear(sizeof(t_bank) * x->bank_cnt);
+  MY_ASSERT_ERR(!bank_arr, ERR_ALLOC, "snapshot:  Failed to allocate the banks.");
+
+  char* ptr = (char*)(head + 1);
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    t_snap_bank* rec = (t_snap_bank*)ptr;
+    MY_ASSERT_GOTO(_snap_bank(x, bank_arr + bnk, head, rec, snap->model_arr[bnk]) != ERR_NONE,
+      SNAP_RECALL_FAIL, "snapshot:  Failed to allocate bank %i.", bnk);
+    ptr += rec->size;
+  }
+
+  // The states, the extra slots are cleared
+  for (t_int32 st = 0; st < x->state_cnt; st++) {
+    t_state* state = x->state_arr + st;
+    t_snap_state* rec = (st < head->state_cnt) ? (t_snap_state*)ptr : NULL;
+    t_int32 cnt = (rec) ? rec->cnt : 0;
+
+    if (state->cnt != cnt) {
+      _state_free(state);
+      MY_ASSERT_GOTO(_state_init(state, cnt, 0, 0) != ERR_NONE, SNAP_RECALL_FAIL, "snapshot:  Failed to allocate state %i.", st);
+    }
+    if (cnt) {
+      memcpy(state->U_arr, rec + 1, sizeof(t_double) * cnt);
+      memcpy(state->A_arr, (t_double*)(rec + 1) + cnt, sizeof(t_double) * cnt);
+    }
+    state->name = (rec) ? gensym(rec->name) : gensym("");
+    state->from = (rec) ? gensym(rec->from) : gensym("");
+
+    if (rec) { ptr += rec->size; }
+  }
+  if (head->state_cnt > x->state_cnt) {
+    MY_ERR("snapshot:  Only %i of the %i states are recalled.", x->state_cnt, head->state_cnt);
+  }
+
+  // Handed over to the perform routine
+  systhread_mutex_lock(x->load_mutex);
+  x->snap_bank_arr = bank_arr;
+  x->snap_head = *head;
+  x->snap_kernel = x->kernel_cur;
+  x->snap_stage = SNAP_READY;
+  systhread_mutex_unlock(x->load_mutex);
+
+  qelem_set(x->snap_qelem);
+  return ERR_NONE;
+
+  SNAP_RECALL_FAIL:
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) { bank_free(x, bank_arr + bnk); }
+  sysmem_freeptr(bank_arr);
+  return ERR_ALLOC;
+}
+
+// ====  _SNAP_INSTALL  ====
+
+//******************************************************************************
+//  Install the banks and the settings of a recalled snapshot
+//  The banks are swapped with the banks they replace, which are freed later by
+//  the main thread. Called with the mutex of the loads locked: by the perform
+//  routine between two blocks, or by the main thread if the DSP is off.
+//  Returns true if a snapshot was installed
+//
+t_bool _snap_install(t_modal* x) {
+
+  if (x->snap_stage != SNAP_READY) { return false; }
+
+  t_bank bank_tmp;
+  t_bank* bank = NULL;
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    bank = x->bank_arr + bnk;
+    bank_tmp = *bank;
+    *bank = x->snap_bank_arr[bnk];
+    x->snap_bank_arr[bnk] = bank_tmp;
+
+    // The kernel has changed since the banks were built
+    if (x->snap_kernel != x->kernel_cur) {
+      for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+        if ((bank->reson_arr + res)->rate_cls) { continue; }
+        if (x->kernel_cur == KERNEL_PHASOR) { _phasor_from_biquad(bank->reson_arr + res); }
+        else                                { _phasor_to_biquad(bank->reson_arr + res); }
+      }
+    }
+  }
+
+  // The voices: the ones that are not playing are free, the first voice popped first
+  // The stack of free voices is allocated for all the banks with the object
+  x->voice_first = x->snap_head.voice_first;
+  x->voice_free_cnt = 0;
+  for (t_int32 v = x->snap_head.voice_cnt - 1; v >= 0; v--) {
+    if (!(x->bank_arr + x->voice_first + v)->voice_busy) { x->voice_free[x->voice_free_cnt++] = v; }
+  }
+  x->voice_cnt = x->snap_head.voice_cnt;
+  x->voice_quiet = -1;
+  x->voice_steal = 0;
+  x->voice_ref = x->snap_head.voice_ref;
+  x->voice_freq_mult = x->snap_head.voice_freq_mult;
+
+  x->master = x->snap_head.master;
+  x->ramp_param = x->snap_head.ramp_param;
+
+  x->snap_stage = SNAP_INSTALLED;
+  return true;
+}
+
+// ====  _SNAP_MAIN  ====
+
+//******************************************************************************
+//  Finish a recall from the main thread, called by the qelem
+//  The replaced banks are freed and the reply is sent:  snapshot recall (name)
+//
+void _snap_main(t_modal* x) {
+
+  TRACE("_snap_main");
+
+  systhread_mutex_lock(x->load_mutex);
+
+  // Install here if the perform routine does not run
+  // The loads installed with it are finished by their own qelem
+  t_bool is_main = _load_wait(x);
+
+  if (x->snap_stage != SNAP_INSTALLED) {
+    systhread_mutex_unlock(x->load_mutex);
+    if (is_main) { qelem_set(x->load_qelem); }
+    return;
+  }
+
+  _snap_release(x);
+  systhread_mutex_unlock(x->load_mutex);
+  if (is_main) { qelem_set(x->load_qelem); }
+
+  // The current resonator was in the replaced banks
+  if (!x->reson_cur) { x->reson_cur = x->bank_cur->reson_arr; }
+
+  t_atom mess_arr[2];
+  atom_setsym(mess_arr, gensym("recall"));
+  atom_setsym(mess_arr + 1, gensym(x->snap_head.name));
+  outlet_anything(x->outl_mess, gensym("snapshot"), 2, mess_arr);
+}
+
+// ====  SNAP_SNAPSHOT  ====
+
+//******************************************************************************
+//  Save, recall, write, read or delete whole object snapshots
+//  snapshot save (name) [int: 1 to keep the states of the filters]
+//  snapshot recall (name)
+//  snapshot write (name) [sym: file name]
+//  snapshot read (name) [sym: file name]
+//  snapshot delete (name)
+//  A snapshot holds all the banks with their parameters, multipliers, modes
+//  and diffusion, the states, the voices, and the master gain and ramp
+//  parameter. A recall is installed at once between two blocks.
+//  Without a file name a dialog box is opened.
+//  Replies:  snapshot (command) (name) [size in bytes]
+//
+void snap_snapshot(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("snap_snapshot");
+
+  MY_ASSERT((argc < 2) || (atom_gettype(argv) != A_SYM) || (atom_gettype(argv + 1) != A_SYM),
+    "snapshot:  2 or 3 args expected:  snapshot (save / recall / write / read / delete) (name) [arg]");
+
+  t_symbol* cmd = atom_getsym(argv);
+  t_symbol* name = atom_getsym(argv + 1);
+  t_snapshot* snap = NULL;
+  t_atom mess_arr[3];
+
+  atom_setsym(mess_arr, cmd);
+  atom_setsym(mess_arr + 1, name);
+
+  // ====  Save  ====
+
+  if (cmd == gensym("save")) {
+    MY_ASSERT((argc == 3) && (atom_gettype(argv + 2) != A_LONG), "snapshot:  Arg 2:  0 or 1 expected.");
+    t_bool filters = (argc == 3) && (atom_getlong(argv + 2) != 0);
+
+    t_snap_head* head = _snap_build(x, name, filters);
+    MY_ASSERT(!head, "snapshot:  Failed to allocate the snapshot.");
+
+    snap = _snap_slot(x, name);
+    if (!snap) { sysmem_freeptr(head); MY_ERR("snapshot:  Too many snapshots:  %i at most.", SNAP_MAX); return; }
+
+    snap->head = head;
+    if (_snap_models(x, snap, false) != ERR_NONE) { _snap_clear(snap); MY_ERR("snapshot:  Failed to allocate the snapshot."); return; }
+    snap->name = name;
+
+    atom_setlong(mess_arr + 2, (t_atom_long)head->size);
+    outlet_anything(x->outl_mess, gensym("snapshot"), 3, mess_arr);
+  }
+
+  // ====  Recall  ====
+  // The reply is sent once the banks are installed
+
+  else if (cmd == gensym("recall")) {
+    MY_ASSERT(argc != 2, "snapshot:  2 args expected:  snapshot recall (name)");
+    snap = _snap_find(x, name);
+    MY_ASSERT(!snap, "snapshot:  Arg 1:  Snapshot not found:  %s.", name->s_name);
+
+    _snap_recall(x, snap);
+  }
+
+  // ====  Delete  ====
+
+  else if (cmd == gensym("delete")) {
+    MY_ASSERT(argc != 2, "snapshot:  2 args expected:  snapshot delete (name)");
+    snap = _snap_find(x, name);
+    MY_ASSERT(!snap, "snapshot:  Arg 1:  Snapshot not found:  %s.", name->s_name);
+
+    _snap_clear(snap);
+    outlet_anything(x->outl_mess, gensym("snapshot"), 2, mess_arr);
+  }
+
+  // ====  Write and read  ====
+  // The blob is written and read as it is
+
+  else if ((cmd == gensym("write")) || (cmd == gensym("read"))) {
+    MY_ASSERT((argc == 3) && (atom_gettype(argv + 2) != A_SYM), "snapshot:  Arg 2:  File name expected.");
+
+    t_bool is_write = (cmd == gensym("write"));
+    char   file_name[MAX_FILENAME_CHARS];
+    short  file_path;
+    t_fourcc file_type = FOUR_CHAR_CODE('YMSN');
+    t_filehandle file_handle = NULL;
+    t_ptr_size size = 0;
+
+    if (is_write) {
+      snap = _snap_find(x, name);
+      MY_ASSERT(!snap, "snapshot:  Arg 1:  Snapshot not found:  %s.", name->s_name);
+    }
+
+    // Argument 2 is the file name, otherwise open a dialog box
+    if (argc == 3) {
+      MY_ASSERT(path_frompathname(atom_getsym(argv + 2)->s_name, &file_path, file_name),
+        "snapshot:  Arg 2:  Invalid path and file name.");
+    }
+    else if (is_write) {
+      snprintf(file_name, MAX_FILENAME_CHARS, "%s.yms", name->s_name);
+      saveas_promptset("Save the snapshot.");
+      if (saveasdialog_extended(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+    }
+    else {
+      open_promptset("Choose a snapshot file.");
+      if (open_dialog(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+    }
+
+    if (is_write) {
+      MY_ASSERT(path_createsysfile(file_name, file_path, file_type, &file_handle), "snapshot:  Failed to create the file.");
+      size = (t_ptr_size)snap->head->size;
+      t_max_err err = sysfile_write(file_handle, &size, snap->head);
+      sysfile_close(file_handle);
+      MY_ASSERT(err != MAX_ERR_NONE, "snapshot:  Failed to write the file.");
+    }
+
+    else {
+      MY_ASSERT(path_opensysfile(file_name, file_path, &file_handle, PATH_READ_PERM), "snapshot:  Failed to open the file.");
+      sysfile_geteof(file_handle, &size);
+
+      t_snap_head* head = (size >= sizeof(t_snap_head)) ? (t_snap_head*)sysmem_newptr((long)size) : NULL;
+      t_max_err err = MAX_ERR_GENERIC;
+      if (head) { err = sysfile_read(file_handle, &size, head); }
+      sysfile_close(file_handle);
+
+      if ((!head) || (err != MAX_ERR_NONE) || (_snap_check(x, head, size) != ERR_NONE)) {
+        if (head) { sysmem_freeptr(head); }
+        MY_ERR("snapshot:  Failed to read %s.", file_name);
+        return;
+      }
+
+      snap = _snap_slot(x, name);
+      if (!snap) { sysmem_freeptr(head); MY_ERR("snapshot:  Too many snapshots:  %i at most.", SNAP_MAX); return; }
+
+      memset(head->name, 0, FILE_NAME);
+      strncpy(head->name, name->s_name, FILE_NAME - 1);
+      snap->head = head;
+      if (_snap_models(x, snap, true) != ERR_NONE) { _snap_clear(snap); MY_ERR("snapshot:  Failed to allocate the models."); return; }
+      snap->name = name;
+    }
+
+    atom_setlong(mess_arr + 2, (t_atom_long)size);
+    outlet_anything(x->outl_mess, gensym("snapshot"), 3, mess_arr);
+  }
+
+  else { MY_ERR("snapshot:  Arg 0:  \"save\", \"recall\", \"write\", \"read\" or \"delete\" expected."); }
+}
@@ -128,23 +128,146 @@ void _state_arr_free(t_state** state_arr, t_int32* state_cnt) {
   *state_cnt = 0;
 }
 
+// ====  _STATE_ARR_RESIZE  ====
+
+//******************************************************************************
+//  Resize an array of states, keeping the states that fit
+//  The new states are empty, the states dropped are freed.
+//  cnt:  new number of states in the array, at least 1
+//  Returns ERR_NONE, ERR_COUNT or ERR_ALLOC, the array is unchanged on error
+//
+t_my_err _state_arr_resize(t_state** state_arr, t_int32* state_cnt, t_int32 cnt) {
+
+  if (cnt < 1) { return ERR_COUNT; }
+
+  t_state* state_new = (t_state*)sysmem_newptr(sizeof(t_state) * cnt);
+  if (!state_new) { return ERR_ALLOC; }
+
+  t_int32 keep = (*state_arr) ? MIN(cnt, *state_cnt) : 0;
+  if (keep) { memcpy(state_new, *state_arr, sizeof(t_state) * keep); }
+  for (t_int32 st = keep; st < cnt; st++) { _state_init(state_new + st, 0, 0, 0); }
+
+  if (*state_arr) {
+    for (t_int32 st = keep; st < *state_cnt; st++) { _state_free(*state_arr + st); }
+    sysmem_freeptr(*state_arr);
+  }
+
+  *state_arr = state_new;
+  *state_cnt = cnt;
+  return ERR_NONE;
+}
+
+// ====  _STATE_HASH  ====
+
+//******************************************************************************
+//  The first slot of a name in the index, from the address of the symbol
+//
+static t_int32 _state_hash(t_symbol* name, t_int32 slot_cnt) {
+
+  return (t_int32)(((t_uint32)((uintptr_t)name >> 4) * 2654435761u) & (t_uint32)(slot_cnt - 1));
+}
+
+// ====  _STATE_INDEX_BUILD  ====
+
+//******************************************************************************
+//  Build the index of the states by name, growing it if needed
+//  The empty name is not indexed, and for repeated names the first state wins.
+//  Returns ERR_NONE or ERR_ALLOC
+//
+static t_my_err _state_index_build(t_modal* x) {
+
+  t_state_index* index = &x->state_index;
+
+  t_int32 slot_cnt = 16;
+  while (slot_cnt < 2 * x->state_cnt) { slot_cnt *= 2; }
+
+  if (slot_cnt != index->slot_cnt) {
+    _state_index_free(x);
+    index->slot_arr = (t_int32*)sysmem_newptr(sizeof(t_int32) * slot_cnt);
+    if (!index->slot_arr) { return ERR_ALLOC; }
+    index->slot_cnt = slot_cnt;
+  }
+
+  for (t_int32 slot = 0; slot < slot_cnt; slot++) { index->slot_arr[slot] = -1; }
+
+  t_symbol* empty = gensym("");
+  for (t_int32 st = 0; st < x->state_cnt; st++) {
+    t_symbol* name = x->state_arr[st].name;
+    if (name == empty) { continue; }
+
+    t_int32 slot = _state_hash(name, slot_cnt);
+    while ((index->slot_arr[slot] != -1) && (x->state_arr[index->slot_arr[slot]].name != name)) {
+      slot = (slot + 1) & (slot_cnt - 1);
+    }
+    if (index->slot_arr[slot] == -1) { index->slot_arr[slot] = st; }
+  }
+
+  return ERR_NONE;
+}
+
+// ====  _STATE_INDEX_PROBE  ====
+
+//******************************************************************************
+//  Look a name up in the index, which might be out of date
+//  Only a state that still has the name is returned.
+//
+static t_state* _state_index_probe(t_modal* x, t_symbol* name) {
+
+  t_state_index* index = &x->state_index;
+  if (!index->slot_arr) { return NULL; }
+
+  t_int32 slot = _state_hash(name, index->slot_cnt);
+  for (t_int32 cnt = 0; (cnt < index->slot_cnt) && (index->slot_arr[slot] != -1); cnt++) {
+    t_int32 st = index->slot_arr[slot];
+    if ((st < x->state_cnt) && (x->state_arr[st].name == name)) { return x->state_arr + st; }
+    slot = (slot + 1) & (index->slot_cnt - 1);
+  }
+
+  return NULL;
+}
+
+// ====  _STATE_INDEX_FREE  ====
+
+//******************************************************************************
+//  Free the index of the states by name
+//
+void _state_index_free(t_modal* x) {
+
+  if (x->state_index.slot_arr) { sysmem_freeptr(x->state_index.slot_arr); }
+  x->state_index.slot_arr = NULL;
+  x->state_index.slot_cnt = 0;
+}
+
 // ====  _STATE_FIND  ====
 
 //******************************************************************************
-//  Find a state within the array of states
+//  Find a state within the array of states, by index or by name
+//  A name that is not found in the index rebuilds it, as the states might
+//  have been stored, loaded or recalled under new names since.
 //  Returns a pointer to the state or NULL
 //
-t_state* _state_find(t_state* state_arr, t_int32 state_cnt, t_atom* atom) {
+t_state* _state_find(t_modal* x, t_atom* atom) {
 
   // Test if the array of storage slots is not yet allocated
-  // If the atom is not an integer
-  if ((!state_arr) || (atom_gettype(atom) != A_LONG))  { return NULL; }
+  if (!x->state_arr) { return NULL; }
+
+  // By name
+  if (atom_gettype(atom) == A_SYM) {
+    t_symbol* name = atom_getsym(atom);
+    if (name == gensym("")) { return NULL; }
+
+    t_state* state = (x->state_index.slot_cnt >= 2 * x->state_cnt) ? _state_index_probe(x, name) : NULL;
+    if ((!state) && (_state_index_build(x) == ERR_NONE)) { state = _state_index_probe(x, name); }
+    return state;
+  }
+
+  // By index, if within range
+  if (atom_gettype(atom) != A_LONG) { return NULL; }
 
-  // Test if the index of the slot is within range
   t_int32 state_ind = (t_int32)atom_getlong(atom);
-  if ((state_ind < 0) || (state_ind >= state_cnt)) { return NULL; }
+  if ((state_ind < 0) || (state_ind >= x->state_cnt)) { return NULL; }
 
-  return (state_arr + state_ind);
+  return (x->state_arr + state_ind);
 }
 
 // ====  _STATE_STORE  ====
@@ -254,7 +377,7 @@ t_my_err _state_dict_load(t_dictionary* dict_state, t_state* state) {
 // ====  STATE_STATE  ====
 
 //******************************************************************************
-//  Interface method to call:  new / free / resize / get / post / store / save / load / rename / delete
+//  Interface method to call:  new / free / resize / get / post / store / save / load / rename / delete / write / read
 //
 void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
@@ -262,7 +385,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   // Argument 0 should be a command: new, free, resize, post or store
   MY_ASSERT((argc < 1) || (atom_gettype(argv) != A_SYM),
-    "state:  Arg 0:  Command expected: new / free / resize / get / post / store / save / load / rename / delete.");
+    "state:  Arg 0:  Command expected: new / free / resize / get / post / store / save / load / rename / delete / write / read.");
   t_symbol* cmd = atom_getsym(argv);
 
   // ====  NEW:  Allocate a new array of states  ====
@@ -296,10 +419,89 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     POST("state free:  Array of states freed.");
   }
 
-  // ====  RESIZE:  Resize the array of storage slots  ====
+  // ====  RESIZE:  Resize the array of states  ====
+  // state resize (int: state count)
+
+  else if (cmd == gensym("resize")) {
+
+    MY_ASSERT(!x->state_arr, "state resize:  No array of states available to resize.");
+    MY_ASSERT((argc != 2) || (atom_gettype(argv + 1) != A_LONG), "state resize:  2 args expected:  state resize (int: array size)");
+
+    t_int32 state_cnt = (t_int32)atom_getlong(argv + 1);
+    MY_ASSERT(state_cnt < 1, "state resize:  Arg 1:  Value of at least 1 expected for the number of states.");
+
+    t_my_err err = _state_arr_resize(&(x->state_arr), &(x->state_cnt), state_cnt);
+    MY_ASSERT(err != ERR_NONE, "state resize:  Failed to allocate an array of states.");
+
+    POST("state resize:  Array of %i states.", x->state_cnt);
+  }
+
+  // ====  WRITE:  Write the array of states to a file  ====
+  // state write (sym: f32 / u16) [int: base state] [sym: file name]
+  // The file is written by the worker thread, the reply is:  state write (count)
+
+  else if (cmd == gensym("write")) {
+
+    MY_ASSERT(!x->state_arr, "state write:  No array of states available to write.");
+    MY_ASSERT((argc < 2) || (argc > 4) || (atom_gettype(argv + 1) != A_SYM),
+      "state write:  2 to 4 args expected:  state write (sym: f32 / u16) [int: base state] [sym: file name]");
+
+    t_symbol* format_sym = atom_getsym(argv + 1);
+    MY_ASSERT((format_sym != gensym("f32")) && (format_sym != gensym("u16")), "state write:  Arg 1:  \"f32\" or \"u16\" expected.");
+    t_uint32 format = (format_sym == gensym("f32")) ? STATE_F32 : STATE_U16;
+
+    t_int32 base = -1;
+    t_atom* atom = argv + 2;
+    if ((atom < argv + argc) && (atom_gettype(atom) == A_LONG)) {
+      t_state* state = _state_find(x, atom);
+      MY_ASSERT((!state) || (state->cnt < 1), "state write:  Arg 2:  Non empty base state expected.");
+      MY_ASSERT(format != STATE_U16, "state write:  Arg 2:  The differences with a base state are only stored as u16.");
+      base = (t_int32)(state - x->state_arr);
+      atom++;
+    }
+
+    char  file_name[MAX_FILENAME_CHARS];
+    short file_path;
+    t_fourcc file_type = FOUR_CHAR_CODE('YMST');
+
+    // The last argument is the file name, otherwise open a dialog box
+    if (atom < argv + argc) {
+      MY_ASSERT((atom != argv + argc - 1) || (atom_gettype(atom) != A_SYM), "state write:  Invalid args:  state write (sym: f32 / u16) [int: base state] [sym: file name]");
+      MY_ASSERT(path_frompathname(atom_getsym(atom)->s_name, &file_path, file_name), "state write:  Invalid path and file name.");
+    }
+    else {
+      snprintf(file_name, MAX_FILENAME_CHARS, "states.yst");
+      saveas_promptset("Save the states.");
+      if (saveasdialog_extended(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+    }
+
+    // The states are encoded now, as they might change while the file is written
+    t_load encoded = { 0 };
+    MY_ASSERT(_state_encode(x, &encoded, format, base) != ERR_NONE, "state write:  Failed to allocate the file data.");
+    if (!_load_queue(x, NULL, LOAD_STATE_WRITE, sym, file_name, file_path, &encoded)) { _state_load_free(&encoded); }
+  }
+
+  // ====  READ:  Read the array of states from a file  ====
+  // state read [sym: file name]
+  // The file is read by the worker thread, the reply is:  state read (count)
+
+  else if (cmd == gensym("read")) {
+
+    MY_ASSERT((argc > 2) || ((argc == 2) && (atom_gettype(argv + 1) != A_SYM)), "state read:  1 or 2 args expected:  state read [sym: file name]");
 
-  else if ((cmd == gensym("resize")) && (argc == 3) && (atom_gettype(argv + 2) == A_LONG)) {
-    ;
+    char  file_name[MAX_FILENAME_CHARS];
+    short file_path;
+    t_fourcc file_type = FOUR_CHAR_CODE('YMST');
+
+    if (argc == 2) {
+      MY_ASSERT(path_frompathname(atom_getsym(argv + 1)->s_name, &file_path, file_name), "state read:  Invalid path and file name.");
+    }
+    else {
+      open_promptset("Choose a state file.");
+      if (open_dialog(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+    }
+
+    _load_queue(x, NULL, LOAD_STATE_READ, sym, file_name, file_path, NULL);
   }
 
   // ====  GET:  get information on a state as a message  ====
@@ -311,7 +513,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     MY_ASSERT(argc != 2, "state get:  2 args expected:  state get (int: state index)");
 
     // Argument 1 should reference a non empty state
-    t_state* state = _state_find(x->state_arr, x->state_cnt, argv + 1);
+    t_state* state = _state_find(x, argv + 1);
     MY_ASSERT(!state, "state get:  Arg 1:  State not found.");
 
     // Output a message with information about the state
@@ -347,7 +549,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     else if (atom_gettype(argv + 1) == A_LONG) {
 
       // Find the state
-      t_state* state = _state_find(x->state_arr, x->state_cnt, argv + 1);
+      t_state* state = _state_find(x, argv + 1);
       MY_ASSERT(!state, "state post:  Arg 1:  State not found.");
 
       // Post detailed information on one state
@@ -376,7 +578,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     MY_ASSERT(!bank, "state store:  Arg 1:  Bank not found");
 
     // Argument 2 should reference a state
-    t_state* state = _state_find(x->state_arr, x->state_cnt, argv + 2);
+    t_state* state = _state_find(x, argv + 2);
     MY_ASSERT(!state, "state store:  Arg 2:  State not found");
 
     // Argument 3 should hold the name of the state as a symbol
@@ -398,7 +600,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     MY_ASSERT(argc != 3, "state save:  3 args expected:  state save (int: state index) (sym: state name)");
 
     // Argument 1 should reference a non empty state
-    t_state* state = _state_find(x->state_arr, x->state_cnt, argv + 1);
+    t_state* state = _state_find(x, argv + 1);
     MY_ASSERT(!state, "state save:  Arg 1:  State not found.");
     MY_ASSERT(!state->cnt, "state save:  Arg 1:  The state is empty.");
 
@@ -416,7 +618,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     MY_ASSERT(argc != 3, "state load:  3 args expected:  state load (sym: state name) (int: state index)");
 
     // Argument 2 should reference a state
-    t_state* state = _state_find(x->state_arr, x->state_cnt, argv + 2);
+    t_state* state = _state_find(x, argv + 2);
     MY_ASSERT(!state, "state load:  Arg 2:  State not found.");
 
     if (dict_load(x, x->dict_sym, gensym("states"), gensym("state load"), 1, state, argv + 1, _state_dict_load) == ERR_NONE) {
@@ -452,7 +654,7 @@ void state_state(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   // ====  Otherwise the argument is invalid  ====
 
   else {
-    MY_ERR("state:  Arg 0:  Command expected: new / free / resize / get / post / store / save / load / rename / delete."); return;
+    MY_ERR("state:  Arg 0:  Command expected: new / free / resize / get / post / store / save / load / rename / delete / write / read."); return;
   }
 }
 
@@ -507,7 +709,7 @@ void state_ramp_to(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   MY_ASSERT(!bank, "ramp_to:  Arg 0:  Bank not found.");
 
   // The second argument should reference a state
-  t_state* state = _state_find(x->state_arr, x->state_cnt, argv + 1);
+  t_state* state = _state_find(x, argv + 1);
   MY_ASSERT(!state, "ramp_to:  Arg 1:  State not found.");
 
   // Argument 2 should be a positive float: the time in ms
@@ -538,11 +740,11 @@ void state_ramp_between(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   MY_ASSERT(!bank, "ramp_between:  Arg 0:  Bank not found.");
 
   // Argument 1 should reference a state
-  t_state* state1 = _state_find(x->state_arr, x->state_cnt, argv + 1);
+  t_state* state1 = _state_find(x, argv + 1);
   MY_ASSERT(!state1, "ramp_between:  Arg 1:  State not found.");
 
   // Argument 2 should reference a state
-  t_state* state2 = _state_find(x->state_arr, x->state_cnt, argv + 2);
+  t_state* state2 = _state_find(x, argv + 2);
   MY_ASSERT(!state2, "ramp_between:  Arg 2:  State not found.");
 
   // Argument 3 should be a float between 0 and 1: interpolation between the two states
@@ -611,7 +813,7 @@ void state_ramp_max(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   while (state_cnt--) {
 
     // The first argument of the pair should reference a state
-    state = _state_find(x->state_arr, x->state_cnt, atom++);
+    state = _state_find(x, atom++);
     MY_ASSERT(!state, "ramp_max:  Arg:  State not found.");
 
     // The second argument of the pair should be a float between 0 and 1: interpolation from 0
@@ -691,4 +893,287 @@ void state_freeze(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   MY_ASSERT((is_frozen != 0) && (is_frozen != 1), "freeze:  Arg 1:  0 or 1 expected to freeze or unfreeze the state.");
 
   bank->is_frozen = (is_frozen == 1) ? true : false;
+
+  // Render the frozen bank by convolution if it is set to
+  if ((bank->is_frozen) && (bank->conv_use)) { _conv_start(x, bank); }
+}
+
+// ====  _STATE_QUANT  ====
+
+//******************************************************************************
+//  Quantize a U value to 16 bits over 0 to 1
+//
+static t_int32 _state_quant(t_double u) {
+
+  return (t_int32)lround(CLAMP(u, 0.0, 1.0) * 65535.0);
+}
+
+// ====  _STATE_ENCODE  ====
+
+//******************************************************************************
+//  Encode the array of states into the data of a state library file
+//  Called from the main thread, the file is written by the worker thread.
+//  The empty states are skipped. With a base state, the other states with the
+//  same count are stored as differences of the quantized values, as zigzag
+//  varints of 3 bytes at most.
+//  load:  receives state_blob, state_size and the number of records in state_cnt
+//  Returns ERR_NONE or ERR_ALLOC
+//
+t_my_err _state_encode(t_modal* x, t_load* load, t_uint32 format, t_int32 base) {
+
+  load->state_blob = NULL;
+  load->state_size = 0;
+  load->state_arr = NULL;
+  load->state_cnt = 0;
+
+  // The size is bound by 4 bytes per value
+  t_ptr_size size = sizeof(t_state_file);
+  for (t_int32 st = 0; st < x->state_cnt; st++) {
+    size += sizeof(t_state_rec) + sizeof(t_float) * MAX(x->state_arr[st].cnt, 0);
+  }
+
+  char* blob = (char*)sysmem_newptrclear((long)size);
+  if (!blob) { return ERR_ALLOC; }
+
+  t_state_file* head = (t_state_file*)blob;
+  memcpy(head->magic, STATE_MAGIC, 4);
+  head->version = STATE_VERSION;
+  head->order = FILE_ORDER;
+  head->format = format;
+  head->slot_cnt = x->state_cnt;
+  head->base = base;
+
+  char* ptr = (char*)(head + 1);
+  t_state* base_state = (base != -1) ? x->state_arr + base : NULL;
+
+  // The base state first, so that it is read before the differences
+  for (t_int32 rec_ind = -1; rec_ind < x->state_cnt; rec_ind++) {
+    t_int32 st = (rec_ind == -1) ? base : rec_ind;
+    if ((st == -1) || ((rec_ind != -1) && (st == base))) { continue; }
+
+    t_state* state = x->state_arr + st;
+    if (state->cnt < 1) { continue; }
+
+    t_state_rec* rec = (t_state_rec*)ptr;
+    rec->ind = st;
+    rec->cnt = state->cnt;
+    strncpy(rec->name, state->name->s_name, FILE_NAME - 1);
+    strncpy(rec->from, state->from->s_name, FILE_NAME - 1);
+
+    if (format == STATE_F32) {
+      t_float* val_arr = (t_float*)(rec + 1);
+      for (t_int32 res = 0; res < state->cnt; res++) { val_arr[res] = (t_float)state->U_arr[res]; }
+      rec->size = sizeof(t_float) * state->cnt;
+    }
+
+    else if ((base_state) && (state != base_state) && (state->cnt == base_state->cnt)) {
+      t_uint8* byte = (t_uint8*)(rec + 1);
+      for (t_int32 res = 0; res < state->cnt; res++) {
+        t_int32 diff = _state_quant(state->U_arr[res]) - _state_quant(base_state->U_arr[res]);
+        t_uint32 zig = (diff < 0) ? (((t_uint32)(-diff) << 1) - 1) : ((t_uint32)diff << 1);
+        while (zig >= 0x80) { *byte++ = (t_uint8)(zig | 0x80); zig >>= 7; }
+        *byte++ = (t_uint8)zig;
+      }
+      rec->flags = STATE_DELTA;
+      rec->size = (t_uint32)(byte - (t_uint8*)(rec + 1));
+    }
+
+    else {
+      t_uint16* val_arr = (t_uint16*)(rec + 1);
+      for (t_int32 res = 0; res < state->cnt; res++) { val_arr[res] = (t_uint16)_state_quant(state->U_arr[res]); }
+      rec->size = sizeof(t_uint16) * state->cnt;
+    }
+
+    // The records are aligned on 4 bytes
+    ptr += sizeof(t_state_rec) + ((rec->size + 3) & ~3u);
+    head->rec_cnt++;
+  }
+
+  load->state_blob = blob;
+  load->state_size = (t_ptr_size)(ptr - blob);
+  load->state_cnt = head->rec_cnt;
+  return ERR_NONE;
+}
+
+// ====  _STATE_FILE_WRITE  ====
+
+//******************************************************************************
+//  Write the encoded states to a file, called by the worker thread
+//  Returns ERR_NONE, ERR_ARG_VALUE if the file is not created, or ERR_MISC
+//
+t_my_err _state_file_write(t_modal* x, t_load* load) {
+
+  t_filehandle file_handle = NULL;
+
+  if (path_createsysfile(load->file_name, load->file_path, FOUR_CHAR_CODE('YMST'), &file_handle)) {
+    MY_ERR("state write:  Failed to create the file %s.", load->file_name);
+    return ERR_ARG_VALUE;
+  }
+
+  t_ptr_size size = load->state_size;
+  t_max_err err = sysfile_write(file_handle, &size, load->state_blob);
+  sysfile_close(file_handle);
+
+  if ((err != MAX_ERR_NONE) || (size != load->state_size)) {
+    MY_ERR("state write:  Failed to write the file %s.", load->file_name);
+    return ERR_MISC;
+  }
+
+  return ERR_NONE;
+}
+
+// ====  _STATE_FILE_DECODE  ====
+
+//******************************************************************************
+//  Decode and check the data of a state library file into a new array of states
+//  Only the U values are set, the A values are calculated when installed.
+//  Returns ERR_NONE, ERR_ALLOC, or ERR_SYNTAX if the data is invalid
+//
+static t_my_err _state_file_decode(t_load* load, char* blob, t_ptr_size size) {
+
+  t_state_file head;
+  if (size < sizeof(t_state_file)) { return ERR_SYNTAX; }
+  memcpy(&head, blob, sizeof(t_state_file));
+
+  if ((memcmp(head.magic, STATE_MAGIC, 4)) || (head.version != STATE_VERSION) || (head.order != FILE_ORDER)
+    || ((head.format != STATE_F32) && (head.format != STATE_U16)) || (head.slot_cnt < 1)
+    || (head.rec_cnt < 0) || (head.rec_cnt > head.slot_cnt) || (head.base < -1) || (head.base >= head.slot_cnt)) {
+    return ERR_SYNTAX;
+  }
+
+  load->state_arr = _state_arr_new(head.slot_cnt, &load->state_cnt);
+  if (!load->state_arr) { return ERR_ALLOC; }
+
+  char* ptr = blob + sizeof(t_state_file);
+  char* end = blob + size;
+  t_state_rec rec;
+
+  for (t_int32 rec_ind = 0; rec_ind < head.rec_cnt; rec_ind++) {
+
+    if ((t_ptr_size)(end - ptr) < sizeof(t_state_rec)) { return ERR_SYNTAX; }
+    memcpy(&rec, ptr, sizeof(t_state_rec));
+    ptr += sizeof(t_state_rec);
+
+    t_bool is_delta = (rec.flags & STATE_DELTA);
+    t_state* base = (head.base != -1) ? load->state_arr + head.base : NULL;
+
+    if ((rec.ind < 0) || (rec.ind >= head.slot_cnt) || (rec.cnt < 1) || (rec.size > (t_uint32)(end - ptr))) { return ERR_SYNTAX; }
+    if ((head.format == STATE_F32) && ((is_delta) || (rec.size != sizeof(t_float) * (t_uint32)rec.cnt))) { return ERR_SYNTAX; }
+    if ((head.format == STATE_U16) && (!is_delta) && (rec.size != sizeof(t_uint16) * (t_uint32)rec.cnt)) { return ERR_SYNTAX; }
+    if ((is_delta) && ((!base) || (base->cnt != rec.cnt) || (rec.ind == head.base))) { return ERR_SYNTAX; }
+
+    t_state* state = load->state_arr + rec.ind;
+    _state_free(state);
+    if (_state_init(state, rec.cnt, 0, 0) != ERR_NONE) { return ERR_ALLOC; }
+
+    rec.name[FILE_NAME - 1] = '\0';
+    rec.from[FILE_NAME - 1] = '\0';
+    state->name = gensym(rec.name);
+    state->from = gensym(rec.from);
+
+    if (head.format == STATE_F32) {
+      t_float val;
+      for (t_int32 res = 0; res < rec.cnt; res++) {
+        memcpy(&val, ptr + sizeof(t_float) * res, sizeof(t_float));
+        state->U_arr[res] = val;
+      }
+    }
+
+    else if (is_delta) {
+      t_uint8* byte = (t_uint8*)ptr;
+      t_uint8* byte_end = byte + rec.size;
+      for (t_int32 res = 0; res < rec.cnt; res++) {
+        t_uint32 zig = 0;
+        for (t_int32 shift = 0; ; shift += 7) {
+          if ((byte == byte_end) || (shift > 14)) { return ERR_SYNTAX; }
+          zig |= (t_uint32)(*byte & 0x7F) << shift;
+          if (!(*byte++ & 0x80)) { break; }
+        }
+        t_int32 quant = _state_quant(base->U_arr[res]) + ((zig & 1) ? -(t_int32)((zig + 1) >> 1) : (t_int32)(zig >> 1));
+        if ((quant < 0) || (quant > 65535)) { return ERR_SYNTAX; }
+        state->U_arr[res] = quant / 65535.0;
+      }
+      if (byte != byte_end) { return ERR_SYNTAX; }
+    }
+
+    else {
+      t_uint16 val;
+      for (t_int32 res = 0; res < rec.cnt; res++) {
+        memcpy(&val, ptr + sizeof(t_uint16) * res, sizeof(t_uint16));
+        state->U_arr[res] = val / 65535.0;
+      }
+    }
+
+    ptr += MIN((rec.size + 3) & ~3u, (t_uint32)(end - ptr));
+  }
+
+  return ERR_NONE;
+}
+
+// ====  _STATE_FILE_READ  ====
+
+//******************************************************************************
+//  Read a state library file into a new array of states, called by the worker thread
+//  Returns ERR_NONE, ERR_ALLOC, ERR_ARG_VALUE if the file is not read, or ERR_SYNTAX
+//
+t_my_err _state_file_read(t_modal* x, t_load* load) {
+
+  t_filehandle file_handle = NULL;
+  t_ptr_size size = 0;
+  t_my_err err = ERR_NONE;
+
+  if (path_opensysfile(load->file_name, load->file_path, &file_handle, PATH_READ_PERM)) {
+    MY_ERR("state read:  Failed to open the file %s.", load->file_name);
+    return ERR_ARG_VALUE;
+  }
+
+  sysfile_geteof(file_handle, &size);
+  char* blob = (size >= sizeof(t_state_file)) ? (char*)sysmem_newptr((long)size) : NULL;
+  if ((!blob) || (sysfile_read(file_handle, &size, blob) != MAX_ERR_NONE)) { err = ERR_ARG_VALUE; }
+  sysfile_close(file_handle);
+
+  if (err == ERR_NONE) { err = _state_file_decode(load, blob, size); }
+  if (blob) { sysmem_freeptr(blob); }
+
+  if (err != ERR_NONE) {
+    _state_load_free(load);
+    MY_ERR("state read:  Failed to read %s.", load->file_name);
+  }
+
+  return err;
+}
+
+// ====  _STATE_INSTALL  ====
+
+//******************************************************************************
+//  Replace the array of states with the one read, called from the main thread
+//
+void _state_install(t_modal* x, t_load* load) {
+
+  if (!load->state_arr) { return; }
+
+  for (t_int32 st = 0; st < load->state_cnt; st++) {
+    t_state* state = load->state_arr + st;
+    for (t_int32 res = 0; res < state->cnt; res++) { state->A_arr[res] = x->ramp_func(state->U_arr[res], x->ramp_param); }
+  }
+
+  _state_arr_free(&(x->state_arr), &(x->state_cnt));
+  x->state_arr = load->state_arr;
+  x->state_cnt = load->state_cnt;
+  load->state_arr = NULL;
+}
+
+// ====  _STATE_LOAD_FREE  ====
+
+//******************************************************************************
+//  Free the states held by a load, the count is kept for the reply
+//
+void _state_load_free(t_load* load) {
+
+  if (load->state_blob) { sysmem_freeptr(load->state_blob); load->state_blob = NULL; }
+  load->state_size = 0;
+
+  t_int32 cnt = load->state_cnt;
+  if (load->state_arr) { _state_arr_free(&load->state_arr, &load->state_cnt); }
+  load->state_cnt = cnt;
 }
@@ -0,0 +1,132 @@
+#include "modal~.h"
+
+// ====  STATS_STATS  ====
+
+//******************************************************************************
+//  Output the DSP statistics of all the banks as a dictionary, or reset them
+//  The statistics are collected when the profile attribute is on.
+//  For each bank that has processed blocks:
+//    time_min, time_mean, time_max, time_p99:  block times in ms over the last STATS_WIN blocks
+//    blocks, active_mean, splits, iters, rms:  counters since the last reset
+//  Output:  dictionary (sym: dictionary name)
+//  stats
+//  stats reset
+//
+void stats_stats(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("stats_stats");
+
+  // "stats reset"
+  if ((argc == 1) && (atom_getsym(argv) == gensym("reset"))) {
+    for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) { _stats_reset(x->bank_arr + bnk); }
+    return;
+  }
+
+  MY_ASSERT(argc != 0, "stats:  No argument, or \"reset\" expected.");
+  if (!x->profile) { POST("stats:  The profile attribute is off:  no statistics are collected."); }
+
+  // Replace the previous dictionary
+  if (x->stats_dict) { object_free(x->stats_dict); x->stats_dict = NULL; }
+
+  t_dictionary* dict = dictionary_new();
+  MY_ASSERT(!dict, "stats:  Failed to create the dictionary.");
+
+  t_dictionary* dict_bank = NULL;
+  t_stats* stats = NULL;
+  t_double times[STATS_WIN];
+  t_double sum = 0.0;
+  char key[32];
+
+  for (t_int32 bnk = 0; bnk < x->bank_cnt; bnk++) {
+    stats = &(x->bank_arr + bnk)->stats;
+    if (stats->time_cnt == 0) { continue; }
+
+    // Sort the block times for the percentile
+    sum = 0.0;
+    for (t_int32 i = 0; i < stats->time_cnt; i++) { times[i] = stats->time[i]; sum += times[i]; }
+    qsort(times, stats->time_cnt, sizeof(t_double), _stats_compare);
+
+    dict_bank = dictionary_new();
+    MY_ASSERT_GOTO(!dict_bank, STATS_FAIL, "stats:  Failed to create the dictionary.");
+    dictionary_appendfloat(dict_bank, gensym("time_min"),  times[0]);
+    dictionary_appendfloat(dict_bank, gensym("time_mean"), sum / stats->time_cnt);
+    dictionary_appendfloat(dict_bank, gensym("time_max"),  times[stats->time_cnt - 1]);
+    dictionary_appendfloat(dict_bank, gensym("time_p99"),  times[(t_int32)(0.99 * (stats->time_cnt - 1))]);
+    dictionary_appendlong (dict_bank, gensym("blocks"), stats->blocks);
+    dictionary_appendfloat(dict_bank, gensym("active_mean"), (t_double)stats->active / stats->blocks);
+    dictionary_appendlong (dict_bank, gensym("splits"), stats->splits);
+    dictionary_appendlong (dict_bank, gensym("iters"),  stats->iters);
+    dictionary_appendlong (dict_bank, gensym("rms"),    stats->rms);
+
+    snprintf(key, 32, "bank %i", bnk);
+    dictionary_appenddictionary(dict, gensym(key), (t_object*)dict_bank);
+  }
+
+  dictionary_appendfloat(dict, gensym("load"), x->load);
+  dictionary_appendfloat(dict, gensym("cull_frac"), x->cull_frac);
+
+  // Register the dictionary and output its name
+  t_symbol* dict_sym = NULL;
+  x->stats_dict = dictobj_register(dict, &dict_sym);
+  MY_ASSERT_GOTO(!x->stats_dict, STATS_FAIL, "stats:  Failed to register the dictionary.");
+
+  t_atom mess_arr[1];
+  atom_setsym(mess_arr, dict_sym);
+  outlet_anything(x->outl_mess, gensym("dictionary"), 1, mess_arr);
+  return;
+
+  // The dictionary is not registered, with the subdictionaries already appended
+  STATS_FAIL:
+  object_free(dict);
+}
+
+// ====  _STATS_COMPARE  ====
+
+//******************************************************************************
+//  Compare two block times, used with qsort
+//
+int _stats_compare(const void* time1, const void* time2) {
+
+  if (*(t_double*)time1 < *(t_double*)time2) { return -1; }
+  else if (*(t_double*)time1 > *(t_double*)time2) { return 1; }
+  else { return 0; }
+}
+
+// ====  _STATS_BANK  ====
+
+//******************************************************************************
+//  Add the time and counters of one block of a bank to its statistics
+//  Called by the perform routine when the profile attribute is on
+//
+void _stats_bank(t_bank* bank, t_double time_ms, t_int32 active, t_int32 splits, t_int32 iters, t_int32 rms) {
+
+  t_stats* stats = &bank->stats;
+
+  stats->time[stats->time_ind] = time_ms;
+  stats->time_ind = (stats->time_ind + 1) % STATS_WIN;
+  if (stats->time_cnt < STATS_WIN) { stats->time_cnt++; }
+
+  stats->blocks++;
+  stats->active += active;
+  stats->splits += splits;
+  stats->iters  += iters;
+  stats->rms    += rms;
+}
+
+// ====  _STATS_RESET  ====
+
+//******************************************************************************
+//  Reset the statistics of a bank
+//
+void _stats_reset(t_bank* bank) {
+
+  t_stats* stats = &bank->stats;
+
+  stats->time_ind = 0;
+  stats->time_cnt = 0;
+  stats->blocks = 0;
+  stats->active = 0;
+  stats->splits = 0;
+  stats->iters  = 0;
+  stats->rms    = 0;
+}
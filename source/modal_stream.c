@@ -0,0 +1,422 @@
+#include "modal~.h"
+
+// ====  _STREAM_PREFETCH  ====
+
+//******************************************************************************
+//  Prefetch thread: read one byte per page of the frames ahead of the position
+//  The window covers STREAM_AHEAD ms at the current rate, in the direction of
+//  the playback, so that the pages are mapped before the perform routine
+//  reads them.
+//
+static void* _stream_prefetch(t_stream* stream) {
+
+  t_ptr_size frame_size = sizeof(t_float) * 3 * stream->mode_cnt;
+  volatile char sink = 0;
+
+  while (!stream->stop) {
+
+    t_double rate = stream->rate;
+    t_int32 ahead = (t_int32)(stream->frame_rate * fabs(rate) * STREAM_AHEAD / 1000.0) + 2;
+    t_int32 frame = (t_int32)stream->pos;
+    t_int32 beg = (rate >= 0) ? frame : frame - ahead;
+    t_int32 end = (rate >= 0) ? frame + ahead : frame + 1;
+    beg = CLAMP(beg, 0, stream->frame_cnt);
+    end = CLAMP(end, 0, stream->frame_cnt);
+
+    const char* ptr = (const char*)stream->frame_arr + frame_size * beg;
+    const char* ptr_end = (const char*)stream->frame_arr + frame_size * end;
+    for ( ; ptr < ptr_end; ptr += STREAM_PAGE) { sink += *ptr; }
+    if (ptr_end > (const char*)stream->frame_arr) { sink += *(ptr_end - 1); }
+
+    systhread_sleep(STREAM_SLEEP);
+  }
+
+  systhread_exit(0);
+  return NULL;
+}
+
+// ====  _STREAM_OPEN  ====
+
+//******************************************************************************
+//  Build a bank from a frame stream file, called by the worker thread
+//  The file is mapped in memory and checked, the bank is built from the first
+//  frame, and the prefetch thread is started.
+//  Returns ERR_NONE on success
+//
+t_my_err _stream_open(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path) {
+
+  TRACE("_stream_open");
+
+  char path_abs[MAX_PATH_CHARS];
+  char path_native[MAX_PATH_CHARS];
+
+  MY_ASSERT_ERR(path_toabsolutesystempath(file_path, file_name, path_abs), ERR_ARG_VALUE,
+    "stream:  Failed to resolve the path of %s.", file_name);
+  path_nameconform(path_abs, path_native, PATH_STYLE_NATIVE, PATH_TYPE_ABSOLUTE);
+
+  t_ptr_size size = 0;
+  const char* ptr = _file_map(path_native, &size);
+  MY_ASSERT_ERR(!ptr, ERR_ARG_VALUE, "stream:  Failed to map the file %s.", file_name);
+
+  t_my_err err = ERR_NONE;
+  const t_stream_file* head = (const t_stream_file*)ptr;
+  t_stream* stream = NULL;
+  t_int32 cnt = 0;
+
+  // Test the validity of the header and of the size of the file
+  if ((size < sizeof(t_stream_file)) || (memcmp(head->magic, STREAM_MAGIC, 4))) {
+    MY_ERR("stream:  %s is not a frame stream file.", file_name); err = ERR_SYNTAX; goto STREAM_OPEN_FAIL;
+  }
+  if ((head->order != FILE_ORDER) || (head->version != STREAM_VERSION)) {
+    MY_ERR("stream:  %s:  Unsupported version or byte order.", file_name); err = ERR_SYNTAX; goto STREAM_OPEN_FAIL;
+  }
+
+  cnt = head->mode_cnt;
+  if ((head->size < sizeof(t_stream_file)) || (head->size % sizeof(t_float)) || (cnt < 1) || (head->frame_cnt < 1)
+    || (!(head->frame_rate > 0))
+    || ((size - head->size) / (sizeof(t_float) * 3 * (t_ptr_size)cnt) < (t_ptr_size)head->frame_cnt)) {
+    MY_ERR("stream:  %s:  Invalid header or truncated file.", file_name); err = ERR_SYNTAX; goto STREAM_OPEN_FAIL;
+  }
+  if (cnt > x->reson_max) {
+    MY_ERR("stream:  Invalid number of modes: %i. Expected: 1 to %i.", cnt, x->reson_max); err = ERR_COUNT; goto STREAM_OPEN_FAIL;
+  }
+
+  stream = (t_stream*)sysmem_newptrclear(sizeof(t_stream));
+  if (stream) { stream->work = (t_double*)sysmem_newptr(sizeof(t_double) * 9 * cnt); }
+  if ((!stream) || (!stream->work)) { MY_ERR("stream:  Failed to allocate the stream."); err = ERR_ALLOC; goto STREAM_OPEN_FAIL; }
+
+  stream->map = ptr;
+  stream->map_size = size;
+  stream->frame_arr = (const t_float*)(ptr + head->size);
+  stream->mode_cnt = cnt;
+  stream->frame_cnt = head->frame_cnt;
+  stream->frame_rate = head->frame_rate;
+  stream->pos = 0.0;
+  stream->frame_prev = 0;
+  stream->rate = 1.0;
+
+  // Free the existing bank and create a new one, from the first frame
+  bank_free(x, bank);
+  if (bank_new(x, bank, cnt) == ERR_ALLOC) { err = ERR_ALLOC; goto STREAM_OPEN_FAIL; }
+
+  bank->name = name;
+  bank->gain = head->gain;
+
+  for (t_int32 res = 0; res < cnt; res++) {
+    bank->model->ampl_ref[res]  = stream->frame_arr[res];
+    bank->model->freq_ref[res]  = stream->frame_arr[cnt + res];
+    bank->model->decay_ref[res] = stream->frame_arr[2 * cnt + res];
+  }
+
+  // Set before the update, so that the bank is not pruned on the first frame
+  bank->stream = stream;
+  bank_update(x, bank);
+  bank_sort(x, bank);
+
+  if (systhread_create((method)_stream_prefetch, stream, 0, 0, 0, &stream->thread)) {
+    bank->stream = NULL;
+    MY_ERR("stream:  Failed to start the prefetch thread."); err = ERR_MISC; goto STREAM_OPEN_FAIL;
+  }
+
+  return ERR_NONE;
+
+  STREAM_OPEN_FAIL:
+  if (stream) {
+    if (stream->work) { sysmem_freeptr(stream->work); }
+    sysmem_freeptr(stream);
+  }
+  _file_unmap(ptr, size);
+  return err;
+}
+
+// ====  _STREAM_FREE  ====
+
+//******************************************************************************
+//  Stop the prefetch thread, unmap the file and free a stream
+//  Called by bank_free, once the bank is not rendered anymore.
+//
+void _stream_free(t_stream* stream) {
+
+  stream->stop = true;
+  if (stream->thread) { systhread_join(stream->thread, NULL); }
+
+  _file_unmap(stream->map, stream->map_size);
+  sysmem_freeptr(stream->work);
+  sysmem_freeptr(stream);
+}
+
+// ====  _STREAM_COEFS  ====
+
+//******************************************************************************
+//  Set the parameters of the resonators from the frames around a position
+//  Each pass runs over contiguous arrays so that it can be vectorized: the
+//  interpolation of the frames, then the terms of the poles, and only then
+//  are the coefficients scattered into the resonators.
+//  is_step:  advance the terms of the poles by their steps, instead of
+//            calculating them again, when the position stays in the frame
+//
+static void _stream_coefs(t_modal* x, t_bank* bank, t_stream* stream, t_double pos, t_bool is_step) {
+
+  t_int32 cnt = MIN(stream->mode_cnt, bank->reson_cnt);
+  t_int32 frame = (t_int32)pos;
+  t_int32 next = MIN(frame + 1, stream->frame_cnt - 1);
+  t_double frac = pos - frame;
+
+  const t_float* src0 = stream->frame_arr + (t_ptr_size)3 * stream->mode_cnt * frame;
+  const t_float* src1 = stream->frame_arr + (t_ptr_size)3 * stream->mode_cnt * next;
+
+  t_double* ampl  = stream->work;
+  t_double* freq  = ampl + cnt;
+  t_double* decay = freq + cnt;
+  t_double* r_arr = decay + cnt;
+  t_double* cos_arr = r_arr + cnt;
+  t_double* sin_arr = cos_arr + cnt;
+  t_double* step_r   = sin_arr + cnt;
+  t_double* step_cos = step_r + cnt;
+  t_double* step_sin = step_cos + cnt;
+
+  // Interpolate the frames, with the bank multipliers
+  // The decays are limited before the interpolation, so that they stay linear in the frame
+  for (t_int32 res = 0; res < cnt; res++) {
+    ampl[res] = (src0[res] + frac * (src1[res] - src0[res])) * bank->ampl_mult;
+  }
+  src0 += stream->mode_cnt; src1 += stream->mode_cnt;
+  for (t_int32 res = 0; res < cnt; res++) {
+    freq[res] = (src0[res] + frac * (src1[res] - src0[res])) * bank->freq_mult;
+  }
+  src0 += stream->mode_cnt; src1 += stream->mode_cnt;
+  for (t_int32 res = 0; res < cnt; res++) {
+    t_double d0 = MAX(src0[res] * bank->decay_mult, PRUNE_DECAY_MIN);
+    t_double d1 = MAX(src1[res] * bank->decay_mult, PRUNE_DECAY_MIN);
+    decay[res] = d0 + frac * (d1 - d0);
+  }
+
+  // The radius and angle of the poles: multiplied by a real decay step and a
+  // unit complex step, which are the same for each block in a frame
+  if (is_step) {
+    t_double tmp = 0.0;
+    for (t_int32 res = 0; res < cnt; res++) { r_arr[res] *= step_r[res]; }
+    for (t_int32 res = 0; res < cnt; res++) {
+      tmp          = cos_arr[res] * step_cos[res] - sin_arr[res] * step_sin[res];
+      sin_arr[res] = sin_arr[res] * step_cos[res] + cos_arr[res] * step_sin[res];
+      cos_arr[res] = tmp;
+    }
+  }
+
+  // Otherwise calculated again, when a frame is crossed or the parameters change
+  else {
+    t_double sr_inv = 1.0 / x->samplerate;
+    t_double w = TWOPI * sr_inv;
+    for (t_int32 res = 0; res < cnt; res++) { r_arr[res] = exp(-decay[res] * sr_inv); }
+    for (t_int32 res = 0; res < cnt; res++) { cos_arr[res] = cos(w * freq[res]); }
+    for (t_int32 res = 0; res < cnt; res++) { sin_arr[res] = sin(w * freq[res]); }
+  }
+
+  // The coefficients of both kernels, as in reson_update
+  for (t_int32 res = 0; res < cnt; res++) {
+    t_resonator* reson = bank->reson_arr + res;
+    t_double r = r_arr[res];
+    t_double sin_t = sin_arr[res];
+    if (fabs(sin_t) < 1e-9) { sin_t = (sin_t < 0) ? -1e-9 : 1e-9; }
+
+    reson->a0 = ampl[res];
+    reson->freq = freq[res];
+    reson->decay = decay[res];
+    reson->b1 = 2 * r * cos_arr[res];
+    reson->b2 = -r * r;
+    reson->p_re = r * cos_arr[res];
+    reson->p_im = r * sin_arr[res];
+    reson->c_re = 0.5 * reson->a0;
+    reson->c_im = -0.5 * reson->a0 * cos_arr[res] / sin_t;
+
+    // The parameters change all the time: the resonators are not pruned
+    reson->skip &= ~SKIP_PRUNE;
+
+    if (reson->rate_cls) { _rate_coefs(x, reson); }
+  }
+
+  bank->prune_freq = 0;
+  bank->prune_ampl = 0;
+  bank->prune_decay = 0;
+
+  // The rate classes are assigned again when a frame is crossed
+  if ((bank->rate) && (frame != stream->frame_prev)) { bank->rate->dirty = true; }
+  stream->frame_prev = frame;
+}
+
+// ====  _STREAM_STEPS  ====
+
+//******************************************************************************
+//  Set the steps of the poles for an advance of the position in a frame
+//  The frequencies and decays are linear in the frame, so each block rotates
+//  the poles by the same angle and scales them by the same factor.
+//  dpos:  advance of the position in frames, for one block
+//
+static void _stream_steps(t_modal* x, t_bank* bank, t_stream* stream, t_double dpos) {
+
+  t_int32 cnt = MIN(stream->mode_cnt, bank->reson_cnt);
+  t_int32 frame = (t_int32)stream->pos;
+  t_int32 next = MIN(frame + 1, stream->frame_cnt - 1);
+
+  const t_float* src0 = stream->frame_arr + (t_ptr_size)3 * stream->mode_cnt * frame + stream->mode_cnt;
+  const t_float* src1 = stream->frame_arr + (t_ptr_size)3 * stream->mode_cnt * next + stream->mode_cnt;
+
+  t_double* step_r   = stream->work + 6 * cnt;
+  t_double* step_cos = step_r + cnt;
+  t_double* step_sin = step_cos + cnt;
+
+  t_double sr_inv = 1.0 / x->samplerate;
+  t_double w = TWOPI * sr_inv * bank->freq_mult * dpos;
+
+  for (t_int32 res = 0; res < cnt; res++) { step_cos[res] = cos(w * (src1[res] - src0[res])); }
+  for (t_int32 res = 0; res < cnt; res++) { step_sin[res] = sin(w * (src1[res] - src0[res])); }
+
+  src0 += stream->mode_cnt; src1 += stream->mode_cnt;
+  for (t_int32 res = 0; res < cnt; res++) {
+    t_double d0 = MAX(src0[res] * bank->decay_mult, PRUNE_DECAY_MIN);
+    t_double d1 = MAX(src1[res] * bank->decay_mult, PRUNE_DECAY_MIN);
+    step_r[res] = exp(-(d1 - d0) * dpos * sr_inv);
+  }
+}
+
+// ====  _STREAM_PERFORM  ====
+
+//******************************************************************************
+//  Update a streamed bank at the start of a block, called by the perform routine
+//  The parameters are set at the current position, which is then advanced by
+//  the duration of the block. The playback stops at either end of the stream.
+//  The poles are calculated when a frame is crossed, and only advanced by
+//  their steps for the next blocks in the same frame.
+//
+void _stream_perform(t_modal* x, t_bank* bank, t_int32 sampleframes) {
+
+  t_stream* stream = bank->stream;
+  t_bool is_update = stream->is_dirty;
+
+  if (stream->is_seek) {
+    stream->pos = CLAMP(stream->seek, 0.0, (t_double)(stream->frame_cnt - 1));
+    stream->is_seek = false;
+    is_update = true;
+  }
+
+  if ((!stream->is_playing) && (!is_update)) { return; }
+  stream->is_dirty = false;
+
+  _stream_coefs(x, bank, stream, stream->pos, (stream->is_step) && (!is_update));
+  stream->is_step = false;
+
+  // Impulse responses would not match the parameters
+  bank->conv_targ = false;
+
+  if (!stream->is_playing) { return; }
+
+  t_double pos = stream->pos + stream->rate * stream->frame_rate * sampleframes / x->samplerate;
+  t_double last = (t_double)(stream->frame_cnt - 1);
+  if ((pos <= 0.0) || (pos >= last)) {
+    pos = CLAMP(pos, 0.0, last);
+    stream->is_playing = false;
+  }
+
+  // The next block stays in the frame: the poles only need to be advanced
+  else if ((t_int32)pos == (t_int32)stream->pos) {
+    _stream_steps(x, bank, stream, pos - stream->pos);
+    stream->is_step = true;
+  }
+
+  stream->pos = pos;
+}
+
+// ====  STREAM_STREAM  ====
+
+//******************************************************************************
+//  Stream time varying modal frames into a bank
+//  stream open (bank) (sym: name) [sym: file name]
+//  stream play / stop (bank)
+//  stream pos (bank) (float: position in ms)
+//  stream rate (bank) (float: rate, 1 for the frame rate of the file)
+//  The bank is built from the first frame by the worker thread, and the
+//  reply is:  stream (bank) (name) (count) (gain)
+//
+void stream_stream(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("stream_stream");
+
+  MY_ASSERT((argc < 2) || (atom_gettype(argv) != A_SYM),
+    "stream:  Arg 0:  Command expected:  open / play / stop / pos / rate.");
+  t_symbol* cmd = atom_getsym(argv);
+
+  // Argument 1 should reference a bank
+  t_bank* bank = bank_find(x, argv + 1, sym);
+  MY_ASSERT(!bank, "stream:  Arg 1:  Bank not found.");
+
+  // ====  OPEN:  Build the bank from a frame stream file  ====
+
+  if (cmd == gensym("open")) {
+
+    MY_ASSERT((argc != 3) && (argc != 4), "stream open:  3 or 4 args expected:  stream open (bank) (sym: name) [sym: file name]");
+    t_symbol* name = atom_getsym(argv + 2);
+    MY_ASSERT(name == gensym(""), "stream open:  Arg 2:  Symbol expected for the name of the bank.");
+
+    char     file_name[MAX_FILENAME_CHARS];
+    short    file_path;
+    t_fourcc file_type = FOUR_CHAR_CODE('YMFR');
+
+    // Argument 3 is the file name, otherwise open a dialog box
+    if (argc == 4) {
+      MY_ASSERT(atom_gettype(argv + 3) != A_SYM, "stream open:  Arg 3:  Symbol expected for the file name.");
+      MY_ASSERT(path_frompathname(atom_getsym(argv + 3)->s_name, &file_path, file_name),
+        "stream open:  Arg 3:  Invalid path and file name.");
+    }
+    else {
+      open_promptset("Choose a frame stream file.");
+      if (open_dialog(file_name, &file_path, &file_type, &file_type, 1) != 0) { return; }
+    }
+
+    _load_queue(x, bank, LOAD_STREAM, name, file_name, file_path, NULL);
+    return;
+  }
+
+  t_stream* stream = bank->stream;
+  MY_ASSERT(!stream, "stream %s:  Arg 1:  The bank is not streamed.", cmd->s_name);
+
+  // ====  PLAY / STOP  ====
+  // Playing again from the end starts from the other end
+
+  if ((cmd == gensym("play")) || (cmd == gensym("stop"))) {
+
+    MY_ASSERT(argc != 2, "stream %s:  2 args expected:  stream %s (bank)", cmd->s_name, cmd->s_name);
+
+    if (cmd == gensym("play")) {
+      t_double pos = (stream->is_seek) ? stream->seek : stream->pos;
+      if ((stream->rate > 0) && (pos >= stream->frame_cnt - 1)) { stream->seek = 0.0; stream->is_seek = true; }
+      else if ((stream->rate < 0) && (pos <= 0.0)) { stream->seek = stream->frame_cnt - 1; stream->is_seek = true; }
+    }
+    stream->is_playing = (cmd == gensym("play"));
+  }
+
+  // ====  POS:  Set the position in ms  ====
+
+  else if (cmd == gensym("pos")) {
+
+    MY_ASSERT((argc != 3) || ((atom_gettype(argv + 2) != A_FLOAT) && (atom_gettype(argv + 2) != A_LONG)),
+      "stream pos:  3 args expected:  stream pos (bank) (float: position in ms)");
+
+    t_double pos = atom_getfloat(argv + 2);
+    MY_ASSERT(pos < 0, "stream pos:  Arg 2:  Positive float expected for the position in ms.");
+
+    stream->seek = pos * stream->frame_rate / 1000.0;
+    stream->is_seek = true;
+  }
+
+  // ====  RATE:  Set the playback rate  ====
+
+  else if (cmd == gensym("rate")) {
+
+    MY_ASSERT((argc != 3) || ((atom_gettype(argv + 2) != A_FLOAT) && (atom_gettype(argv + 2) != A_LONG)),
+      "stream rate:  3 args expected:  stream rate (bank) (float: rate)");
+
+    stream->rate = atom_getfloat(argv + 2);
+  }
+
+  else { MY_ERR("stream:  Arg 0:  Command expected:  open / play / stop / pos / rate."); }
+}
@@ -0,0 +1,323 @@
+#include "modal~.h"
+
+// ====  VOICE_VOICES  ====
+
+//******************************************************************************
+//  Set up a range of banks as voices, cloned from a template bank
+//  All the allocations are done here, so that notes can be played without any
+//  allocation: the voices are then taken from a stack of free voices, or the
+//  quietest voice is stolen, as tracked by the perform routine.
+//  The voices are cloned into a separate array, and swapped into the range of
+//  banks by the perform routine, which owns them. The replaced banks are freed
+//  by the main thread.
+//  voices (template bank) (int: first bank index) (int: voice count) [float: reference pitch]
+//  voices off
+//
+void voice_voices(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("voice_voices");
+
+  // "voices off": stop using banks as voices
+  if ((argc == 1) && (atom_gettype(argv) == A_SYM) && (atom_getsym(argv) == gensym("off"))) {
+    systhread_mutex_lock(x->load_mutex);
+    _voice_release(x);
+    x->voice_pend = 0;
+    systhread_mutex_unlock(x->load_mutex);
+    qelem_set(x->load_qelem);
+    return;
+  }
+
+  MY_ASSERT((argc != 3) && (argc != 4),
+    "voices:  3 or 4 args expected:  voices (template bank) (int: first bank) (int: count) [float: reference pitch]");
+
+  // Argument 0 should reference the template bank
+  t_bank* bank_tmpl = bank_find(x, argv, sym);
+  MY_ASSERT(!bank_tmpl, "voices:  Arg 0:  Template bank not found.");
+  t_int32 tmpl_ind = (t_int32)(bank_tmpl - x->bank_arr);
+
+  // Arguments 1 and 2 should be the range of banks used as voices
+  MY_ASSERT((atom_gettype(argv + 1) != A_LONG) || (atom_gettype(argv + 2) != A_LONG),
+    "voices:  Args 1 and 2:  Int expected.");
+  t_int32 first = (t_int32)atom_getlong(argv + 1);
+  t_int32 cnt = (t_int32)atom_getlong(argv + 2);
+  MY_ASSERT((first < 0) || (cnt < 1) || (first + cnt > x->bank_cnt),
+    "voices:  Args 1 and 2:  Invalid range of banks:  %i to %i.", first, first + cnt - 1);
+  MY_ASSERT((tmpl_ind >= first) && (tmpl_ind < first + cnt),
+    "voices:  The template bank should not be in the range of voices.");
+
+  // Argument 3 is the optional reference pitch of the template
+  t_double ref = (argc == 4) ? atom_getfloat(argv + 3) : VOICE_REF_DEF;
+
+  // Clone the template into each voice, switched off
+  t_bank* bank_arr = (t_bank*)sysmem_newptrclear(sizeof(t_bank) * cnt);
+  MY_ASSERT(!bank_arr, "voices:  Failed to allocate the voices.");
+
+  t_bank* bank = NULL;
+  for (t_int32 v = 0; v < cnt; v++) {
+    bank = bank_arr + v;
+    if (bank_clone(x, bank, bank_tmpl) != ERR_NONE) {
+      MY_ERR("voices:  Failed to clone the template into bank %i.", first + v);
+      for (t_int32 v2 = 0; v2 <= v; v2++) { bank_free(x, bank_arr + v2); }
+      sysmem_freeptr(bank_arr);
+      return;
+    }
+    bank->is_on = false;
+    bank->name = gensym("voice");
+  }
+
+  x->voice_ref = ref;
+  x->voice_freq_mult = bank_tmpl->freq_mult;
+
+  // Handed over to the perform routine, dropping the voices not installed yet
+  systhread_mutex_lock(x->load_mutex);
+  _voice_release(x);
+  x->voice_bank_arr = bank_arr;
+  x->voice_bank_cnt = cnt;
+  x->voice_kernel = x->kernel_cur;
+  x->voice_pend_first = first;
+  x->voice_pend = cnt;
+  systhread_mutex_unlock(x->load_mutex);
+
+  // Installed by the main thread if the perform routine is not running
+  qelem_set(x->load_qelem);
+
+  POST("voices:  %i voices in banks %i to %i, cloned from bank %i.", cnt, first, first + cnt - 1, tmpl_ind);
+}
+
+// ====  VOICE_NOTE  ====
+
+//******************************************************************************
+//  Queue a note to be played by the perform routine
+//  The frequency multiplier of the voice is calculated here, so that the
+//  perform routine only has to retune the frequencies of the resonators.
+//  The voices and their stack of free voices are only handled by the perform
+//  routine: the queue has a single writer on each side, the message thread
+//  writing the notes and the perform routine reading them.
+//  A velocity of 0 is ignored: the resonators ring out and the voice is
+//  released by the perform routine once it is silent.
+//  note (float: pitch) (float: velocity 0 - 127)
+//
+void voice_note(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("voice_note");
+
+  MY_ASSERT(argc != 2, "note:  2 args expected:  note (float: pitch) (float: velocity)");
+  MY_ASSERT((x->voice_cnt == 0) && (x->voice_pend <= 0), "note:  No voices.  Use the voices message first.");
+
+  t_double pitch = atom_getfloat(argv);
+  t_double vel = atom_getfloat(argv + 1);
+  if (vel <= 0) { return; }
+
+  t_uint32 write = (t_uint32)x->voice_write;
+  MY_ASSERT(write - (t_uint32)x->voice_read >= VOICE_QUEUE, "note:  Too many notes queued:  note ignored.");
+
+  // Fill the slot, then publish it
+  t_voice_note* note = x->voice_queue + (write & (VOICE_QUEUE - 1));
+  note->pitch = pitch;
+  note->freq_mult = x->voice_freq_mult * pow(2, (pitch - x->voice_ref) / 12);
+  note->ampl = CLAMP(vel, 0, 127) / 127;
+  ATOMIC_INCREMENT(&x->voice_write);
+}
+
+// ====  _VOICE_RETUNE  ====
+
+//******************************************************************************
+//  Retune a voice with a new frequency multiplier
+//  Only the frequency dependent coefficients are recalculated: the pole radius
+//  is kept from b2 = -r^2, and the amplitude threshold of the pruning does not
+//  depend on the frequencies. The voice starts from silence, so the resonators
+//  that are not pruned anymore are restored without fading.
+//
+static void _voice_retune(t_modal* x, t_bank* bank, t_double freq_mult) {
+
+  t_resonator* reson = NULL;
+  t_double r = 0.0, theta = 0.0, cos_t = 0.0, sin_t = 0.0;
+
+  bank->freq_mult = freq_mult;
+
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    reson = bank->reson_arr + res;
+
+    reson->freq = bank->model->freq_ref[res] * freq_mult;
+    r = sqrt(-reson->b2);
+    theta = TWOPI * reson->freq / x->samplerate;
+    cos_t = cos(theta);
+    sin_t = sin(theta);
+    if (fabs(sin_t) < 1e-9) { sin_t = (sin_t < 0) ? -1e-9 : 1e-9; }
+
+    // Biquad and phasor kernels, as in reson_update and _phasor_update
+    reson->b1 = 2 * r * cos_t;
+    reson->p_re = r * cos_t;
+    reson->p_im = r * sin_t;
+    reson->c_im = -0.5 * reson->a0 * cos_t / sin_t;
+
+    if (reson->rate_cls) { _rate_coefs(x, reson); }
+  }
+
+  if (bank->rate) { bank->rate->dirty = true; }
+  bank->conv_targ = false;
+
+  _bank_prune_flag(x, bank);
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+    if (!(bank->reson_arr + res)->skip) { (bank->reson_arr + res)->skip_A = 1.0; }
+  }
+}
+
+// ====  _VOICE_INSTALL  ====
+
+//******************************************************************************
+//  Install the range of voices set by the voices message
+//  The cloned voices are swapped with the banks they replace, which are freed
+//  later by the main thread. The previous voices are released, and all the
+//  new ones are free.
+//  Called with the mutex of the loads locked: by the perform routine between
+//  two blocks, or by the main thread if the perform routine is not running.
+//  Returns true if voices were installed
+//
+t_bool _voice_install(t_modal* x) {
+
+  if (x->voice_pend < 0) { return false; }
+
+  t_bank bank_tmp;
+  t_bank* bank = NULL;
+  t_int32 cnt = x->voice_pend;
+
+  for (t_int32 v = 0; v < x->voice_cnt; v++) { (x->bank_arr + x->voice_first + v)->voice_ind = -1; }
+
+  x->voice_first = x->voice_pend_first;
+  for (t_int32 v = 0; v < cnt; v++) {
+    bank = x->bank_arr + x->voice_first + v;
+    bank_tmp = *bank;
+    *bank = x->voice_bank_arr[v];
+    x->voice_bank_arr[v] = bank_tmp;
+    bank->voice_ind = v;
+    bank->voice_busy = false;
+
+    // The kernel has changed since the voices were cloned
+    if (x->voice_kernel != x->kernel_cur) {
+      for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+        if (x->kernel_cur == KERNEL_PHASOR) { _phasor_from_biquad(bank->reson_arr + res); }
+        else                                { _phasor_to_biquad(bank->reson_arr + res); }
+      }
+    }
+  }
+
+  // Push all the voices on the free stack, so that the first voice is popped first
+  for (t_int32 v = 0; v < cnt; v++) { x->voice_free[v] = cnt - 1 - v; }
+
+  x->voice_cnt = cnt;
+  x->voice_free_cnt = cnt;
+  x->voice_quiet = -1;
+  x->voice_steal = 0;
+  x->voice_pend = -1;
+  return true;
+}
+
+// ====  _VOICE_RELEASE  ====
+
+//******************************************************************************
+//  Free the voices cloned by the voices message: not installed yet, or the
+//  banks they replaced. Called by the main thread with the mutex of the loads
+//  locked, and by modal_free.
+//
+void _voice_release(t_modal* x) {
+
+  if (x->voice_bank_arr) {
+    for (t_int32 v = 0; v < x->voice_bank_cnt; v++) { bank_free(x, x->voice_bank_arr + v); }
+    sysmem_freeptr(x->voice_bank_arr);
+  }
+
+  x->voice_bank_arr = NULL;
+  x->voice_bank_cnt = 0;
+}
+
+// ====  _VOICE_NOTES  ====
+
+//******************************************************************************
+//  Called at the start of each perform cycle to play the queued notes
+//  Takes a voice from the free stack, or steals the quietest voice, then
+//  retunes the voice and strikes it at the start of the cycle.
+//
+void _voice_notes(t_modal* x) {
+
+  t_voice_note* note = NULL;
+  t_bank* bank = NULL;
+  t_int32 v = -1;
+
+  while (x->voice_read != x->voice_write) {
+    note = x->voice_queue + ((t_uint32)x->voice_read & (VOICE_QUEUE - 1));
+
+    // The notes queued before the voices were switched off are dropped
+    if (x->voice_cnt == 0) { ATOMIC_INCREMENT(&x->voice_read); continue; }
+
+    // Pop a free voice, or steal the quietest voice, or the next voice in turn
+    if (x->voice_free_cnt > 0) { v = x->voice_free[--x->voice_free_cnt]; }
+    else if (x->voice_quiet >= 0) { v = x->voice_quiet; }
+    else { v = x->voice_steal; x->voice_steal = (x->voice_steal + 1) % x->voice_cnt; }
+
+    bank = x->bank_arr + x->voice_first + v;
+
+    // A stolen voice is restarted from silence
+    if (bank->voice_busy) {
+      for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+        (bank->reson_arr + res)->y_m1 = 0.0;
+        (bank->reson_arr + res)->y_m2 = 0.0;
+        (bank->reson_arr + res)->u_re = 0.0;
+        (bank->reson_arr + res)->u_im = 0.0;
+      }
+    }
+
+    // Retune the voice relative to the reference pitch of the template
+    _voice_retune(x, bank, note->freq_mult);
+
+    // Strike the voice with an impulse at the start of the cycle
+    bank->voice_pitch = note->pitch;
+    bank->voice_busy = true;
+    bank->rms_peak = 0.0;
+    bank->imp_ampl = note->ampl;
+    bank->imp_cntd = 0;
+    bank->is_on = true;
+
+    // The quietest voice is recalculated at the end of the cycle
+    if (v == x->voice_quiet) { x->voice_quiet = -1; }
+
+    ATOMIC_INCREMENT(&x->voice_read);
+  }
+}
+
+// ====  _VOICE_UPDATE  ====
+
+//******************************************************************************
+//  Called once per perform cycle, after all the banks are processed
+//  Releases the voices that have become silent, and finds the quietest voice
+//  The level of a voice is the sum of the smoothed rms of its resonators
+//
+void _voice_update(t_modal* x) {
+
+  t_bank* bank = NULL;
+  t_double rms_min = -1;
+
+  x->voice_quiet = -1;
+
+  for (t_int32 v = 0; v < x->voice_cnt; v++) {
+    bank = x->bank_arr + x->voice_first + v;
+    if (!bank->voice_busy) { continue; }
+
+    // Track the peak level since the note, ignoring voices that are not struck yet
+    if (bank->imp_ampl != 0.0) { continue; }
+    if (bank->rms_sum > bank->rms_peak) { bank->rms_peak = bank->rms_sum; }
+
+    // Release a silent voice: switch it off and push it on the free stack
+    if (bank->rms_sum <= bank->rms_peak * VOICE_SILENT) {
+      bank->voice_busy = false;
+      bank->is_on = false;
+      x->voice_free[x->voice_free_cnt++] = v;
+    }
+
+    // Otherwise check if it is the quietest voice
+    else if ((rms_min < 0) || (bank->rms_sum < rms_min)) {
+      rms_min = bank->rms_sum;
+      x->voice_quiet = v;
+    }
+  }
+}
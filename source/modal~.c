@@ -56,6 +56,7 @@ void C74_EXPORT ext_main(void* r) {
 
   class_addmethod(c, (method)modal_dsp64,  "dsp64",  A_CANT, 0);
   class_addmethod(c, (method)modal_assist, "assist", A_CANT, 0);
+  class_addmethod(c, (method)modal_multichanneloutputs, "multichanneloutputs", A_CANT, 0);
 
   class_addmethod(c, (method)modal_out_type, "out_type", A_SYM, 0);
   class_addmethod(c, (method)modal_out_sort, "out_sort", A_SYM, 0);
@@ -71,6 +72,11 @@ void C74_EXPORT ext_main(void* r) {
   class_addmethod(c, (method)io_rename, "rename", A_GIMME, 0);
   class_addmethod(c, (method)io_delete, "delete", A_GIMME, 0);
   class_addmethod(c, (method)io_clear,  "clear",  A_GIMME, 0);
+  class_addmethod(c, (method)load_cancel, "cancel", A_GIMME, 0);
+  class_addmethod(c, (method)cache_cache, "cache",  A_GIMME, 0);
+  class_addmethod(c, (method)snap_snapshot, "snapshot", A_GIMME, 0);
+  class_addmethod(c, (method)stream_stream, "stream", A_GIMME, 0);
+  class_addmethod(c, (method)sdif_import, "sdif", A_GIMME, 0);
 
   class_addmethod(c, (method)modal_info,  "info",  A_GIMME, 0);
   class_addmethod(c, (method)modal_param, "param", A_GIMME, 0);
@@ -83,6 +89,7 @@ void C74_EXPORT ext_main(void* r) {
 
   class_addmethod(c, (method)modal_is_on,      "is_on", A_GIMME, 0);
   class_addmethod(c, (method)modal_gain,       "gain",  A_GIMME, 0);
+  class_addmethod(c, (method)modal_route,      "route", A_GIMME, 0);
   class_addmethod(c, (method)modal_ampl_mult,  "ampl",  A_GIMME, 0);
   class_addmethod(c, (method)modal_freq_shift, "freq",  A_GIMME, 0);
   class_addmethod(c, (method)modal_decay_mult, "decay", A_GIMME, 0);
@@ -104,6 +111,40 @@ void C74_EXPORT ext_main(void* r) {
   class_addmethod(c, (method)state_velocity,     "velocity",     A_GIMME, 0);
   class_addmethod(c, (method)state_freeze,       "freeze",       A_GIMME, 0);
 
+  // ====  VOICES  ====
+
+  class_addmethod(c, (method)voice_voices, "voices", A_GIMME, 0);
+  class_addmethod(c, (method)voice_note,   "note",   A_GIMME, 0);
+
+  // ====  EXCITERS  ====
+
+  class_addmethod(c, (method)excite_strike, "strike", A_GIMME, 0);
+
+  // ====  LEVEL OF DETAIL  ====
+
+  class_addmethod(c, (method)skip_lod,    "lod",    A_GIMME, 0);
+  class_addmethod(c, (method)skip_pruned, "pruned", A_GIMME, 0);
+
+  // ====  STATISTICS  ====
+
+  class_addmethod(c, (method)stats_stats, "stats", A_GIMME, 0);
+
+  // ====  CONVOLUTION  ====
+
+  class_addmethod(c, (method)conv_conv, "conv", A_GIMME, 0);
+
+  // ====  INVERSE FFT SYNTHESIS  ====
+
+  class_addmethod(c, (method)ifft_ifft, "ifft", A_GIMME, 0);
+
+  // ====  MULTIRATE RENDERING  ====
+
+  class_addmethod(c, (method)rate_multirate, "multirate", A_GIMME, 0);
+
+  // ====  BINARY BANK FILES  ====
+
+  class_addmethod(c, (method)file_export, "export", A_GIMME, 0);
+
   // Ranges
 
   class_addmethod(c, (method)modal_get_ampl_rng,  "get_ampl_rng",  A_GIMME, 0);
@@ -128,6 +169,32 @@ void C74_EXPORT ext_main(void* r) {
   //CLASS_ATTR_FILTER_CLIP(c, "smoothing", 0, 1);
   //CLASS_ATTR_SAVE(c, "smoothing", 0);
 
+  // Resonator kernel: direct form two pole filter, or complex one pole
+  CLASS_ATTR_LONG(c, "kernel", 0, t_modal, kernel);
+  CLASS_ATTR_ENUMINDEX(c, "kernel", 0, "biquad phasor");
+  CLASS_ATTR_LABEL(c, "kernel", 0, "resonator kernel");
+  CLASS_ATTR_FILTER_CLIP(c, "kernel", KERNEL_BIQUAD, KERNEL_PHASOR);
+
+  // Collect DSP statistics, output with the stats message
+  CLASS_ATTR_LONG(c, "profile", 0, t_modal, profile);
+  CLASS_ATTR_STYLE_LABEL(c, "profile", 0, "onoff", "collect dsp statistics");
+  CLASS_ATTR_FILTER_CLIP(c, "profile", 0, 1);
+
+  // CPU budget as a fraction of the block period: 0 to disable
+  CLASS_ATTR_DOUBLE(c, "budget", 0, t_modal, budget);
+  CLASS_ATTR_LABEL(c, "budget", 0, "dsp time budget");
+  CLASS_ATTR_FILTER_CLIP(c, "budget", 0, 1);
+
+  // Number of inputs, as signal inlets or channels of a multichannel inlet: only read when the object is created
+  CLASS_ATTR_LONG(c, "inputs", 0, t_modal, in_cnt);
+  CLASS_ATTR_LABEL(c, "inputs", 0, "number of inputs");
+  CLASS_ATTR_FILTER_CLIP(c, "inputs", 1, IN_MAX);
+
+  // Multichannel inlet and outlet: only read when the object is created
+  CLASS_ATTR_LONG(c, "mc", 0, t_modal, mc_mode);
+  CLASS_ATTR_STYLE_LABEL(c, "mc", 0, "onoff", "multichannel output");
+  CLASS_ATTR_FILTER_CLIP(c, "mc", 0, 1);
+
   class_dspinit(c);
   class_register(CLASS_BOX, c);
   modal_class = c;
@@ -138,6 +205,9 @@ void C74_EXPORT ext_main(void* r) {
   sym_ampl = gensym("ampl");
   sym_freq = gensym("freq");
   sym_decay = gensym("decay");
+
+  // The model cache is shared by all the instances
+  _cache_init();
 }
 
 // ========  NEW INSTANCE ROUTINE: MODAL_NEW  ========
@@ -156,25 +226,33 @@ void* modal_new(t_symbol* sym, t_int32 argc, t_atom* argv) {
   }
   TRACE("modal_new");
 
-  dsp_setup((t_pxobject*)x, 1);                  // Creating one MSP inlet
+  // ====  Attributes  ====
+  // Processed first, as the inlets and outlets depend on them
+  // Only the arguments before the attributes are positional
 
-  x->outl_float = floatout((t_object*)x);
-  x->outl_mess = outlet_new((t_object*)x, NULL);  // Outlet 8: For messages
+  x->mc_mode = 0;
+  x->in_cnt = 1;
+  x->kernel = KERNEL_BIQUAD;
+  x->kernel_cur = KERNEL_BIQUAD;
+  attr_args_process(x, (short)argc, argv);
+  argc = (t_int32)attr_args_offset((short)argc, argv);
+  x->in_cnt = CLAMP(x->in_cnt, 1, IN_MAX);
 
-  outlet_new((t_object*)x, "signal");            // Outlet 7: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 6: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 5: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 4: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 3: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 2: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 1: For signals
-  outlet_new((t_object*)x, "signal");            // Outlet 0: For signals
+  // ====  Inlets  ====
+  // One multichannel inlet, or one signal inlet per input
 
-  x->obj.z_misc |= Z_NO_INPLACE;      // Separate input and output arrays
+  if (x->mc_mode) {
+    dsp_setup((t_pxobject*)x, 1);
+    x->obj.z_misc |= Z_MC_INLETS;
+  }
+  else {
+    dsp_setup((t_pxobject*)x, (long)x->in_cnt);
+  }
 
   // ====  Arguments  ====
 
   t_int32 state_cnt = 0;
+  x->chan_cnt = CHAN_CNT_DEF;
 
   // If no arguments are provided, the default values are used
   if (argc == 0) {
@@ -211,6 +289,20 @@ void* modal_new(t_symbol* sym, t_int32 argc, t_atom* argv) {
     x->reson_max = (t_int32)atom_getlong(argv + 1);
     state_cnt = (t_int32)atom_getlong(argv + 2);
   }
+  // If four arguments are provided, get:
+  // the number of banks, the max number of resonators, the number of states, and the number of channels
+  else if ((argc == 4)
+      && (atom_gettype(argv) == A_LONG) && (atom_getlong(argv) >= 1)
+      && (atom_gettype(argv + 1) == A_LONG) && (atom_getlong(argv + 1) >= 1)
+      && (atom_gettype(argv + 2) == A_LONG) && (atom_getlong(argv + 2) >= 1)
+      && (atom_gettype(argv + 3) == A_LONG) && (atom_getlong(argv + 3) >= 1)
+      && (atom_getlong(argv + 3) <= CHAN_MAX) && !(atom_getlong(argv + 3) & (atom_getlong(argv + 3) - 1))) {
+
+    x->bank_cnt   = (t_int32)atom_getlong(argv);
+    x->reson_max = (t_int32)atom_getlong(argv + 1);
+    state_cnt = (t_int32)atom_getlong(argv + 2);
+    x->chan_cnt = (t_int32)atom_getlong(argv + 3);
+  }
   // Otherwise the arguments are invalid and the default values are used
   else {
     x->bank_cnt   = BANK_CNT_DEF;
@@ -218,20 +310,66 @@ void* modal_new(t_symbol* sym, t_int32 argc, t_atom* argv) {
     state_cnt = STATE_CNT_DEF;
 
     MY_ERR("modal_new:  Invalid arguments.  The method expects:");
-    MY_ERR2("  The arguments determine the number of banks, maximum resonators per bank, and number of states.");
-    MY_ERR2("  The default values are:  Banks: %i - Max reson: %i - States: %i.", BANK_CNT_DEF, RESON_MAX_DEF, STATE_CNT_DEF);
+    MY_ERR2("  The arguments determine the number of banks, maximum resonators per bank, number of states, and number of channels.");
+    MY_ERR2("  The default values are:  Banks: %i - Max reson: %i - States: %i - Channels: %i.", BANK_CNT_DEF, RESON_MAX_DEF, STATE_CNT_DEF, CHAN_CNT_DEF);
     MY_ERR2("  Possible arguments are:");
     MY_ERR2("    No arguments:  All defaults");
     MY_ERR2("    One Int:    Banks: Arg 0");
     MY_ERR2("    Two Int:    Banks: Arg 0 - Max reson: Arg 1");
     MY_ERR2("    Three Int:  Banks: Arg 0 - Max reson: Arg 1 - States: Arg 2");
+    MY_ERR2("    Four Int:   Banks: Arg 0 - Max reson: Arg 1 - States: Arg 2 - Channels: Arg 3 (1, 2, 4, 8, 16, 32 or 64)");
 }
 
-  POST("modal_new:  modal~ object created:  %i banks, %i resonators max, %i states.", x->bank_cnt, x->reson_max, state_cnt);
+  // ====  Outlets  ====
+  // Created right to left: the message outlet is after the signal outlets
+
+  x->outl_float = floatout((t_object*)x);
+  x->outl_mess = outlet_new((t_object*)x, NULL);  // Last outlet: For messages
+
+  // One multichannel outlet, or one outlet per channel
+  if (x->mc_mode) {
+    outlet_new((t_object*)x, "multichannelsignal");  // Outlet 0: For a multichannel signal
+  }
+  else {
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      outlet_new((t_object*)x, "signal");          // Outlets 0 to chan_cnt - 1: For signals
+    }
+  }
+
+  x->obj.z_misc |= Z_NO_INPLACE;      // Separate input and output arrays
+
+  // Select the mixing kernel for the channel count
+  _mix_func_set(x);
+
+  POST("modal_new:  modal~ object created:  %i banks, %i resonators max, %i states, %i channels%s.",
+    x->bank_cnt, x->reson_max, state_cnt, x->chan_cnt, x->mc_mode ? " (multichannel)" : "");
   POST("  You need to load modal models before using the object.");
 
   // Set pointers to NULL
   x->outp_mess_arr = NULL;
+  x->mix_buf = NULL;
+  x->in_buf = NULL;
+  x->vec_max = 0;
+  x->voice_free = NULL;
+  x->voice_cnt = 0;
+  x->voice_free_cnt = 0;
+  x->voice_quiet = -1;
+  x->voice_write = 0;
+  x->voice_read = 0;
+  x->voice_pend = -1;
+  x->voice_bank_arr = NULL;
+  x->voice_bank_cnt = 0;
+  x->budget = 0.0;
+  x->load = 0.0;
+  x->cull_frac = 0.0;
+  x->profile = 0;
+  x->stats_dict = NULL;
+
+  // No loads queued
+  _load_init(x);
+
+  // No snapshots
+  _snap_init(x);
 
   // Initializing variables
   x->master      = MASTER_MULT;
@@ -252,6 +390,12 @@ void* modal_new(t_symbol* sym, t_int32 argc, t_atom* argv) {
       return NULL;
     }
   }
+  // The stack of free voices, for any range of banks used as voices
+  x->voice_free = (t_int32*)sysmem_newptr(sizeof(t_int32) * x->bank_cnt);
+  if (!x->voice_free) {
+    MY_ERR("modal_new:  Failed to allocate voice_free.");
+    return NULL;
+  }
   // Set the ramping function, inverse function, and parameter
   x->ramp_param     = 4;
   x->ramp_func     = ramp_exp;
@@ -263,6 +407,8 @@ void* modal_new(t_symbol* sym, t_int32 argc, t_atom* argv) {
     MY_ERR("modal_new:  Failed to allocate state_arr.");
     return NULL;
   }
+  x->state_index.slot_arr = NULL;
+  x->state_index.slot_cnt = 0;
   // Initialize the temporary state used for calculations
   _state_init(x->state_tmp, x->reson_max, 0, 0);
   if ((!x->state_tmp->U_arr) || (!x->state_tmp->A_arr)) {
@@ -286,6 +432,7 @@ void* modal_new(t_symbol* sym, t_int32 argc, t_atom* argv) {
   x->sort_type = OUT_SORT_FREQ;
   x->a_smoothing = 0.1;
 
+  x->bank_cur = x->bank_arr;
   x->reson_cur = x->bank_arr->reson_arr;
 
   return (x);
@@ -298,13 +445,23 @@ void modal_free(t_modal* x) {
 
   TRACE("modal_free");
 
+  // Stop the worker thread first, it builds banks
+  _load_free(x);
+  _snap_free(x);
+  _voice_release(x);
+
   for (int i = 0; i < x->bank_cnt; i++) { bank_free(x, x->bank_arr + i); }
   if (x->bank_arr) { sysmem_freeptr(x->bank_arr); }
 
   if (x->state_arr) { _state_arr_free(&(x->state_arr), &(x->state_cnt)); }
+  _state_index_free(x);
   _state_free(x->state_tmp);
 
   if (x->outp_mess_arr) { sysmem_freeptr(x->outp_mess_arr); }
+  if (x->mix_buf)       { sysmem_freeptr(x->mix_buf); }
+  if (x->in_buf)        { sysmem_freeptr(x->in_buf); }
+  if (x->voice_free)    { sysmem_freeptr(x->voice_free); }
+  if (x->stats_dict)    { object_free(x->stats_dict); }
 
   dsp_free((t_pxobject*)x);
 }
@@ -319,6 +476,19 @@ void modal_dsp64(
   TRACE("modal_dsp64");
   POST("Samplerate = %.0f - Maxvectorsize = %i", samplerate, maxvectorsize);
 
+  // Allocate the scratch tile used to mix the resonator outputs
+  x->mix_buf = (t_double*)sysmem_resizeptr(x->mix_buf, sizeof(t_double) * MIX_TILE * maxvectorsize);
+  if (!x->mix_buf) { MY_ERR("modal_dsp64:  Failed to allocate mix_buf."); x->vec_max = 0; return; }
+  x->vec_max = (t_int32)maxvectorsize;
+
+  // Allocate the buffer used to sum the inputs routed to a bank
+  x->in_buf = (t_double*)sysmem_resizeptrclear(x->in_buf, sizeof(t_double) * maxvectorsize);
+  if (!x->in_buf) { MY_ERR("modal_dsp64:  Failed to allocate in_buf."); return; }
+
+  // Store which inlets are connected, unconnected inlets are skipped when routing
+  // A multichannel inlet is considered connected, its channel count is known in the perform routine
+  for (t_int32 i = 0; i < x->in_cnt; i++) { x->in_conn[i] = (x->mc_mode) ? true : (t_bool)count[i]; }
+
   object_method(dsp64, gensym("dsp_add64"), x, modal_perform64, 0, NULL);
 
   // Recalculate everything that depends on the samplerate
@@ -326,24 +496,63 @@ void modal_dsp64(
   x->msr = x->samplerate / 1000;
 
   // Update the banks of resonators
-  for (int i = 0; i < x->bank_cnt; i++) { bank_update(x, x->bank_arr + i); }
+  for (int i = 0; i < x->bank_cnt; i++) {
+    x->bank_arr[i].diff_ramp = (t_int32)(x->bank_arr[i].diff_ramp_ms * x->msr);
+    bank_update(x, x->bank_arr + i);
+  }
 }
 
 // ========  METHOD: MODAL_PERFORM64  ========
+// Each resonator is rendered into one row of a scratch tile, with the bank and
+// resonator gains applied. Full tiles are then mixed into the channel buses
+// with the diffusion gains, using the mixing kernel for the channel count.
 
 void modal_perform64(
   t_modal* x, t_object* dsp64, t_double** ins, long numins, t_double** outs,
   long numouts, long sampleframes, long flags, void* userparam) {
 
-  // Input and output vectors
-  t_double* in = ins[0];
-  t_double* out0 = outs[0], *out1 = outs[1], *out2 = outs[2], *out3 = outs[3];
-  t_double* out4 = outs[4], *out5 = outs[5], *out6 = outs[6], *out7 = outs[7];
+  // Start timing the perform routine for the CPU budget
+  t_double time_start = (x->budget > 0) ? time_now_ms() : 0.0;
+
+  // Input vector of the bank, current row of the tile and position in it
+  t_double* bank_in = NULL;
+  t_double* in = NULL;
+  t_double* row = NULL;
+  t_double* buf = NULL;
+
+  // Tell the main thread that the perform routine runs, and output silence
+  // while the main thread installs, see _load_install_main
+  x->perform_cnt++;
+  ATOMIC_INCREMENT(&x->perform_busy);
+  if (x->load_installing) {
+    for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+      for (int i = 0; i < sampleframes; i++) { outs[ch][i] = 0; }
+    }
+    ATOMIC_DECREMENT(&x->perform_busy);
+    return;
+  }
+
+  // Convert the states of the resonators if the kernel has changed
+  if (x->kernel_cur != x->kernel) { _kernel_switch(x); }
+
+  // Install the banks built by the worker thread, the impulse responses and
+  // inverse FFT syntheses built by the main thread, and the banks of a recalled
+  // snapshot, without waiting for the mutex
+  if ((_load_pending(x)) && (!systhread_mutex_trylock(x->load_mutex))) {
+    t_int32 installed = _load_install(x) + _conv_install(x) + _ifft_install(x) + _voice_install(x);
+    t_bool recalled = _snap_install(x);
+    systhread_mutex_unlock(x->load_mutex);
+    if (installed) { qelem_set(x->load_qelem); }
+    if (recalled) { qelem_set(x->snap_qelem); }
+  }
+
+  // Play the notes queued since the last cycle
+  _voice_notes(x);
 
   // Set all output vectors to 0
-  for (int i = 0; i < sampleframes; i++) {
-    out0[i] = 0; out1[i] = 0; out2[i] = 0; out3[i] = 0;
-    out4[i] = 0; out5[i] = 0; out6[i] = 0; out7[i] = 0;
+  // In multichannel mode the channels of the outlet are laid out in the same way
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) {
+    for (int i = 0; i < sampleframes; i++) { outs[ch][i] = 0; }
   }
 
   // Loop through all the banks
@@ -353,33 +562,81 @@ void modal_perform64(
 
     if (bank->is_on == true) {
 
+      // Start timing the bank for the statistics
+      t_double time_bank = (x->profile) ? time_now_ms() : 0.0;
+
+      // Set the parameters of a streamed bank from its frames
+      if (bank->stream) { _stream_perform(x, bank, (t_int32)sampleframes); }
+
+      // Route the inputs into the bank, and flag the bank if its input is silent
+      bank_in = _route_inputs(x, bank, ins, numins, sampleframes);
+
+      // Add the internal exciters to the input of the bank
+      bank_in = _excite(x, bank, bank_in, sampleframes);
+
+      bank->rms_sum = 0.0;
+
+      // Smooth the gain compensating for the level of detail
+      bank->lod_gain_cur += LOD_SMOOTH * (bank->lod_gain - bank->lod_gain_cur);
+
       // Variables for the loop through all the resonators
       t_resonator* reson = bank->reson_arr;
       t_int32 chunk_len = -1;
       t_int32 counter = 0;
       t_int32 counter_x_vel = 0;
       t_int32 cntd_d_vel = 0;
-      t_double gain_bank = x->master * bank->gain;
+      t_int32 tile_cnt = 0;
+      t_bool  is_active = false;
+      t_bool  is_skipped = false;
+      t_double gain_bank = x->master * bank->gain * bank->lod_gain_cur;
       t_double d_ampl = 0.0;
       t_double gain_res = 0.0;
       t_double sum_sqr = 0.0;
       t_double tmp = 0.0;
       t_double dA = 0.0;
+      t_double gain_rec = 1.0;
+      t_double d_rec = 0.0;
+
+      // Counters for the statistics: cheap enough to be always incremented
+      t_int32 cnt_active = 0;
+      t_int32 cnt_chunk = 0;
+      t_int32 cnt_full = 0;  // Resonators rendered by the chunk loop, at full rate
+      t_int32 cnt_iter = 0;
+
+      // Render the bank by inverse FFT synthesis: the recursion is skipped
+      t_int32 reson_cnt = bank->reson_cnt;
+      if ((bank->ifft) && (_ifft_perform(x, bank, bank_in, outs, sampleframes, gain_bank))) { reson_cnt = 0; }
+
+      // Render the bank by convolution: the recursion is faded out, then skipped
+      // The gain of the recursion is ramped on the rows of the tiles
+      if ((bank->conv) && ((bank->conv_targ) || (bank->conv_A > 0.0))) {
+        gain_rec = _conv_perform(x, bank, bank_in, outs, sampleframes, gain_bank, &d_rec);
+        if ((gain_rec == 0.0) && (d_rec == 0.0)) { reson_cnt = 0; }
+      }
+      t_bool is_ramped = (gain_rec != 1.0) || (d_rec != 0.0);
+
+      // Render the low resonators at decimated rates, and skip them below
+      if ((bank->rate) && (reson_cnt)) { _rate_perform(x, bank, bank_in, outs, sampleframes, gain_bank); }
 
       // Loop through all the resonators
-      for (t_int32 res = 0; res < bank->reson_cnt; res++) {
+      for (t_int32 res = 0; res < reson_cnt; res++) {
 
         // Set the resonator and initialize
         reson = bank->reson_arr + res;
+        if (reson->rate_cls) { continue; }
+        cnt_full++;
         counter = sampleframes;
-        in = ins[0];
-        out0 = outs[0]; out1 = outs[1]; out2 = outs[2]; out3 = outs[3];
-        out4 = outs[4]; out5 = outs[5]; out6 = outs[6]; out7 = outs[7];
+        in = bank_in;
+        row = buf = x->mix_buf + tile_cnt * x->vec_max;
+        is_active = false;
+        is_skipped = (reson->skip) && (reson->skip_A == 0.0);
         sum_sqr = 0.0;
 
         // Keep looping until all the chunks are processed
         while (counter) {
 
+          cnt_chunk++;
+
           // == Calculate:
           //   chunk_len:   the number of samples to process in this chunk loop - cannot be 0
           //   counter:     the number of samples left to process in this perform cycle
@@ -412,11 +669,14 @@ void modal_perform64(
 
           // ==== Process the chunk depending on the mode of the resonator
 
-          // == RESONATOR IS OFF
-          // == Iterate the input and output pointers so they will be ready for the next chunk
-          if (reson->mode_type == MODE_TYPE_OFF) {
-            out0 += chunk_len; out1 += chunk_len; out2 += chunk_len; out3 += chunk_len;
-            out4 += chunk_len; out5 += chunk_len; out6 += chunk_len; out7 += chunk_len; in += chunk_len;
+          // == RESONATOR IS OFF, OR SKIPPED AND FADED OUT
+          // == Clear the chunk in the row, unless the resonator is off for the whole vector
+          // == Iterate the input and row pointers so they will be ready for the next chunk
+          if ((reson->mode_type == MODE_TYPE_OFF) || (is_skipped)) {
+            if (chunk_len != sampleframes) {
+              for (t_int32 smp = 0; smp < chunk_len; smp++) { buf[smp] = 0.0; }
+            }
+            buf += chunk_len; in += chunk_len;
           }
 
           // == RESONATOR IS FIXED, FROZEN OR INDEFINITE
@@ -425,24 +685,42 @@ void modal_perform64(
 
             // The output gain does not vary over the chunk
             gain_res = gain_bank * reson->out_A_cur;
+            is_active = true;
+
+            // The input of the bank is silent: zero input recurrence, split at an impulse
+            if (bank->in_silent) {
+              if (x->kernel_cur == KERNEL_PHASOR) {
+                _reson_phasor_zero_input(reson, buf, chunk_len, gain_res, &sum_sqr,
+                  bank->imp_ofs - (t_int32)(in - bank_in), bank->imp_ampl * reson->in_A_cur);
+              }
+              else {
+                _reson_zero_input(reson, buf, chunk_len, gain_res, &sum_sqr,
+                  bank->imp_ofs - (t_int32)(in - bank_in), bank->imp_ampl * reson->in_A_cur);
+              }
+              buf += chunk_len; in += chunk_len;
+            }
 
-            for (t_int32 smp = 0; smp < chunk_len; smp++) {
+            // Phasor kernel
+            else if (x->kernel_cur == KERNEL_PHASOR) {
+              _reson_phasor(reson, in, buf, chunk_len, 0.0, gain_res, &sum_sqr);
+              buf += chunk_len; in += chunk_len;
+            }
 
-              // Calculate the next value of the resonator
-              tmp = reson->a0 * (*in) * reson->in_A_cur + reson->b1 * reson->y_m1 + reson->b2 * reson->y_m2;
-              reson->y_m2 = reson->y_m1;
-              reson->y_m1 = tmp;
+            else {
+              for (t_int32 smp = 0; smp < chunk_len; smp++) {
 
-              // To calculate RMS. Does not include resonator gain
-              sum_sqr += tmp * tmp;
+                // Calculate the next value of the resonator
+                tmp = reson->a0 * (*in) * reson->in_A_cur + reson->b1 * reson->y_m1 + reson->b2 * reson->y_m2;
+                reson->y_m2 = reson->y_m1;
+                reson->y_m1 = tmp;
+
+                // To calculate RMS. Does not include resonator gain
+                sum_sqr += tmp * tmp;
 
-              // Apply gain and iterate the input and output pointers
-              tmp *= gain_res;
-              *out0 += tmp * reson->diff_mult[0]; *out1 += tmp * reson->diff_mult[1];
-              *out2 += tmp * reson->diff_mult[2]; *out3 += tmp * reson->diff_mult[3];
-              *out4 += tmp * reson->diff_mult[4]; *out5 += tmp * reson->diff_mult[5];
-              *out6 += tmp * reson->diff_mult[6]; *out7 += tmp * reson->diff_mult[7];
-              out0++; out1++; out2++; out3++; out4++; out5++; out6++; out7++; in++;
+                // Apply gain and iterate the input and row pointers
+                *buf++ = tmp * gain_res;
+                in++;
+              }
             }
           }
 
@@ -462,9 +740,33 @@ void modal_perform64(
 
             // Calculate dA
             dA = (tmp - reson->in_A_cur) / chunk_len;    // chunk_len cannot be 0
+            is_active = true;
+
+            // The input of the bank is silent: zero input recurrence, split at an impulse
+            // The input gain is ramped over the whole chunk
+            if (bank->in_silent) {
+              gain_res = gain_bank * reson->out_A_cur;
+              if (x->kernel_cur == KERNEL_PHASOR) {
+                _reson_phasor_zero_input(reson, buf, chunk_len, gain_res, &sum_sqr,
+                  bank->imp_ofs - (t_int32)(in - bank_in), bank->imp_ampl * reson->in_A_cur);
+              }
+              else {
+                _reson_zero_input(reson, buf, chunk_len, gain_res, &sum_sqr,
+                  bank->imp_ofs - (t_int32)(in - bank_in), bank->imp_ampl * reson->in_A_cur);
+              }
+              reson->in_A_cur += dA * chunk_len;
+              buf += chunk_len; in += chunk_len;
+            }
+
+            // Phasor kernel: the input gain is ramped per sample
+            else if (x->kernel_cur == KERNEL_PHASOR) {
+              gain_res = gain_bank * reson->out_A_cur;
+              _reson_phasor(reson, in, buf, chunk_len, dA, gain_res, &sum_sqr);
+              buf += chunk_len; in += chunk_len;
+            }
 
             // Loop over all the samples of the chunk
-            for (t_int32 smp = 0; smp < chunk_len; smp++) {
+            else for (t_int32 smp = 0; smp < chunk_len; smp++) {
 
               // Ramp current amplitude multipliers
               gain_res = gain_bank * reson->out_A_cur;
@@ -480,13 +782,9 @@ void modal_perform64(
               // To calculate RMS
               sum_sqr += tmp * tmp;
 
-              // Apply gain and iterate the input and output pointers
-              tmp *= gain_res;
-              *out0 += tmp * reson->diff_mult[0]; *out1 += tmp * reson->diff_mult[1];
-              *out2 += tmp * reson->diff_mult[2]; *out3 += tmp * reson->diff_mult[3];
-              *out4 += tmp * reson->diff_mult[4]; *out5 += tmp * reson->diff_mult[5];
-              *out6 += tmp * reson->diff_mult[6]; *out7 += tmp * reson->diff_mult[7];
-              out0++; out1++; out2++; out3++; out4++; out5++; out6++; out7++; in++;
+              // Apply gain and iterate the input and row pointers
+              *buf++ = tmp * gain_res;
+              in++;
             }
           }
 
@@ -516,13 +814,9 @@ void modal_perform64(
               // To calculate RMS
               sum_sqr += tmp * tmp;
 
-              // Apply gain and iterate the input and output pointers
-              tmp *= gain_res;
-              *out0 += tmp * reson->diff_mult[0]; *out1 += tmp * reson->diff_mult[1];
-              *out2 += tmp * reson->diff_mult[2]; *out3 += tmp * reson->diff_mult[3];
-              *out4 += tmp * reson->diff_mult[4]; *out5 += tmp * reson->diff_mult[5];
-              *out6 += tmp * reson->diff_mult[6]; *out7 += tmp * reson->diff_mult[7];
-              out0++; out1++; out2++; out3++; out4++; out5++; out6++; out7++; in++;
+              // Apply gain and iterate the input and row pointers
+              *buf++ = tmp * gain_res;
+              in++;
             }
           } */
 
@@ -534,15 +828,51 @@ void modal_perform64(
           // This happened either from outside the perform64 method, as a way to set an initial mode
           // Or within the chunk loop
   MODAL_PEFORM64_MODE_CHANGE:
-          if (reson->cntd == 0) { _mode_iterate(x, bank, reson); }
+          if (reson->cntd == 0) { _mode_iterate(x, bank, reson); cnt_iter++; }
         }
 
         // Smoothing parameter for rms output
         reson->rms = x->a_smoothing * sqrt(sum_sqr / sampleframes) + (1 - x->a_smoothing) * reson->rms;
+        bank->rms_sum += reson->rms;
+
+        // Fade the row of a resonator that is being skipped or restored
+        if ((is_active) && ((reson->skip) || (reson->skip_A != 1.0))) { _skip_fade(x, reson, row, sampleframes, 1); }
+
+        // Add the row to the tile, and mix the tile into the outputs when it is full
+        if (is_active) {
+          cnt_active++;
+          x->mix_tile[tile_cnt++] = reson;
+          if (tile_cnt == MIX_TILE) {
+            if (is_ramped) { _conv_ramp(x, tile_cnt, sampleframes, gain_rec, d_rec); }
+            x->mix_func(x, outs, tile_cnt, sampleframes, 1);
+            tile_cnt = 0;
+          }
+        }
+      }
+
+      // Mix the remaining partial tile
+      if (tile_cnt) {
+        if (is_ramped) { _conv_ramp(x, tile_cnt, sampleframes, gain_rec, d_rec); }
+        x->mix_func(x, outs, tile_cnt, sampleframes, 1);
+      }
+
+      // The impulse has been rendered by the zero input path
+      if (bank->imp_ofs >= 0) { bank->imp_ampl = 0.0; bank->imp_ofs = -1; }
+
+      // Collect the statistics of the bank
+      if (x->profile) {
+        _stats_bank(bank, time_now_ms() - time_bank, cnt_active, cnt_chunk - cnt_full, cnt_iter, cnt_full);
       }
     }
   }
 
+  // Release the silent voices and find the quietest one
+  if (x->voice_cnt) { _voice_update(x); }
+
+  // Adapt the number of culled resonators to the CPU budget
+  if (x->budget > 0) { _budget_update(x, time_now_ms() - time_start, sampleframes); }
+  else if (x->cull_frac > 0) { _budget_update(x, 0.0, sampleframes); }
+
   // == Output information for all resonators of one bank, done once per perform cycle
   // ==   matrixctrl (row index) (column index) (parameter value, scaled 0-100) ... (resonator count) times
 
@@ -590,7 +920,7 @@ void modal_perform64(
       for (t_int32 res = 0; res < bank->reson_cnt; res++) {
         atom_setlong(mess++, res % 10);
         atom_setlong(mess++, (t_int32)(res / 10));
-        atom_setlong(mess++, (t_int32)((((bank->reson_arr + out_sort[res])->diff_ind + 4) % 8) * 12.5));
+        atom_setlong(mess++, (t_int32)((((bank->reson_arr + out_sort[res])->diff_ind + x->chan_cnt / 2) % x->chan_cnt) * 100.0 / x->chan_cnt));
       }
     }
 
@@ -608,7 +938,9 @@ void modal_perform64(
   }
 
   // ==== Output a float for the scrolling multislider object
-  outlet_float(x->outl_float, x->reson_cur->rms);
+  if (x->reson_cur) { outlet_float(x->outl_float, x->reson_cur->rms); }
+
+  ATOMIC_DECREMENT(&x->perform_busy);
 }
 
 // ========  METHOD: MODAL_ASSIST  ========
@@ -619,25 +951,30 @@ void modal_assist(t_modal* x, void* b, long msg, t_int32 arg, char* str) {
 
   if (msg == ASSIST_INLET) {
     switch (arg) {
-    case 0: sprintf(str, "Inlet 0: All purpose (signal, list)"); break;
-    default: break;
+    case 0: sprintf(str, (x->mc_mode) ? "Inlet 0: All purpose (multichannel signal, list)" : "Inlet 0: All purpose (signal, list)"); break;
+    default: sprintf(str, "Inlet %i: Input %i (signal)", arg, arg); break;
   }
 }
 
-  else if (msg == ASSIST_OUTLET) {
-    switch (arg) {
-    case 0: sprintf(str, "Outlet 0: For signals - Channel 1 (signal)"); break;
-    case 1: sprintf(str, "Outlet 1: For signals - Channel 2 (signal)"); break;
-    case 2: sprintf(str, "Outlet 2: For signals - Channel 3 (signal)"); break;
-    case 3: sprintf(str, "Outlet 3: For signals - Channel 4 (signal)"); break;
-    case 4: sprintf(str, "Outlet 4: For signals - Channel 5 (signal)"); break;
-    case 5: sprintf(str, "Outlet 5: For signals - Channel 6 (signal)"); break;
-    case 6: sprintf(str, "Outlet 6: For signals - Channel 7 (signal)"); break;
-    case 7: sprintf(str, "Outlet 7: For signals - Channel 8 (signal)"); break;
-    case 8: sprintf(str, "Outlet 8: For messages (list)"); break;
-    default: break;
+  else if ((msg == ASSIST_OUTLET) && (x->mc_mode)) {
+    if (arg == 0) { sprintf(str, "Outlet 0: For signals - %i channels (multichannel signal)", x->chan_cnt); }
+    else if (arg == 1) { sprintf(str, "Outlet 1: For messages (list)"); }
+    else if (arg == 2) { sprintf(str, "Outlet 2: For floats (float)"); }
   }
+
+  else if (msg == ASSIST_OUTLET) {
+    if (arg < x->chan_cnt) { sprintf(str, "Outlet %i: For signals - Channel %i (signal)", arg, arg + 1); }
+    else if (arg == x->chan_cnt) { sprintf(str, "Outlet %i: For messages (list)", arg); }
+    else if (arg == x->chan_cnt + 1) { sprintf(str, "Outlet %i: For floats (float)", arg); }
+}
 }
+
+// ========  METHOD: MODAL_MULTICHANNELOUTPUTS  ========
+// Called by MSP to get the number of channels of a multichannel outlet
+
+long modal_multichanneloutputs(t_modal* x, long outletindex) {
+
+  return (x->mc_mode && (outletindex == 0)) ? x->chan_cnt : 1;
 }
 
 // ====  METHOD: BANK_FIND  ====
@@ -724,7 +1061,8 @@ void modal_out_sort(t_modal* x, t_symbol* type) {
 }
 
 // ====  METHOD: IO_IMPORT  ====
-// Import resonator data from a text file into a bank.
+// Import resonator data from a text file, or a binary bank file, into a bank.
+// The import runs on a worker thread, and the reply is sent once the bank is installed.
 // Arguments:  int/sym, sym, [sym]
 //   Arg 0:  The bank to import into (int/sym):  index / name / "free"
 //   Arg 1:  The name of the new bank (sym)
@@ -734,10 +1072,6 @@ void io_import(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   TRACE("io_import");
 
-  // Pointers to structures that need cleanup
-  t_filehandle file_handle = NULL;
-  t_handle file_text = NULL;
-
   t_bool test_arg = true;
   t_bank* bank;
   t_symbol* name;
@@ -772,6 +1106,7 @@ void io_import(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   short       file_path;
   t_fileinfo file_info;
   t_fourcc   file_type = FOUR_CHAR_CODE('TEXT');
+  t_fourcc   file_types[3] = { FOUR_CHAR_CODE('TEXT'), FOUR_CHAR_CODE('YMBK'), FOUR_CHAR_CODE('SDIF') };
 
   // If 3 arguments, try opening the corresponding file
   if (argc == 3) {
@@ -797,90 +1132,90 @@ void io_import(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   // If 2 arguments or the file was not found, open a dialog box
   if ((argc == 2) || (test_file == false)) {
-    open_promptset("Choose a text file with modal parameters.");
-    if (open_dialog(file_name, &file_path, &file_type, &file_type, 1) != 0)
+    open_promptset("Choose a text, binary or SDIF file with modal parameters.");
+    if (open_dialog(file_name, &file_path, &file_type, file_types, 3) != 0)
       { goto MODAL_IMPORT_END; }
     }  // If no file selected cancel
 
-  // Open the file
-  if (path_opensysfile(file_name, file_path, &file_handle, PATH_READ_PERM)) {
-    MY_ERR("%s:  Arg 2:  Failed to open the file.", sym->s_name); goto MODAL_IMPORT_END;
-  }
+  // Queue the import, the bank is built by the worker thread
+  _load_queue(x, bank, LOAD_IMPORT, name, file_name, file_path, NULL);
 
-  // Read the file into text
-  file_text = sysmem_newhandle(0);
-  // TEXT_NULL_TERMINATE is important, otherwise the string has no end
-  sysfile_readtextfile(file_handle, file_text, 0, TEXT_LB_NATIVE | TEXT_NULL_TERMINATE);
+  MODAL_IMPORT_END:
+  return;
+}
 
-  // Test the validity of the file content
-  int nb = 0, d_ptr = 0, valid = 0;
-  char* ptr = *file_text;
+// ====  METHOD: _IO_IMPORT_FILE  ====
+// Import a text file, or a binary bank file, into a bank.
+// Called by the worker thread, with a bank that is not rendered yet.
+// Returns ERR_NONE on success.
 
-  // The first token should be an int
-  valid = sscanf_s(ptr, "%i %n", &nb, &d_ptr);
+t_my_err _io_import_file(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path) {
 
-  // Followed by 3*n floats
-  t_int32 cntd = 3 * nb;
-  while ((valid == 1) && (cntd--)) {
-    float f;
-    ptr += d_ptr;
-    valid = sscanf_s(ptr, "%f %n", &f, &d_ptr);
-  }
+  TRACE("_io_import_file");
 
-  // If sscanf_s failed to read
-  if (valid != 1) { MY_ERR("%s:  Invalid data in the modal file %s.", file_name, sym->s_name); }
+  // Pointers to structures that need cleanup
+  t_filehandle file_handle = NULL;
+  t_double* param_arr = NULL;
+  t_my_err err = ERR_NONE;
 
-  // ==== Otherwise load the values
-  else {
+  // The model might already be cached, by this or another instance
+  char key[CACHE_KEY];
+  t_uint64 stamp = 0;
+  t_bool is_key = _cache_key_file(key, file_name, file_path, &stamp);
+  if ((is_key) && (_cache_fetch(x, bank, name, key, stamp))) { goto MODAL_IMPORT_FILE_END; }
 
-    // Free the existing bank and create a new one
-    bank_free(x, bank);
-    if (bank_new(x, bank, nb) == ERR_ALLOC) { goto MODAL_IMPORT_END; }
+  // Open the file
+  if (path_opensysfile(file_name, file_path, &file_handle, PATH_READ_PERM)) {
+    MY_ERR("import:  Failed to open the file %s.", file_name); err = ERR_ARG_VALUE; goto MODAL_IMPORT_FILE_END;
+  }
 
-    // Set the name and gain for the resonator
-    bank->name = name;
-    bank->gain = 1.0;
+  // Binary bank files are mapped in memory instead of parsed
+  if (_file_is_binary(file_handle)) {
+    sysfile_close(file_handle); file_handle = NULL;
+    err = _file_import(x, bank, name, file_name, file_path);
+    if ((is_key) && (err == ERR_NONE)) { _cache_store(bank, key, stamp); }
+    goto MODAL_IMPORT_FILE_END;
+  }
 
-    // Read the data from the text file
-    int tmp;
-    t_resonator* reson;
-    ptr = *file_text;
+  // SDIF files are imported from their first frame, and cached by frame
+  if (_sdif_is_sdif(file_handle)) {
+    sysfile_close(file_handle); file_handle = NULL;
+    err = _sdif_import(x, bank, name, file_name, file_path, 0, 0.0, false);
+    goto MODAL_IMPORT_FILE_END;
+  }
 
-    // Read the number of resonators
-    sscanf_s(ptr, "%i %n", &tmp, &d_ptr); ptr += d_ptr;
+  // Parse the text file in one streaming pass, keeping the bank if it fails
+  t_int32 nb = 0;
+  err = _file_parse_text(x, file_handle, file_name, &param_arr, &nb);
+  if (err != ERR_NONE) { goto MODAL_IMPORT_FILE_END; }
 
-    // Read the resonator parameters
-    float ampl, freq, decay;
-    for (t_int32 i = 0; i < bank->reson_cnt; i++) {
-      sscanf_s(ptr, "%f %n", &ampl, &d_ptr); ptr += d_ptr;
-      sscanf_s(ptr, "%f %n", &freq, &d_ptr); ptr += d_ptr;
-      sscanf_s(ptr, "%f %n", &decay, &d_ptr); ptr += d_ptr;
-
-      reson = bank->reson_arr + i;
-      reson->ampl_ref   = (t_double)ampl;
-      reson->freq_ref  = (t_double)freq;
-      reson->decay_ref = (t_double)decay;
-    }
+  // Free the existing bank and create a new one
+  bank_free(x, bank);
+  if (bank_new(x, bank, nb) == ERR_ALLOC) { err = ERR_ALLOC; goto MODAL_IMPORT_FILE_END; }
 
-    // Update and sort the resonators by amplitude, frequency and decay
-    bank_update(x, bank);
-    bank_sort(x, bank);
+  // Set the name and gain for the resonator
+  bank->name = name;
+  bank->gain = 1.0;
+
+  // Copy the resonator parameters into the model: amplitude, frequency and decay
+  t_model* model = bank->model;
+  for (t_int32 i = 0; i < bank->reson_cnt; i++) {
+    model->ampl_ref[i]  = param_arr[3 * i];
+    model->freq_ref[i]  = param_arr[3 * i + 1];
+    model->decay_ref[i] = param_arr[3 * i + 2];
   }
 
-  // Send out a message to indicate completion of import
-  // NB: Using mess_arr was not working, possibly because the function was deferred
-  t_atom mess_arr[4];
-  atom_setlong(mess_arr, bank - x->bank_arr);
-  atom_setsym(mess_arr + 1, bank->name);
-  atom_setlong(mess_arr + 2, bank->reson_cnt);
-  atom_setfloat(mess_arr + 3, bank->gain);
-  outlet_anything(x->outl_mess, gensym("import"), 4, mess_arr);
+  // Update and sort the resonators by amplitude, frequency and decay
+  bank_update(x, bank);
+  bank_sort(x, bank);
 
-  // Close the file and handle
-  MODAL_IMPORT_END:
+  if (is_key) { _cache_store(bank, key, stamp); }
+
+  // Close the file and free the parameters
+  MODAL_IMPORT_FILE_END:
   if (file_handle) { sysfile_close(file_handle); }
-  if (file_text)   { sysmem_freehandle(file_text); }
-  return;
+  if (param_arr)   { sysmem_freeptr(param_arr); }
+  return err;
 }
 
 // ====  METHOD: IO_DICTIONARY  ====
@@ -899,6 +1234,7 @@ void io_dictionary(t_modal* x, t_symbol* dict_sym) {
 
 // ====  METHOD: IO_LOAD  ====
 // Load a bank from the main dictionary.
+// The load runs on a worker thread, and the reply is sent once the bank is installed.
 // Arguments: int/sym sym sym
 //   Arg 0:  The name of the bank to load in the dictionary (sym)
 //   Arg 1:  The bank to load into (int/sym):  index / name / "free"
@@ -907,16 +1243,30 @@ void io_load(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   TRACE("io_load");
 
-  // Pointers to structures that need cleanup
-  t_dictionary* dict = NULL;
-
   // Get the name of the bank to look for in the dictionary
   t_symbol* bank_sym = atom_getsym(argv);
-  if (bank_sym == sym_empty) { MY_ERR("io_load:  Arg 0:  A bank name to look for in the dictionary is required."); goto MODAL_LOAD_END; }
+  if (bank_sym == sym_empty) { MY_ERR("io_load:  Arg 0:  A bank name to look for in the dictionary is required."); return; }
 
   // Get the bank to load into
   t_bank* bank = bank_find(x, argv + 1, sym);
-  if (bank == NULL) { MY_ERR("io_load:  Arg 1:  The bank to load into was not found."); goto MODAL_LOAD_END; }
+  if (bank == NULL) { MY_ERR("io_load:  Arg 1:  The bank to load into was not found."); return; }
+
+  // Queue the load, the bank is built by the worker thread
+  _load_queue(x, bank, LOAD_DICT, bank_sym, NULL, 0, NULL);
+}
+
+// ====  METHOD: _IO_LOAD_DICT  ====
+// Load a bank from the main dictionary.
+// Called by the worker thread, with a bank that is not rendered yet.
+// Returns ERR_NONE on success.
+
+t_my_err _io_load_dict(t_modal* x, t_bank* bank, t_symbol* bank_sym) {
+
+  TRACE("_io_load_dict");
+
+  // Pointers to structures that need cleanup
+  t_dictionary* dict = NULL;
+  t_my_err err = ERR_DICT_NONE;
 
   // Test if the main dictionary is found
   dict = dictobj_findregistered_retain(x->dict_sym);
@@ -936,6 +1286,12 @@ void io_load(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     MY_ERR("io_load:  The bank %s was not found in the main dictionary %s.", bank_sym->s_name, x->dict_sym->s_name); goto MODAL_LOAD_END;
   }
 
+  // The model might already be cached, by this or another instance
+  char key[CACHE_KEY];
+  t_uint64 stamp = _cache_stamp_dict(dict_bank);
+  _cache_key_dict(key, x->dict_sym, bank_sym);
+  if (_cache_fetch(x, bank, bank_sym, key, stamp)) { err = ERR_NONE; goto MODAL_LOAD_END; }
+
   // Get the number of resonators
   t_atom_long a_al = 0;
   dictionary_getlong(dict_bank, gensym("reson_cnt"), &a_al);
@@ -952,43 +1308,77 @@ void io_load(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   double a_d;
   dictionary_getfloat(dict_bank, gensym("gain"), &a_d); bank->gain = (t_double)a_d;
 
-  // Get the array of atoms
-  t_atom* atom_arr = NULL;
-  long a_l = 0;
-  dictionary_getatoms(dict_bank, gensym("resonators"), &a_l, &atom_arr);
+  t_model* model = bank->model;
+
+  // Flat arrays of amplitudes, frequencies and decays
+  if (dictionary_hasentry(dict_bank, gensym("ampl"))) {
 
-  // The number of atoms in the array should match the number of resonators previously retrieved
-  if (a_l != bank->reson_cnt) {
-    MY_ERR("io_load:  The number of resonators is inconsistent with the number of parameters provided."); goto MODAL_LOAD_END;
+    t_atom* ampl_arr = NULL;
+    t_atom* freq_arr = NULL;
+    t_atom* decay_arr = NULL;
+    long ampl_cnt = 0, freq_cnt = 0, decay_cnt = 0;
+    dictionary_getatoms(dict_bank, gensym("ampl"),  &ampl_cnt,  &ampl_arr);
+    dictionary_getatoms(dict_bank, gensym("freq"),  &freq_cnt,  &freq_arr);
+    dictionary_getatoms(dict_bank, gensym("decay"), &decay_cnt, &decay_arr);
+
+    // The length of each array should match the number of resonators previously retrieved
+    if ((ampl_cnt != bank->reson_cnt) || (freq_cnt != bank->reson_cnt) || (decay_cnt != bank->reson_cnt)) {
+      MY_ERR("io_load:  The number of resonators is inconsistent with the number of parameters provided."); goto MODAL_LOAD_END;
+    }
+
+    for (t_int32 i = 0; i < bank->reson_cnt; i++) {
+      model->ampl_ref[i]  = atom_getfloat(ampl_arr + i);
+      model->freq_ref[i]  = atom_getfloat(freq_arr + i);
+      model->decay_ref[i] = atom_getfloat(decay_arr + i);
+    }
   }
 
-  // Read the data for all the resonators
-  t_resonator*  reson;
-  t_dictionary* dict_reson;
-  for (t_int32 i = 0; i < bank->reson_cnt; i++) {
-    reson = bank->reson_arr + i;
-    dict_reson = (t_dictionary*)atom_getobj(atom_arr + i);
-    dictionary_getfloat(dict_reson, gensym("ampl"),  &a_d); reson->ampl_ref   = a_d;
-    dictionary_getfloat(dict_reson, gensym("freq"),  &a_d); reson->freq_ref   = a_d;
-    dictionary_getfloat(dict_reson, gensym("decay"), &a_d); reson->decay_ref = a_d;
+  // Older layout: an array with one subdictionary per resonator
+  else {
+
+    t_atom* atom_arr = NULL;
+    long a_l = 0;
+    dictionary_getatoms(dict_bank, gensym("resonators"), &a_l, &atom_arr);
+
+    // The number of atoms in the array should match the number of resonators previously retrieved
+    if (a_l != bank->reson_cnt) {
+      MY_ERR("io_load:  The number of resonators is inconsistent with the number of parameters provided."); goto MODAL_LOAD_END;
+    }
+
+    t_dictionary* dict_reson;
+    for (t_int32 i = 0; i < bank->reson_cnt; i++) {
+      dict_reson = (t_dictionary*)atom_getobj(atom_arr + i);
+      dictionary_getfloat(dict_reson, gensym("ampl"),  &a_d); model->ampl_ref[i]  = a_d;
+      dictionary_getfloat(dict_reson, gensym("freq"),  &a_d); model->freq_ref[i]  = a_d;
+      dictionary_getfloat(dict_reson, gensym("decay"), &a_d); model->decay_ref[i] = a_d;
+    }
   }
 
   // Update and sort the resonators by amplitude, frequency and decay
   bank_update(x, bank);
   bank_sort(x, bank);
+  _cache_store(bank, key, stamp);
 
-  // Send out a message to indicate completion of load
-  t_atom mess_arr[4];
-  atom_setlong(mess_arr, bank - x->bank_arr);
-  atom_setsym(mess_arr + 1, bank->name);
-  atom_setlong(mess_arr + 2, bank->reson_cnt);
-  atom_setfloat(mess_arr + 3, bank->gain);
-  outlet_anything(x->outl_mess, gensym("load"), 4, mess_arr);
+  err = ERR_NONE;
 
   // Release the main dictionary
   MODAL_LOAD_END:
   if (dict)   { dictobj_release(dict); }
-  return;
+  return err;
+}
+
+// ====  METHOD: _IO_DICT_ARRAYS  ====
+// Append the parameters of the resonators to a bank subdictionary,
+// as three flat arrays of floats:  ampl, freq and decay.
+//   atoms:  The amplitudes, frequencies and decays, in blocks of stride atoms
+//   cnt:    The number of resonators, at most stride
+
+void _io_dict_arrays(t_dictionary* dict_bank, t_int32 cnt, t_int32 stride, t_atom* atoms) {
+
+  // The atoms are copied
+  dictionary_appendatoms(dict_bank, gensym("ampl"),  cnt, atoms);
+  dictionary_appendatoms(dict_bank, gensym("freq"),  cnt, atoms + stride);
+  dictionary_appendatoms(dict_bank, gensym("decay"), cnt, atoms + 2 * stride);
 }
 
 // ====  METHOD: IO_SAVE  ====
@@ -1067,25 +1457,25 @@ void io_save(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     bank->name->s_name, bank->reson_cnt, bank->gain, is_protect->s_name,
     bank->ampl_min, bank->ampl_max, bank->freq_min, bank->freq_max, bank->decay_min, bank->decay_max);
   dictionary_appenddictionary(dict_all_banks, bank_sym, (t_object*)dict_bank);
+  _cache_drop_dict(x->dict_sym, bank_sym);
 
-  // Create an array of atoms for the resonators
-  atoms = (t_atom*)sysmem_newptr(sizeof(t_atom) * bank->reson_cnt);
+  // Create an array of atoms for the amplitudes, frequencies and decays
+  t_int32 cnt = bank->reson_cnt;
+  atoms = (t_atom*)sysmem_newptr(sizeof(t_atom) * 3 * cnt);
   if (atoms == NULL) {
     MY_ERR("io_save:  Failed to allocate a temporary array of atoms."); goto MODAL_SAVE_END;
   }
 
-  // Create a subdictionary for each resonator, put each in the array of atoms
-  t_resonator*  reson = NULL;
-  t_dictionary* dict_reson = NULL;
-  for (t_int32 i = 0; i < bank->reson_cnt; i++) {
+  t_resonator* reson = NULL;
+  for (t_int32 i = 0; i < cnt; i++) {
     reson = bank->reson_arr + i;
-    dict_reson = dictionary_sprintf("@index %i @ampl %f @freq %f @decay %f @b1 %f @b2 %f",
-      i, reson->a0, reson->freq, reson->decay, reson->b1, reson->b2);
-    atom_setobj(atoms + i, dict_reson);
+    atom_setfloat(atoms + i, reson->a0);
+    atom_setfloat(atoms + cnt + i, reson->freq);
+    atom_setfloat(atoms + 2 * cnt + i, reson->decay);
   }
 
-  // Append the array of atoms to dict_bank. The atoms are copied.
-  dictionary_appendatoms(dict_bank, gensym("resonators"), bank->reson_cnt, atoms);
+  // Append the three arrays to dict_bank
+  _io_dict_arrays(dict_bank, cnt, cnt, atoms);
 
   // Send out a message to indicate completion of load
   t_atom mess_arr[3];
@@ -1130,7 +1520,7 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   }
 
   // Set the name for the second bank with the removed resonators
-  name = (char*)sysmem_newptr(sizeof(char) * (long)(strlen(bank_sym->s_name) + 4));
+  name = (char*)sysmem_newptr(sizeof(char) * (long)(strlen(bank_sym->s_name) + 5));
   if (name == NULL) { MY_ERR("io_save:  Failed to allocate a temporary string."); goto MODAL_SPLIT_END; }
 
   strcpy(name, bank_sym->s_name);
@@ -1154,19 +1544,17 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     dictionary_appenddictionary(dict, gensym("banks"), (t_object*)dict_all_banks);
   }
 
-  // Create two arrays of atoms for the resonators
-  atoms      = (t_atom*)sysmem_newptr(sizeof(t_atom) * bank->reson_cnt);
-  atoms_rem = (t_atom*)sysmem_newptr(sizeof(t_atom) * bank->reson_cnt);
+  // Create two arrays of atoms for the amplitudes, frequencies and decays
+  t_int32 stride = bank->reson_cnt;
+  atoms     = (t_atom*)sysmem_newptr(sizeof(t_atom) * 3 * stride);
+  atoms_rem = (t_atom*)sysmem_newptr(sizeof(t_atom) * 3 * stride);
 
   if ((atoms == NULL) || (atoms_rem == NULL)) {
     MY_ERR("io_save:  Failed to allocate a temporary array of atoms."); goto MODAL_SPLIT_END;
   }
 
-  // Create a subdictionary for each resonator, put each in one of the array of atoms
-  t_resonator*  reson = NULL;
-  t_dictionary* dict_reson = NULL;
-
-  t_int32 ind;
+  // Put the parameters of each resonator in one of the arrays of atoms
+  t_resonator* reson = NULL;
   t_atom* p_atom;
 
   t_int32 cnt1 = 0, cnt2 = 0;
@@ -1181,7 +1569,6 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     reson = bank->reson_arr + res;
 
     if (reson->mode_ind != MODE_FIX_OFF) {
-      ind = cnt1;
       p_atom = atoms + cnt1;
       cnt1++;
       if (reson->a0 < ampl1_min) { ampl1_min = reson->a0; }
@@ -1193,7 +1580,6 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     }
 
     else {
-      ind = cnt2;
       p_atom = atoms_rem + cnt2;
       cnt2++;
       if (reson->a0 < ampl2_min) { ampl2_min = reson->a0; }
@@ -1204,9 +1590,9 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       if (reson->decay > decay2_max) { decay2_max = reson->decay; }
     }
 
-    dict_reson = dictionary_sprintf("@index %i @ampl %f @freq %f @decay %f @b1 %f @b2 %f",
-      ind, reson->a0, reson->freq, reson->decay, reson->b1, reson->b2);
-    atom_setobj(p_atom, dict_reson);
+    atom_setfloat(p_atom, reson->a0);
+    atom_setfloat(p_atom + stride, reson->freq);
+    atom_setfloat(p_atom + 2 * stride, reson->decay);
   }
 
   // If
@@ -1219,9 +1605,10 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     bank->name->s_name, cnt1, bank->gain, "false",
     ampl1_min, ampl1_max, freq1_min, freq1_max, decay1_min, decay1_max);
   dictionary_appenddictionary(dict_all_banks, bank_sym, (t_object*)dict_bank);
+  _cache_drop_dict(x->dict_sym, bank_sym);
 
-  // Append the array of atoms to dict_bank. The atoms are copied.
-  dictionary_appendatoms(dict_bank, gensym("resonators"), cnt1, atoms);
+  // Append the three arrays to dict_bank
+  _io_dict_arrays(dict_bank, cnt1, stride, atoms);
 }
 
   if (cnt2 != 0) {
@@ -1232,9 +1619,10 @@ void io_split(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
     bank->name->s_name, cnt2, bank->gain, "false",
     ampl2_min, ampl2_max, freq2_min, freq2_max, decay2_min, decay2_max);
   dictionary_appenddictionary(dict_all_banks, bank_rem_sym, (t_object*)dict_bank_rem);
+  _cache_drop_dict(x->dict_sym, bank_rem_sym);
 
-  // Append the array of atoms to dict_bank_rem. The atoms are copied.
-  dictionary_appendatoms(dict_bank_rem, gensym("resonators"), cnt2, atoms_rem);
+  // Append the three arrays to dict_bank_rem
+  _io_dict_arrays(dict_bank_rem, cnt2, stride, atoms_rem);
 }
 
   // Send out a message to indicate completion of load
@@ -1280,7 +1668,7 @@ void io_join(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   // Copy the resonators into the second segment of the resonator array
   for (t_int32 res = 0; res < bank2->reson_cnt; res ++) {
-    reson_copy(x, bank1, bank1->reson_arr + res_cnt_1 + res, bank2->reson_arr + res);
+    reson_copy(x, bank1, bank1->reson_arr + res_cnt_1 + res, bank2, bank2->reson_arr + res);
   }
 
   bank_update(x, bank1);
@@ -1332,6 +1720,8 @@ void io_rename(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   // Chuck the entry and reappend it under a different key
   dictionary_chuckentry(dict_all_banks, bank_sym);
   dictionary_appenddictionary(dict_all_banks, bank_sym_new, (t_object*)dict_bank);
+  _cache_drop_dict(x->dict_sym, bank_sym);
+  _cache_drop_dict(x->dict_sym, bank_sym_new);
 
   // Send out a message to indicate completion of rename
   t_atom mess_arr[2];
@@ -1378,6 +1768,7 @@ void io_delete(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   // Chuck the entry and reappend it under a different key
   dictionary_deleteentry(dict_all_banks, bank_sym);
+  _cache_drop_dict(x->dict_sym, bank_sym);
 
   // Send out a message to indicate completion of delete
   t_atom mess_arr[1];
@@ -1600,6 +1991,8 @@ void modal_flush(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
       for (int i = 0; i < bank->reson_cnt; i++) {
         (bank->reson_arr + i)->y_m1 = 0.0;
         (bank->reson_arr + i)->y_m2 = 0.0;
+        (bank->reson_arr + i)->u_re = 0.0;
+        (bank->reson_arr + i)->u_im = 0.0;
       }
 
       return;
@@ -1639,6 +2032,40 @@ void modal_gain(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
   (x->bank_arr + index)->gain = atom_getfloat(argv + 1);
 }
 
+// ====  METHOD: MODAL_ROUTE  ====
+// Set the routing of the inputs into a bank of resonators.
+// Arguments:
+//   Arg 0:  Int or Sym - The bank
+//   Then either:
+//     Int Float - The index of an input and its gain
+//     "gains" Float ... - One gain per input
+
+void modal_route(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
+
+  TRACE("modal_route");
+
+  if (argc < 2) { MY_ERR("%s:  Missing arguments.", sym->s_name); return; }
+
+  // The first argument should reference a bank of resonator
+  t_bank* bank = bank_find(x, argv, sym);
+  if (bank == NULL) { return; }
+
+  // One input and its gain
+  if ((argc == 3) && (atom_gettype(argv + 1) == A_LONG)) {
+    t_int32 ind = (t_int32)atom_getlong(argv + 1);
+    if ((ind < 0) || (ind >= x->in_cnt)) { MY_ERR("%s:  Arg 1:  Invalid input index: %i.", sym->s_name, ind); return; }
+    bank->in_gain[ind] = atom_getfloat(argv + 2);
+  }
+
+  // One gain per input
+  else if ((atom_gettype(argv + 1) == A_SYM) && (atom_getsym(argv + 1) == gensym("gains"))) {
+    if (argc - 2 != x->in_cnt) { MY_ERR("%s:  Invalid arguments:  %i gains expected.", sym->s_name, x->in_cnt); return; }
+    for (t_int32 i = 0; i < x->in_cnt; i++) { bank->in_gain[i] = atom_getfloat(argv + 2 + i); }
+  }
+
+  else { MY_ERR("%s:  Invalid arguments:  Expecting an input index and gain, or \"gains\" and one gain per input.", sym->s_name); }
+}
+
 // ====  METHOD: MODAL_IS_ON  ====
 // Set the bank of resonators on or off.
 // Arguments:  Int Int
@@ -1673,11 +2100,7 @@ void modal_ampl_mult(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
   bank->ampl_mult = atom_getfloat(argv + 1);
 
-  /*t_resonator* reson = bank->reson_arr + bank->reson_cnt;
-
-  while (reson-- != bank->reson_arr) {
-    reson->a0 = reson->ampl_ref * bank->ampl_mult;
-  } */
+  bank_update(x, bank);
 }
 
 // ====  METHOD: MODAL_FREQ_MULT  ====
@@ -1785,7 +2208,7 @@ void modal_sel_all(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv) {
 
 // ====  METHOD: MODAL_SEL_INIT  ====
 
-__inline void modal_sel_init(t_modal* x, t_bank* bank) {
+static __inline void modal_sel_init(t_modal* x, t_bank* bank) {
 
   bank->sel_ampl_min = bank->ampl_max;
   bank->sel_ampl_max = bank->ampl_min;
@@ -1797,7 +2220,7 @@ __inline void modal_sel_init(t_modal* x, t_bank* bank) {
 
 // ====  METHOD: MODAL_SEL_COMPARE  ====
 
-__inline void modal_sel_compare(t_modal* x, t_bank* bank, t_resonator* reson) {
+static __inline void modal_sel_compare(t_modal* x, t_bank* bank, t_resonator* reson) {
 
   bank->sel_ampl_min = MIN(bank->sel_ampl_min, reson->a0);
   bank->sel_ampl_max = MAX(bank->sel_ampl_max, reson->a0);
@@ -1809,7 +2232,7 @@ __inline void modal_sel_compare(t_modal* x, t_bank* bank, t_resonator* reson) {
 
 // ====  METHOD: MODAL_SEL_OUT  ====
 
-__inline void modal_sel_out(t_modal* x, t_bank* bank, t_int32 cnt) {
+static __inline void modal_sel_out(t_modal* x, t_bank* bank, t_int32 cnt) {
 
   t_atom mess_arr[7];
 
@@ -2009,13 +2432,14 @@ void reson_new(t_modal* x, t_bank* bank, t_resonator* reson) {
 
   TRACE("reson_new");
 
-  reson->ampl_ref   = 1.0;
-  reson->freq_ref   = 400;
-  reson->decay_ref = 1000;
+  reson->rate_cls = 0;
 
+  // The reference parameters are in the model of the bank
   reson_update(x, bank, reson);
   reson->y_m1 = 0.0;
   reson->y_m2 = 0.0;
+  reson->u_re = 0.0;
+  reson->u_im = 0.0;
 
   reson->in_U_cur  = 0.0;
   reson->in_A_cur  = 0.0;
@@ -2036,13 +2460,18 @@ void reson_new(t_modal* x, t_bank* bank, t_resonator* reson) {
   }
 
   reson->diff_type = MODE_DIFF_ONE_RR;
-  for (t_int32 ch = 0; ch < 8; ch++) { reson->diff_mult[ch]  = 0.0; }
-  reson->diff_ind = rand() % 8;
-  reson->diff_mult[reson->diff_ind] = 1.0;
+  for (t_int32 ch = 0; ch < x->chan_cnt; ch++) { reson->diff_targ[ch]  = 0.0; }
+  reson->diff_ind = rand() % x->chan_cnt;
+  reson->diff_targ[reson->diff_ind] = 1.0;
   reson->diff_cnt = 1;
+  reson->diff_sto = 0;
   reson->diff_chg = false;
+  _diff_snap(x, reson);
 
   reson->rms = 0;
+
+  reson->skip = 0;
+  reson->skip_A = 1.0;
 }
 
 // ====  METHOD: RESON_FREE  ====
@@ -2055,35 +2484,51 @@ void reson_free(t_modal* x, t_resonator* reson) {
 }
 
 // ====  METHOD: RESON_COPY  ====
+// Copy the reference parameters of a resonator from another bank.
+// The model of the bank should not be shared.
 
-void reson_copy(t_modal* x, t_bank* bank, t_resonator* reson, t_resonator* reson_src) {
+void reson_copy(t_modal* x, t_bank* bank, t_resonator* reson, t_bank* bank_src, t_resonator* reson_src) {
 
   TRACE("reson_copy");
 
-  reson->ampl_ref  = reson_src->ampl_ref;
-  reson->freq_ref  = reson_src->freq_ref;
-  reson->decay_ref = reson_src->decay_ref;
+  t_int32 res = (t_int32)(reson - bank->reson_arr);
+  t_int32 res_src = (t_int32)(reson_src - bank_src->reson_arr);
+
+  bank->model->ampl_ref[res]  = bank_src->model->ampl_ref[res_src];
+  bank->model->freq_ref[res]  = bank_src->model->freq_ref[res_src];
+  bank->model->decay_ref[res] = bank_src->model->decay_ref[res_src];
 
   reson_update(x, bank, reson);
 }
 
 // ====  METHOD: RESON_UPDATE  ====
+// The resonator should be in the array of the bank, to find its reference parameters.
 
 void reson_update(t_modal* x, t_bank* bank, t_resonator* reson) {
 
-  reson->a0     = reson->ampl_ref  * bank->ampl_mult;
-  reson->freq  = reson->freq_ref  * bank->freq_mult;
-  reson->decay = reson->decay_ref * bank->decay_mult;
+  t_int32 res = (t_int32)(reson - bank->reson_arr);
+
+  reson->a0    = bank->model->ampl_ref[res]  * bank->ampl_mult;
+  reson->freq  = bank->model->freq_ref[res]  * bank->freq_mult;
+  reson->decay = bank->model->decay_ref[res] * bank->decay_mult;
 
   t_double r = exp(-reson->decay / x->samplerate);
   reson->b1 = 2 * r * cos(TWOPI * reson->freq / x->samplerate);
   reson->b2 = -r * r;
+
+  // Coefficients for the phasor kernel
+  _phasor_update(x, reson);
+
+  // Coefficients at the decimated rate, and the class might change
+  if (reson->rate_cls) { _rate_coefs(x, reson); }
+  if (bank->rate) { bank->rate->dirty = true; }
 }
 
 // ========  BANK METHODS  ========
 
 // ====  METHOD: BANK_NEW  ====
-// Allocate all the arrays for a bank of resonators.
+// Allocate all the arrays for a bank of resonators, with a new model
+// owned by the bank, set to default parameters.
 
 t_int32 bank_new(t_modal* x, t_bank* bank, t_int32 nb) {
 
@@ -2091,17 +2536,64 @@ t_int32 bank_new(t_modal* x, t_bank* bank, t_int32 nb) {
 
   // Set pointers to NULL
   bank->reson_arr   = NULL;
-  bank->sort_ampl  = NULL;
-  bank->sort_freq  = NULL;
-  bank->sort_decay = NULL;
+  bank->diff_arr   = NULL;
+  bank->model      = NULL;
+  bank->conv       = NULL;
+  bank->conv_new   = NULL;
+  bank->conv_old   = NULL;
+  bank->ifft       = NULL;
+  bank->ifft_new   = NULL;
+  bank->ifft_old   = NULL;
+  bank->rate       = NULL;
+  bank->stream     = NULL;
 
   // Check the validity of the number of resonators
   if (nb < 1) {
     MY_ERR("bank_new:  Invalid number of resonators: %i. Should be at least 1.", nb);
     return ERR_ALLOC;
   }
+
+  t_model* model = _model_new(nb);
+  if (model == NULL) { MY_ERR("bank_new:  Failed to allocate the model."); return ERR_ALLOC; }
+
+  // The bank holds its own reference
+  t_int32 err = bank_new_model(x, bank, model);
+  _model_release(model);
+
+  return err;
+}
+
+// ====  METHOD: BANK_NEW_MODEL  ====
+// Allocate the arrays for a bank of resonators sharing an existing model.
+// Only the runtime state of the resonators is allocated: the reference
+// parameters and the sort permutations are those of the model.
+
+t_int32 bank_new_model(t_modal* x, t_bank* bank, t_model* model) {
+
+  TRACE("bank_new_model");
+
+  t_int32 nb = model->reson_cnt;
+
+  // Set pointers to NULL
+  bank->reson_arr   = NULL;
+  bank->diff_arr   = NULL;
+  bank->model      = NULL;
+  bank->sort_ampl  = NULL;
+  bank->sort_freq  = NULL;
+  bank->sort_decay = NULL;
+  bank->sort_prio  = NULL;
+  bank->conv       = NULL;
+  bank->conv_new   = NULL;
+  bank->conv_old   = NULL;
+  bank->ifft       = NULL;
+  bank->ifft_new   = NULL;
+  bank->ifft_old   = NULL;
+  bank->rate       = NULL;
+  bank->stream     = NULL;
+
+  // Check the validity of the number of resonators
   if (nb > x->reson_max) {
-    MY_ERR("bank_new:  Invalid number of resonators: %i. Should be at most %i.", x->reson_max, nb);
+    MY_ERR("bank_new:  Invalid number of resonators: %i. Should be at most %i.", nb, x->reson_max);
     return ERR_ALLOC;
   }
 
@@ -2109,9 +2601,61 @@ t_int32 bank_new(t_modal* x, t_bank* bank, t_int32 nb) {
   bank->is_on      = false;
   bank->is_frozen = false;
   bank->name      = sym_free;
-  bank->gain      = 1.0;
+  bank->gain      = model->gain;
   bank->reson_cnt = nb;
   bank->velocity  = 1.0;
+  bank->diff_ramp_ms = DIFF_RAMP_DEF;
+  bank->diff_ramp = (t_int32)(bank->diff_ramp_ms * x->msr);
+
+  // Input routing: from input 0 only
+  for (t_int32 i = 0; i < IN_MAX; i++) { bank->in_gain[i] = 0.0; }
+  bank->in_gain[0] = 1.0;
+  bank->in_silent = false;
+
+  // Not a voice
+  bank->voice_ind = -1;
+  bank->voice_busy = false;
+  bank->voice_pitch = 0.0;
+  bank->rms_sum = 0.0;
+  bank->rms_peak = 0.0;
+  bank->cull_cnt = 0;
+
+  // All resonators rendered
+  bank->lod_type = LOD_OFF;
+  bank->lod_val = 0.0;
+  bank->lod_cnt = nb;
+  bank->lod_gain = 1.0;
+  bank->lod_gain_cur = 1.0;
+
+  // No statistics
+  _stats_reset(bank);
+
+  // Rendered by recursion
+  bank->conv_use = false;
+  bank->conv_db = CONV_DB_DEF;
+  bank->conv_targ = false;
+  bank->conv_A = 0.0;
+  bank->ifft_targ = false;
+  bank->ifft_active = false;
+
+  // All resonators at full rate
+  bank->rate_use = false;
+
+  // No resonator pruned
+  bank->prune_freq = 0;
+  bank->prune_ampl = 0;
+  bank->prune_decay = 0;
+  bank->prune_thr = 0.0;
+
+  // No exciter
+  bank->imp_ampl = 0.0;
+  bank->imp_cntd = 0;
+  bank->imp_ofs = -1;
+  bank->exc_type = EXC_NONE;
+  bank->exc_cntd = 0;
+  bank->exc_len = 0;
+  bank->exc_pos = 0;
+  bank->exc_seed = 22222;
 
   bank->ampl_mult   = 1.0;    // These need to be set before calling reson_new
   bank->freq_mult  = 1.0;
@@ -2120,27 +2664,46 @@ t_int32 bank_new(t_modal* x, t_bank* bank, t_int32 nb) {
   // Set up mode tree (before calling reson_new)
   _mode_new(x, bank);
 
+  // The reference parameters, before initializing the resonators
+  _bank_model(bank, model);
+
   // Memory allocation for the resonators
   bank->reson_arr  = (t_resonator*)sysmem_newptr(sizeof(t_resonator) * bank->reson_cnt);
   if (bank->reson_arr == NULL) { MY_ERR("bank_new:  Failed to allocate reson_arr."); return ERR_ALLOC; }
 
+  // Memory allocation for the diffusion gains
+  bank->diff_arr  = (t_double*)sysmem_newptr(sizeof(t_double) * 2 * x->chan_cnt * bank->reson_cnt);
+  if (bank->diff_arr == NULL) { MY_ERR("bank_new:  Failed to allocate diff_arr."); return ERR_ALLOC; }
+  _diff_arr_set(x, bank->reson_arr, bank->diff_arr, bank->reson_cnt);
+
   // Resonator initialization
   for (int i = 0; i < bank->reson_cnt; i++) { reson_new(x, bank, bank->reson_arr + i); }
 
-  // Memory allocation for sorting
-  bank->sort_ampl   = (t_int32*)sysmem_newptr(sizeof(t_int32) * bank->reson_cnt);
-  if (bank->sort_ampl == NULL) { MY_ERR("bank_new:  Failed to allocate sort_ampl."); return ERR_ALLOC; }
+  // The current resonator might have been freed with the previous bank
+  // Only for the banks in use: the banks built by the worker thread are set
+  // by _load_main once installed
+  if ((bank >= x->bank_arr) && (bank < x->bank_arr + x->bank_cnt) && (!x->reson_cur)) { x->reson_cur = bank->reson_arr; }
 
-  bank->sort_freq = (t_int32*)sysmem_newptr(sizeof(t_int32) * bank->reson_cnt);
-  if (bank->sort_freq == NULL) { MY_ERR("bank_new:  Failed to allocate sort_freq."); return ERR_ALLOC; }
+  // The ranges from the sort permutations of the model
+  _bank_ranges(x, bank);
 
-  bank->sort_decay = (t_int32*)sysmem_newptr(sizeof(t_int32) * bank->reson_cnt);
-  if (bank->sort_decay == NULL) { MY_ERR("bank_new:  Failed to allocate sort_decay."); return ERR_ALLOC; }
+  return ERR_NONE;
+}
 
-  // Sort the resonators by amplitude, frequency and decay
-  bank_sort(x, bank);
+// ====  METHOD: _BANK_MODEL  ====
+// Set the model of a bank, and point the sort arrays into it.
+// The bank takes a reference to the new model, and releases the previous one.
 
-  return ERR_NONE;
+void _bank_model(t_bank* bank, t_model* model) {
+
+  _model_retain(model);
+  if (bank->model) { _model_release(bank->model); }
+
+  bank->model      = model;
+  bank->sort_ampl  = model->sort_ampl;
+  bank->sort_freq  = model->sort_freq;
+  bank->sort_decay = model->sort_decay;
+  bank->sort_prio  = model->sort_prio;
 }
 
 // ====  METHOD: BANK_REALLOC  ====
@@ -2162,6 +2725,10 @@ t_int32 bank_realloc(t_modal* x, t_bank* bank, t_int32 nb) {
 
   // Variable initialization
   bank->is_on      = false;
+  bank->conv_targ  = false;
+  bank->ifft_targ  = false;
+  bank->ifft_active = false;
+  if (bank->rate) { bank->rate->dirty = true; }
   //bank->is_frozen = false;
   //bank->gain      = 1.0;
 
@@ -2169,30 +2736,41 @@ t_int32 bank_realloc(t_modal* x, t_bank* bank, t_int32 nb) {
   bank->freq_mult  = 1.0;
   bank->decay_mult = 1.0;
 
+  // A new model owned by the bank, with the parameters of the current resonators
+  t_model* model = _model_new(nb);
+  if (model == NULL) { MY_ERR("bank_realloc:  Failed to allocate the model."); return ERR_ALLOC; }
+
+  model->gain = bank->model->gain;
+  for (t_int32 res = 0; res < min(nb, bank->reson_cnt); res++) {
+    model->ampl_ref[res]  = bank->model->ampl_ref[res];
+    model->freq_ref[res]  = bank->model->freq_ref[res];
+    model->decay_ref[res] = bank->model->decay_ref[res];
+  }
+
   // Memory allocation for new array of resonators
   t_resonator* new_reson_arr =  (t_resonator*)sysmem_newptr(sizeof(t_resonator) * nb);
-  if (new_reson_arr == NULL) { MY_ERR("bank_realloc:  Failed to allocate new_reson_arr."); return ERR_ALLOC; }
+  if (new_reson_arr == NULL) { MY_ERR("bank_realloc:  Failed to allocate new_reson_arr."); _model_release(model); return ERR_ALLOC; }
 
-  // Copy the current resonators
-  for (t_int32 res = 0; res < nb; res++) { reson_new(x, bank, new_reson_arr + res); }
-  for (t_int32 res = 0; res < min(nb, bank->reson_cnt); res++){
-    reson_copy(x, bank, new_reson_arr + res, bank->reson_arr + res);
+  t_double* new_diff_arr = (t_double*)sysmem_newptr(sizeof(t_double) * 2 * x->chan_cnt * nb);
+  if (new_diff_arr == NULL) {
+    MY_ERR("bank_realloc:  Failed to allocate new_diff_arr."); sysmem_freeptr(new_reson_arr); _model_release(model); return ERR_ALLOC;
   }
+  _diff_arr_set(x, new_reson_arr, new_diff_arr, nb);
 
   // Free the current array of resonators and set pointer to the new array
+  if ((x->reson_cur >= bank->reson_arr) && (x->reson_cur < bank->reson_arr + bank->reson_cnt)) { x->reson_cur = new_reson_arr; }
   if (bank->reson_arr) { sysmem_freeptr(bank->reson_arr); }
+  if (bank->diff_arr)  { sysmem_freeptr(bank->diff_arr); }
   bank->reson_arr = new_reson_arr;
+  bank->diff_arr  = new_diff_arr;
   bank->reson_cnt = nb;
 
-  // Memory reallocation for sorting
-  bank->sort_ampl   = (t_int32*)sysmem_resizeptrclear(bank->sort_ampl, sizeof(t_int32) * bank->reson_cnt);
-  if (bank->sort_ampl == NULL) { MY_ERR("bank_realloc:  Failed to reallocate sort_ampl."); return ERR_ALLOC; }
-
-  bank->sort_freq = (t_int32*)sysmem_resizeptrclear(bank->sort_freq, sizeof(t_int32)* bank->reson_cnt);
-  if (bank->sort_freq == NULL) { MY_ERR("bank_realloc:  Failed to reallocate sort_freq."); return ERR_ALLOC; }
+  _bank_model(bank, model);
+  _model_release(model);
 
-  bank->sort_decay = (t_int32*)sysmem_resizeptrclear(bank->sort_decay, sizeof(t_int32)* bank->reson_cnt);
-  if (bank->sort_decay == NULL) { MY_ERR("bank_realloc:  Failed to reallocate sort_decay."); return ERR_ALLOC; }
+  // Initialize the resonators with the copied parameters
+  for (t_int32 res = 0; res < nb; res++) { reson_new(x, bank, bank->reson_arr + res); }
+  bank->cull_cnt = 0;
 
   // Sort the resonators by amplitude, frequency and decay
   bank_sort(x, bank);
@@ -2200,6 +2778,53 @@ t_int32 bank_realloc(t_modal* x, t_bank* bank, t_int32 nb) {
   return ERR_NONE;
 }
 
+// ====  METHOD: BANK_CLONE  ====
+// Make a bank an exact copy of another bank: parameters, resonators and their states.
+// Used to set up voices, outside of the perform routine, as it allocates memory.
+
+t_int32 bank_clone(t_modal* x, t_bank* bank, t_bank* bank_src) {
+
+  TRACE("bank_clone");
+
+  // Reallocate the bank, sharing the model of the source bank
+  bank_free(x, bank);
+  if (bank_new_model(x, bank, bank_src->model) == ERR_ALLOC) { return ERR_ALLOC; }
+
+  // Copy the bank, keeping the arrays of the bank. The model is the same.
+  t_resonator* reson_arr = bank->reson_arr;
+  t_double* diff_arr = bank->diff_arr;
+
+  *bank = *bank_src;
+
+  bank->reson_arr = reson_arr;
+  bank->diff_arr = diff_arr;
+
+  // The impulse responses are not shared
+  bank->conv = NULL;
+  bank->conv_new = NULL;
+  bank->conv_old = NULL;
+  bank->conv_targ = false;
+  bank->conv_A = 0.0;
+  bank->ifft = NULL;
+  bank->ifft_new = NULL;
+  bank->ifft_old = NULL;
+  bank->ifft_targ = false;
+  bank->ifft_active = false;
+  bank->rate = NULL;
+  bank->rate_use = false;
+  bank->stream = NULL;
+
+  // Copy the arrays
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) { bank->reson_arr[res] = bank_src->reson_arr[res]; }
+  for (t_int32 i = 0; i < 2 * x->chan_cnt * bank->reson_cnt; i++) { bank->diff_arr[i] = bank_src->diff_arr[i]; }
+  _diff_arr_set(x, bank->reson_arr, bank->diff_arr, bank->reson_cnt);
+
+  // Bring the resonators rendered at decimated rates back to full rate
+  for (t_int32 res = 0; res < bank->reson_cnt; res++) { _rate_move(x, bank->reson_arr + res, 0); }
+
+  return ERR_NONE;
+}
+
 // ====  METHOD: BANK_FREE  ====
 // Free all the arrays of a bank of resonators.
 
@@ -2207,10 +2832,20 @@ void bank_free(t_modal* x, t_bank* bank) {
 
   TRACE("bank_free");
 
+  // Do not leave the current resonator pointing into the freed array
+  if ((x->reson_cur >= bank->reson_arr) && (x->reson_cur < bank->reson_arr + bank->reson_cnt)) { x->reson_cur = NULL; }
+
   if (bank->reson_arr)  { sysmem_freeptr(bank->reson_arr); }
-  if (bank->sort_ampl)  { sysmem_freeptr(bank->sort_ampl); }
-  if (bank->sort_freq)  { sysmem_freeptr(bank->sort_freq); }
-  if (bank->sort_decay) { sysmem_freeptr(bank->sort_decay); }
+  if (bank->diff_arr)   { sysmem_freeptr(bank->diff_arr); }
+  if (bank->model)      { _model_release(bank->model); bank->model = NULL; }
+  if (bank->conv)       { _conv_free(bank->conv); bank->conv = NULL; }
+  if (bank->conv_new)   { _conv_free(bank->conv_new); bank->conv_new = NULL; }
+  if (bank->conv_old)   { _conv_free(bank->conv_old); bank->conv_old = NULL; }
+  if (bank->ifft)       { _ifft_free(bank->ifft); bank->ifft = NULL; }
+  if (bank->ifft_new)   { _ifft_free(bank->ifft_new); bank->ifft_new = NULL; }
+  if (bank->ifft_old)   { _ifft_free(bank->ifft_old); bank->ifft_old = NULL; }
+  if (bank->rate)       { _rate_free(bank->rate); bank->rate = NULL; }
+  if (bank->stream)     { _stream_free(bank->stream); bank->stream = NULL; }
 }
 
 // ====  METHOD: COMPARE_AMPL  ====
@@ -2240,6 +2875,19 @@ int compare_decay(void* bank, const t_int32* index1, const t_int32* index2) {
   else { return -1; }
 }
 
+// ====  METHOD: COMPARE_PRIO  ====
+// Method used for sorting resonators by priority, used with qsort_s
+// The priority is the energy of the impulse response: proportional to a0^2 / decay
+
+int compare_prio(void* bank, const t_int32* index1, const t_int32* index2) {
+
+  t_resonator* reson1 = ((t_bank*)bank)->reson_arr + *index1;
+  t_resonator* reson2 = ((t_bank*)bank)->reson_arr + *index2;
+
+  if (reson1->a0 * reson1->a0 * reson2->decay < reson2->a0 * reson2->a0 * reson1->decay) { return 1; }
+  else { return -1; }
+}
+
 // ====  METHOD: BANK_SORT  ====
 // Sort the resonators by amplitude, frequency and decay
 
@@ -2247,17 +2895,30 @@ void bank_sort(t_modal* x, t_bank* bank) {
 
   TRACE("bank_sort");
 
+  // The permutations are in the model, copied first if it is shared
+  if (_model_own(x, bank) != ERR_NONE) { return; }
+
   // Initializing the arrays for sorting
   for (int i = 0; i < bank->reson_cnt; i++){
     bank->sort_ampl[i]  = i;
     bank->sort_freq[i]  = i;
     bank->sort_decay[i]  = i;
+    bank->sort_prio[i]  = i;
   }
 
   // Sort the arrays of indexes for amplitude, frequency, and decay values
   qsort_s(bank->sort_ampl, bank->reson_cnt, sizeof(t_int32), compare_ampl, bank);
   qsort_s(bank->sort_freq, bank->reson_cnt, sizeof(t_int32), compare_freq, bank);
   qsort_s(bank->sort_decay, bank->reson_cnt, sizeof(t_int32), compare_decay, bank);
+  qsort_s(bank->sort_prio, bank->reson_cnt, sizeof(t_int32), compare_prio, bank);
+
+  _bank_ranges(x, bank);
+}
+
+// ====  METHOD: _BANK_RANGES  ====
+// Set the ranges of the bank from the sorted arrays of indexes
+
+void _bank_ranges(t_modal* x, t_bank* bank) {
 
   // Set the ranges for amplitude, frequency, and decay values
   bank->ampl_min  = (bank->reson_arr + bank->sort_ampl[bank->reson_cnt - 1])->a0;
@@ -2273,15 +2934,31 @@ void bank_sort(t_modal* x, t_bank* bank) {
   bank->sel_freq_max  = bank->freq_max;
   bank->sel_decay_min = bank->decay_min;
   bank->sel_decay_max = bank->decay_max;
+
+  // Apply the level of detail to the new ranking
+  _bank_lod(x, bank);
 }
 
 // ====  METHOD: BANK_UPDATE  ====
 // Used to update the parameters of the resonators.
 // Amplitude, frequency and decay have to be already defined.
 
-__inline void bank_update(t_modal* x, t_bank* bank) {
+void bank_update(t_modal* x, t_bank* bank) {
 
   TRACE("bank_update");
 
   for (t_int32 i = 0; i < bank->reson_cnt; i++) { reson_update(x, bank, bank->reson_arr + i); }
+
+  // The impulse responses do not match the new parameters
+  bank->conv_targ = false;
+
+  // A streamed bank is set again from its frames, and is not pruned as the
+  // values here are only those of the first frame
+  if (bank->stream) { bank->stream->is_dirty = true; }
+
+  // Prune the resonators that are useless to render with the new parameters
+  else { _bank_prune(x, bank); }
+
+  // The level of detail follows the new amplitudes
+  if (bank->lod_type != LOD_OFF) { _bank_lod(x, bank); }
 }
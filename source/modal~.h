@@ -4,10 +4,13 @@
 // ========  HEADER FILE FOR MISCELLANEOUS MAX UTILITIES  ========
 
 #include "ext.h"
+#include "ext_systhread.h"
+#include "ext_atomic.h"
 #include "max_util.h"
 #include "envelopes.h"
 #include "random.h"
 #include "dict.h"
+#include "fft.h"
 #include <time.h>
 
 // ========  DEFINES  ========
@@ -20,6 +23,96 @@
 
 #define MASTER_MULT 0.01   // Default for master multiplier
 
+#define MIX_TILE 16        // Number of resonators rendered per mixing tile
+#define CHAN_CNT_DEF 8     // Default number of output channels
+#define CHAN_MAX 64        // Maximum number of output channels
+#define IN_MAX 16          // Maximum number of inputs
+
+#define EXC_NOISE_DEF 5     // Default duration of a noise burst in ms
+#define EXC_MALLET_DEF 2    // Default duration of a mallet pulse in ms
+
+#define SKIP_CULL  1         // Skip flags: culled to fit the CPU budget
+#define SKIP_LOD   2         // Skip flags: outside of the level of detail of the bank
+#define SKIP_PRUNE 4         // Skip flags: pruned as useless to render
+#define SKIP_FADE  10        // Fade time in ms when skipping or restoring a resonator
+
+#define BUDGET_SMOOTH  0.95  // Smoothing of the measured load when it decreases
+#define BUDGET_HYST    0.75  // Fraction of the budget under which resonators are restored
+#define CULL_STEP_UP   0.05  // Increase of the culled fraction per block when over budget
+#define CULL_STEP_DOWN 0.005 // Decrease of the culled fraction per block when under budget
+#define CULL_MAX       0.95  // Maximum culled fraction
+
+#define PRUNE_DB 100         // Resonators this far in dB under the loudest of the bank are pruned
+#define PRUNE_DECAY_MIN 0.01 // Resonators with a decay under this are pruned
+
+#define LOD_GAIN_MAX 4       // Maximum gain to compensate for the level of detail
+#define LOD_SMOOTH   0.1     // Smoothing of the level of detail gain per block
+
+#define KERNEL_BIQUAD 0       // Resonator kernel: direct form two pole filter
+#define KERNEL_PHASOR 1       // Resonator kernel: complex one pole, a decaying rotating phasor
+
+#define CONV_RATIO_MAX 64    // Maximum ratio of the tail to the head partition size of the convolution
+#define CONV_DB_DEF  80      // Default floor in dB under the peak at which impulse responses are truncated
+#define CONV_LEN_MAX 10      // Maximum length of the impulse responses in s
+#define CONV_FADE    50      // Crossfade time in ms between recursive and convolution rendering
+
+#define IFFT_SIZE_DEF 1024   // Default FFT size of the inverse FFT synthesis
+#define IFFT_BINS 4          // Half width in bins of the spectral kernel of a mode
+#define IFFT_OS   32         // Oversampling of the table of the spectral kernel
+#define IFFT_INTERP 8        // Number of bins to interpolate the input spectra
+#define IFFT_IN_NONE  0      // Input of a hop: silent
+#define IFFT_IN_IMP   1      // Input of a hop: a single impulse
+#define IFFT_IN_DENSE 2      // Input of a hop: any other input
+
+#define RATE_CLS_MAX 3       // Number of decimated rate classes: down to 1/8 of the sample rate
+#define RATE_TAPS   23       // Taps of the halfband filters between two rate classes
+#define RATE_MIN     4       // Minimum number of resonators for a rate class to be used
+
+#define FILE_MAGIC   "YMBK"     // Signature of binary bank files
+#define FILE_VERSION 1          // Version of the binary bank file format
+#define FILE_ORDER   0x01020304 // Written in native byte order, to reject files of the other order
+#define FILE_SORTED  1          // Header flag: the sort permutations follow the parameters
+#define FILE_NAME    64         // Maximum length of the bank name in the header
+#define FILE_BUF     65536      // Size of the buffer of streaming reads of text files
+#define FILE_TOKEN   64         // Maximum length of a token in text files
+
+#define STREAM_MAGIC   "YMFR"   // Signature of frame stream files
+#define STREAM_VERSION 1        // Version of the frame stream format
+#define STREAM_AHEAD   500      // Time in ms of the frames prefetched ahead of the position
+#define STREAM_SLEEP   5        // Period in ms of the prefetch thread
+#define STREAM_PAGE    4096     // Stride of the prefetch reads in bytes
+
+#define SDIF_MAGIC     "SDIF"   // Signature of SDIF files
+#define SDIF_FRAME     24       // Size of a frame header:  signature, size, time, stream and matrix count
+#define SDIF_MATRIX    16       // Size of a matrix header:  signature, data type, rows and columns
+#define SDIF_ROWS      256      // Number of rows of a matrix read at once
+#define SDIF_COLS      8        // Maximum number of columns for a matrix to be read in blocks of rows
+#define SDIF_DECAY_DEF 1.0      // Decay of the tracks with no amplitude in the next frame
+
+#define LOAD_MAX 16             // Maximum number of loads and imports queued at once
+#define LOAD_WAIT 100           // Time in ms after which the loads are installed by the main thread if the perform routine has not run
+
+#define CACHE_SIZE 64           // Default memory cap of the model cache, in MB
+#define CACHE_KEY  (MAX_PATH_CHARS + 16)  // Maximum length of a cache key
+
+#define STATE_MAGIC   "YMST"    // Signature of state library files
+#define STATE_VERSION 1         // Version of the state library format
+#define STATE_F32     0         // Format of the U values: float32
+#define STATE_U16     1         // Format of the U values: quantized to 16 bits over 0 to 1
+#define STATE_DELTA   1         // Record flag: differences with the base state, as zigzag varints
+
+#define SNAP_MAX     16         // Maximum number of snapshots per object
+#define SNAP_MAGIC   "YMSN"     // Signature of snapshot files
+#define SNAP_VERSION 1          // Version of the snapshot format
+#define SNAP_FILTERS 1          // Header flag: the states of the filters are recalled
+
+#define STATS_WIN 256        // Number of blocks in the window of timing statistics
+
+#define VOICE_REF_DEF 60   // Default reference pitch of a voice template
+#define VOICE_SILENT 1e-4  // Level relative to the peak under which a voice is released: -80 dB
+#define VOICE_QUEUE 64     // Size of the queue of notes sent to the perform routine, a power of 2
+#define DIFF_RAMP_DEF 50   // Default interpolation time for diffusion gains in ms
+
 // ========  STRUCTURES  ========
 
 typedef struct _state     t_state;
@@ -43,6 +136,48 @@ typedef struct _state {
 
 } t_state;
 
+// ========  STRUCTURE:  STATE INDEX  ========
+// Open addressing hash table of the states by name, keyed by the address of
+// the symbols. It is not updated when the names change: a probe only returns
+// a state that still has the name, and a lookup that misses rebuilds the index.
+
+typedef struct _state_index {
+
+  t_int32* slot_arr;  // Index of the state in each slot, -1 if empty
+  t_int32  slot_cnt;  // Power of 2, at least twice the number of states
+
+} t_state_index;
+
+// ========  STRUCTURE:  STATE LIBRARY FILE  ========
+// Header of a state library file, followed by one record per state that is
+// not empty, each followed by its U values. The A values are calculated from
+// the U values when read. The base state is written first, and the states
+// with the same count can be stored as differences with it.
+
+typedef struct _state_file {
+
+  char     magic[4];    // STATE_MAGIC
+  t_uint32 version;     // STATE_VERSION
+  t_uint32 order;       // FILE_ORDER
+  t_uint32 format;      // STATE_F32 or STATE_U16
+  t_int32  slot_cnt;    // Number of states of the library
+  t_int32  rec_cnt;     // Number of records
+  t_int32  base;        // Index of the base state, or -1
+  t_int32  pad;
+
+} t_state_file;
+
+typedef struct _state_rec {
+
+  t_uint32 size;        // Size of the values in bytes
+  t_uint32 flags;       // STATE_DELTA
+  t_int32  ind;         // Index of the state in the library
+  t_int32  cnt;
+  char     name[FILE_NAME];
+  char     from[FILE_NAME];
+
+} t_state_rec;
+
 // ========  STRUCTURE:  MODE  ========
 // Used to create mode graphs
 
@@ -125,13 +260,16 @@ typedef struct _resonator {
   t_double y_m1;   // Stores previous values y(n-1)
   t_double y_m2;   // Stores previous values y(n-2)
 
+  t_double p_re;   // Phasor kernel: complex pole, r * e^(j * theta)
+  t_double p_im;
+  t_double c_re;   // Phasor kernel: complex input coefficient, including a0
+  t_double c_im;
+  t_double u_re;   // Phasor kernel: complex state, the output is 2 * u_re
+  t_double u_im;
+
   t_double freq;   // Resonator frequencies
   t_double decay;  // Resonator decays
 
-  t_double ampl_ref;
-  t_double freq_ref;
-  t_double decay_ref;
-
   t_double freq_tmp;  // For pitch shifting, to state the initial value
 
   t_double in_U_cur;   // For input amplitude: current abscissa value: 0 to 1
@@ -146,7 +284,9 @@ typedef struct _resonator {
   t_double out_A_targ;  // Target amplitude multiplier for cycling (ramped)
 
   t_diff_type diff_type;
-  t_double    diff_mult[8];
+  t_double*   diff_mult;     // Current diffusion gains, one per channel, stored in the bank
+  t_double*   diff_targ;     // Target diffusion gains, for interpolation, stored in the bank
+  t_int32     diff_cntd;     // Samples left to interpolate the diffusion gains
   t_int32     diff_sto;      // Store the diffusion channel index
   t_bool      diff_chg;      // Indicate diffusion channels have changed
   t_int32     diff_ind;      // For output: index of diffusion channel
@@ -160,8 +300,311 @@ typedef struct _resonator {
 
   t_double rms;
 
+  t_int32  skip;    // Skip flags: the resonator is faded out and not rendered when non zero
+  t_double skip_A;  // Current fade multiplier for skipping, 0 to 1
+
+  t_int32  rate_cls;   // Rate class: rendered at the sample rate divided by 2^rate_cls
+  t_double rate_p_re;  // Decimated rate: pole and input coefficient of the phasor kernel
+  t_double rate_p_im;
+  t_double rate_c_re;
+  t_double rate_c_im;
+
 } t_resonator;
 
+// ========  ENUM:  LEVEL OF DETAIL TYPE  ========
+
+typedef enum _lod_type {
+
+  LOD_OFF,   // All resonators
+  LOD_CNT,   // A number of resonators
+  LOD_DB,    // The resonators above a threshold under the loudest
+  LOD_FRAC   // A fraction of the resonators
+
+} t_lod_type;
+
+// ========  ENUM:  EXCITER TYPE  ========
+
+typedef enum _exc_type {
+
+  EXC_NONE,
+  EXC_IMPULSE,
+  EXC_NOISE,
+  EXC_MALLET
+
+} t_exc_type;
+
+// ========  STRUCTURE:  NOTE  ========
+// A note queued by the message thread, and played by the perform routine
+
+typedef struct _voice_note {
+
+  t_double pitch;
+  t_double freq_mult;  // Frequency multiplier of the voice for the pitch
+  t_double ampl;       // Amplitude of the impulse, from the velocity
+
+} t_voice_note;
+
+// ========  STRUCTURE:  STATISTICS  ========
+// DSP statistics of a bank
+
+typedef struct _stats {
+
+  t_double    time[STATS_WIN];  // Ring of the last block times in ms
+  t_int32     time_ind;         // Next position in the ring
+  t_int32     time_cnt;         // Number of block times in the ring
+  t_atom_long blocks;           // Number of blocks processed
+  t_atom_long active;           // Total of active resonators over all blocks
+  t_atom_long splits;           // Number of chunk splits
+  t_atom_long iters;            // Number of mode changes: calls to _mode_iterate
+  t_atom_long rms;              // Number of rms calculations
+
+} t_stats;
+
+// ========  STRUCTURE:  CONVOLUTION  ========
+// Impulse responses of a static bank, one per channel, rendered by partitioned
+// convolution. The head of the responses uses partitions of the vector size,
+// the tail partitions ratio times longer. The spectra are stored per
+// partition as N / 2 + 1 real values followed by N / 2 + 1 imaginary values.
+
+typedef struct _conv {
+
+  t_int32 len;                 // Length of the impulse responses in samples
+  t_int32 chan_cnt;            // Number of channels with an impulse response
+  t_int32 chan_ind[CHAN_MAX];  // Output channel of each impulse response
+
+  t_int32 head_len;   // Head partition size: the vector size
+  t_int32 head_cnt;   // Number of head partitions
+  t_int32 tail_len;   // Tail partition size
+  t_int32 ratio;      // Ratio of the tail to the head partition size, a power of 2
+  t_int32 tail_cnt;   // Number of tail partitions, 0 if the responses fit in the head
+  t_fft   head_fft;   // Real FFT of size 2 x head_len
+  t_fft   tail_fft;   // Real FFT of size 2 x tail_len
+
+  t_double* head_H;   // Spectra of the head partitions: chan_cnt x head_cnt
+  t_double* tail_H;   // Spectra of the tail partitions: chan_cnt x tail_cnt
+  t_double* head_X;   // Spectra of the past input blocks: a ring of head_cnt
+  t_double* tail_X;   // Spectra of the past input periods: a ring of tail_cnt
+  t_int32   head_pos; // Newest spectrum in head_X
+  t_int32   tail_pos; // Newest spectrum in tail_X
+  t_double* head_in;  // Input window: previous and current block
+  t_double* tail_in;  // Input window: previous and current period
+  t_int32   tail_fill;  // Samples in the current period
+  t_double* tail_acc;   // Spectra of the next tail output, accumulated over the period: chan_cnt
+  t_double* tail_out;   // Tail output of the current period: chan_cnt x tail_len
+  t_double* work;       // Scratch samples: 2 x tail_len
+  t_double* spec;       // Scratch spectrum: tail_len + 1 bins
+
+  t_int32 silent;      // Number of consecutive silent input samples
+  t_int32 silent_max;  // Number of silent samples after which all the state is 0
+
+} t_conv;
+
+// ========  STRUCTURE:  INVERSE FFT SYNTHESIS  ========
+// Additive synthesis of a bank in the frequency domain. Each mode is a
+// sinusoid with a constant amplitude over a frame, added to the spectrum of
+// the frame as the transform of the window. The frames are overlap-added with
+// triangles over the central half of the window, with a hop of N / 4.
+
+typedef struct _ifft_mode {
+
+  t_double freq;    // Frequency and decay the powers of the pole are calculated for
+  t_double decay;
+  t_double bin;     // Frequency in bins
+  t_double pH_re;   // p^H: advance of the state over a hop
+  t_double pH_im;
+  t_double pH1_re;  // p^(H + 1): from the end of a hop to the center of the next frame
+  t_double pH1_im;
+  t_double pM_re;   // p^((H - 1) / 2): from the middle to the end of a hop
+  t_double pM_im;
+
+} t_ifft_mode;
+
+typedef struct _ifft {
+
+  t_int32 size;      // FFT size N
+  t_int32 hop;       // Hop size H: N / 4
+  t_int32 mode_cnt;  // Number of modes of the cache
+  t_fft   fft;
+
+  t_double win_tab[2 * IFFT_BINS * IFFT_OS + 1];  // Transform of the window around its peak
+  t_double* tri_w;     // Synthesis triangle divided by the window, over the central 2 H samples
+  t_double* cen;       // e^(j w (H - 1) / 2) per bin, to center the input spectra: N / 2 + 1 real then imaginary
+  t_ifft_mode* mode_arr;
+
+  t_double* in_hop;    // Input of the current hop
+  t_int32   in_type;   // IFFT_IN_NONE, IFFT_IN_IMP or IFFT_IN_DENSE
+  t_int32   imp_pos;   // Position and amplitude of a single impulse in the hop
+  t_double  imp_ampl;
+  t_double* in_spec;   // Centered spectrum of the input of the hop
+  t_double* spec;      // Spectra of the frame: one per channel
+  t_bool    chan_used[CHAN_MAX];  // Whether a channel has a contribution in the frame
+  t_double* acc;       // Overlap-add buffers: 2 H per channel, the first hop being played
+  t_double* work;      // Scratch samples: N
+  t_int32   hop_pos;   // Position in the current hop
+  t_double  rms_sum;   // Sum of the rms of the resonators, updated every hop
+
+} t_ifft;
+
+// ========  STRUCTURE:  MULTIRATE RENDERING  ========
+// The low resonators of a bank are grouped into octave band rate classes,
+// rendered at the sample rate divided by 2, 4 or 8. The input is decimated and
+// the outputs interpolated by a cascade of halfband filters, one per class.
+
+typedef struct _rate {
+
+  t_int32  vec_max;  // Vector size the buffers are allocated for
+  t_int32  vec;      // Vector size the classes are assigned for
+  t_int32  cls_max;  // Highest class with resonators
+  t_int32  cls_run;  // Highest class with running filters: above cls_max while flushing
+  t_int32  flush;    // Samples left to flush the filters above cls_max
+  t_bool   dirty;    // Set when the classes should be assigned again
+
+  t_double  hb[RATE_TAPS];  // Halfband filter
+  t_int32*  cls_ind;        // Indexes of the resonators, grouped by class in order of frequency
+  t_int32   cls_beg[RATE_CLS_MAX + 2];     // Start of each class in cls_ind
+  t_double* in_arr[RATE_CLS_MAX + 1];      // Input of each class, after RATE_TAPS - 1 samples of history
+  t_double* out_arr[RATE_CLS_MAX + 1][CHAN_MAX];  // Output of each class and channel, after RATE_TAPS / 2 samples of history
+  t_double* mem;            // Memory for the buffers
+
+} t_rate;
+
+// ========  STRUCTURE:  BINARY BANK FILE  ========
+// Header of a binary bank file. It is followed by the arrays of amplitudes,
+// frequencies and decays, as doubles, then optionally by the permutations
+// sorting the bank by amplitude, frequency, decay and priority, as int32.
+// The file is mapped in memory and copied into the bank without parsing.
+
+typedef struct _bank_file {
+
+  char     magic[4];    // FILE_MAGIC
+  t_uint32 version;     // FILE_VERSION
+  t_uint32 size;        // Size of the header: offset of the arrays
+  t_uint32 order;       // FILE_ORDER
+  t_int32  reson_cnt;   // Number of resonators
+  t_uint32 flags;       // FILE_SORTED
+
+  t_double samplerate;  // Sample rate when exported, as a hint
+  t_double gain;
+  t_double ampl_min;    // Ranges of the reference parameters
+  t_double ampl_max;
+  t_double freq_min;
+  t_double freq_max;
+  t_double decay_min;
+  t_double decay_max;
+
+  char     name[FILE_NAME];  // Name of the bank, null terminated
+
+} t_bank_file;
+
+// ========  STRUCTURE:  FRAME STREAM FILE  ========
+// Header of a frame stream file: a time series of modal parameters, as float32.
+// It is followed by the frames, each holding the amplitudes, then the
+// frequencies, then the decays of all the modes.
+
+typedef struct _stream_file {
+
+  char     magic[4];    // STREAM_MAGIC
+  t_uint32 version;     // STREAM_VERSION
+  t_uint32 size;        // Size of the header: offset of the frames
+  t_uint32 order;       // FILE_ORDER
+  t_int32  mode_cnt;    // Number of modes per frame
+  t_int32  frame_cnt;   // Number of frames
+
+  t_double frame_rate;  // Frames per second
+  t_double gain;
+  char     name[FILE_NAME];
+
+} t_stream_file;
+
+// ========  STRUCTURE:  FRAME STREAM  ========
+// Frames streamed into a bank. The file is mapped in memory, and a thread
+// reads the pages ahead of the position so that the perform routine does not
+// wait for the disk. The parameters are interpolated between the two frames
+// around the position once per block, and the poles are advanced by a step
+// within a frame. The bank is built from the first frame, and its model is
+// not changed: the bank multipliers still apply.
+
+typedef struct _stream {
+
+  const char*    map;        // The mapped file
+  t_ptr_size     map_size;
+  const t_float* frame_arr;  // The first frame
+  t_int32  mode_cnt;
+  t_int32  frame_cnt;
+  t_double frame_rate;
+
+  t_double pos;              // Position in frames, advanced by the perform routine
+  t_int32  frame_prev;       // Frame of the previous update, to assign the rate classes again when it changes
+  volatile t_double rate;    // Playback rate, negative to play backwards
+  volatile t_double seek;    // Position in frames requested by the main thread
+  volatile t_bool is_seek;
+  volatile t_bool is_playing;
+  volatile t_bool is_dirty;  // Set when the bank is updated from its model
+  t_bool   is_step;          // The poles are advanced by their steps at the next update
+
+  t_double* work;            // Interpolated parameters, pole terms and their steps per block, 9 x mode_cnt
+
+  t_systhread thread;        // Prefetch thread
+  volatile t_bool stop;
+
+} t_stream;
+
+// ========  STRUCTURE:  SDIF FRAME  ========
+// Resonance (1RES) or track (1TRC) frame of a SDIF file, found while scanning it
+
+typedef struct _sdif_frame {
+
+  t_ptr_size pos;        // Position of the frame header in the file
+  t_ptr_size size;       // Size of the frame, header included
+  t_double   time;       // Time in s
+  t_int32    stream_id;
+  t_int32    mat_cnt;    // Number of matrices
+
+} t_sdif_frame;
+
+// ========  STRUCTURE:  TEXT FILE READER  ========
+// Streaming reader of text bank files, read in blocks of FILE_BUF characters.
+// The position of each token is kept to report errors.
+
+typedef struct _file_reader {
+
+  t_filehandle handle;
+  char*    buf;        // Block of the file being read
+  t_int32  len;        // Number of characters in the block
+  t_int32  pos;        // Position of the next character in the block
+  t_bool   eof;        // Set when the end of the file has been read
+  t_int32  line;       // Line and column of the next character, from 1
+  t_int32  col;
+  t_int32  tok_line;   // Line and column of the last token
+  t_int32  tok_col;
+  char     tok[FILE_TOKEN];  // Last token, null terminated
+
+} t_file_reader;
+
+// ========  STRUCTURE:  MODEL  ========
+// Reference parameters of a bank and the permutations sorting them, shared
+// read only by the banks of all the instances that load the same model, and
+// held by the model cache. The model is freed by the last release. A bank
+// copies its model before changing it, if the model is shared.
+
+typedef struct _model {
+
+  t_int32_atomic refcnt;   // Number of banks and cache entries holding the model
+  t_int32    reson_cnt;
+  t_double   gain;         // Gain of the bank when loaded
+  t_ptr_size size;         // Size in bytes, allocated as one block
+
+  t_double*  ampl_ref;     // Reference parameters, before the bank multipliers
+  t_double*  freq_ref;
+  t_double*  decay_ref;
+
+  t_int32*   sort_ampl;    // Permutations sorting by amplitude, frequency, decay and priority
+  t_int32*   sort_freq;
+  t_int32*   sort_decay;
+  t_int32*   sort_prio;
+
+} t_model;
+
 // ========  STRUCTURE:  BANK  ========
 // Bank of resonators
 
@@ -169,6 +612,7 @@ typedef struct _bank {
 
   t_resonator* reson_arr;  // Array of resonators
   t_int32      reson_cnt;  // Number of resonators in the bank
+  t_double*    diff_arr;   // Diffusion gains of the resonators: 2 x chan_cnt per resonator
 
   t_bool    is_on;      // Whether the bank is on or off
   t_bool    is_frozen;
@@ -180,11 +624,69 @@ typedef struct _bank {
   t_double  freq_shift;
   t_double  decay_mult;  // Decay multiplier for the bank
 
-  t_int32* sort_ampl;   // An array to sort the resonators by amplitude
+  t_model* model;       // Shared reference parameters and sort permutations
+  t_int32* sort_ampl;   // An array to sort the resonators by amplitude:  in the model
   t_int32* sort_freq;   // An array to sort the resonators by frequency
   t_int32* sort_decay;  // An array to sort the resonators by decay
+  t_int32* sort_prio;   // An array to sort the resonators by priority: a0^2 / decay
+  t_int32  cull_cnt;    // Number of lowest priority resonators culled for the CPU budget
+
+  t_lod_type lod_type;      // Level of detail: how the rendered resonators are selected
+  t_double   lod_val;       // Count, threshold or fraction
+  t_int32    lod_cnt;       // Number of resonators rendered
+  t_double   lod_gain;      // Gain compensating for the skipped resonators
+  t_double   lod_gain_cur;  // Current gain, smoothed
+
+  t_int32  prune_freq;   // Number of resonators pruned for their frequency
+  t_int32  prune_ampl;   // Number of resonators pruned for their amplitude
+  t_int32  prune_decay;  // Number of resonators pruned for their decay
+  t_double prune_thr;    // Amplitude under which resonators are pruned
+
+  t_stats stats;  // DSP statistics
+
+  t_conv*  conv;       // Impulse responses for convolution rendering, or NULL
+  t_conv*  conv_new;   // Impulse responses built by the main thread, waiting to be installed
+  t_conv*  conv_old;   // Impulse responses replaced by the perform routine, waiting to be freed
+  t_bool   conv_use;   // Whether the bank is rendered by convolution when it is static
+  t_double conv_db;    // Floor in dB under the peak at which the impulse responses are truncated
+  t_bool   conv_targ;  // Whether the bank is rendered by convolution, or fading back to recursion
+  t_double conv_A;     // Crossfade position: 0 for recursion, 1 for convolution
+
+  t_ifft* ifft;         // Inverse FFT synthesis, or NULL
+  t_ifft* ifft_new;     // Synthesis built by the main thread, waiting to be installed
+  t_ifft* ifft_old;     // Synthesis replaced by the perform routine, waiting to be freed
+  t_bool  ifft_targ;    // Whether the bank should be rendered by inverse FFT
+  t_bool  ifft_active;  // Whether it is: switched at hop boundaries
+
+  t_rate* rate;      // Multirate rendering, or NULL
+  t_bool  rate_use;  // Whether the low resonators are rendered at decimated rates
+
+  t_stream* stream;  // Frames streamed into the bank, or NULL
 
   t_double velocity;  // Velocity multiplier to affect rate of change
+  t_double diff_ramp_ms; // Interpolation time for diffusion gains in ms
+  t_int32  diff_ramp;    // Same in samples, recalculated when the samplerate changes
+
+  t_double in_gain[IN_MAX];  // Routing of the inputs into the bank: one gain per input
+  t_bool   in_silent;        // Set when the routed input is silent for the block
+
+  t_int32  voice_ind;    // Index of the voice, or -1 if the bank is not a voice
+  t_bool   voice_busy;   // Whether the voice is playing a note
+  t_double voice_pitch;  // Pitch of the note played by the voice
+  t_double rms_sum;      // Sum of the rms of the resonators, updated every perform cycle
+  t_double rms_peak;     // Peak of rms_sum since the last note
+
+  t_double   imp_ampl;   // Pending impulse, 0 if none
+  t_int32    imp_cntd;   // Samples until the impulse
+  t_int32    imp_ofs;    // Offset of the impulse in the cycle for the zero input path, or -1
+  t_exc_type exc_type;   // Current burst exciter, or EXC_NONE
+  t_double   exc_ampl;   // Amplitude of the burst
+  t_int32    exc_cntd;   // Samples until the burst
+  t_int32    exc_len;    // Length of the burst in samples
+  t_int32    exc_pos;    // Position in the burst
+  t_double   exc_param;  // Noise color or mallet hardness, 0 to 1
+  t_double   exc_lp;     // State of the noise lowpass filter
+  t_uint32   exc_seed;   // State of the noise generator
 
   t_double ampl_min;
   t_double ampl_max;
@@ -204,6 +706,163 @@ typedef struct _bank {
 
 } t_bank;
 
+// ========  STRUCTURE:  ASYNCHRONOUS LOADING  ========
+// Imports and loads are queued, and run in order by a worker thread. Each
+// builds a new bank, installed by the perform routine between two blocks, or
+// directly if the DSP is off. The replaced bank is freed and the reply is sent
+// from the main thread. The states are changed under the mutex, which the
+// perform routine only tries to lock, so that it never waits.
+
+typedef enum _load_state {
+
+  LOAD_FREE,       // Slot not in use
+  LOAD_QUEUED,     // Waiting for the worker thread
+  LOAD_RUNNING,    // Being built by the worker thread
+  LOAD_DONE,       // Built, waiting to be installed
+  LOAD_INSTALLED,  // Installed, the replaced bank is to be freed
+  LOAD_FAILED,
+  LOAD_CANCELLED
+
+} t_load_state;
+
+typedef enum _load_type {
+
+  LOAD_IMPORT,       // From a text or binary file
+  LOAD_DICT,         // From the main dictionary
+  LOAD_STATE_READ,   // The state library, from a file
+  LOAD_STATE_WRITE,  // The state library, to a file
+  LOAD_STREAM,       // A bank streamed from a frame file
+  LOAD_SDIF          // A frame of a SDIF file
+
+} t_load_type;
+
+typedef struct _load {
+
+  volatile t_int32 state;
+  t_load_type type;
+  t_int32     seq;          // Order in which the loads were queued
+  t_int32     bank_ind;     // Index of the bank to load into, -1 for the states
+  t_symbol*   name;         // Name of the new bank, also the name in the dictionary
+  char        file_name[MAX_FILENAME_CHARS];
+  short       file_path;
+  t_bool      reserved;     // The bank was free and is reserved under the new name
+  volatile t_bool cancel;   // Set to cancel while running
+  t_bank      bank;         // The new bank, then the replaced bank once installed
+  char*       state_blob;   // State library encoded to be written
+  t_ptr_size  state_size;
+  t_state*    state_arr;    // State library read, not installed yet
+  t_int32     state_cnt;    // Number of states read or written
+  t_int32     sdif_frame;   // Frame of a SDIF file:  its index, or -1 to select it by time
+  t_double    sdif_time;
+  t_bool      sdif_rate;    // The 1RES values are decay rates instead of bandwidths
+
+} t_load;
+
+// ========  STRUCTURE:  MODEL CACHE  ========
+// Process wide cache of the models parsed by imports and loads, shared by all
+// the instances. Each entry holds a reference to a model, so that a hit shares
+// it with the new bank, which only needs to update its coefficients.
+// Entries are keyed by the absolute path of a file and its modification date,
+// or by the names of a dictionary and a bank and the address of the bank
+// subdictionary. They are kept in a list from the most recently used, and the
+// least recently used are evicted above the memory cap.
+
+typedef struct _cache_entry {
+
+  struct _cache_entry* prev;  // More recently used
+  struct _cache_entry* next;  // Less recently used
+  char*      key;        // "file:" and the path, or "dict:" and the dictionary and bank names
+  t_uint64   stamp;      // Modification date, or address of the subdictionary
+  t_ptr_size size;       // Size of the entry and of its model in bytes
+  t_model*   model;
+
+} t_cache_entry;
+
+typedef struct _cache {
+
+  t_systhread_mutex mutex;
+  t_cache_entry* head;   // Most recently used
+  t_cache_entry* tail;   // Least recently used
+  t_int32    entry_cnt;
+  t_ptr_size size;       // Total size of the entries in bytes
+  t_ptr_size size_max;   // Memory cap in bytes
+  t_int64    hit_cnt;
+  t_int64    miss_cnt;
+
+} t_cache;
+
+// ========  STRUCTURE:  SNAPSHOT  ========
+// Whole object snapshot, stored as one contiguous blob, identical in memory
+// and on disk: the header, then one record per bank, then one record per
+// state. A bank record is the bank itself, followed by its resonators, its
+// diffusion gains, and the arrays of its model. The structures are copied as
+// they are, so that a recall is mostly memcpy, and the files are only read by
+// the same build. The models are also held by the snapshot, and shared with
+// the recalled banks.
+
+typedef struct _snap_head {
+
+  char     magic[4];     // SNAP_MAGIC
+  t_uint32 version;      // SNAP_VERSION
+  t_uint32 order;        // FILE_ORDER
+  t_uint32 flags;        // SNAP_FILTERS
+  t_uint64 size;         // Size of the blob in bytes
+  t_uint32 bank_size;    // Size of the bank and resonator structures, to reject other builds
+  t_uint32 reson_size;
+  t_int32  bank_cnt;
+  t_int32  chan_cnt;
+  t_int32  state_cnt;
+  t_int32  kernel;       // Kernel the states of the filters are in
+
+  t_double samplerate;
+  t_double master;
+  t_double ramp_param;
+  t_int32  voice_first;  // Voice allocation
+  t_int32  voice_cnt;
+  t_double voice_ref;
+  t_double voice_freq_mult;
+
+  char     name[FILE_NAME];  // Name of the snapshot, null terminated
+
+} t_snap_head;
+
+typedef struct _snap_bank {
+
+  t_uint64 size;        // Size of the record: offset of the next one
+  t_int32  reson_cnt;
+  t_int32  ifft_size;   // FFT size of the inverse FFT synthesis, 0 if none
+  t_double model_gain;
+  char     name[FILE_NAME];
+  t_bank   bank;        // Copy of the bank, its pointers are not used
+
+} t_snap_bank;
+
+typedef struct _snap_state {
+
+  t_uint64 size;        // Size of the record: offset of the next one
+  t_int32  cnt;         // Followed by cnt U values and cnt A values
+  t_int32  pad;
+  char     name[FILE_NAME];
+  char     from[FILE_NAME];
+
+} t_snap_state;
+
+typedef struct _snapshot {
+
+  t_symbol*    name;       // NULL if the slot is free
+  t_snap_head* head;       // The blob
+  t_model**    model_arr;  // The model of each bank, held by the snapshot
+
+} t_snapshot;
+
+typedef enum _snap_stage {
+
+  SNAP_IDLE,        // No recall in progress
+  SNAP_READY,       // Banks built, waiting to be installed
+  SNAP_INSTALLED    // Installed, the replaced banks are to be freed
+
+} t_snap_stage;
+
 // ========  STRUCTURE:  MODAL OBJECT  ========
 
 typedef enum _sort_type {
@@ -250,6 +909,7 @@ typedef struct _modal {
   t_int32  state_cnt;
 
   t_state state_tmp[1];
+  t_state_index state_index;  // The states by name
 
   t_double ramp_param;
   t_ramp   ramp_func;
@@ -264,6 +924,70 @@ typedef struct _modal {
   t_double a_smoothing;
   t_atom*  outp_mess_arr;  // To output messages
 
+  t_double*    mix_buf;             // Scratch tile of resonator outputs: MIX_TILE x vec_max
+  t_resonator* mix_tile[MIX_TILE];  // The resonators rendered into the tile
+  t_int32      vec_max;             // Maximum vector size, for the scratch tile
+
+  t_int32 chan_cnt;  // Number of output channels: 1, 2, 4, 8, 16, 32 or 64
+  t_atom_long mc_mode;  // Attribute: one multichannel inlet and outlet instead of one per channel
+
+  t_atom_long in_cnt;           // Attribute: number of inputs
+  t_bool      in_conn[IN_MAX];  // Whether each input is connected
+  t_double*   in_buf;           // Buffer to sum the inputs routed to a bank
+
+  t_int32  voice_first;      // Index of the first bank used as a voice
+  t_int32  voice_cnt;        // Number of voices, 0 if not used
+  t_int32* voice_free;       // Stack of free voices, allocated for all banks and owned by the perform routine
+  t_int32  voice_free_cnt;   // Number of free voices on the stack
+  t_int32  voice_quiet;      // Quietest busy voice, or -1, updated every perform cycle
+  t_int32  voice_steal;      // Next voice to steal if the levels are not known yet
+  t_double voice_ref;        // Reference pitch of the template
+  t_double voice_freq_mult;  // Frequency multiplier of the template
+
+  volatile t_int32 voice_pend;        // Number of voices set by the voices message, or -1 if none pending
+  t_int32          voice_pend_first;  // And index of their first bank: both installed by the perform routine
+  t_bank*          voice_bank_arr;    // Voices cloned by the voices message, then the replaced banks once installed
+  t_int32          voice_bank_cnt;    // Number of banks in voice_bank_arr
+  t_atom_long      voice_kernel;      // Kernel the resonators of the cloned voices are in
+
+  t_voice_note   voice_queue[VOICE_QUEUE];  // Notes waiting to be played by the perform routine
+  t_int32_atomic voice_write;               // Number of notes queued, written by the message thread only
+  t_int32_atomic voice_read;                // Number of notes played, written by the perform routine only
+
+  t_double budget;     // Attribute: DSP time budget as a fraction of the block period, 0 if off
+  t_double load;       // Measured DSP time as a fraction of the block period, smoothed
+  t_double cull_frac;  // Fraction of the lowest priority resonators culled in each bank
+
+  t_atom_long kernel;      // Attribute: resonator kernel, KERNEL_BIQUAD or KERNEL_PHASOR
+  t_atom_long kernel_cur;  // Kernel the resonator states are in, converted by the perform routine
+
+  t_atom_long   profile;     // Attribute: collect DSP statistics
+  t_dictionary* stats_dict;  // Dictionary to output the statistics
+  void (*mix_func)(struct _modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+
+  t_load            load_arr[LOAD_MAX];  // Queued, running and finished loads
+  t_int32           load_seq;            // Sequence number of the next load
+  t_int32_atomic    load_done;           // Number of loads waiting to be installed
+  t_bool            load_running;        // Whether the worker thread is running
+  t_bool            load_stop;           // Set to stop the worker thread
+  t_systhread       load_thread;
+  t_systhread_mutex load_mutex;
+  void*             load_qelem;          // To free the replaced banks and reply from the main thread
+  void*             load_clock;          // To install the loads if the perform routine does not run
+  volatile t_int32  perform_cnt;         // Number of perform cycles, to tell if the perform routine runs
+  t_int32_atomic    perform_busy;        // Non zero while the perform routine is in a cycle
+  t_int32_atomic    load_installing;     // Non zero while the main thread installs: the perform routine is silent
+  t_int32           perform_seen;        // Number of perform cycles when the clock was set
+  volatile t_bool   conv_pend;           // Set when impulse responses are waiting to be installed
+  volatile t_bool   ifft_pend;           // Set when inverse FFT syntheses are waiting to be installed
+
+  t_snapshot       snap_arr[SNAP_MAX];  // Snapshots saved or read
+  volatile t_int32 snap_stage;          // Stage of the recall in progress
+  t_bank*          snap_bank_arr;       // Banks of the recalled snapshot, then the replaced banks once installed
+  t_snap_head      snap_head;           // Header of the recalled snapshot, with the settings of the object
+  t_atom_long      snap_kernel;         // Kernel the resonators of the recalled banks are in
+  void*            snap_qelem;          // To free the replaced banks and reply from the main thread
+
 } t_modal;
 
 // ========  METHOD PROTOTYPES  ========
@@ -275,6 +999,7 @@ void modal_free(t_modal* x);
 void modal_dsp64(t_modal* x, t_object* dsp64, t_int32* count, t_double samplerate, long maxvectorsize, long flags);
 void modal_perform64(t_modal* x, t_object* dsp64, t_double** ins, long numins, t_double** outs, long numouts, long sampleframes, long flags, void* userparam);
 void modal_assist(t_modal* x, void* b, long msg, t_int32 arg, char* str);
+long modal_multichanneloutputs(t_modal* x, long outletindex);
 
 // ====  INTERFACE METHODS  ====
 
@@ -284,6 +1009,9 @@ void modal_out_sort (t_modal* x, t_symbol* sort);
 void io_dictionary(t_modal* x, t_symbol* dict_sym);
 
 void io_import(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_my_err _io_import_file(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path);
+t_my_err _io_load_dict(t_modal* x, t_bank* bank, t_symbol* bank_sym);
+void _io_dict_arrays(t_dictionary* dict_bank, t_int32 cnt, t_int32 stride, t_atom* atoms);
 void io_load  (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void io_save  (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void io_split (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
@@ -301,6 +1029,7 @@ void modal_master(t_modal* x, t_double gain);
 
 void modal_is_on     (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void modal_gain      (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void modal_route     (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void modal_ampl_mult (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void modal_freq_shift(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void modal_decay_mult(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
@@ -321,6 +1050,7 @@ void modal_sel_decay_rng(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 
 void _mode_new    (t_modal* x, t_bank* bank);
 void _mode_iterate(t_modal* x, t_bank* bank, t_resonator* reson);
+t_double _mode_countdown(t_modal* x, t_bank* bank, t_resonator* reson, t_int32 len);
 
 void mode_all_on   (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void mode_all_off  (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
@@ -328,6 +1058,179 @@ void mode_cycle    (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void mode_diffusion(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void mode_resonator(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 
+void _diff_snap(t_modal* x, t_resonator* reson);
+void _diff_arr_set(t_modal* x, t_resonator* reson_arr, t_double* diff_arr, t_int32 reson_cnt);
+void _diff_targ(t_modal* x, t_bank* bank, t_resonator* reson);
+void _diff_pan (t_modal* x, t_bank* bank, t_resonator* reson, t_double azim, t_double spread);
+
+// ====  VOICES  ====
+// Voice allocation over a range of banks cloned from a template
+
+void voice_voices(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void voice_note  (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _voice_notes (t_modal* x);
+t_bool _voice_install(t_modal* x);
+void _voice_release(t_modal* x);
+void _voice_update(t_modal* x);
+
+// ====  SKIPPING RESONATORS  ====
+// Culling resonators to fit a CPU budget, level of detail, pruning
+
+void _skip_fade(t_modal* x, t_resonator* reson, t_double* row, long sampleframes, t_int32 decim);
+void _budget_update(t_modal* x, t_double time_ms, long sampleframes);
+void _bank_cull(t_modal* x, t_bank* bank);
+void skip_lod(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _bank_lod(t_modal* x, t_bank* bank);
+void _bank_prune(t_modal* x, t_bank* bank);
+void _bank_prune_flag(t_modal* x, t_bank* bank);
+void skip_pruned(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+
+// ====  STATISTICS  ====
+// DSP timing and counters per bank
+
+void stats_stats(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _stats_bank(t_bank* bank, t_double time_ms, t_int32 active, t_int32 splits, t_int32 iters, t_int32 rms);
+void _stats_reset(t_bank* bank);
+int  _stats_compare(const void* time1, const void* time2);
+
+// ====  PHASOR KERNEL  ====
+// Resonators as complex one pole filters, selected with the kernel attribute
+
+void _phasor_update(t_modal* x, t_resonator* reson);
+void _phasor_from_biquad(t_resonator* reson);
+void _phasor_to_biquad(t_resonator* reson);
+void _kernel_switch(t_modal* x);
+void _reson_phasor(t_resonator* reson, t_double* in, t_double* buf, t_int32 len,
+  t_double dA, t_double gain, t_double* sum_sqr);
+void _reson_phasor_zero_input(t_resonator* reson, t_double* buf, t_int32 len, t_double gain,
+  t_double* sum_sqr, t_int32 imp_pos, t_double imp);
+
+// ====  CONVOLUTION  ====
+// Partitioned convolution rendering of frozen and static banks
+
+void conv_conv(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _conv_start(t_modal* x, t_bank* bank);
+t_bool _conv_install(t_modal* x);
+void _conv_release(t_modal* x);
+t_bool _conv_is_static(t_bank* bank);
+t_conv* _conv_build(t_modal* x, t_bank* bank);
+void _conv_free(t_conv* conv);
+void _conv_reset(t_conv* conv);
+t_double _conv_perform(t_modal* x, t_bank* bank, t_double* in, t_double** outs, long sampleframes, t_double gain, t_double* d_rec);
+void _conv_ramp(t_modal* x, t_int32 tile_cnt, long sampleframes, t_double gain, t_double d_gain);
+
+// ====  INVERSE FFT SYNTHESIS  ====
+// Additive rendering of very large banks, in the frequency domain
+
+void ifft_ifft(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_ifft* _ifft_build(t_modal* x, t_bank* bank, t_int32 size);
+void _ifft_free(t_ifft* ifft);
+t_bool _ifft_install(t_modal* x);
+void _ifft_release(t_modal* x);
+t_bool _ifft_perform(t_modal* x, t_bank* bank, t_double* in, t_double** outs, long sampleframes, t_double gain);
+
+// ====  MULTIRATE RENDERING  ====
+// Low resonators rendered at decimated rates, in octave band classes
+
+void rate_multirate(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_rate* _rate_new(t_modal* x);
+void _rate_free(t_rate* rate);
+void _rate_coefs(t_modal* x, t_resonator* reson);
+void _rate_move(t_modal* x, t_resonator* reson, t_int32 cls);
+void _rate_perform(t_modal* x, t_bank* bank, t_double* in, t_double** outs, long sampleframes, t_double gain);
+
+// ====  ASYNCHRONOUS LOADING  ====
+// Imports and loads run by a worker thread, installed between two blocks
+
+void load_cancel(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _load_init(t_modal* x);
+void _load_free(t_modal* x);
+t_load* _load_queue(t_modal* x, t_bank* bank, t_load_type type, t_symbol* name, char* file_name, short file_path, t_load* extra);
+void* _load_worker(t_modal* x);
+t_int32 _load_install(t_modal* x);
+t_bool _load_pending(t_modal* x);
+t_bool _load_wait(t_modal* x);
+void _load_tick(t_modal* x);
+void _load_main(t_modal* x);
+
+// ====  SNAPSHOTS  ====
+// Whole object snapshots as contiguous blobs, recalled between two blocks
+
+void snap_snapshot(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _snap_init(t_modal* x);
+void _snap_free(t_modal* x);
+t_bool _snap_install(t_modal* x);
+void _snap_main(t_modal* x);
+
+// ====  MODEL CACHE  ====
+// Shared models, and process wide LRU cache of parsed and sorted models
+
+t_model* _model_new(t_int32 reson_cnt);
+void _model_retain(t_model* model);
+void _model_release(t_model* model);
+t_my_err _model_own(t_modal* x, t_bank* bank);
+
+void cache_cache(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+void _cache_init(void);
+t_bool _cache_key_file(char* key, char* file_name, short file_path, t_uint64* stamp);
+void _cache_key_dict(char* key, t_symbol* dict_sym, t_symbol* bank_sym);
+t_uint64 _cache_stamp_dict(t_dictionary* dict_bank);
+t_bool _cache_fetch(t_modal* x, t_bank* bank, t_symbol* name, const char* key, t_uint64 stamp);
+void _cache_store(t_bank* bank, const char* key, t_uint64 stamp);
+void _cache_drop(const char* key);
+void _cache_drop_dict(t_symbol* dict_sym, t_symbol* bank_sym);
+
+// ====  BANK FILES  ====
+// Export and import of banks as memory mapped binary files, and parsing of text files
+
+void file_export(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_bool _file_is_binary(t_filehandle file_handle);
+t_my_err _file_import(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path);
+t_my_err _file_parse_text(t_modal* x, t_filehandle file_handle, char* file_name, t_double** param_arr, t_int32* reson_cnt);
+const char* _file_map(const char* path, t_ptr_size* size);
+void _file_unmap(const char* ptr, t_ptr_size size);
+
+// ====  FRAME STREAMS  ====
+// Time series of modal frames streamed into a bank from a mapped file
+
+void stream_stream(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_my_err _stream_open(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path);
+void _stream_free(t_stream* stream);
+void _stream_perform(t_modal* x, t_bank* bank, t_int32 sampleframes);
+
+// ====  SDIF FILES  ====
+// Import of resonance and track frames of SDIF files
+
+void sdif_import(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_bool _sdif_is_sdif(t_filehandle file_handle);
+t_my_err _sdif_import(t_modal* x, t_bank* bank, t_symbol* name, char* file_name, short file_path,
+  t_int32 frame_ind, t_double time, t_bool is_rate);
+
+// ====  EXCITERS  ====
+// Internal exciters: impulses, noise bursts and mallet pulses
+
+void excite_strike(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
+t_double* _excite(t_modal* x, t_bank* bank, t_double* in, long sampleframes);
+t_double* _excite_input(t_modal* x, t_bank* bank, t_double* in, long sampleframes);
+void _reson_zero_input(t_resonator* reson, t_double* buf, t_int32 len, t_double gain,
+  t_double* sum_sqr, t_int32 imp_pos, t_double imp);
+
+// ====  MIXING AND ROUTING  ====
+// Accumulate a tile of resonator outputs into the channel buses
+// One kernel is specialized per channel count
+// Route the inputs into each bank
+
+void _mix_tile_1 (t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_tile_2 (t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_tile_4 (t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_tile_8 (t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_tile_16(t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_tile_32(t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_tile_64(t_modal* x, t_double** outs, t_int32 tile_cnt, long sampleframes, t_int32 decim);
+void _mix_func_set(t_modal* x);
+
+t_double* _route_inputs(t_modal* x, t_bank* bank, t_double** ins, long numins, long sampleframes);
+
 // ====  STATES  ====
 // Use storage slots to ramp to and in between
 
@@ -337,13 +1240,22 @@ void     _state_free(t_state* state);
 t_state* _state_arr_new   (t_int32 cnt, t_int32* state_cnt);
 void     _state_arr_free (t_state** state_arr, t_int32* state_cnt);
 
-t_state* _state_find(t_state* state_arr, t_int32 state_cnt, t_atom* atom);
+t_my_err _state_arr_resize(t_state** state_arr, t_int32* state_cnt, t_int32 cnt);
+
+t_state* _state_find(t_modal* x, t_atom* atom);
+void     _state_index_free(t_modal* x);
 t_my_err _state_store(t_modal* x, t_bank* bank, t_state* state, t_symbol* name);
 void     _state_ramp(t_modal* x, t_bank* bank, t_state* state, t_int32 cntd);
 
 t_my_err _state_dict_save(t_state* state, t_dictionary* dict_arr_states, t_symbol* state_sym, t_symbol* is_prot);
 t_my_err _state_dict_load(t_dictionary* dict_state, t_state* state);
 
+t_my_err _state_encode(t_modal* x, t_load* load, t_uint32 format, t_int32 base);
+t_my_err _state_file_write(t_modal* x, t_load* load);
+t_my_err _state_file_read(t_modal* x, t_load* load);
+void     _state_install(t_modal* x, t_load* load);
+void     _state_load_free(t_load* load);
+
 void state_state       (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void state_ramp_to     (t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
 void state_ramp_between(t_modal* x, t_symbol* sym, t_int32 argc, t_atom* argv);
@@ -357,7 +1269,7 @@ t_resonator* modal_find_reson(t_modal* x, t_bank* bank, t_atom* argv, t_symbol*
 
 void reson_new   (t_modal* x, t_bank* bank, t_resonator* reson);
 void reson_free  (t_modal* x, t_resonator* reson);
-void reson_copy  (t_modal* x, t_bank* bank, t_resonator* reson, t_resonator* reson_src);
+void reson_copy  (t_modal* x, t_bank* bank, t_resonator* reson, t_bank* bank_src, t_resonator* reson_src);
 void reson_update(t_modal* x, t_bank* bank, t_resonator* reson);
 
 // ====  BANK METHODS  ====
@@ -367,11 +1279,16 @@ t_bank* bank_find  (t_modal* x, t_atom* argv, t_symbol* sym);
 int compare_ampl (void* bank, const t_int32* index1, const t_int32* index2);
 int compare_freq (void* bank, const t_int32* index1, const t_int32* index2);
 int compare_decay(void* bank, const t_int32* index1, const t_int32* index2);
+int compare_prio (void* bank, const t_int32* index1, const t_int32* index2);
 
 t_int32  bank_new    (t_modal* x, t_bank* bank, t_int32 nb);
+t_int32  bank_new_model(t_modal* x, t_bank* bank, t_model* model);
+void _bank_model     (t_bank* bank, t_model* model);
 t_int32  bank_realloc(t_modal* x, t_bank* bank, t_int32 nb);
+t_int32  bank_clone  (t_modal* x, t_bank* bank, t_bank* bank_src);
 void bank_free       (t_modal* x, t_bank* bank);
 void bank_sort       (t_modal* x, t_bank* bank);
+void _bank_ranges    (t_modal* x, t_bank* bank);
 void bank_update     (t_modal* x, t_bank* bank);
 
 // ========  END OF HEADER FILE  ========
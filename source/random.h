@@ -12,7 +12,7 @@
 // ====  RANDOM_INT  ====
 // Choose a random int between min and max
 
-__inline t_int32 random_int(t_int32 min, t_int32 max) {
+static __inline t_int32 random_int(t_int32 min, t_int32 max) {
 
   return ((min == max)
     ? min
@@ -22,7 +22,7 @@ __inline t_int32 random_int(t_int32 min, t_int32 max) {
 // ====  RANDOM_FLOAT  ====
 // Choose a random float between min and max
 
-__inline t_double random_float(t_double min, t_double max) {
+static __inline t_double random_float(t_double min, t_double max) {
 
   return ((min == max)
     ? min
@@ -32,7 +32,7 @@ __inline t_double random_float(t_double min, t_double max) {
 // ====  RANDOM_TIME_TO_SMP  ====
 // Choose a random number of samples corresponding to a time between min and max
 
-__inline t_int32 random_time_to_smp(t_double min, t_double max, t_double msr) {
+static __inline t_int32 random_time_to_smp(t_double min, t_double max, t_double msr) {
 
   return ((min == max)
     ? (t_int32)(min * msr)